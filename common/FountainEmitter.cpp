@@ -1,4 +1,5 @@
 #include "FountainEmitter.h"
+#include "profiler.h"
 #include <iostream>
 #include <glm/gtx/rotate_vector.hpp>
 #include <glm/gtx/vector_angle.hpp>
@@ -8,6 +9,7 @@ FountainEmitter::FountainEmitter(Drawable* _model, int number)
 
 // Function to update the particles over time
 void FountainEmitter::updateParticles(float time, float dt, glm::vec3 camera_pos) {
+    PROFILE_CPU("updateParticles");
 
     // Slowly increase the number of active particles
     if (active_particles < number_of_particles) {
@@ -1,4 +1,8 @@
 #include "IntParticleEmitter.h"
+#include "profiler.h"
+#include "memorytracker.h"
+#include "gldebug.h"
+#include "backend.h"
 #include "iostream"
 #include <algorithm>
 
@@ -20,13 +24,13 @@ IntParticleEmitter::IntParticleEmitter(Drawable* _model, int number) {
     scales.resize(number_of_particles, 1.0f);
     lifes.resize(number_of_particles, 0.0f);
 
-    configureVAO();
+    if (model) configureVAO();
 }
 
 void IntParticleEmitter::renderParticles(int time) {
     if (number_of_particles == 0) return;
-    bindAndUpdateBuffers();
-    glDrawElementsInstanced(GL_TRIANGLES, 3 * model->indices.size(), GL_UNSIGNED_INT, 0, number_of_particles);
+    GLuint baseInstance = bindAndUpdateBuffers();
+    RenderBackend::get().drawElementsInstanced(GL_TRIANGLES, model->indexCount, 0, number_of_particles, baseInstance);
 }
 
 glm::vec4 IntParticleEmitter::calculateBillboardRotationMatrix(glm::vec3 particle_pos, glm::vec3 camera_pos)
@@ -41,7 +45,24 @@ glm::vec4 IntParticleEmitter::calculateBillboardRotationMatrix(glm::vec3 particl
     return glm::vec4(rot_axis, rot_angle);
 }
 
-void IntParticleEmitter::bindAndUpdateBuffers()
+GLuint IntParticleEmitter::bindAndUpdateBuffers()
+{
+    PROFILE_CPU("particle upload");
+    packInstances();
+
+    //Bind the VAO
+    RenderBackend& backend = RenderBackend::get();
+    backend.bindVertexArray(emitterVAO);
+
+    //Send the instance data to the GPU, all four buffers give the same base instance
+    GLuint baseInstance = backend.streamInstances(MemoryTag::Particles, transformations_buffer, sizeof(glm::mat4), number_of_particles, &translations[0]);
+    backend.streamInstances(MemoryTag::Particles, rotations_buffer, sizeof(glm::mat4), number_of_particles, &rotations[0]);
+    backend.streamInstances(MemoryTag::Particles, scales_buffer, sizeof(float), number_of_particles, &scales[0]);
+    backend.streamInstances(MemoryTag::Particles, lifes_buffer, sizeof(float), number_of_particles, &lifes[0]);
+    return baseInstance;
+}
+
+void IntParticleEmitter::packInstances()
 {
     if (use_sorting) {
         std::sort(std::execution::par_unseq, p_attributes.begin(), p_attributes.end());
@@ -97,26 +118,6 @@ void IntParticleEmitter::bindAndUpdateBuffers()
         lifes[i] = p.life;
     }
 #endif // USE_PARALLEL_TRANSFORM
-
-    //Bind the VAO
-    glBindVertexArray(emitterVAO);
-
-    //Send transformation data to the GPU
-    glBindBuffer(GL_ARRAY_BUFFER, transformations_buffer);
-    glBufferData(GL_ARRAY_BUFFER, number_of_particles * sizeof(glm::mat4), NULL, GL_STREAM_DRAW); // Buffer orphaning and reallocating to avoid synchronization, see https://www.khronos.org/opengl/wiki/Buffer_Object_Streaming
-    glBufferSubData(GL_ARRAY_BUFFER, 0, number_of_particles * sizeof(glm::mat4), &translations[0]); //Sending data
-
-    glBindBuffer(GL_ARRAY_BUFFER, rotations_buffer);
-    glBufferData(GL_ARRAY_BUFFER, number_of_particles * sizeof(glm::mat4), NULL, GL_STREAM_DRAW); // Buffer orphaning and reallocating to avoid synchronization, see https://www.khronos.org/opengl/wiki/Buffer_Object_Streaming
-    glBufferSubData(GL_ARRAY_BUFFER, 0, number_of_particles * sizeof(glm::mat4), &rotations[0]); //Sending data
-
-    glBindBuffer(GL_ARRAY_BUFFER, scales_buffer);
-    glBufferData(GL_ARRAY_BUFFER, number_of_particles * sizeof(float), NULL, GL_STREAM_DRAW); // Buffer orphaning and reallocating to avoid synchronization, see https://www.khronos.org/opengl/wiki/Buffer_Object_Streaming
-    glBufferSubData(GL_ARRAY_BUFFER, 0, number_of_particles * sizeof(float), &scales[0]); //Sending 
-
-    glBindBuffer(GL_ARRAY_BUFFER, lifes_buffer);
-    glBufferData(GL_ARRAY_BUFFER, number_of_particles * sizeof(float), NULL, GL_STREAM_DRAW); // Buffer orphaning and reallocating to avoid synchronization, see https://www.khronos.org/opengl/wiki/Buffer_Object_Streaming
-    glBufferSubData(GL_ARRAY_BUFFER, 0, number_of_particles * sizeof(float), &lifes[0]); //Sending data
 }
 
 void IntParticleEmitter::changeParticleNumber(int new_number) {
@@ -128,38 +129,34 @@ void IntParticleEmitter::changeParticleNumber(int new_number) {
     rotations.resize(number_of_particles, glm::mat4(1.0f));
     scales.resize(number_of_particles, 1.0f);
     lifes.resize(number_of_particles, 0.0f);
+
+    //The instance buffers hold a fixed number of particles, make them again for more
+    if (model && number_of_particles > capacity) {
+        RenderBackend& backend = RenderBackend::get();
+        backend.deleteBuffer(transformations_buffer);
+        backend.deleteBuffer(rotations_buffer);
+        backend.deleteBuffer(scales_buffer);
+        backend.deleteBuffer(lifes_buffer);
+        glDeleteVertexArrays(1, &emitterVAO);
+        configureVAO();
+    }
 }
 
 void IntParticleEmitter::configureVAO()
 {
+    RenderBackend& backend = RenderBackend::get();
+    capacity = std::max(number_of_particles, 1);
     glGenVertexArrays(1, &emitterVAO);
     glBindVertexArray(emitterVAO);
 
 
     //We are using the model's buffer but since they are already in the GPU from the Drawable's constructor we just need to configure 
     //our own VAO by using glVertexAttribPointer and glEnableVertexAttribArray but without sending any data with glBufferData.
-    glBindBuffer(GL_ARRAY_BUFFER, model->verticesVBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
-
-    if (model->indexedNormals.size() != 0) {
-        glBindBuffer(GL_ARRAY_BUFFER, model->normalsVBO);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(1);
-    }
-
-
-    if (model->indexedUVS.size() != 0) {
-        glBindBuffer(GL_ARRAY_BUFFER, model->uvsVBO);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(2);
-    }
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->elementVBO);
+    model->setupAttributes();
 
     //GLSL treats mat4 data as 4 vec4. So we need to enable attributes 3,4,5 and 6, one for each vec4
-    glGenBuffers(1, &transformations_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, transformations_buffer);
+    transformations_buffer = backend.createInstanceBuffer(MemoryTag::Particles, sizeof(glm::mat4), capacity);
+    GLDebug::get().label(GL_BUFFER, transformations_buffer, "particle translations");
     std::size_t vec4Size = sizeof(glm::vec4);
     glEnableVertexAttribArray(3);
     glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)0);
@@ -176,8 +173,8 @@ void IntParticleEmitter::configureVAO()
     glVertexAttribDivisor(5, 1);
     glVertexAttribDivisor(6, 1);
 
-    glGenBuffers(1, &rotations_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, rotations_buffer);
+    rotations_buffer = backend.createInstanceBuffer(MemoryTag::Particles, sizeof(glm::mat4), capacity);
+    GLDebug::get().label(GL_BUFFER, rotations_buffer, "particle rotations");
 
     glEnableVertexAttribArray(7);
     glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)0);
@@ -193,14 +190,14 @@ void IntParticleEmitter::configureVAO()
     glVertexAttribDivisor(9, 1);
     glVertexAttribDivisor(10, 1);
 
-    glGenBuffers(1, &scales_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, scales_buffer);
+    scales_buffer = backend.createInstanceBuffer(MemoryTag::Particles, sizeof(float), capacity);
+    GLDebug::get().label(GL_BUFFER, scales_buffer, "particle scales");
     glEnableVertexAttribArray(11);
     glVertexAttribPointer(11, 1, GL_FLOAT, GL_FALSE, 0, NULL);
     glVertexAttribDivisor(11, 1);
 
-    glGenBuffers(1, &lifes_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, lifes_buffer);
+    lifes_buffer = backend.createInstanceBuffer(MemoryTag::Particles, sizeof(float), capacity);
+    GLDebug::get().label(GL_BUFFER, lifes_buffer, "particle lifes");
     glEnableVertexAttribArray(12);
     glVertexAttribPointer(12, 1, GL_FLOAT, GL_FALSE, 0, NULL);
     glVertexAttribDivisor(12, 1);
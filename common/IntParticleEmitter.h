@@ -44,6 +44,7 @@ public:
 
     glm::vec3 emitter_pos; //the origin of the emitter
 
+    //Without a model the emitter only simulates and packs, it needs no GL context
     IntParticleEmitter(Drawable* _model, int number);
 	void changeParticleNumber(int new_number);
 
@@ -53,6 +54,9 @@ public:
     
     glm::vec4 calculateBillboardRotationMatrix(glm::vec3 particle_pos, glm::vec3 camera_pos);
 
+    //Fills the per instance matrices, scales and lifes that renderParticles uploads
+    void packInstances();
+
 
 private:
 
@@ -63,7 +67,9 @@ private:
 
     Drawable* model;
     void configureVAO();
-    void bindAndUpdateBuffers();
+    //Returns the base instance of this frame's instances
+    GLuint bindAndUpdateBuffers();
+    int capacity = 0; //particles the instance buffers hold
     GLuint transformations_buffer;
     GLuint rotations_buffer;
     GLuint scales_buffer;
@@ -0,0 +1,180 @@
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+using namespace std;
+#include "assets.h"
+#include "util.h"
+#include "trace.h"
+
+AssetPipeline::AssetPipeline(int threads)
+    : threads(threads > 0 ? threads : workerThreadCount()), totalTime(0.0) {
+}
+
+AssetPipeline::Job AssetPipeline::add(const string& name, function<void()> work,
+                                      const vector<Job>& dependencies) {
+    return addJob(name, work, false, dependencies);
+}
+
+AssetPipeline::Job AssetPipeline::addUpload(const string& name, function<void()> work,
+                                            const vector<Job>& dependencies) {
+    return addJob(name, work, true, dependencies);
+}
+
+AssetPipeline::Job AssetPipeline::addJob(const string& name, function<void()> work, bool upload,
+                                         const vector<Job>& dependencies) {
+    Job job = (Job) jobs.size();
+    JobInfo info;
+    info.name = name;
+    info.traceName = TRACE_INTERN(name);
+    info.work = work;
+    info.upload = upload;
+    info.waitingFor = 0;
+    info.start = info.end = 0.0;
+    info.thread = -1;
+    jobs.push_back(info);
+
+    // a job can only wait for earlier ones, so the graph has no cycles
+    for (Job dependency : dependencies) {
+        if (dependency < 0 || dependency >= job) {
+            throw runtime_error("Invalid dependency of asset job " + name);
+        }
+        jobs[dependency].dependents.push_back(job);
+        jobs[job].dependencies.push_back(dependency);
+        jobs[job].waitingFor++;
+    }
+    return job;
+}
+
+#ifdef ENABLE_PROFILER
+// Flow of a trace from a job to one that waited for it
+static unsigned long long flowId(unsigned long long run, int from, int to) {
+    return run << 40 | (unsigned long long) from << 20 | (unsigned long long) to;
+}
+#endif
+
+void AssetPipeline::run() {
+#ifdef ENABLE_PROFILER
+    static atomic<unsigned long long> runs(0);
+    unsigned long long run = runs++;
+#endif
+    mutex lock;
+    condition_variable changed;
+    deque<Job> workerQueue, uploadQueue;
+    int remaining = (int) jobs.size();
+    int running = 0;
+    exception_ptr error;
+
+    auto start = chrono::steady_clock::now();
+    auto now = [&start]() {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+
+    auto enqueue = [&](Job job) {
+        (jobs[job].upload ? uploadQueue : workerQueue).push_back(job);
+    };
+    for (Job job = 0; job < (Job) jobs.size(); job++) {
+        if (jobs[job].waitingFor == 0) enqueue(job);
+    }
+
+    // after a failure the jobs that are running are allowed to finish
+    auto stopped = [&]() {
+        return remaining == 0 || (error && running == 0);
+    };
+
+    // Runs the job without holding the lock, then releases its dependents
+    auto execute = [&](deque<Job>& queue, int thread, unique_lock<mutex>& guard) {
+        Job job = queue.front();
+        queue.pop_front();
+        running++;
+        guard.unlock();
+
+        JobInfo& info = jobs[job];
+        info.thread = thread;
+        info.start = now();
+        exception_ptr jobError;
+        {
+            TRACE_SCOPE(info.upload ? "upload" : "assets", info.traceName);
+            for (Job dependency : info.dependencies) TRACE_FLOW_END("asset", flowId(run, dependency, job));
+            try {
+                info.work();
+            } catch (...) {
+                jobError = current_exception();
+            }
+            for (Job dependent : info.dependents) TRACE_FLOW_BEGIN("asset", flowId(run, job, dependent));
+        }
+        info.end = now();
+
+        guard.lock();
+        running--;
+        remaining--;
+        if (jobError) {
+            if (!error) error = jobError;
+        } else {
+            for (Job dependent : info.dependents) {
+                if (--jobs[dependent].waitingFor == 0) enqueue(dependent);
+            }
+        }
+        changed.notify_all();
+    };
+
+    vector<thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.push_back(thread([&, i]() {
+            TRACE_THREAD_NAME("asset worker " + to_string(i + 1));
+            unique_lock<mutex> guard(lock);
+            while (true) {
+                changed.wait(guard, [&]() {
+                    return stopped() || (!error && !workerQueue.empty());
+                });
+                if (stopped()) break;
+                execute(workerQueue, i + 1, guard);
+            }
+        }));
+    }
+
+    {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            changed.wait(guard, [&]() {
+                return stopped() || (!error && !uploadQueue.empty());
+            });
+            if (stopped()) break;
+            execute(uploadQueue, 0, guard);
+        }
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    totalTime = now();
+
+    if (error) rethrow_exception(error);
+}
+
+void AssetPipeline::printReport() const {
+    vector<const JobInfo*> ran;
+    for (const auto& job : jobs) {
+        if (job.thread >= 0) ran.push_back(&job);
+    }
+    sort(ran.begin(), ran.end(), [](const JobInfo* a, const JobInfo* b) {
+        return a->start < b->start;
+    });
+
+    cout << "Asset pipeline: " << ran.size() << " jobs, " << threads
+         << " workers + GL thread, " << fixed << setprecision(1) << totalTime << " ms" << endl;
+    cout << "   start(ms)  time(ms)  thread  job" << endl;
+    for (const JobInfo* job : ran) {
+        cout << setw(12) << job->start << setw(10) << job->end - job->start
+             << setw(8) << (job->thread == 0 ? string("GL") : to_string(job->thread))
+             << "  " << job->name << endl;
+    }
+    cout << defaultfloat << setprecision(6);
+}
@@ -0,0 +1,58 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <string>
+#include <vector>
+#include <functional>
+
+/**
+* Startup job graph. Decoding and parsing jobs run on worker threads, upload
+* jobs need the GL context and run on the thread that calls run(). A job starts
+* once all of its dependencies have finished, so a typical asset is a decode
+* job followed by an upload job that depends on it. In a trace capture every
+* job is a slice with flows from the jobs it waited for.
+*/
+class AssetPipeline {
+public:
+    typedef int Job;
+
+    explicit AssetPipeline(int threads = 0);
+
+    /** A job for the worker threads, must not touch GL. */
+    Job add(const std::string& name, std::function<void()> work,
+            const std::vector<Job>& dependencies = std::vector<Job>());
+
+    /** A job for the GL thread. */
+    Job addUpload(const std::string& name, std::function<void()> work,
+                  const std::vector<Job>& dependencies = std::vector<Job>());
+
+    /**
+    * Runs every job and waits for them. The first exception thrown by a job is
+    * rethrown here after the jobs already running have finished; the jobs that
+    * have not started by then are skipped.
+    */
+    void run();
+
+    /** Prints when and where every job ran and the time to the last one. */
+    void printReport() const;
+
+private:
+    struct JobInfo {
+        std::string name;
+        const char* traceName;
+        std::function<void()> work;
+        bool upload;
+        int waitingFor;             // unfinished dependencies
+        std::vector<Job> dependencies, dependents;
+        double start, end;          // ms since run()
+        int thread;                 // 0 is the GL thread
+    };
+    std::vector<JobInfo> jobs;
+    int threads;
+    double totalTime;
+
+    Job addJob(const std::string& name, std::function<void()> work, bool upload,
+               const std::vector<Job>& dependencies);
+};
+
+#endif
@@ -0,0 +1,169 @@
+#include <iostream>
+#include <memory>
+#include <cstring>
+#include <stdexcept>
+#include "backend.h"
+#include "glcalls.h"
+
+using namespace std;
+
+static unique_ptr<RenderBackend> backend;
+
+void RenderBackend::select(const string& name) {
+    if (name == "gl33") backend.reset(new GL33Backend());
+    else if (name == "gl45") backend.reset(new GL45Backend());
+    else if (name == "null") backend.reset(new NullBackend());
+    else throw runtime_error("Unknown backend: " + name + " (gl33, gl45 or null)");
+}
+
+RenderBackend& RenderBackend::get() {
+    if (!backend) backend.reset(new GL33Backend());
+    return *backend;
+}
+
+GLuint GL33Backend::createBuffer(MemoryTag tag, GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    bufferData(tag, buffer, target, size, data, usage);
+    return buffer;
+}
+
+void GL33Backend::deleteBuffer(GLuint buffer) {
+    capacities.erase(buffer);
+    deleteBuffers(1, &buffer);
+}
+
+GLuint GL33Backend::createInstanceBuffer(MemoryTag tag, size_t stride, GLsizei capacity) {
+    GLuint buffer = createBuffer(tag, GL_ARRAY_BUFFER, stride * capacity, NULL, GL_STREAM_DRAW);
+    capacities[buffer] = capacity;
+    return buffer;
+}
+
+GLuint GL33Backend::streamInstances(MemoryTag tag, GLuint buffer, size_t stride, GLsizei count, const void* data) {
+    if (count > capacities[buffer]) throw runtime_error("More instances than the instance buffer holds");
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    // orphaning, the driver gives new storage instead of waiting for the draws of the last frame
+    bufferData(tag, buffer, GL_ARRAY_BUFFER, count * stride, NULL, GL_STREAM_DRAW);
+    bufferSubData(tag, GL_ARRAY_BUFFER, 0, count * stride, data);
+    return 0;
+}
+
+GLuint GL33Backend::createTexture(GLenum target) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(target, texture);
+    return texture;
+}
+
+void GL33Backend::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(target, texture);
+}
+
+void GL33Backend::useProgram(GLuint program) {
+    glUseProgram(program);
+}
+
+void GL33Backend::bindVertexArray(GLuint vertexArray) {
+    glBindVertexArray(vertexArray);
+}
+
+void GL33Backend::drawElements(GLenum mode, GLsizei count, size_t offset) {
+    glDrawElements(mode, count, GL_UNSIGNED_INT, (const void*) offset);
+}
+
+void GL33Backend::drawElementsInstanced(GLenum mode, GLsizei count, size_t offset, GLsizei instances,
+                                        GLuint /*baseInstance*/) {
+    // streamInstances always gives 0
+    glDrawElementsInstanced(mode, count, GL_UNSIGNED_INT, (const void*) offset, instances);
+}
+
+void GL45Backend::initialize() {
+    dsa = GLEW_VERSION_4_5 ||
+          (GLEW_ARB_direct_state_access && GLEW_ARB_buffer_storage && GLEW_ARB_base_instance);
+    if (!dsa) cout << "GL 4.5 not supported, using the gl33 backend" << endl;
+}
+
+void GL45Backend::endFrame() {
+    if (!dsa) return;
+    // the fence of FRAMES frames ago is still there unless a stream waited for it
+    GLsync& fence = fences[frame % FRAMES];
+    if (fence) glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame++;
+    waited = false;
+}
+
+GLuint GL45Backend::createBuffer(MemoryTag tag, GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+    if (!dsa) return GL33Backend::createBuffer(tag, target, size, data, usage);
+    GLuint buffer;
+    glCreateBuffers(1, &buffer);
+    glNamedBufferData(buffer, size, data, usage);
+    MemoryTracker::get().allocate(MemoryTracker::BUFFER, buffer, size, tag);
+    if (data) MemoryTracker::get().upload(tag, size);
+    glBindBuffer(target, buffer);
+    return buffer;
+}
+
+void GL45Backend::deleteBuffer(GLuint buffer) {
+    auto found = mapped.find(buffer);
+    if (found != mapped.end()) {
+        glUnmapNamedBuffer(buffer);
+        mapped.erase(found);
+    }
+    GL33Backend::deleteBuffer(buffer);
+}
+
+GLuint GL45Backend::createInstanceBuffer(MemoryTag tag, size_t stride, GLsizei capacity) {
+    if (!dsa) return GL33Backend::createInstanceBuffer(tag, stride, capacity);
+    GLuint buffer;
+    glCreateBuffers(1, &buffer);
+    GLsizeiptr size = stride * capacity * FRAMES;
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glNamedBufferStorage(buffer, size, nullptr, flags);
+    mapped[buffer] = (unsigned char*) glMapNamedBufferRange(buffer, 0, size, flags);
+    MemoryTracker::get().allocate(MemoryTracker::BUFFER, buffer, size, tag);
+    capacities[buffer] = capacity;
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    return buffer;
+}
+
+GLuint GL45Backend::streamInstances(MemoryTag tag, GLuint buffer, size_t stride, GLsizei count, const void* data) {
+    if (!dsa) return GL33Backend::streamInstances(tag, buffer, stride, count, data);
+    GLsizei capacity = capacities[buffer];
+    if (count > capacity) throw runtime_error("More instances than the instance buffer holds");
+
+    // the copy of this frame was last drawn FRAMES frames ago
+    GLsync& fence = fences[frame % FRAMES];
+    if (!waited && fence) {
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(fence);
+        fence = 0;
+    }
+    waited = true;
+
+    GLuint first = (GLuint) (frame % FRAMES * capacity);
+    memcpy(mapped[buffer] + first * stride, data, count * stride);
+    MemoryTracker::get().upload(tag, count * stride);
+    return first;
+}
+
+GLuint GL45Backend::createTexture(GLenum target) {
+    if (!dsa) return GL33Backend::createTexture(target);
+    GLuint texture;
+    glCreateTextures(target, 1, &texture);
+    glBindTexture(target, texture);
+    return texture;
+}
+
+void GL45Backend::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    if (!dsa) return GL33Backend::bindTexture(unit, target, texture);
+    glBindTextureUnit(unit, texture);
+}
+
+void GL45Backend::drawElementsInstanced(GLenum mode, GLsizei count, size_t offset, GLsizei instances,
+                                        GLuint baseInstance) {
+    if (!dsa) return GL33Backend::drawElementsInstanced(mode, count, offset, instances, baseInstance);
+    glDrawElementsInstancedBaseInstance(mode, count, GL_UNSIGNED_INT, (const void*) offset, instances, baseInstance);
+}
@@ -0,0 +1,144 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <GL/glew.h>
+#include <string>
+#include <map>
+#include "memorytracker.h"
+
+/**
+* What the renderer does with the GL every frame: buffers, textures, programs
+* and draws. The backend is chosen once with select() before the window is
+* made, everything else uses get().
+*
+* gl33 issues the plain GL 3.3 calls. gl45 creates its objects with direct
+* state access and streams instance data through persistently mapped
+* buffers, it falls back to gl33 without GL 4.5. null needs no window or
+* context: it replaces every GL entry point with one that checks its
+* arguments against the objects made so far and counts it, so the whole frame
+* loop runs on a host without a GPU and times only the CPU side of
+* simulation, packing and submission. Code that still calls the GL directly
+* is checked and counted the same way.
+*/
+class RenderBackend {
+public:
+    struct Counts {
+        unsigned long long calls = 0;       // GL entry points
+        unsigned long long draws = 0;
+        unsigned long long instances = 0;
+        unsigned long long bytes = 0;       // buffer, texture and uniform data
+    };
+
+    /* "gl33" (the default), "gl45" or "null" */
+    static void select(const std::string& name);
+    static RenderBackend& get();
+
+    virtual ~RenderBackend() {}
+    virtual const char* name() const = 0;
+    virtual bool needsContext() const { return true; }
+    /* After glewInit, the null backend instead of making a context */
+    virtual void initialize() {}
+    /* Call once per frame after its last draw */
+    virtual void endFrame() {}
+    /* What the null backend counted, zero for the others */
+    virtual Counts lastFrame() const { return Counts(); }
+    virtual Counts total() const { return Counts(); }
+    virtual void printReport() const {}
+
+    /* Left bound to target, e.g. to the vertex array being set up */
+    virtual GLuint createBuffer(MemoryTag tag, GLenum target, GLsizeiptr size, const void* data, GLenum usage) = 0;
+    virtual void deleteBuffer(GLuint buffer) = 0;
+    /* Per instance data of at most capacity instances, rewritten every frame; left bound to GL_ARRAY_BUFFER */
+    virtual GLuint createInstanceBuffer(MemoryTag tag, size_t stride, GLsizei capacity) = 0;
+    /* Replaces the instances, returns the base instance to draw them with */
+    virtual GLuint streamInstances(MemoryTag tag, GLuint buffer, size_t stride, GLsizei count, const void* data) = 0;
+
+    /* Left bound to target on the active unit */
+    virtual GLuint createTexture(GLenum target) = 0;
+    virtual void bindTexture(GLuint unit, GLenum target, GLuint texture) = 0;
+
+    virtual void useProgram(GLuint program) = 0;
+
+    /* Draws of GL_UNSIGNED_INT indices, offset in bytes into the element buffer */
+    virtual void bindVertexArray(GLuint vertexArray) = 0;
+    virtual void drawElements(GLenum mode, GLsizei count, size_t offset) = 0;
+    virtual void drawElementsInstanced(GLenum mode, GLsizei count, size_t offset, GLsizei instances,
+                                       GLuint baseInstance) = 0;
+};
+
+class GL33Backend : public RenderBackend {
+public:
+    const char* name() const override { return "gl33"; }
+
+    GLuint createBuffer(MemoryTag tag, GLenum target, GLsizeiptr size, const void* data, GLenum usage) override;
+    void deleteBuffer(GLuint buffer) override;
+    GLuint createInstanceBuffer(MemoryTag tag, size_t stride, GLsizei capacity) override;
+    GLuint streamInstances(MemoryTag tag, GLuint buffer, size_t stride, GLsizei count, const void* data) override;
+
+    GLuint createTexture(GLenum target) override;
+    void bindTexture(GLuint unit, GLenum target, GLuint texture) override;
+
+    void useProgram(GLuint program) override;
+
+    void bindVertexArray(GLuint vertexArray) override;
+    void drawElements(GLenum mode, GLsizei count, size_t offset) override;
+    void drawElementsInstanced(GLenum mode, GLsizei count, size_t offset, GLsizei instances,
+                               GLuint baseInstance) override;
+
+protected:
+    std::map<GLuint, GLsizei> capacities;   // of the instance buffers
+};
+
+/**
+* Instance buffers hold FRAMES copies of their instances in immutable,
+* persistently mapped storage. Each frame writes the next copy and draws it
+* with a base instance, a fence per frame keeps the CPU from overwriting a
+* copy the GPU still reads.
+*/
+class GL45Backend : public GL33Backend {
+public:
+    static const int FRAMES = 3;
+
+    const char* name() const override { return dsa ? "gl45" : "gl33"; }
+    void initialize() override;
+    void endFrame() override;
+
+    GLuint createBuffer(MemoryTag tag, GLenum target, GLsizeiptr size, const void* data, GLenum usage) override;
+    void deleteBuffer(GLuint buffer) override;
+    GLuint createInstanceBuffer(MemoryTag tag, size_t stride, GLsizei capacity) override;
+    GLuint streamInstances(MemoryTag tag, GLuint buffer, size_t stride, GLsizei count, const void* data) override;
+
+    GLuint createTexture(GLenum target) override;
+    void bindTexture(GLuint unit, GLenum target, GLuint texture) override;
+
+    void drawElementsInstanced(GLenum mode, GLsizei count, size_t offset, GLsizei instances,
+                               GLuint baseInstance) override;
+
+private:
+    bool dsa = false;           // GL 4.5 or the extensions, gl33 otherwise
+    std::map<GLuint, unsigned char*> mapped;
+    GLsync fences[FRAMES] = {};
+    int frame = 0;
+    bool waited = false;        // for the copy of this frame
+};
+
+/**
+* The gl33 calls on a GL that only exists in memory. Every entry point throws
+* a runtime_error on a call a driver would reject, e.g. an unknown name, a
+* draw without a vertex array, element buffer or linked program, a buffer
+* write past the end or a uniform location the program doesn't have. Shaders
+* are not compiled, their uniforms are read from the source so that the
+* programs reflect the same locations. GLEW reports GL 3.3 without extensions.
+*/
+class NullBackend : public GL33Backend {
+public:
+    const char* name() const override { return "null"; }
+    bool needsContext() const override { return false; }
+    void initialize() override;
+    void endFrame() override;
+    Counts lastFrame() const override;
+    Counts total() const override;
+    void printReport() const override;
+};
+
+#endif
@@ -9,6 +9,9 @@ Camera::Camera(GLFWwindow* window) : window(window) {
     horizontalAngle = 0.5 * 3.14f;
     verticalAngle = -0.1 * 3.14f;
     FoV = 45.0f;
+    aspect = 4.0f / 3.0f;
+    nearPlane = 0.1f;
+    farPlane = 100.0f;
     speed = 3.0f;
     mouseSpeed = 0.001f;
     fovSpeed = 2.0f;
@@ -52,7 +55,7 @@ void Camera::update() {
     }
 
     // Task 5.2: update view matrix so it always looks at the origin
-    projectionMatrix = perspective(radians(FoV), 4.0f / 3.0f, 0.1f, 100.0f);
+    projectionMatrix = perspective(radians(FoV), aspect, nearPlane, farPlane);
     viewMatrix = lookAt(
         position,
         vec3(0, 0, 0),
@@ -67,22 +70,8 @@ void Camera::update() {
     verticalAngle += mouseSpeed * float(height / 2 - yPos);
 
     // Task 5.4: right and up vectors of the camera coordinate system
-    // use spherical coordinates
-    vec3 direction(
-        cos(verticalAngle) * sin(horizontalAngle),
-        sin(verticalAngle),
-        cos(verticalAngle) * cos(horizontalAngle)
-    );
-
-    // Right vector
-    vec3 right(
-        sin(horizontalAngle - 3.14f / 2.0f),
-        0,
-        cos(horizontalAngle - 3.14f / 2.0f)
-    );
-
-    // Up vector
-    vec3 up = cross(right, direction);
+    vec3 direction, right, up;
+    orientation(direction, right, up);
 
     // Task 5.5: update camera position using the direction/right vectors
     // Move forward
@@ -113,16 +102,48 @@ void Camera::update() {
     }
 
     // Task 5.7: construct projection and view matrices
-    projectionMatrix = perspective(radians(FoV), 4.0f / 3.0f, 0.1f, 100.0f);
-    viewMatrix = lookAt(
-        position,
-        position + direction,
-        up
-    );
+    updateMatrices();
     //*/
 
     // Homework XX: perform orthographic projection
 
     // For the next frame, the "last time" will be "now"
     lastTime = currentTime;
+}
+
+void Camera::setPose(const vec3& position, float horizontalAngle, float verticalAngle) {
+    this->position = position;
+    this->horizontalAngle = horizontalAngle;
+    this->verticalAngle = verticalAngle;
+    updateMatrices();
+}
+
+// use spherical coordinates
+void Camera::orientation(vec3& direction, vec3& right, vec3& up) const {
+    direction = vec3(
+        cos(verticalAngle) * sin(horizontalAngle),
+        sin(verticalAngle),
+        cos(verticalAngle) * cos(horizontalAngle)
+    );
+
+    // Right vector
+    right = vec3(
+        sin(horizontalAngle - 3.14f / 2.0f),
+        0,
+        cos(horizontalAngle - 3.14f / 2.0f)
+    );
+
+    // Up vector
+    up = cross(right, direction);
+}
+
+void Camera::updateMatrices() {
+    vec3 direction, right, up;
+    orientation(direction, right, up);
+    projectionMatrix = perspective(radians(FoV), aspect, nearPlane, farPlane);
+    viewMatrix = lookAt(
+        position,
+        position + direction,
+        up
+    );
 }
\ No newline at end of file
@@ -18,6 +18,10 @@ public:
     float verticalAngle;
     // Field of View
     float FoV;
+    // Width over height of the view and the clip planes
+    float aspect;
+    float nearPlane;
+    float farPlane;
 
     float speed; // units / second
     float mouseSpeed;
@@ -25,7 +29,15 @@ public:
 
     Camera(GLFWwindow* window);
 
+    /* Moves and turns with the mouse and keyboard */
     void update();
+
+    /* Places the camera without input, e.g. along a scripted path */
+    void setPose(const glm::vec3& position, float horizontalAngle, float verticalAngle);
+
+private:
+    void orientation(glm::vec3& direction, glm::vec3& right, glm::vec3& up) const;
+    void updateMatrices();
 };
 
 #endif
\ No newline at end of file
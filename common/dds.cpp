@@ -0,0 +1,267 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+using namespace std;
+#include "dds.h"
+
+// Halves both sides (down to 1), averaging 2x2 pixels
+static RGBAImage downsample(const RGBAImage& image, bool normalMap) {
+    RGBAImage result;
+    result.width = max(image.width / 2, 1);
+    result.height = max(image.height / 2, 1);
+    result.pixels.resize(result.width * result.height * 4);
+
+    for (int y = 0; y < result.height; y++) {
+        for (int x = 0; x < result.width; x++) {
+            float sum[4] = { 0, 0, 0, 0 };
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    int sx = min(2 * x + dx, image.width - 1);
+                    int sy = min(2 * y + dy, image.height - 1);
+                    const unsigned char* p = &image.pixels[(sy * image.width + sx) * 4];
+                    for (int c = 0; c < 4; c++) {
+                        sum[c] += normalMap && c < 3 ? p[c] / 127.5f - 1.0f : p[c];
+                    }
+                }
+            }
+
+            unsigned char* out = &result.pixels[(y * result.width + x) * 4];
+            if (normalMap) {
+                float length = sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+                if (length < 1e-6f) {
+                    sum[0] = sum[1] = 0.0f;
+                    sum[2] = length = 1.0f;
+                }
+                for (int c = 0; c < 3; c++) {
+                    out[c] = (unsigned char) lround((sum[c] / length + 1.0f) * 127.5f);
+                }
+            } else {
+                for (int c = 0; c < 3; c++) {
+                    out[c] = (unsigned char) lround(sum[c] / 4.0f);
+                }
+            }
+            out[3] = (unsigned char) lround(sum[3] / 4.0f);
+        }
+    }
+    return result;
+}
+
+vector<RGBAImage> buildMipChain(const RGBAImage& image, bool normalMap) {
+    vector<RGBAImage> levels(1, image);
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        levels.push_back(downsample(levels.back(), normalMap));
+    }
+    return levels;
+}
+
+/*****************************************************************************/
+
+static unsigned short packRGB565(const float color[3]) {
+    int r = (int) lround(min(max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f);
+    int g = (int) lround(min(max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f);
+    int b = (int) lround(min(max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f);
+    return (unsigned short) ((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(unsigned short packed, float color[3]) {
+    color[0] = ((packed >> 11) & 31) * 255.0f / 31.0f;
+    color[1] = ((packed >> 5) & 63) * 255.0f / 63.0f;
+    color[2] = (packed & 31) * 255.0f / 31.0f;
+}
+
+static void writeLittleEndian(unsigned char* out, unsigned long long value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (unsigned char) (value >> (8 * i));
+    }
+}
+
+// BC1 colour block: the end points are the extremes of the colours along their
+// principal axis, found by power iteration on the covariance matrix
+static void encodeColorBlock(const unsigned char block[16][4], unsigned char* out) {
+    float mean[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) mean[c] += block[i][c] / 16.0f;
+    }
+
+    float covariance[3][3] = {};
+    for (int i = 0; i < 16; i++) {
+        float d[3] = { block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2] };
+        for (int a = 0; a < 3; a++) {
+            for (int b = 0; b < 3; b++) covariance[a][b] += d[a] * d[b];
+        }
+    }
+
+    float axis[3] = { 1, 1, 1 };
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[3];
+        for (int a = 0; a < 3; a++) {
+            next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+        }
+        float length = sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f) break;  // flat block, any axis will do
+        for (int a = 0; a < 3; a++) axis[a] = next[a] / length;
+    }
+
+    float minT = 1e30f, maxT = -1e30f;
+    for (int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < 3; c++) t += (block[i][c] - mean[c]) * axis[c];
+        minT = min(minT, t);
+        maxT = max(maxT, t);
+    }
+    float end0[3], end1[3];
+    for (int c = 0; c < 3; c++) {
+        end0[c] = mean[c] + axis[c] * maxT;
+        end1[c] = mean[c] + axis[c] * minT;
+    }
+
+    // color0 > color1 selects the four colour mode
+    unsigned short color0 = packRGB565(end0), color1 = packRGB565(end1);
+    if (color0 < color1) swap(color0, color1);
+
+    float palette[4][3];
+    unpackRGB565(color0, palette[0]);
+    unpackRGB565(color1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+
+    unsigned int indices = 0;
+    if (color0 != color1) {
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            float bestDistance = 1e30f;
+            for (int k = 0; k < 4; k++) {
+                float distance = 0.0f;
+                for (int c = 0; c < 3; c++) {
+                    float d = block[i][c] - palette[k][c];
+                    distance += d * d;
+                }
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = k;
+                }
+            }
+            indices |= best << (2 * i);
+        }
+    }
+
+    writeLittleEndian(out, color0, 2);
+    writeLittleEndian(out + 2, color1, 2);
+    writeLittleEndian(out + 4, indices, 4);
+}
+
+// BC4 block of one channel (the alpha of BC3, each channel of BC5), using the
+// eight value mode between the minimum and the maximum
+static void encodeChannelBlock(const unsigned char block[16][4], int channel, unsigned char* out) {
+    int low = 255, high = 0;
+    for (int i = 0; i < 16; i++) {
+        low = min(low, (int) block[i][channel]);
+        high = max(high, (int) block[i][channel]);
+    }
+
+    float palette[8] = { (float) high, (float) low };
+    for (int k = 2; k < 8; k++) {
+        palette[k] = ((8 - k) * high + (k - 1) * low) / 7.0f;
+    }
+
+    unsigned long long indices = 0;
+    if (high != low) {
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            float bestDistance = 1e30f;
+            for (int k = 0; k < 8; k++) {
+                float distance = fabs(block[i][channel] - palette[k]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = k;
+                }
+            }
+            indices |= (unsigned long long) best << (3 * i);
+        }
+    }
+
+    out[0] = (unsigned char) high;
+    out[1] = (unsigned char) low;
+    writeLittleEndian(out + 2, indices, 6);
+}
+
+vector<unsigned char> compressBlocks(const RGBAImage& image, BlockFormat format) {
+    int blocksX = (image.width + 3) / 4;
+    int blocksY = (image.height + 3) / 4;
+    int blockSize = format == BlockFormat::BC1 ? 8 : 16;
+    vector<unsigned char> blocks(blocksX * blocksY * blockSize);
+
+    for (int by = 0; by < blocksY; by++) {
+        for (int bx = 0; bx < blocksX; bx++) {
+            unsigned char block[16][4];
+            for (int i = 0; i < 16; i++) {
+                int x = min(bx * 4 + i % 4, image.width - 1);
+                int y = min(by * 4 + i / 4, image.height - 1);
+                memcpy(block[i], &image.pixels[(y * image.width + x) * 4], 4);
+            }
+
+            unsigned char* out = &blocks[(by * blocksX + bx) * blockSize];
+            switch (format) {
+                case BlockFormat::BC1:
+                    encodeColorBlock(block, out);
+                    break;
+                case BlockFormat::BC3:
+                    encodeChannelBlock(block, 3, out);
+                    encodeColorBlock(block, out + 8);
+                    break;
+                case BlockFormat::BC5:
+                    encodeChannelBlock(block, 0, out);
+                    encodeChannelBlock(block, 1, out + 8);
+                    break;
+            }
+        }
+    }
+    return blocks;
+}
+
+/*****************************************************************************/
+
+void writeDDS(const string& path, BlockFormat format, const vector<vector<RGBAImage>>& faces) {
+    if (faces.empty() || faces[0].empty()) {
+        throw runtime_error("No image to write: " + path);
+    }
+    const RGBAImage& top = faces[0][0];
+
+    const char* fourCC = format == BlockFormat::BC1 ? "DXT1" :
+                         format == BlockFormat::BC3 ? "DXT5" : "ATI2";
+    int blockSize = format == BlockFormat::BC1 ? 8 : 16;
+
+    // DDS_HEADER, offsets in the comments are in bytes
+    unsigned int header[31] = {};
+    header[0] = 124;                                    // size
+    header[1] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, height, width, pixel format, mip count, linear size
+    header[2] = top.height;                             // 8
+    header[3] = top.width;                              // 12
+    header[4] = ((top.width + 3) / 4) * ((top.height + 3) / 4) * blockSize;
+    header[6] = (unsigned int) faces[0].size();         // 24 mip count
+    header[18] = 32;                                    // 72 pixel format size
+    header[19] = 0x4;                                   // 76 DDPF_FOURCC
+    memcpy(&header[20], fourCC, 4);                     // 80
+    header[26] = 0x1000 | 0x400000 | 0x8;               // 104 texture, mipmap, complex
+    if (faces.size() == 6) {
+        header[27] = 0x200 | 0xFC00;                    // 108 cube map with all faces
+    }
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        throw runtime_error("Can't write file: " + path);
+    }
+    fwrite("DDS ", 1, 4, file);
+    fwrite(header, sizeof(header), 1, file);
+    for (const auto& levels : faces) {
+        for (const auto& level : levels) {
+            vector<unsigned char> blocks = compressBlocks(level, format);
+            fwrite(&blocks[0], 1, blocks.size(), file);
+        }
+    }
+    fclose(file);
+}
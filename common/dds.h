@@ -0,0 +1,46 @@
+#ifndef DDS_H
+#define DDS_H
+
+#include <vector>
+#include <string>
+
+/**
+* Mip chain generation, block compression and .dds writing for the texconv
+* tool. Nothing here needs a GL context, loadDDS() reads the result.
+*/
+
+enum class BlockFormat {
+    BC1,    // RGB, 4 bpp ("DXT1")
+    BC3,    // RGBA, 8 bpp ("DXT5")
+    BC5     // two channels, 8 bpp ("ATI2"), for normal maps
+};
+
+/**
+* 8 bit RGBA pixels, rows in the order they are uploaded.
+*/
+struct RGBAImage {
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+};
+
+/**
+* Levels 1..n down to 1x1 with a box filter, after level 0. Normal maps are
+* renormalized on every level.
+*/
+std::vector<RGBAImage> buildMipChain(const RGBAImage& image, bool normalMap);
+
+/**
+* The 4x4 blocks of an image, the last row and column are repeated to fill
+* partial blocks.
+*/
+std::vector<unsigned char> compressBlocks(const RGBAImage& image, BlockFormat format);
+
+/**
+* Writes a 2D texture (one face) or a cube map (six faces, +X -X +Y -Y +Z -Z),
+* each face a full mip chain.
+*/
+void writeDDS(const std::string& path, BlockFormat format,
+              const std::vector<std::vector<RGBAImage>>& faces);
+
+#endif
@@ -0,0 +1,30 @@
+#define GL_CALLS_IMPLEMENTATION
+#include "glcalls.h"
+
+decltype(&::glBindTexture) glrBindTexture = ::glBindTexture;
+decltype(&::glBlendFunc) glrBlendFunc = ::glBlendFunc;
+decltype(&::glClear) glrClear = ::glClear;
+decltype(&::glClearColor) glrClearColor = ::glClearColor;
+decltype(&::glDeleteTextures) glrDeleteTextures = ::glDeleteTextures;
+decltype(&::glDepthFunc) glrDepthFunc = ::glDepthFunc;
+decltype(&::glDepthMask) glrDepthMask = ::glDepthMask;
+decltype(&::glDisable) glrDisable = ::glDisable;
+decltype(&::glDrawBuffer) glrDrawBuffer = ::glDrawBuffer;
+decltype(&::glDrawElements) glrDrawElements = ::glDrawElements;
+decltype(&::glEnable) glrEnable = ::glEnable;
+decltype(&::glFinish) glrFinish = ::glFinish;
+decltype(&::glGenTextures) glrGenTextures = ::glGenTextures;
+decltype(&::glGetFloatv) glrGetFloatv = ::glGetFloatv;
+decltype(&::glGetIntegerv) glrGetIntegerv = ::glGetIntegerv;
+decltype(&::glGetString) glrGetString = ::glGetString;
+decltype(&::glGetTexLevelParameteriv) glrGetTexLevelParameteriv = ::glGetTexLevelParameteriv;
+decltype(&::glIsEnabled) glrIsEnabled = ::glIsEnabled;
+decltype(&::glPixelStorei) glrPixelStorei = ::glPixelStorei;
+decltype(&::glPolygonMode) glrPolygonMode = ::glPolygonMode;
+decltype(&::glReadBuffer) glrReadBuffer = ::glReadBuffer;
+decltype(&::glScissor) glrScissor = ::glScissor;
+decltype(&::glTexImage2D) glrTexImage2D = ::glTexImage2D;
+decltype(&::glTexParameterfv) glrTexParameterfv = ::glTexParameterfv;
+decltype(&::glTexParameteri) glrTexParameteri = ::glTexParameteri;
+decltype(&::glTexSubImage2D) glrTexSubImage2D = ::glTexSubImage2D;
+decltype(&::glViewport) glrViewport = ::glViewport;
@@ -0,0 +1,71 @@
+#ifndef GL_CALLS_H
+#define GL_CALLS_H
+
+#include <GL/glew.h>
+
+/**
+* GLEW doesn't dispatch the GL 1.1 entry points, files that issue them include
+* this header, which sends them through pointers the recorder (glrecorder.h)
+* and the state cache (glstate.h) can hook and the null backend (backend.h)
+* can replace. Code that never hooks them, like the offline tools, only needs
+* this and glcalls.cpp.
+*/
+extern decltype(&::glBindTexture) glrBindTexture;
+extern decltype(&::glBlendFunc) glrBlendFunc;
+extern decltype(&::glClear) glrClear;
+extern decltype(&::glClearColor) glrClearColor;
+extern decltype(&::glDeleteTextures) glrDeleteTextures;
+extern decltype(&::glDepthFunc) glrDepthFunc;
+extern decltype(&::glDepthMask) glrDepthMask;
+extern decltype(&::glDisable) glrDisable;
+extern decltype(&::glDrawBuffer) glrDrawBuffer;
+extern decltype(&::glDrawElements) glrDrawElements;
+extern decltype(&::glEnable) glrEnable;
+extern decltype(&::glFinish) glrFinish;
+extern decltype(&::glGenTextures) glrGenTextures;
+extern decltype(&::glGetFloatv) glrGetFloatv;
+extern decltype(&::glGetIntegerv) glrGetIntegerv;
+extern decltype(&::glGetString) glrGetString;
+extern decltype(&::glGetTexLevelParameteriv) glrGetTexLevelParameteriv;
+extern decltype(&::glIsEnabled) glrIsEnabled;
+extern decltype(&::glPixelStorei) glrPixelStorei;
+extern decltype(&::glPolygonMode) glrPolygonMode;
+extern decltype(&::glReadBuffer) glrReadBuffer;
+extern decltype(&::glScissor) glrScissor;
+extern decltype(&::glTexImage2D) glrTexImage2D;
+extern decltype(&::glTexParameterfv) glrTexParameterfv;
+extern decltype(&::glTexParameteri) glrTexParameteri;
+extern decltype(&::glTexSubImage2D) glrTexSubImage2D;
+extern decltype(&::glViewport) glrViewport;
+
+#ifndef GL_CALLS_IMPLEMENTATION
+#define glBindTexture glrBindTexture
+#define glBlendFunc glrBlendFunc
+#define glClear glrClear
+#define glClearColor glrClearColor
+#define glDeleteTextures glrDeleteTextures
+#define glDepthFunc glrDepthFunc
+#define glDepthMask glrDepthMask
+#define glDisable glrDisable
+#define glDrawBuffer glrDrawBuffer
+#define glDrawElements glrDrawElements
+#define glEnable glrEnable
+#define glFinish glrFinish
+#define glGenTextures glrGenTextures
+#define glGetFloatv glrGetFloatv
+#define glGetIntegerv glrGetIntegerv
+#define glGetString glrGetString
+#define glGetTexLevelParameteriv glrGetTexLevelParameteriv
+#define glIsEnabled glrIsEnabled
+#define glPixelStorei glrPixelStorei
+#define glPolygonMode glrPolygonMode
+#define glReadBuffer glrReadBuffer
+#define glScissor glrScissor
+#define glTexImage2D glrTexImage2D
+#define glTexParameterfv glrTexParameterfv
+#define glTexParameteri glrTexParameteri
+#define glTexSubImage2D glrTexSubImage2D
+#define glViewport glrViewport
+#endif
+
+#endif
@@ -0,0 +1,151 @@
+#include <iostream>
+#include <algorithm>
+#include "gldebug.h"
+#include "glcalls.h"
+
+using namespace std;
+
+GLDebug& GLDebug::get() {
+    static GLDebug debug;
+    return debug;
+}
+
+static const char* sourceName(GLenum source) {
+    switch (source) {
+        case GL_DEBUG_SOURCE_API: return "api";
+        case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+        case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+        case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+        case GL_DEBUG_SOURCE_APPLICATION: return "application";
+        default: return "other";
+    }
+}
+
+static const char* typeName(GLenum type) {
+    switch (type) {
+        case GL_DEBUG_TYPE_ERROR: return "error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+        case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+        case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+        case GL_DEBUG_TYPE_MARKER: return "marker";
+        default: return "other";
+    }
+}
+
+static bool isError(GLenum type) {
+    return type == GL_DEBUG_TYPE_ERROR || type == GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR;
+}
+
+bool GLDebug::enable() {
+    if (!GLEW_VERSION_4_3 && !GLEW_KHR_debug) {
+        cout << "KHR_debug not supported, no GL debug output" << endl;
+        return false;
+    }
+    GLint flags = 0;
+    glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+    if (!(flags & GL_CONTEXT_FLAG_DEBUG_BIT)) {
+        cout << "Not a debug context, the driver may leave out performance warnings" << endl;
+    }
+
+    glEnable(GL_DEBUG_OUTPUT);
+    // on the GL thread inside the call that raised it, so the group is known
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    glDebugMessageCallback(callback, this);
+    // notifications are informational, including the ones of the groups
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL, GL_FALSE);
+    active = true;
+    return true;
+}
+
+void GLDebug::label(GLenum identifier, GLuint name, const string& label) {
+    if (!active || name == 0) return;
+    GLint maxLength = 256;
+    glGetIntegerv(GL_MAX_LABEL_LENGTH, &maxLength);
+    string text = label.substr(0, maxLength - 1);
+    glObjectLabel(identifier, name, (GLsizei) text.size(), text.c_str());
+}
+
+void GLDebug::pushGroup(const char* name) {
+    if (!active) return;
+    groups.push_back(name);
+    glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+}
+
+void GLDebug::popGroup() {
+    if (!active) return;
+    groups.pop_back();
+    glPopDebugGroup();
+}
+
+void GLAPIENTRY GLDebug::callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                  GLsizei length, const GLchar* message, const void* user) {
+    string text = length < 0 ? string(message) : string(message, length);
+    ((GLDebug*) user)->receive(source, type, id, severity, text);
+}
+
+void GLDebug::receive(GLenum source, GLenum type, GLuint id, GLenum severity, const string& text) {
+    if (type == GL_DEBUG_TYPE_PUSH_GROUP || type == GL_DEBUG_TYPE_POP_GROUP) return;
+
+    if (type == GL_DEBUG_TYPE_PERFORMANCE) frame.performance++;
+    else if (isError(type)) frame.errors++;
+    else frame.other++;
+
+    auto key = make_tuple(source, type, id);
+    auto found = messages.find(key);
+    if (found != messages.end()) {
+        found->second.count++;
+        return;
+    }
+    Message& entry = messages[key];
+    entry.source = source;
+    entry.type = type;
+    entry.severity = severity;
+    entry.text = text;
+    entry.group = groups.empty() ? "" : groups.back();
+    entry.firstFrame = frameNumber;
+    entry.count = 1;
+
+    if (printed >= PRINTS_PER_FRAME) {
+        suppressed++;
+        return;
+    }
+    printed++;
+    cout << "GL " << typeName(type) << " (" << sourceName(source) << " " << id;
+    if (!entry.group.empty()) cout << ", in " << entry.group;
+    cout << "): " << text << endl;
+}
+
+void GLDebug::endFrame() {
+    last = frame;
+    all.performance += frame.performance;
+    all.errors += frame.errors;
+    all.other += frame.other;
+    frame = Counts();
+    printed = 0;
+    frameNumber++;
+}
+
+void GLDebug::printReport() const {
+    if (!active) return;
+    unsigned long long count = all.performance + all.errors + all.other +
+                               frame.performance + frame.errors + frame.other;
+    cout << "GL debug output: " << count << " messages, " << messages.size() << " distinct";
+    if (suppressed) cout << " (" << suppressed << " not printed)";
+    cout << endl;
+
+    vector<const Message*> sorted;
+    for (const auto& message : messages) sorted.push_back(&message.second);
+    stable_sort(sorted.begin(), sorted.end(), [](const Message* a, const Message* b) {
+        if (isError(a->type) != isError(b->type)) return isError(a->type);
+        if ((a->type == GL_DEBUG_TYPE_PERFORMANCE) != (b->type == GL_DEBUG_TYPE_PERFORMANCE)) {
+            return a->type == GL_DEBUG_TYPE_PERFORMANCE;
+        }
+        return a->count > b->count;
+    });
+    for (const Message* message : sorted) {
+        cout << "  " << message->count << "x " << typeName(message->type) << ", frame " << message->firstFrame;
+        if (!message->group.empty()) cout << ", " << message->group;
+        cout << ": " << message->text << endl;
+    }
+}
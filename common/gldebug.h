@@ -0,0 +1,84 @@
+#ifndef GL_DEBUG_H
+#define GL_DEBUG_H
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <tuple>
+
+/**
+* KHR_debug output of the driver: errors, undefined behavior and performance
+* warnings such as implicit syncs, buffer stalls and shader recompiles. The
+* messages are delivered synchronously on the GL thread, so every one is
+* attributed to the debug group (pass) it was raised in, and drivers name the
+* objects that have a label.
+*
+* Messages are deduplicated by id: a new one is printed once, at most
+* PRINTS_PER_FRAME a frame, later repeats only add to its count. Performance
+* messages and errors are also counted per frame. Everything is a no-op until
+* enable() found GL 4.3 or KHR_debug, ask for a debug context to get the
+* performance warnings of most drivers.
+*/
+class GLDebug {
+public:
+    static const int PRINTS_PER_FRAME = 5;
+
+    struct Message {
+        GLenum source, type, severity;
+        std::string text;
+        std::string group;          // innermost debug group when first raised
+        long long firstFrame;
+        unsigned long long count;
+    };
+
+    struct Counts {
+        unsigned int performance = 0;
+        unsigned int errors = 0;        // errors and undefined behavior
+        unsigned int other = 0;
+    };
+
+    static GLDebug& get();
+
+    /* Installs the callback in the current context, false when unsupported */
+    bool enable();
+    bool enabled() const { return active; }
+
+    /* glObjectLabel, e.g. GL_BUFFER, GL_TEXTURE, GL_PROGRAM or GL_FRAMEBUFFER */
+    void label(GLenum identifier, GLuint name, const std::string& label);
+
+    void pushGroup(const char* name);
+    void popGroup();
+
+    /* Call once per frame, closes the counts of the frame */
+    void endFrame();
+
+    const Counts& lastFrame() const { return last; }
+    const Counts& total() const { return all; }
+
+    /* Every distinct message with its count and group, errors first */
+    void printReport() const;
+
+private:
+    GLDebug() {}
+    static void GLAPIENTRY callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                    GLsizei length, const GLchar* message, const void* user);
+    void receive(GLenum source, GLenum type, GLuint id, GLenum severity, const std::string& text);
+
+    bool active = false;
+    std::vector<const char*> groups;
+    std::map<std::tuple<GLenum, GLenum, GLuint>, Message> messages;
+    Counts frame, last, all;
+    long long frameNumber = 0;
+    int printed = 0;            // new messages printed in this frame
+    unsigned long long suppressed = 0;
+};
+
+/* Puts the GL commands of its lifetime into a debug group */
+class GLDebugGroup {
+public:
+    explicit GLDebugGroup(const char* name) { GLDebug::get().pushGroup(name); }
+    ~GLDebugGroup() { GLDebug::get().popGroup(); }
+};
+
+#endif
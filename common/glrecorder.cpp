@@ -0,0 +1,783 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <tuple>
+#include <map>
+#include "glrecorder.h"
+
+using namespace std;
+
+/*
+* Capture file: the magic, the names of the calls in the order of their ids,
+* then records of a 16 bit call id and its arguments. Data is a 64 bit size
+* and the bytes, pixels a 0 (null), 1 (data) or 2 (64 bit offset into the
+* bound unpack buffer) tag first. The footer is the end offset of every frame
+* and, in the last 8 bytes, where the footer starts.
+*/
+static const char MAGIC[8] = { 'G', 'L', 'R', 'E', 'C', '1', '\r', '\n' };
+static const uint16_t FRAME_END = 0xffff;
+
+// Object names of the capture are mapped to the ones of the replay per kind
+enum NameKind { BUFFER, TEXTURE, VERTEX_ARRAY, FRAMEBUFFER, RENDERBUFFER, PROGRAM, SHADER, NAME_KINDS };
+
+struct GLReplay::State {
+    vector<char> file;
+    const char* cursor = nullptr;
+    const char* end = nullptr;
+    vector<int> calls;              // call id of the file -> index in callTable()
+    size_t recordsStart = 0;
+    vector<size_t> frameEnds;
+    vector<size_t> frameCalls;
+    vector<GLuint> names[NAME_KINDS];
+    map<GLuint, vector<GLint>> locations;   // of every program
+    vector<GLint>* programLocations = nullptr;
+
+    void need(size_t size) {
+        if ((size_t) (end - cursor) < size) throw runtime_error("Truncated GL capture");
+    }
+
+    template<class T> T read() {
+        need(sizeof(T));
+        T value;
+        memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return value;
+    }
+
+    const void* data(uint64_t* size = nullptr) {
+        uint64_t bytes = read<uint64_t>();
+        need(bytes);
+        const char* start = cursor;
+        cursor += bytes;
+        if (size) *size = bytes;
+        return start;
+    }
+
+    const void* pixels() {
+        uint8_t tag = read<uint8_t>();
+        if (tag == 0) return nullptr;
+        if (tag == 2) return (const void*) (uintptr_t) read<uint64_t>();
+        return data();
+    }
+
+    GLuint name(NameKind kind, GLuint recorded) {
+        const vector<GLuint>& actual = names[kind];
+        return recorded < actual.size() ? actual[recorded] : recorded;
+    }
+
+    void remap(NameKind kind, GLuint recorded, GLuint actual) {
+        vector<GLuint>& mapped = names[kind];
+        if (mapped.size() <= recorded) mapped.resize(recorded + 1, 0);
+        mapped[recorded] = actual;
+    }
+
+    GLint location(GLint recorded) {
+        if (recorded < 0 || !programLocations || (size_t) recorded >= programLocations->size()) return recorded;
+        return (*programLocations)[recorded];
+    }
+};
+
+// Writing on the GL thread while recording
+static ofstream capture;
+
+static void beginCall(int id) {
+    uint16_t call = (uint16_t) id;
+    capture.write((const char*) &call, sizeof(call));
+}
+
+template<class T> static void write(const T& value) {
+    capture.write((const char*) &value, sizeof(T));
+}
+
+static void writeData(const void* data, size_t size) {
+    write((uint64_t) size);
+    capture.write((const char*) data, size);
+}
+
+static void writeString(const char* text, size_t length) {
+    writeData(text, length);
+}
+
+// Pixels of an upload, an offset when they come from a pixel unpack buffer
+static void writePixels(const void* pixels, size_t size) {
+    GLint unpackBuffer = 0;
+    glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpackBuffer);
+    if (unpackBuffer) {
+        write((uint8_t) 2);
+        write((uint64_t) (uintptr_t) pixels);
+    } else if (!pixels) {
+        write((uint8_t) 0);
+    } else {
+        write((uint8_t) 1);
+        writeData(pixels, size);
+    }
+}
+
+// Bytes glTex(Sub)Image reads for an image with the current unpack alignment
+static size_t imageBytes(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type) {
+    size_t components = 4;
+    switch (format) {
+        case GL_RED: case GL_DEPTH_COMPONENT: components = 1; break;
+        case GL_RG: components = 2; break;
+        case GL_RGB: case GL_BGR: components = 3; break;
+    }
+    size_t componentBytes = 1;
+    switch (type) {
+        case GL_FLOAT: case GL_INT: case GL_UNSIGNED_INT: componentBytes = 4; break;
+        case GL_HALF_FLOAT: case GL_SHORT: case GL_UNSIGNED_SHORT: componentBytes = 2; break;
+    }
+    GLint alignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    size_t row = (size_t) width * components * componentBytes;
+    size_t alignedRow = (row + alignment - 1) / alignment * alignment;
+    size_t rows = (size_t) height * depth;
+    return rows == 0 ? 0 : alignedRow * (rows - 1) + row;
+}
+
+/* Argument types: plain values, or values that need mapping on replay */
+template<NameKind K> struct Name {};
+struct Location {};     // uniform location in the current program
+struct Offset {};       // pointer argument that is an offset into a bound buffer
+
+template<class T> struct Arg {
+    typedef T Type;
+    static void put(T value) { write(value); }
+    static T get(GLReplay::State& state) { return state.read<T>(); }
+};
+
+template<NameKind K> struct Arg<Name<K>> {
+    typedef GLuint Type;
+    static void put(GLuint value) { write(value); }
+    static GLuint get(GLReplay::State& state) { return state.name(K, state.read<GLuint>()); }
+};
+
+template<> struct Arg<Location> {
+    typedef GLint Type;
+    static void put(GLint value) { write(value); }
+    static GLint get(GLReplay::State& state) { return state.location(state.read<GLint>()); }
+};
+
+template<> struct Arg<Offset> {
+    typedef const void* Type;
+    static void put(const void* value) { write((uint64_t) (uintptr_t) value); }
+    static const void* get(GLReplay::State& state) { return (const void*) (uintptr_t) state.read<uint64_t>(); }
+};
+
+template<int... I> struct Indices {};
+template<int N, int... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+template<int... I> struct MakeIndices<0, I...> { typedef Indices<I...> Type; };
+
+/* The function pointer a call is dispatched through, and its id in a capture */
+template<class Fn, Fn* Slot> struct Hooked {
+    static Fn original;
+    static int id;
+    static Fn* slot() { return Slot; }
+};
+template<class Fn, Fn* Slot> Fn Hooked<Fn, Slot>::original = nullptr;
+template<class Fn, Fn* Slot> int Hooked<Fn, Slot>::id = -1;
+
+/* A call that only takes values */
+template<class Fn, Fn* Slot, class... A> struct Call : Hooked<Fn, Slot> {
+    typedef Hooked<Fn, Slot> Base;
+
+    static void GLAPIENTRY hook(typename Arg<A>::Type... args) {
+        beginCall(Base::id);
+        int order[] = { 0, (Arg<A>::put(args), 0)... };
+        (void) order;
+        Base::original(args...);
+    }
+
+    static void replay(GLReplay::State& state) {
+        replayWith(state, typename MakeIndices<sizeof...(A)>::Type());
+    }
+
+    template<int... I> static void replayWith(GLReplay::State& state, Indices<I...>) {
+        // a braced list reads the arguments in order
+        tuple<typename Arg<A>::Type...> values{ Arg<A>::get(state)... };
+        (void) values;
+        Base::original(get<I>(values)...);
+    }
+};
+
+/* glGen*: the names are recorded and mapped to new ones on replay */
+template<class Fn, Fn* Slot, NameKind K> struct Generate : Hooked<Fn, Slot> {
+    typedef Hooked<Fn, Slot> Base;
+
+    static void GLAPIENTRY hook(GLsizei count, GLuint* names) {
+        Base::original(count, names);
+        beginCall(Base::id);
+        write(count);
+        for (GLsizei i = 0; i < count; i++) write(names[i]);
+    }
+
+    static void replay(GLReplay::State& state) {
+        GLsizei count = state.read<GLsizei>();
+        vector<GLuint> names(count);
+        Base::original(count, names.data());
+        for (GLsizei i = 0; i < count; i++) state.remap(K, state.read<GLuint>(), names[i]);
+    }
+};
+
+template<class Fn, Fn* Slot, NameKind K> struct Delete : Hooked<Fn, Slot> {
+    typedef Hooked<Fn, Slot> Base;
+
+    static void GLAPIENTRY hook(GLsizei count, const GLuint* names) {
+        beginCall(Base::id);
+        write(count);
+        for (GLsizei i = 0; i < count; i++) write(names[i]);
+        Base::original(count, names);
+    }
+
+    static void replay(GLReplay::State& state) {
+        GLsizei count = state.read<GLsizei>();
+        vector<GLuint> names(count);
+        for (GLsizei i = 0; i < count; i++) names[i] = state.name(K, state.read<GLuint>());
+        Base::original(count, names.data());
+    }
+};
+
+struct CreateProgram : Hooked<PFNGLCREATEPROGRAMPROC, &__glewCreateProgram> {
+    static GLuint GLAPIENTRY hook() {
+        GLuint program = original();
+        beginCall(id);
+        write(program);
+        return program;
+    }
+    static void replay(GLReplay::State& state) {
+        state.remap(PROGRAM, state.read<GLuint>(), original());
+    }
+};
+
+struct CreateShader : Hooked<PFNGLCREATESHADERPROC, &__glewCreateShader> {
+    static GLuint GLAPIENTRY hook(GLenum type) {
+        GLuint shader = original(type);
+        beginCall(id);
+        write(type);
+        write(shader);
+        return shader;
+    }
+    static void replay(GLReplay::State& state) {
+        GLenum type = state.read<GLenum>();
+        state.remap(SHADER, state.read<GLuint>(), original(type));
+    }
+};
+
+struct ShaderSource : Hooked<PFNGLSHADERSOURCEPROC, &__glewShaderSource> {
+    static void GLAPIENTRY hook(GLuint shader, GLsizei count, const GLchar* const* strings, const GLint* lengths) {
+        beginCall(id);
+        write(shader);
+        write(count);
+        for (GLsizei i = 0; i < count; i++) {
+            writeString(strings[i], lengths && lengths[i] >= 0 ? lengths[i] : strlen(strings[i]));
+        }
+        original(shader, count, strings, lengths);
+    }
+    static void replay(GLReplay::State& state) {
+        GLuint shader = state.name(SHADER, state.read<GLuint>());
+        GLsizei count = state.read<GLsizei>();
+        vector<const GLchar*> strings(count);
+        vector<GLint> lengths(count);
+        for (GLsizei i = 0; i < count; i++) {
+            uint64_t length;
+            strings[i] = (const GLchar*) state.data(&length);
+            lengths[i] = (GLint) length;
+        }
+        original(shader, count, strings.data(), lengths.data());
+    }
+};
+
+struct GetUniformLocation : Hooked<PFNGLGETUNIFORMLOCATIONPROC, &__glewGetUniformLocation> {
+    static GLint GLAPIENTRY hook(GLuint program, const GLchar* name) {
+        GLint location = original(program, name);
+        beginCall(id);
+        write(program);
+        writeString(name, strlen(name));
+        write(location);
+        return location;
+    }
+    static void replay(GLReplay::State& state) {
+        GLuint program = state.name(PROGRAM, state.read<GLuint>());
+        uint64_t length;
+        const char* text = (const char*) state.data(&length);
+        GLint recorded = state.read<GLint>();
+        GLint location = original(program, string(text, (size_t) length).c_str());
+        if (recorded < 0) return;
+        vector<GLint>& locations = state.locations[program];
+        if (locations.size() <= (size_t) recorded) locations.resize(recorded + 1, -1);
+        locations[recorded] = location;
+    }
+};
+
+struct UseProgram : Hooked<PFNGLUSEPROGRAMPROC, &__glewUseProgram> {
+    static void GLAPIENTRY hook(GLuint program) {
+        beginCall(id);
+        write(program);
+        original(program);
+    }
+    static void replay(GLReplay::State& state) {
+        GLuint program = state.name(PROGRAM, state.read<GLuint>());
+        state.programLocations = &state.locations[program];
+        original(program);
+    }
+};
+
+struct BufferData : Hooked<PFNGLBUFFERDATAPROC, &__glewBufferData> {
+    static void GLAPIENTRY hook(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+        beginCall(id);
+        write(target);
+        write((uint64_t) size);
+        write(usage);
+        write((uint8_t) (data != nullptr));
+        if (data) writeData(data, size);
+        original(target, size, data, usage);
+    }
+    static void replay(GLReplay::State& state) {
+        GLenum target = state.read<GLenum>();
+        GLsizeiptr size = (GLsizeiptr) state.read<uint64_t>();
+        GLenum usage = state.read<GLenum>();
+        const void* data = state.read<uint8_t>() ? state.data() : nullptr;
+        original(target, size, data, usage);
+    }
+};
+
+struct BufferSubData : Hooked<PFNGLBUFFERSUBDATAPROC, &__glewBufferSubData> {
+    static void GLAPIENTRY hook(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {
+        beginCall(id);
+        write(target);
+        write((uint64_t) offset);
+        writeData(data, size);
+        original(target, offset, size, data);
+    }
+    static void replay(GLReplay::State& state) {
+        GLenum target = state.read<GLenum>();
+        GLintptr offset = (GLintptr) state.read<uint64_t>();
+        uint64_t size;
+        const void* data = state.data(&size);
+        original(target, offset, (GLsizeiptr) size, data);
+    }
+};
+
+/* glUniform{1,2,3,4}fv */
+template<class Fn, Fn* Slot, int N> struct UniformArray : Hooked<Fn, Slot> {
+    typedef Hooked<Fn, Slot> Base;
+
+    static void GLAPIENTRY hook(GLint location, GLsizei count, const GLfloat* values) {
+        beginCall(Base::id);
+        write(location);
+        write(count);
+        writeData(values, count * N * sizeof(GLfloat));
+        Base::original(location, count, values);
+    }
+
+    static void replay(GLReplay::State& state) {
+        GLint location = state.location(state.read<GLint>());
+        GLsizei count = state.read<GLsizei>();
+        Base::original(location, count, (const GLfloat*) state.data());
+    }
+};
+
+struct UniformMatrix4fv : Hooked<PFNGLUNIFORMMATRIX4FVPROC, &__glewUniformMatrix4fv> {
+    static void GLAPIENTRY hook(GLint location, GLsizei count, GLboolean transpose, const GLfloat* values) {
+        beginCall(id);
+        write(location);
+        write(count);
+        write(transpose);
+        writeData(values, count * 16 * sizeof(GLfloat));
+        original(location, count, transpose, values);
+    }
+    static void replay(GLReplay::State& state) {
+        GLint location = state.location(state.read<GLint>());
+        GLsizei count = state.read<GLsizei>();
+        GLboolean transpose = state.read<GLboolean>();
+        original(location, count, transpose, (const GLfloat*) state.data());
+    }
+};
+
+struct TexImage2D : Hooked<decltype(glrTexImage2D), &glrTexImage2D> {
+    static void GLAPIENTRY hook(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height,
+                                GLint border, GLenum format, GLenum type, const void* pixels) {
+        beginCall(id);
+        write(target); write(level); write(internalFormat); write(width); write(height);
+        write(border); write(format); write(type);
+        writePixels(pixels, imageBytes(width, height, 1, format, type));
+        original(target, level, internalFormat, width, height, border, format, type, pixels);
+    }
+    static void replay(GLReplay::State& state) {
+        GLenum target = state.read<GLenum>();
+        GLint level = state.read<GLint>();
+        GLint internalFormat = state.read<GLint>();
+        GLsizei width = state.read<GLsizei>();
+        GLsizei height = state.read<GLsizei>();
+        GLint border = state.read<GLint>();
+        GLenum format = state.read<GLenum>();
+        GLenum type = state.read<GLenum>();
+        original(target, level, internalFormat, width, height, border, format, type, state.pixels());
+    }
+};
+
+struct TexSubImage2D : Hooked<decltype(glrTexSubImage2D), &glrTexSubImage2D> {
+    static void GLAPIENTRY hook(GLenum target, GLint level, GLint x, GLint y, GLsizei width, GLsizei height,
+                                GLenum format, GLenum type, const void* pixels) {
+        beginCall(id);
+        write(target); write(level); write(x); write(y); write(width); write(height);
+        write(format); write(type);
+        writePixels(pixels, imageBytes(width, height, 1, format, type));
+        original(target, level, x, y, width, height, format, type, pixels);
+    }
+    static void replay(GLReplay::State& state) {
+        GLenum target = state.read<GLenum>();
+        GLint level = state.read<GLint>();
+        GLint x = state.read<GLint>();
+        GLint y = state.read<GLint>();
+        GLsizei width = state.read<GLsizei>();
+        GLsizei height = state.read<GLsizei>();
+        GLenum format = state.read<GLenum>();
+        GLenum type = state.read<GLenum>();
+        original(target, level, x, y, width, height, format, type, state.pixels());
+    }
+};
+
+struct TexImage3D : Hooked<PFNGLTEXIMAGE3DPROC, &__glewTexImage3D> {
+    static void GLAPIENTRY hook(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height,
+                                GLsizei depth, GLint border, GLenum format, GLenum type, const void* pixels) {
+        beginCall(id);
+        write(target); write(level); write(internalFormat); write(width); write(height); write(depth);
+        write(border); write(format); write(type);
+        writePixels(pixels, imageBytes(width, height, depth, format, type));
+        original(target, level, internalFormat, width, height, depth, border, format, type, pixels);
+    }
+    static void replay(GLReplay::State& state) {
+        GLenum target = state.read<GLenum>();
+        GLint level = state.read<GLint>();
+        GLint internalFormat = state.read<GLint>();
+        GLsizei width = state.read<GLsizei>();
+        GLsizei height = state.read<GLsizei>();
+        GLsizei depth = state.read<GLsizei>();
+        GLint border = state.read<GLint>();
+        GLenum format = state.read<GLenum>();
+        GLenum type = state.read<GLenum>();
+        original(target, level, internalFormat, width, height, depth, border, format, type, state.pixels());
+    }
+};
+
+struct CompressedTexImage2D : Hooked<PFNGLCOMPRESSEDTEXIMAGE2DPROC, &__glewCompressedTexImage2D> {
+    static void GLAPIENTRY hook(GLenum target, GLint level, GLenum internalFormat, GLsizei width, GLsizei height,
+                                GLint border, GLsizei imageSize, const void* data) {
+        beginCall(id);
+        write(target); write(level); write(internalFormat); write(width); write(height);
+        write(border); write(imageSize);
+        writePixels(data, imageSize);
+        original(target, level, internalFormat, width, height, border, imageSize, data);
+    }
+    static void replay(GLReplay::State& state) {
+        GLenum target = state.read<GLenum>();
+        GLint level = state.read<GLint>();
+        GLenum internalFormat = state.read<GLenum>();
+        GLsizei width = state.read<GLsizei>();
+        GLsizei height = state.read<GLsizei>();
+        GLint border = state.read<GLint>();
+        GLsizei imageSize = state.read<GLsizei>();
+        original(target, level, internalFormat, width, height, border, imageSize, state.pixels());
+    }
+};
+
+struct TexParameterfv : Hooked<decltype(glrTexParameterfv), &glrTexParameterfv> {
+    static void GLAPIENTRY hook(GLenum target, GLenum name, const GLfloat* values) {
+        beginCall(id);
+        write(target);
+        write(name);
+        writeData(values, (name == GL_TEXTURE_BORDER_COLOR ? 4 : 1) * sizeof(GLfloat));
+        original(target, name, values);
+    }
+    static void replay(GLReplay::State& state) {
+        GLenum target = state.read<GLenum>();
+        GLenum name = state.read<GLenum>();
+        original(target, name, (const GLfloat*) state.data());
+    }
+};
+
+struct MultiDrawElementsBaseVertex
+    : Hooked<PFNGLMULTIDRAWELEMENTSBASEVERTEXPROC, &__glewMultiDrawElementsBaseVertex> {
+    static void GLAPIENTRY hook(GLenum mode, const GLsizei* counts, GLenum type, const void* const* offsets,
+                                GLsizei drawCount, const GLint* baseVertices) {
+        beginCall(id);
+        write(mode);
+        write(type);
+        write(drawCount);
+        for (GLsizei i = 0; i < drawCount; i++) {
+            write(counts[i]);
+            write((uint64_t) (uintptr_t) offsets[i]);
+            write(baseVertices[i]);
+        }
+        original(mode, counts, type, offsets, drawCount, baseVertices);
+    }
+    static void replay(GLReplay::State& state) {
+        GLenum mode = state.read<GLenum>();
+        GLenum type = state.read<GLenum>();
+        GLsizei drawCount = state.read<GLsizei>();
+        vector<GLsizei> counts(drawCount);
+        vector<const void*> offsets(drawCount);
+        vector<GLint> baseVertices(drawCount);
+        for (GLsizei i = 0; i < drawCount; i++) {
+            counts[i] = state.read<GLsizei>();
+            offsets[i] = (const void*) (uintptr_t) state.read<uint64_t>();
+            baseVertices[i] = state.read<GLint>();
+        }
+        original(mode, counts.data(), type, offsets.data(), drawCount, baseVertices.data());
+    }
+};
+
+struct CallEntry {
+    const char* name;
+    void (*install)(int id);
+    void (*uninstall)();
+    void (*bind)();
+    void (*replay)(GLReplay::State& state);
+};
+
+template<class C> CallEntry entry(const char* name) {
+    CallEntry call;
+    call.name = name;
+    call.install = [](int id) {
+        C::id = id;
+        C::original = *C::slot();
+        // entry points the context lacks stay null
+        if (C::original) *C::slot() = C::hook;
+    };
+    call.uninstall = []() {
+        if (C::original) *C::slot() = C::original;
+    };
+    call.bind = []() { C::original = *C::slot(); };
+    call.replay = C::replay;
+    return call;
+}
+
+#define VALUES(name, ...) entry<Call<decltype(__glew##name), &__glew##name, __VA_ARGS__>>("gl" #name)
+#define VALUES_GL11(name, ...) entry<Call<decltype(glr##name), &glr##name, __VA_ARGS__>>("gl" #name)
+
+// Every recorded call, a capture refers to them by name
+static const vector<CallEntry>& callTable() {
+    static const vector<CallEntry> calls = {
+        // objects
+        entry<Generate<decltype(__glewGenBuffers), &__glewGenBuffers, BUFFER>>("glGenBuffers"),
+        entry<Generate<decltype(glrGenTextures), &glrGenTextures, TEXTURE>>("glGenTextures"),
+        entry<Generate<decltype(__glewGenVertexArrays), &__glewGenVertexArrays, VERTEX_ARRAY>>("glGenVertexArrays"),
+        entry<Generate<decltype(__glewGenFramebuffers), &__glewGenFramebuffers, FRAMEBUFFER>>("glGenFramebuffers"),
+        entry<Generate<decltype(__glewGenRenderbuffers), &__glewGenRenderbuffers, RENDERBUFFER>>("glGenRenderbuffers"),
+        entry<Delete<decltype(__glewDeleteBuffers), &__glewDeleteBuffers, BUFFER>>("glDeleteBuffers"),
+        entry<Delete<decltype(glrDeleteTextures), &glrDeleteTextures, TEXTURE>>("glDeleteTextures"),
+        entry<Delete<decltype(__glewDeleteVertexArrays), &__glewDeleteVertexArrays, VERTEX_ARRAY>>("glDeleteVertexArrays"),
+        entry<Delete<decltype(__glewDeleteFramebuffers), &__glewDeleteFramebuffers, FRAMEBUFFER>>("glDeleteFramebuffers"),
+        entry<Delete<decltype(__glewDeleteRenderbuffers), &__glewDeleteRenderbuffers, RENDERBUFFER>>("glDeleteRenderbuffers"),
+        entry<CreateProgram>("glCreateProgram"),
+        entry<CreateShader>("glCreateShader"),
+        VALUES(DeleteProgram, Name<PROGRAM>),
+        VALUES(DeleteShader, Name<SHADER>),
+
+        // programs
+        entry<ShaderSource>("glShaderSource"),
+        VALUES(CompileShader, Name<SHADER>),
+        VALUES(AttachShader, Name<PROGRAM>, Name<SHADER>),
+        VALUES(DetachShader, Name<PROGRAM>, Name<SHADER>),
+        VALUES(ProgramParameteri, Name<PROGRAM>, GLenum, GLint),
+        VALUES(LinkProgram, Name<PROGRAM>),
+        entry<GetUniformLocation>("glGetUniformLocation"),
+        entry<UseProgram>("glUseProgram"),
+        VALUES(Uniform1i, Location, GLint),
+        VALUES(Uniform1f, Location, GLfloat),
+        entry<UniformArray<decltype(__glewUniform1fv), &__glewUniform1fv, 1>>("glUniform1fv"),
+        entry<UniformArray<decltype(__glewUniform2fv), &__glewUniform2fv, 2>>("glUniform2fv"),
+        entry<UniformArray<decltype(__glewUniform3fv), &__glewUniform3fv, 3>>("glUniform3fv"),
+        entry<UniformArray<decltype(__glewUniform4fv), &__glewUniform4fv, 4>>("glUniform4fv"),
+        entry<UniformMatrix4fv>("glUniformMatrix4fv"),
+
+        // buffers and vertex arrays
+        VALUES(BindBuffer, GLenum, Name<BUFFER>),
+        VALUES(BindBufferBase, GLenum, GLuint, Name<BUFFER>),
+        entry<BufferData>("glBufferData"),
+        entry<BufferSubData>("glBufferSubData"),
+        VALUES(BindVertexArray, Name<VERTEX_ARRAY>),
+        VALUES(EnableVertexAttribArray, GLuint),
+        VALUES(VertexAttribPointer, GLuint, GLint, GLenum, GLboolean, GLsizei, Offset),
+        VALUES(VertexAttribIPointer, GLuint, GLint, GLenum, GLsizei, Offset),
+        VALUES(VertexAttribDivisor, GLuint, GLuint),
+        VALUES(VertexAttribI1ui, GLuint, GLuint),
+
+        // textures
+        VALUES_GL11(BindTexture, GLenum, Name<TEXTURE>),
+        VALUES(ActiveTexture, GLenum),
+        VALUES_GL11(TexParameteri, GLenum, GLenum, GLint),
+        entry<TexParameterfv>("glTexParameterfv"),
+        VALUES_GL11(PixelStorei, GLenum, GLint),
+        entry<TexImage2D>("glTexImage2D"),
+        entry<TexSubImage2D>("glTexSubImage2D"),
+        entry<TexImage3D>("glTexImage3D"),
+        entry<CompressedTexImage2D>("glCompressedTexImage2D"),
+        VALUES(GenerateMipmap, GLenum),
+
+        // framebuffers
+        VALUES(BindFramebuffer, GLenum, Name<FRAMEBUFFER>),
+        VALUES(BindRenderbuffer, GLenum, Name<RENDERBUFFER>),
+        VALUES(RenderbufferStorage, GLenum, GLenum, GLsizei, GLsizei),
+        VALUES(FramebufferRenderbuffer, GLenum, GLenum, GLenum, Name<RENDERBUFFER>),
+        VALUES(FramebufferTextureLayer, GLenum, GLenum, Name<TEXTURE>, GLint, GLint),
+        VALUES_GL11(DrawBuffer, GLenum),
+        VALUES_GL11(ReadBuffer, GLenum),
+
+        // state
+        VALUES_GL11(Enable, GLenum),
+        VALUES_GL11(Disable, GLenum),
+        VALUES_GL11(Viewport, GLint, GLint, GLsizei, GLsizei),
+        VALUES_GL11(Scissor, GLint, GLint, GLsizei, GLsizei),
+        VALUES_GL11(ClearColor, GLclampf, GLclampf, GLclampf, GLclampf),
+        VALUES_GL11(Clear, GLbitfield),
+        VALUES_GL11(DepthFunc, GLenum),
+        VALUES_GL11(DepthMask, GLboolean),
+        VALUES_GL11(BlendFunc, GLenum, GLenum),
+        VALUES_GL11(PolygonMode, GLenum, GLenum),
+        VALUES(PatchParameteri, GLenum, GLint),
+
+        // draws
+        VALUES_GL11(DrawElements, GLenum, GLsizei, GLenum, Offset),
+        VALUES(DrawElementsInstanced, GLenum, GLsizei, GLenum, Offset, GLsizei),
+        entry<MultiDrawElementsBaseVertex>("glMultiDrawElementsBaseVertex"),
+        VALUES(MultiDrawElementsIndirect, GLenum, GLenum, Offset, GLsizei, GLsizei),
+    };
+    return calls;
+}
+
+GLRecorder& GLRecorder::get() {
+    static GLRecorder recorder;
+    return recorder;
+}
+
+void GLRecorder::start(const string& path, int frames) {
+    if (active) return;
+    capture.open(path, ios::binary);
+    if (!capture) {
+        cout << "Can't write GL capture: " << path << endl;
+        return;
+    }
+    this->path = path;
+    framesLeft = frames;
+    framesRecorded = 0;
+
+    const vector<CallEntry>& calls = callTable();
+    capture.write(MAGIC, sizeof(MAGIC));
+    write((uint32_t) calls.size());
+    for (size_t i = 0; i < calls.size(); i++) {
+        writeString(calls[i].name, strlen(calls[i].name));
+        calls[i].install((int) i);
+    }
+    frameEnds.clear();
+    active = true;
+}
+
+void GLRecorder::frame() {
+    if (!active) return;
+    beginCall(FRAME_END);
+    frameEnds.push_back((unsigned long long) capture.tellp());
+    framesRecorded++;
+    if (--framesLeft <= 0) stop();
+}
+
+void GLRecorder::stop() {
+    if (!active) return;
+    for (const CallEntry& call : callTable()) call.uninstall();
+    active = false;
+
+    uint64_t footer = (uint64_t) capture.tellp();
+    write((uint32_t) frameEnds.size());
+    for (unsigned long long end : frameEnds) write((uint64_t) end);
+    write(footer);
+    capture.close();
+    cout << "GL capture of " << framesRecorded << " frames written to " << path << " ("
+         << footer / 1.0e6 << " MB)" << endl;
+}
+
+GLReplay::GLReplay(const string& path) : state(new State()) {
+    ifstream in(path, ios::binary);
+    if (!in) throw runtime_error("Can't open GL capture: " + path);
+    state->file.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    vector<char>& file = state->file;
+    if (file.size() < sizeof(MAGIC) + 16 || memcmp(file.data(), MAGIC, sizeof(MAGIC)) != 0) {
+        throw runtime_error("Not a GL capture: " + path);
+    }
+
+    // footer
+    uint64_t footer;
+    memcpy(&footer, file.data() + file.size() - sizeof(footer), sizeof(footer));
+    if (footer > file.size() - sizeof(footer)) throw runtime_error("Truncated GL capture");
+    state->cursor = file.data() + footer;
+    state->end = file.data() + file.size() - sizeof(footer);
+    uint32_t frames = state->read<uint32_t>();
+    for (uint32_t i = 0; i < frames; i++) {
+        uint64_t end = state->read<uint64_t>();
+        if (end > footer) throw runtime_error("Truncated GL capture");
+        state->frameEnds.push_back((size_t) end);
+    }
+
+    // the calls of the capture by name
+    const vector<CallEntry>& calls = callTable();
+    state->cursor = file.data() + sizeof(MAGIC);
+    state->end = file.data() + footer;
+    uint32_t count = state->read<uint32_t>();
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t length;
+        const char* text = (const char*) state->data(&length);
+        string name(text, (size_t) length);
+        int index = -1;
+        for (size_t c = 0; c < calls.size(); c++) {
+            if (name == calls[c].name) index = (int) c;
+        }
+        if (index < 0) throw runtime_error("GL capture uses " + name + ", which the replay doesn't know");
+        state->calls.push_back(index);
+    }
+    state->recordsStart = state->cursor - file.data();
+    if (state->frameEnds.empty()) throw runtime_error("GL capture without frames: " + path);
+    state->frameCalls.assign(state->frameEnds.size(), 0);
+}
+
+GLReplay::~GLReplay() {
+}
+
+// Replays the records from start up to end, returns the number of calls
+static size_t replayRange(GLReplay::State& state, size_t start, size_t end) {
+    const vector<CallEntry>& calls = callTable();
+    state.cursor = state.file.data() + start;
+    const char* stop = state.file.data() + end;
+    size_t count = 0;
+    while (state.cursor < stop) {
+        uint16_t id = state.read<uint16_t>();
+        if (id == FRAME_END) continue;
+        if (id >= state.calls.size()) throw runtime_error("Corrupt GL capture");
+        calls[state.calls[id]].replay(state);
+        count++;
+    }
+    return count;
+}
+
+// The first recorded frame holds the loading, it is the setup
+void GLReplay::setup() {
+    // the entry points of the current context, glewInit has loaded them now
+    for (const CallEntry& call : callTable()) call.bind();
+    state->frameCalls[0] = replayRange(*state, state->recordsStart, state->frameEnds[0]);
+}
+
+int GLReplay::frameCount() const {
+    return (int) state->frameEnds.size() - 1;
+}
+
+void GLReplay::replayFrame(int frame) {
+    state->frameCalls[frame + 1] = replayRange(*state, state->frameEnds[frame], state->frameEnds[frame + 1]);
+}
+
+size_t GLReplay::frameCalls(int frame) const {
+    return state->frameCalls[frame + 1];
+}
+
+size_t GLReplay::frameBytes(int frame) const {
+    return state->frameEnds[frame + 1] - state->frameEnds[frame];
+}
@@ -0,0 +1,69 @@
+#ifndef GL_RECORDER_H
+#define GL_RECORDER_H
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "glcalls.h"
+
+/**
+* Recorder of the GL command stream into a binary capture that GLReplay (and
+* the glreplay tool) reissues without the application: object creation,
+* shaders, buffer and texture data, state, uniforms and draws. Object names
+* and uniform locations are remapped on replay, so a capture replays on
+* any context that supports the calls in it.
+*
+* start() hooks the GLEW entry points, so call it right after glewInit, before
+* any object is made; a capture covers the loading and then `frames` calls of
+* frame(). Queries, syncs, mapped buffers and program binaries aren't
+* recorded, an application turns off what depends on them while recording.
+*/
+class GLRecorder {
+public:
+    static GLRecorder& get();
+
+    void start(const std::string& path, int frames);
+    bool recording() const { return active; }
+
+    /* Call once per frame, the capture is written after the last one */
+    void frame();
+    /* Writes the capture now, e.g. when the program ends first */
+    void stop();
+
+private:
+    GLRecorder() {}
+
+    bool active = false;
+    std::string path;
+    int framesLeft = 0;
+    int framesRecorded = 0;
+    std::vector<unsigned long long> frameEnds;     // file offsets
+};
+
+/**
+* Reads a capture of GLRecorder, setup() replays the loading and the first
+* recorded frame, replayFrame() one of the frames after it. Frames can be
+* replayed again and in any order as long as they create no objects. Reading
+* needs no context, setup() needs the current one after glewInit.
+*/
+class GLReplay {
+public:
+    explicit GLReplay(const std::string& path);
+    ~GLReplay();
+
+    void setup();
+    int frameCount() const;
+    void replayFrame(int frame);
+
+    /* Commands of a frame in its last replay, and its bytes in the capture */
+    size_t frameCalls(int frame) const;
+    size_t frameBytes(int frame) const;
+
+    struct State;
+
+private:
+    std::unique_ptr<State> state;
+};
+
+#endif
@@ -0,0 +1,291 @@
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <utility>
+#include "glstate.h"
+#include "glcalls.h"
+
+using namespace std;
+
+GLStateCache& GLStateCache::get() {
+    static GLStateCache cache;
+    return cache;
+}
+
+static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+// What the driver has, as far as the calls through the cache tell
+static struct {
+    GLuint program = UNKNOWN;
+    GLuint vertexArray = UNKNOWN;
+    map<GLenum, GLuint> buffers;                    // by target, absent is unknown
+    GLenum activeTexture = UNKNOWN;
+    map<pair<GLenum, GLenum>, GLuint> textures;     // by unit and target
+    GLuint drawFramebuffer = UNKNOWN, readFramebuffer = UNKNOWN;
+    GLint viewport[4] = { 0, 0, -1, -1 };           // a negative size is unknown
+    map<GLenum, GLboolean> capabilities;
+    GLenum blendSource = UNKNOWN, blendDestination = UNKNOWN;
+    GLenum depthFunc = UNKNOWN;
+    int depthMask = -1;
+} state;
+
+template<class K> static GLuint bound(const map<K, GLuint>& bindings, const K& key) {
+    auto found = bindings.find(key);
+    return found == bindings.end() ? UNKNOWN : found->second;
+}
+
+static bool pass(GLStateCache::Kind kind, bool changes) {
+    return GLStateCache::get().pass(kind, changes);
+}
+
+/* The entry point a wrapper replaced, which it passes the calls on to */
+template<class Fn, Fn* Slot> struct Wrapped {
+    static Fn next;
+    static Fn* slot() { return Slot; }
+};
+template<class Fn, Fn* Slot> Fn Wrapped<Fn, Slot>::next = nullptr;
+
+struct UseProgram : Wrapped<PFNGLUSEPROGRAMPROC, &__glewUseProgram> {
+    static void GLAPIENTRY wrapper(GLuint program) {
+        if (!pass(GLStateCache::PROGRAM, program != state.program)) return;
+        state.program = program;
+        next(program);
+    }
+};
+
+struct BindVertexArray : Wrapped<PFNGLBINDVERTEXARRAYPROC, &__glewBindVertexArray> {
+    static void GLAPIENTRY wrapper(GLuint vertexArray) {
+        if (!pass(GLStateCache::VERTEX_ARRAY, vertexArray != state.vertexArray)) return;
+        state.vertexArray = vertexArray;
+        next(vertexArray);
+    }
+};
+
+struct DeleteVertexArrays : Wrapped<PFNGLDELETEVERTEXARRAYSPROC, &__glewDeleteVertexArrays> {
+    static void GLAPIENTRY wrapper(GLsizei count, const GLuint* names) {
+        for (GLsizei i = 0; i < count; i++) {
+            if (names[i] == state.vertexArray) state.vertexArray = UNKNOWN;
+        }
+        next(count, names);
+    }
+};
+
+struct BindBuffer : Wrapped<PFNGLBINDBUFFERPROC, &__glewBindBuffer> {
+    static void GLAPIENTRY wrapper(GLenum target, GLuint buffer) {
+        // the element buffer binding changes with the vertex array
+        bool element = target == GL_ELEMENT_ARRAY_BUFFER;
+        if (!pass(GLStateCache::BUFFER, element || buffer != bound(state.buffers, target))) return;
+        if (!element) state.buffers[target] = buffer;
+        next(target, buffer);
+    }
+};
+
+struct BindBufferBase : Wrapped<PFNGLBINDBUFFERBASEPROC, &__glewBindBufferBase> {
+    static void GLAPIENTRY wrapper(GLenum target, GLuint index, GLuint buffer) {
+        // the indexed bindings aren't shadowed, this also binds the target
+        pass(GLStateCache::BUFFER, true);
+        state.buffers[target] = buffer;
+        next(target, index, buffer);
+    }
+};
+
+struct DeleteBuffers : Wrapped<PFNGLDELETEBUFFERSPROC, &__glewDeleteBuffers> {
+    static void GLAPIENTRY wrapper(GLsizei count, const GLuint* names) {
+        for (GLsizei i = 0; i < count; i++) {
+            for (auto binding = state.buffers.begin(); binding != state.buffers.end();) {
+                if (names[i] && binding->second == names[i]) binding = state.buffers.erase(binding);
+                else ++binding;
+            }
+        }
+        next(count, names);
+    }
+};
+
+struct ActiveTexture : Wrapped<PFNGLACTIVETEXTUREPROC, &__glewActiveTexture> {
+    static void GLAPIENTRY wrapper(GLenum unit) {
+        if (!pass(GLStateCache::ACTIVE_TEXTURE, unit != state.activeTexture)) return;
+        state.activeTexture = unit;
+        next(unit);
+    }
+};
+
+struct BindTexture : Wrapped<decltype(glrBindTexture), &glrBindTexture> {
+    static void GLAPIENTRY wrapper(GLenum target, GLuint texture) {
+        // on an unknown unit the binding can't be shadowed
+        pair<GLenum, GLenum> key(state.activeTexture, target);
+        bool known = state.activeTexture != UNKNOWN;
+        if (!pass(GLStateCache::TEXTURE, !known || texture != bound(state.textures, key))) return;
+        if (known) state.textures[key] = texture;
+        next(target, texture);
+    }
+};
+
+struct BindTextureUnit : Wrapped<PFNGLBINDTEXTUREUNITPROC, &__glewBindTextureUnit> {
+    static void GLAPIENTRY wrapper(GLuint unit, GLuint texture) {
+        // binds to the texture's own target, which the cache doesn't know
+        pass(GLStateCache::TEXTURE, true);
+        for (auto binding = state.textures.begin(); binding != state.textures.end();) {
+            if (binding->first.first == GL_TEXTURE0 + unit) binding = state.textures.erase(binding);
+            else ++binding;
+        }
+        next(unit, texture);
+    }
+};
+
+struct DeleteTextures : Wrapped<decltype(glrDeleteTextures), &glrDeleteTextures> {
+    static void GLAPIENTRY wrapper(GLsizei count, const GLuint* names) {
+        for (GLsizei i = 0; i < count; i++) {
+            for (auto binding = state.textures.begin(); binding != state.textures.end();) {
+                if (names[i] && binding->second == names[i]) binding = state.textures.erase(binding);
+                else ++binding;
+            }
+        }
+        next(count, names);
+    }
+};
+
+struct BindFramebuffer : Wrapped<PFNGLBINDFRAMEBUFFERPROC, &__glewBindFramebuffer> {
+    static void GLAPIENTRY wrapper(GLenum target, GLuint framebuffer) {
+        bool draw = target != GL_READ_FRAMEBUFFER, read = target != GL_DRAW_FRAMEBUFFER;
+        bool changes = (draw && framebuffer != state.drawFramebuffer) ||
+                       (read && framebuffer != state.readFramebuffer);
+        if (!pass(GLStateCache::FRAMEBUFFER, changes)) return;
+        if (draw) state.drawFramebuffer = framebuffer;
+        if (read) state.readFramebuffer = framebuffer;
+        next(target, framebuffer);
+    }
+};
+
+struct DeleteFramebuffers : Wrapped<PFNGLDELETEFRAMEBUFFERSPROC, &__glewDeleteFramebuffers> {
+    static void GLAPIENTRY wrapper(GLsizei count, const GLuint* names) {
+        for (GLsizei i = 0; i < count; i++) {
+            if (names[i] == state.drawFramebuffer) state.drawFramebuffer = UNKNOWN;
+            if (names[i] == state.readFramebuffer) state.readFramebuffer = UNKNOWN;
+        }
+        next(count, names);
+    }
+};
+
+struct Viewport : Wrapped<decltype(glrViewport), &glrViewport> {
+    static void GLAPIENTRY wrapper(GLint x, GLint y, GLsizei width, GLsizei height) {
+        GLint* current = state.viewport;
+        bool changes = x != current[0] || y != current[1] || width != current[2] || height != current[3];
+        if (!pass(GLStateCache::VIEWPORT, changes)) return;
+        current[0] = x;
+        current[1] = y;
+        current[2] = width;
+        current[3] = height;
+        next(x, y, width, height);
+    }
+};
+
+static bool setCapability(GLenum capability, GLboolean enabled) {
+    auto found = state.capabilities.find(capability);
+    if (!pass(GLStateCache::CAPABILITY, found == state.capabilities.end() || found->second != enabled)) {
+        return false;
+    }
+    state.capabilities[capability] = enabled;
+    return true;
+}
+
+struct Enable : Wrapped<decltype(glrEnable), &glrEnable> {
+    static void GLAPIENTRY wrapper(GLenum capability) {
+        if (setCapability(capability, GL_TRUE)) next(capability);
+    }
+};
+
+struct Disable : Wrapped<decltype(glrDisable), &glrDisable> {
+    static void GLAPIENTRY wrapper(GLenum capability) {
+        if (setCapability(capability, GL_FALSE)) next(capability);
+    }
+};
+
+struct BlendFunc : Wrapped<decltype(glrBlendFunc), &glrBlendFunc> {
+    static void GLAPIENTRY wrapper(GLenum source, GLenum destination) {
+        bool changes = source != state.blendSource || destination != state.blendDestination;
+        if (!pass(GLStateCache::BLEND_FUNC, changes)) return;
+        state.blendSource = source;
+        state.blendDestination = destination;
+        next(source, destination);
+    }
+};
+
+struct DepthFunc : Wrapped<decltype(glrDepthFunc), &glrDepthFunc> {
+    static void GLAPIENTRY wrapper(GLenum func) {
+        if (!pass(GLStateCache::DEPTH_FUNC, func != state.depthFunc)) return;
+        state.depthFunc = func;
+        next(func);
+    }
+};
+
+struct DepthMask : Wrapped<decltype(glrDepthMask), &glrDepthMask> {
+    static void GLAPIENTRY wrapper(GLboolean mask) {
+        if (!pass(GLStateCache::DEPTH_MASK, (int) mask != state.depthMask)) return;
+        state.depthMask = mask;
+        next(mask);
+    }
+};
+
+template<class W> static void wrap() {
+    W::next = *W::slot();
+    // entry points the context lacks stay null
+    if (W::next) *W::slot() = W::wrapper;
+}
+
+void GLStateCache::enable() {
+    if (active) return;
+    wrap<UseProgram>();
+    wrap<BindVertexArray>();
+    wrap<DeleteVertexArrays>();
+    wrap<BindBuffer>();
+    wrap<BindBufferBase>();
+    wrap<DeleteBuffers>();
+    wrap<ActiveTexture>();
+    wrap<BindTexture>();
+    wrap<BindTextureUnit>();
+    wrap<DeleteTextures>();
+    wrap<BindFramebuffer>();
+    wrap<DeleteFramebuffers>();
+    wrap<Viewport>();
+    wrap<Enable>();
+    wrap<Disable>();
+    wrap<BlendFunc>();
+    wrap<DepthFunc>();
+    wrap<DepthMask>();
+    active = true;
+}
+
+bool GLStateCache::pass(Kind kind, bool changes) {
+    if (changes) {
+        frame.issued++;
+    } else {
+        frame.elided++;
+        elidedByKind[kind]++;
+    }
+    return changes;
+}
+
+void GLStateCache::endFrame() {
+    if (!active) return;
+    last = frame;
+    all.issued += frame.issued;
+    all.elided += frame.elided;
+    frame = Counts();
+    frames++;
+}
+
+void GLStateCache::printReport() const {
+    if (!active) return;
+    static const char* names[KINDS] = {
+        "program", "vertex array", "buffer", "active texture", "texture", "framebuffer",
+        "viewport", "enable/disable", "blend func", "depth func", "depth mask"
+    };
+    double perFrame = (double) max(frames, 1ULL);
+    cout << "GL state cache: " << fixed << setprecision(1) << all.elided / perFrame << " of "
+         << (all.issued + all.elided) / perFrame << " state calls per frame elided" << endl;
+    for (int kind = 0; kind < KINDS; kind++) {
+        if (elidedByKind[kind]) cout << "  " << names[kind] << ": " << elidedByKind[kind] << " in all" << endl;
+    }
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+}
@@ -0,0 +1,60 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <GL/glew.h>
+
+/**
+* Shadow of the GL state a frame sets over and over: the program, vertex
+* array, buffer bindings, active unit and textures per unit, framebuffers,
+* viewport, enables, blend function and depth state. enable() wraps the entry
+* points that set them (the GLEW pointers and the GL 1.1 pointers of
+* glcalls.h), so every caller goes through the cache: a call that sets
+* what is already set is dropped and counted, every other one goes on to the
+* driver.
+*
+* Everything starts unknown and the first call of each kind is always passed
+* on. Deleting a bound object makes its bindings unknown again. The element
+* buffer belongs to the vertex array and is never dropped. Enable it after the
+* backend is initialized and before the recorder starts, which then records
+* the calls as the application made them.
+*/
+class GLStateCache {
+public:
+    enum Kind {
+        PROGRAM, VERTEX_ARRAY, BUFFER, ACTIVE_TEXTURE, TEXTURE, FRAMEBUFFER,
+        VIEWPORT, CAPABILITY, BLEND_FUNC, DEPTH_FUNC, DEPTH_MASK, KINDS
+    };
+
+    struct Counts {
+        unsigned long long issued = 0;      // passed on to the driver
+        unsigned long long elided = 0;      // dropped as redundant
+    };
+
+    static GLStateCache& get();
+
+    /* Wraps the entry points of the current context */
+    void enable();
+    bool enabled() const { return active; }
+
+    /* For the wrapped entry points: counts the call, true if it changes the state */
+    bool pass(Kind kind, bool changes);
+
+    /* Call once per frame, closes the counts of the frame */
+    void endFrame();
+
+    const Counts& lastFrame() const { return last; }
+    const Counts& total() const { return all; }
+
+    /* Calls dropped per kind over the whole run */
+    void printReport() const;
+
+private:
+    GLStateCache() {}
+
+    bool active = false;
+    Counts frame, last, all;
+    unsigned long long elidedByKind[KINDS] = {};
+    unsigned long long frames = 0;
+};
+
+#endif
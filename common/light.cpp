@@ -37,28 +37,30 @@ Light::Light(GLFWwindow* window,
 void Light::update() {
 
 
-   // Move across z-axis
-    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) {
-        lightPosition_worldspace += lightSpeed * vec3(0.0, 0.0, 1.0);
+    // Without a window (the null backend) the light stays where it is
+    if (window) {
+        // Move across z-axis
+        if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) {
+            lightPosition_worldspace += lightSpeed * vec3(0.0, 0.0, 1.0);
+        }
+        if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS) {
+            lightPosition_worldspace -= lightSpeed * vec3(0.0, 0.0, 1.0);
+        }
+        // Move across x-axis
+        if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS) {
+            lightPosition_worldspace += lightSpeed * vec3(1.0, 0.0, 0.0);
+        }
+        if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS) {
+            lightPosition_worldspace -= lightSpeed * vec3(1.0, 0.0, 0.0);
+        }
+        // Move across y-axis
+        if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS) {
+            lightPosition_worldspace += lightSpeed * vec3(0.0, 1.0, 0.0);
+        }
+        if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) {
+            lightPosition_worldspace -= lightSpeed * vec3(0.0, 1.0, 0.0);
+        }
     }
-    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS) {
-        lightPosition_worldspace -= lightSpeed * vec3(0.0, 0.0, 1.0);
-    }
-    // Move across x-axis
-    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS) {
-        lightPosition_worldspace += lightSpeed * vec3(1.0, 0.0, 0.0);
-    }
-    if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS) {
-        lightPosition_worldspace -= lightSpeed * vec3(1.0, 0.0, 0.0);
-    }
-    // Move across y-axis
-    if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS) {
-        lightPosition_worldspace += lightSpeed * vec3(0.0, 1.0, 0.0);
-    }
-    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) {
-        lightPosition_worldspace -= lightSpeed * vec3(0.0, 1.0, 0.0);
-    }
-    
 
 
     // We have the direction of the light and the point where the light is looking at
@@ -0,0 +1,288 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+#include "lod.h"
+#include "util.h"
+
+using namespace glm;
+using namespace std;
+
+// Area weighted sum of squared distances to planes, the symmetric 4x4 matrix
+// of Garland and Heckbert as its upper triangle
+struct Quadric {
+    double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+    double weight = 0;
+
+    void addPlane(const dvec3& n, double d, double area) {
+        xx += area * n.x * n.x; xy += area * n.x * n.y; xz += area * n.x * n.z; xw += area * n.x * d;
+        yy += area * n.y * n.y; yz += area * n.y * n.z; yw += area * n.y * d;
+        zz += area * n.z * n.z; zw += area * n.z * d;
+        ww += area * d * d;
+        weight += area;
+    }
+
+    Quadric& operator+=(const Quadric& q) {
+        xx += q.xx; xy += q.xy; xz += q.xz; xw += q.xw;
+        yy += q.yy; yz += q.yz; yw += q.yw;
+        zz += q.zz; zw += q.zw;
+        ww += q.ww;
+        weight += q.weight;
+        return *this;
+    }
+
+    // mean squared distance
+    double error(const vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double e = xx * x * x + 2 * xy * x * y + 2 * xz * x * z + 2 * xw * x
+            + yy * y * y + 2 * yz * y * z + 2 * yw * y
+            + zz * z * z + 2 * zw * z
+            + ww;
+        return weight > 0 ? std::max(e, 0.0) / weight : 0.0;
+    }
+};
+
+struct Collapse {
+    unsigned int from;
+    unsigned int to;
+    double cost;
+};
+
+static unsigned long long edgeKey(unsigned int a, unsigned int b) {
+    if (a > b) swap(a, b);
+    return ((unsigned long long) a << 32) | b;
+}
+
+struct PositionHash {
+    size_t operator()(const vec3& p) const {
+        unsigned int words[3];
+        memcpy(words, &p, sizeof(words));
+        return hashBytes(words, sizeof(words));
+    }
+};
+
+// Vertices sharing a position get the same group, quadrics are per group
+static void positionGroups(const vector<vec3>& positions, vector<unsigned int>& groups,
+                           vector<unsigned int>& groupSizes) {
+    unordered_map<vec3, unsigned int, PositionHash> ids;
+    ids.reserve(positions.size());
+    groups.resize(positions.size());
+    for (size_t v = 0; v < positions.size(); v++) {
+        auto inserted = ids.insert(make_pair(positions[v], (unsigned int) groupSizes.size()));
+        if (inserted.second) groupSizes.push_back(0);
+        groups[v] = inserted.first->second;
+        groupSizes[groups[v]]++;
+    }
+}
+
+static const unsigned int NONE = ~0u;
+
+// Would moving `from` onto `to` turn any of its other triangles over?
+static bool flips(const vector<vec3>& positions, const vector<unsigned int>& indices,
+                  const vector<unsigned int>& first, const vector<unsigned int>& triangles,
+                  unsigned int from, unsigned int to) {
+    for (unsigned int j = first[from]; j < first[from + 1]; j++) {
+        const unsigned int* t = &indices[3 * triangles[j]];
+        if (t[0] == to || t[1] == to || t[2] == to) continue;
+        vec3 before[3], after[3];
+        for (int k = 0; k < 3; k++) {
+            before[k] = positions[t[k]];
+            after[k] = t[k] == from ? positions[to] : positions[t[k]];
+        }
+        vec3 n0 = cross(before[1] - before[0], before[2] - before[0]);
+        vec3 n1 = cross(after[1] - after[0], after[2] - after[0]);
+        if (dot(n0, n1) <= 0.0f) return true;
+    }
+    return false;
+}
+
+// The vertex of `group` that shares a triangle with v, other than `not`
+static unsigned int neighborIn(const vector<unsigned int>& indices, const vector<unsigned int>& groups,
+                               const vector<unsigned int>& first, const vector<unsigned int>& triangles,
+                               unsigned int v, unsigned int group, unsigned int not_) {
+    for (unsigned int j = first[v]; j < first[v + 1]; j++) {
+        const unsigned int* t = &indices[3 * triangles[j]];
+        for (int k = 0; k < 3; k++) {
+            if (t[k] != v && t[k] != not_ && groups[t[k]] == group) return t[k];
+        }
+    }
+    return NONE;
+}
+
+// One pass of independent collapses, returns false if none was possible. A
+// vertex on a seam moves along it together with its twin on the other side.
+static bool collapsePass(const vector<vec3>& positions, const vector<unsigned int>& groups,
+                         const vector<unsigned int>& groupSizes, const vector<unsigned int>& twins,
+                         const vector<bool>& locked, vector<Quadric>& quadrics,
+                         vector<unsigned int>& indices, size_t targetTriangles, double& maxError) {
+    size_t vertexCount = positions.size();
+    size_t triangleCount = indices.size() / 3;
+
+    // triangles of every vertex, triangles[first[v] .. first[v + 1])
+    vector<unsigned int> first(vertexCount + 1, 0);
+    for (unsigned int index : indices) first[index + 1]++;
+    for (size_t v = 0; v < vertexCount; v++) first[v + 1] += first[v];
+    vector<unsigned int> triangles(indices.size()), fill(first.begin(), first.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) triangles[fill[indices[i]]++] = (unsigned int) (i / 3);
+
+    vector<unsigned long long> edges;
+    edges.reserve(indices.size());
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++) {
+            edges.push_back(edgeKey(indices[3 * t + k], indices[3 * t + (k + 1) % 3]));
+        }
+    }
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+
+    // the cheaper direction of every edge, in parallel
+    vector<Collapse> collapses(edges.size());
+    const size_t CHUNK = 1 << 14;
+    parallelFor((int) ((edges.size() + CHUNK - 1) / CHUNK), [&](int chunk) {
+        size_t end = std::min(edges.size(), (chunk + 1) * CHUNK);
+        for (size_t e = chunk * CHUNK; e < end; e++) {
+            unsigned int a = (unsigned int) (edges[e] >> 32), b = (unsigned int) edges[e];
+            Quadric q = quadrics[groups[a]];
+            q += quadrics[groups[b]];
+            Collapse collapse = { a, b, numeric_limits<double>::infinity() };
+            if (!locked[a] && (twins[a] == NONE || groupSizes[groups[b]] > 1)) {
+                collapse.cost = q.error(positions[b]);
+            }
+            if (!locked[b] && (twins[b] == NONE || groupSizes[groups[a]] > 1)) {
+                double cost = q.error(positions[a]);
+                if (cost < collapse.cost) collapse = { b, a, cost };
+            }
+            collapses[e] = collapse;
+        }
+    });
+    sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+        return a.cost < b.cost;
+    });
+
+    // cheapest first, none touching the neighborhood of another
+    vector<unsigned int> remap(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) remap[v] = (unsigned int) v;
+    vector<bool> touched(vertexCount, false);
+    size_t removed = 0, needed = triangleCount - targetTriangles;
+    auto apply = [&](unsigned int from, unsigned int to) {
+        for (unsigned int j = first[from]; j < first[from + 1]; j++) {
+            const unsigned int* t = &indices[3 * triangles[j]];
+            for (int k = 0; k < 3; k++) touched[t[k]] = true;
+            if (t[0] == to || t[1] == to || t[2] == to) removed++;
+        }
+        touched[to] = true;
+        remap[from] = to;
+    };
+    bool collapsed = false;
+    for (const Collapse& collapse : collapses) {
+        if (removed >= needed || std::isinf(collapse.cost)) break;
+        if (touched[collapse.from] || touched[collapse.to]) continue;
+        if (flips(positions, indices, first, triangles, collapse.from, collapse.to)) continue;
+
+        unsigned int twinFrom = twins[collapse.from], twinTo = NONE;
+        if (twinFrom != NONE) {
+            twinTo = neighborIn(indices, groups, first, triangles, twinFrom, groups[collapse.to], collapse.to);
+            if (twinTo == NONE || touched[twinFrom] || touched[twinTo]) continue;
+            if (flips(positions, indices, first, triangles, twinFrom, twinTo)) continue;
+        }
+
+        apply(collapse.from, collapse.to);
+        if (twinFrom != NONE) apply(twinFrom, twinTo);
+        quadrics[groups[collapse.to]] += quadrics[groups[collapse.from]];
+        maxError = std::max(maxError, collapse.cost);
+        collapsed = true;
+    }
+    if (!collapsed) return false;
+
+    size_t out = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        unsigned int a = remap[indices[3 * t]], b = remap[indices[3 * t + 1]], c = remap[indices[3 * t + 2]];
+        if (a == b || b == c || a == c) continue;
+        indices[out++] = a;
+        indices[out++] = b;
+        indices[out++] = c;
+    }
+    indices.resize(out);
+    return true;
+}
+
+void buildLODs(const vector<vec3>& positions, const vector<unsigned int>& indices, int levels,
+               vector<vector<unsigned int>>& lodIndices, vector<float>& errors) {
+    vector<unsigned int> groups, groupSizes;
+    positionGroups(positions, groups, groupSizes);
+
+    // plane quadrics of the triangles around every position
+    vector<Quadric> quadrics(groupSizes.size());
+    for (size_t t = 0; t < indices.size() / 3; t++) {
+        dvec3 p0(positions[indices[3 * t]]), p1(positions[indices[3 * t + 1]]), p2(positions[indices[3 * t + 2]]);
+        dvec3 n = cross(p1 - p0, p2 - p0);
+        double length = glm::length(n);
+        if (length == 0.0) continue;
+        n /= length;
+        for (int k = 0; k < 3; k++) {
+            quadrics[groups[indices[3 * t + k]]].addPlane(n, -dot(n, p0), length / 2.0);
+        }
+    }
+
+    // borders (edges of one triangle) and where seams meet (more than two
+    // vertices at one position) would tear if they moved, a vertex on a single
+    // seam has a twin to move with
+    vector<bool> locked(positions.size(), false);
+    vector<unsigned int> twins(positions.size(), NONE), firstOfGroup(groupSizes.size(), NONE);
+    for (size_t v = 0; v < positions.size(); v++) {
+        unsigned int& other = firstOfGroup[groups[v]];
+        if (groupSizes[groups[v]] != 2) continue;
+        if (other == NONE) {
+            other = (unsigned int) v;
+        } else {
+            twins[v] = other;
+            twins[other] = (unsigned int) v;
+        }
+    }
+    unordered_map<unsigned long long, int> edgeUses;
+    for (size_t t = 0; t < indices.size() / 3; t++) {
+        for (int k = 0; k < 3; k++) {
+            unsigned int a = groups[indices[3 * t + k]], b = groups[indices[3 * t + (k + 1) % 3]];
+            edgeUses[edgeKey(a, b)]++;
+        }
+    }
+    vector<bool> borderGroup(groupSizes.size(), false);
+    for (const auto& edge : edgeUses) {
+        if (edge.second == 1) {
+            borderGroup[edge.first >> 32] = true;
+            borderGroup[(unsigned int) edge.first] = true;
+        }
+    }
+    for (size_t v = 0; v < positions.size(); v++) {
+        locked[v] = groupSizes[groups[v]] > 2 || borderGroup[groups[v]];
+    }
+
+    vector<unsigned int> current = indices;
+    double maxError = 0.0;
+    for (int level = 0; level < levels; level++) {
+        size_t before = current.size() / 3;
+        size_t target = before / 2;
+        if (target < 4) break;
+        while (current.size() / 3 > target &&
+               collapsePass(positions, groups, groupSizes, twins, locked, quadrics, current, target, maxError)) {
+        }
+        // not worth another level and another range in the index buffer
+        if (current.size() / 3 > before * 9 / 10) break;
+        lodIndices.push_back(current);
+        errors.push_back((float) sqrt(maxError));
+    }
+}
+
+float lodPixelScale(float fovY, float viewportHeight) {
+    return viewportHeight / (2.0f * tan(fovY / 2.0f));
+}
+
+int selectLOD(const vector<MeshLOD>& lods, float distance, float pixelScale, float maxPixels) {
+    int selected = 0;
+    for (int level = 1; level < (int) lods.size(); level++) {
+        if (lods[level].error * pixelScale > maxPixels * std::max(distance, 1e-6f)) break;
+        selected = level;
+    }
+    return selected;
+}
@@ -0,0 +1,45 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+* A level of detail of a mesh, a range of its index buffer. error is how far
+* the level may deviate from the full mesh, in object space units.
+*/
+struct MeshLOD {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error;
+};
+
+/**
+* Simplifies indexed triangles by quadric error edge collapses, each level to
+* about half the triangles of the one before, for up to `levels` levels. A
+* vertex only ever collapses onto another one, so all levels index the same
+* vertex buffer. Border vertices stay in place, vertices on uv or normal
+* seams only move along them.
+* Returns the index lists of the levels and their errors, there are fewer
+* levels when simplifying stops paying off.
+*/
+void buildLODs(
+    const std::vector<glm::vec3>& positions,
+    const std::vector<unsigned int>& indices,
+    int levels,
+    std::vector<std::vector<unsigned int>>& lodIndices,
+    std::vector<float>& errors);
+
+/**
+* Pixels covered by one unit at distance one, for a perspective projection.
+*/
+float lodPixelScale(float fovY, float viewportHeight);
+
+/**
+* The coarsest level whose error stays below maxPixels on screen at that
+* distance, level 0 if there are no others.
+*/
+int selectLOD(const std::vector<MeshLOD>& lods, float distance, float pixelScale,
+              float maxPixels = 1.0f);
+
+#endif
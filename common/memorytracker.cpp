@@ -0,0 +1,232 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include "memorytracker.h"
+#include "glcalls.h"
+
+using namespace std;
+
+static const double MB = 1.0e6;
+
+MemoryTracker& MemoryTracker::get() {
+    static MemoryTracker tracker;
+    return tracker;
+}
+
+const char* MemoryTracker::name(MemoryTag tag) {
+    static const char* names[] = {
+        "textures", "shadow map", "grid", "meshes", "particles", "staging", "targets", "waves", "uniforms"
+    };
+    return names[(int) tag];
+}
+
+void MemoryTracker::change(MemoryTag tag, long long bytes) {
+    Usage& usage = tags[(int) tag];
+    usage.live = (size_t) ((long long) usage.live + bytes);
+    usage.peak = std::max(usage.peak, usage.live);
+    liveTotal = (size_t) ((long long) liveTotal + bytes);
+    peakTotal = std::max(peakTotal, liveTotal);
+}
+
+void MemoryTracker::allocate(Kind kind, GLuint id, size_t bytes, MemoryTag tag) {
+    lock_guard<mutex> guard(lock);
+    Allocation& allocation = allocations[make_pair((int) kind, id)];
+    if (allocation.bytes) change(allocation.tag, -(long long) allocation.bytes);
+    allocation.bytes = bytes;
+    allocation.tag = tag;
+    change(tag, (long long) bytes);
+}
+
+void MemoryTracker::grow(Kind kind, GLuint id, size_t bytes, MemoryTag tag) {
+    lock_guard<mutex> guard(lock);
+    auto found = allocations.find(make_pair((int) kind, id));
+    if (found == allocations.end()) {
+        allocations[make_pair((int) kind, id)] = { bytes, tag };
+    } else {
+        found->second.bytes += bytes;
+        tag = found->second.tag;
+    }
+    change(tag, (long long) bytes);
+}
+
+void MemoryTracker::release(Kind kind, GLuint id) {
+    lock_guard<mutex> guard(lock);
+    auto found = allocations.find(make_pair((int) kind, id));
+    if (found == allocations.end()) return;
+    change(found->second.tag, -(long long) found->second.bytes);
+    allocations.erase(found);
+}
+
+void MemoryTracker::upload(MemoryTag tag, size_t bytes) {
+    lock_guard<mutex> guard(lock);
+    frameUploads[(int) tag] += bytes;
+    frameUpload += bytes;
+}
+
+void MemoryTracker::setBudget(MemoryTag tag, size_t bytes) {
+    lock_guard<mutex> guard(lock);
+    tags[(int) tag].budget = bytes;
+}
+
+void MemoryTracker::endFrame() {
+    lock_guard<mutex> guard(lock);
+    // the counters of the frame become the ones of the last frame
+    for (int i = 0; i < (int) MemoryTag::Count; i++) {
+        tags[i].uploaded = frameUploads[i];
+        tags[i].uploadPeak = std::max(tags[i].uploadPeak, frameUploads[i]);
+        frameUploads[i] = 0;
+    }
+    lastUpload = frameUpload;
+    peakUpload = std::max(peakUpload, frameUpload);
+
+    auto check = [&](int index, const string& what, size_t value, size_t budget) {
+        bool over = budget > 0 && value > budget;
+        if (over && !warned[index]) {
+            cout << "Over the " << what << " budget: " << fixed << setprecision(2) << value / MB
+                 << " MB of " << budget / MB << " MB" << defaultfloat << setprecision(6) << endl;
+        }
+        warned[index] = over;
+    };
+    for (int i = 0; i < (int) MemoryTag::Count; i++) {
+        check(i, string(name((MemoryTag) i)) + " memory", tags[i].live, tags[i].budget);
+    }
+    check((int) MemoryTag::Count, "GPU memory", liveTotal, totalBudget);
+    check((int) MemoryTag::Count + 1, "per frame upload", lastUpload, uploadBudget);
+
+    frameUpload = 0;
+}
+
+size_t MemoryTracker::resetUploads() {
+    lock_guard<mutex> guard(lock);
+    size_t bytes = frameUpload;
+    frameUpload = 0;
+    for (size_t& tagBytes : frameUploads) tagBytes = 0;
+    return bytes;
+}
+
+MemoryTracker::Usage MemoryTracker::usage(MemoryTag tag) const {
+    lock_guard<mutex> guard(lock);
+    return tags[(int) tag];
+}
+
+size_t MemoryTracker::live() const {
+    lock_guard<mutex> guard(lock);
+    return liveTotal;
+}
+
+bool MemoryTracker::overBudget() const {
+    lock_guard<mutex> guard(lock);
+    for (bool over : warned) {
+        if (over) return true;
+    }
+    return false;
+}
+
+string MemoryTracker::summary() const {
+    lock_guard<mutex> guard(lock);
+    ostringstream text;
+    text << fixed << setprecision(1) << "GPU " << liveTotal / MB << " MB, upload "
+         << setprecision(2) << lastUpload / MB << " MB/frame";
+    return text.str();
+}
+
+void MemoryTracker::printReport() const {
+    lock_guard<mutex> guard(lock);
+    cout << "GPU memory: " << fixed << setprecision(2) << liveTotal / MB << " MB live, "
+         << peakTotal / MB << " MB peak, uploads up to " << peakUpload / MB << " MB per frame" << endl;
+    cout << "  live(MB)  peak(MB)  upload peak(MB/frame)  tag" << endl;
+    for (int i = 0; i < (int) MemoryTag::Count; i++) {
+        const Usage& usage = tags[i];
+        if (usage.peak == 0 && usage.uploadPeak == 0) continue;
+        cout << setw(10) << usage.live / MB << setw(10) << usage.peak / MB << setw(23)
+             << usage.uploadPeak / MB << "  " << name((MemoryTag) i) << endl;
+    }
+    cout << defaultfloat << setprecision(6);
+}
+
+void MemoryTracker::drawHUD(int width, int height) {
+    lock_guard<mutex> guard(lock);
+    GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+    GLfloat clearColor[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    glEnable(GL_SCISSOR_TEST);
+
+    auto rectangle = [](int x, int y, int w, int h, float r, float g, float b) {
+        glScissor(x, y, w, h);
+        glClearColor(r, g, b, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    };
+    const int margin = 10, barHeight = 6, gap = 3;
+    int barWidth = width / 3;
+    size_t largest = 1;
+    for (const Usage& usage : tags) {
+        largest = std::max(largest, usage.live);
+    }
+
+    int y = margin;
+    auto bar = [&](float fraction, bool over, float r, float g, float b) {
+        int filled = (int) (std::min(fraction, 1.0f) * barWidth);
+        rectangle(margin, y, barWidth, barHeight, 0.1f, 0.1f, 0.1f);
+        if (over) rectangle(margin, y, filled, barHeight, 1.0f, 0.15f, 0.15f);
+        else rectangle(margin, y, filled, barHeight, r, g, b);
+        y += barHeight + gap;
+    };
+    bar(uploadBudget ? (float) lastUpload / uploadBudget : (float) lastUpload / std::max(peakUpload, (size_t) 1),
+        uploadBudget > 0 && lastUpload > uploadBudget, 0.9f, 0.9f, 0.2f);
+    for (int i = (int) MemoryTag::Count - 1; i >= 0 && y < height; i--) {
+        const Usage& usage = tags[i];
+        if (usage.peak == 0) continue;
+        bar(usage.budget ? (float) usage.live / usage.budget : (float) usage.live / largest,
+            usage.budget > 0 && usage.live > usage.budget, 0.3f, 0.8f, 0.4f);
+    }
+
+    glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    if (!scissor) glDisable(GL_SCISSOR_TEST);
+}
+
+size_t textureBytes(int width, int height, int bytesPerPixel, bool mipmapped) {
+    size_t bytes = (size_t) width * height * bytesPerPixel;
+    // the chain ends with the 1x1 level
+    while (mipmapped && (width > 1 || height > 1)) {
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+        bytes += (size_t) width * height * bytesPerPixel;
+    }
+    return bytes;
+}
+
+void bufferData(MemoryTag tag, GLuint buffer, GLenum target, GLsizeiptr size,
+                const void* data, GLenum usage) {
+    glBufferData(target, size, data, usage);
+    MemoryTracker::get().allocate(MemoryTracker::BUFFER, buffer, (size_t) size, tag);
+    if (data) MemoryTracker::get().upload(tag, (size_t) size);
+}
+
+void bufferSubData(MemoryTag tag, GLenum target, GLintptr offset, GLsizeiptr size,
+                   const void* data) {
+    glBufferSubData(target, offset, size, data);
+    MemoryTracker::get().upload(tag, (size_t) size);
+}
+
+void renderbufferStorage(MemoryTag tag, GLuint renderbuffer, GLenum internalFormat,
+                         int width, int height, int bytesPerPixel) {
+    glRenderbufferStorage(GL_RENDERBUFFER, internalFormat, width, height);
+    MemoryTracker::get().allocate(MemoryTracker::RENDERBUFFER, renderbuffer,
+                                  (size_t) width * height * bytesPerPixel, tag);
+}
+
+void deleteBuffers(GLsizei count, const GLuint* buffers) {
+    for (GLsizei i = 0; i < count; i++) MemoryTracker::get().release(MemoryTracker::BUFFER, buffers[i]);
+    glDeleteBuffers(count, buffers);
+}
+
+void deleteTextures(GLsizei count, const GLuint* textures) {
+    for (GLsizei i = 0; i < count; i++) MemoryTracker::get().release(MemoryTracker::TEXTURE, textures[i]);
+    glDeleteTextures(count, textures);
+}
+
+void deleteRenderbuffers(GLsizei count, const GLuint* renderbuffers) {
+    for (GLsizei i = 0; i < count; i++) MemoryTracker::get().release(MemoryTracker::RENDERBUFFER, renderbuffers[i]);
+    glDeleteRenderbuffers(count, renderbuffers);
+}
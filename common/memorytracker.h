@@ -0,0 +1,119 @@
+#ifndef MEMORY_TRACKER_H
+#define MEMORY_TRACKER_H
+
+#include <GL/glew.h>
+#include <string>
+#include <map>
+#include <mutex>
+
+/**
+* What GL memory belongs to, and what the bytes uploaded every frame are for.
+* Uniforms and Waves only count uploads.
+*/
+enum class MemoryTag {
+    Textures,
+    ShadowMap,
+    Grid,           // water grid and tessellation patches
+    Meshes,         // Drawable, Model and the skybox
+    Particles,      // per emitter instance buffers
+    Staging,        // pixel upload ring
+    Targets,        // offscreen render buffers
+    Waves,          // uniforms of uploadWavesToShader
+    Uniforms,       // all other uniforms
+    Count
+};
+
+/**
+* Live GL memory by tag with high-water marks, and bytes uploaded per frame.
+* The sizes are what the objects need at least, drivers add padding and
+* alignment. Use the wrappers below instead of the GL calls so that nothing is
+* missed; everything runs on the GL thread.
+*
+* Budgets (0 for none) are checked at endFrame(), a warning is printed when a
+* total first goes over one.
+*/
+class MemoryTracker {
+public:
+    enum Kind { BUFFER, TEXTURE, RENDERBUFFER };
+
+    struct Usage {
+        size_t live = 0, peak = 0;          // bytes
+        size_t uploaded = 0;                // in the last frame
+        size_t uploadPeak = 0;              // the most in one frame
+        size_t budget = 0;
+    };
+
+    static MemoryTracker& get();
+
+    /* Sets the size of an object, replacing what it had */
+    void allocate(Kind kind, GLuint id, size_t bytes, MemoryTag tag);
+    /* Adds to the size of an object, e.g. a face of a cube map */
+    void grow(Kind kind, GLuint id, size_t bytes, MemoryTag tag);
+    void release(Kind kind, GLuint id);
+    void upload(MemoryTag tag, size_t bytes);
+
+    /* Call once per frame, closes the upload counters of the frame */
+    void endFrame();
+    /* Drops what was uploaded since the last frame, e.g. while loading, and returns it */
+    size_t resetUploads();
+
+    void setBudget(MemoryTag tag, size_t bytes);
+    void setTotalBudget(size_t bytes) { totalBudget = bytes; }
+    void setUploadBudget(size_t bytesPerFrame) { uploadBudget = bytesPerFrame; }
+
+    Usage usage(MemoryTag tag) const;
+    size_t live() const;
+    size_t peak() const { return peakTotal; }
+    size_t uploadedLastFrame() const { return lastUpload; }
+    size_t uploadPeak() const { return peakUpload; }
+    bool overBudget() const;
+
+    /* Live and uploaded MB, e.g. for the window title */
+    std::string summary() const;
+    /* Live, peak and upload peak of every tag */
+    void printReport() const;
+    /**
+    * A bar per tag of its live memory over its budget (or over the largest
+    * tag), red when over budget, and one of the last frame's uploads. Drawn
+    * with scissored clears at the bottom left.
+    */
+    void drawHUD(int width, int height);
+
+    static const char* name(MemoryTag tag);
+
+private:
+    MemoryTracker() {}
+    void change(MemoryTag tag, long long bytes);
+
+    struct Allocation {
+        size_t bytes;
+        MemoryTag tag;
+    };
+    std::map<std::pair<int, GLuint>, Allocation> allocations;
+    Usage tags[(int) MemoryTag::Count];
+    size_t frameUploads[(int) MemoryTag::Count] = {};
+    size_t frameUpload = 0, lastUpload = 0, peakUpload = 0;
+    size_t liveTotal = 0, peakTotal = 0;
+    size_t totalBudget = 0, uploadBudget = 0;
+    bool warned[(int) MemoryTag::Count + 2] = {};
+    mutable std::mutex lock;
+};
+
+/* Bytes of a width x height image with its full mip chain when mipmapped */
+size_t textureBytes(int width, int height, int bytesPerPixel, bool mipmapped);
+
+/* glBufferData on buffer, which must be bound to target */
+void bufferData(MemoryTag tag, GLuint buffer, GLenum target, GLsizeiptr size,
+                const void* data, GLenum usage);
+/* glBufferSubData on the buffer bound to target */
+void bufferSubData(MemoryTag tag, GLenum target, GLintptr offset, GLsizeiptr size,
+                   const void* data);
+/* glRenderbufferStorage on renderbuffer, which must be bound */
+void renderbufferStorage(MemoryTag tag, GLuint renderbuffer, GLenum internalFormat,
+                         int width, int height, int bytesPerPixel);
+
+void deleteBuffers(GLsizei count, const GLuint* buffers);
+void deleteTextures(GLsizei count, const GLuint* textures);
+void deleteRenderbuffers(GLsizei count, const GLuint* renderbuffers);
+
+#endif
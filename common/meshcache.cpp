@@ -0,0 +1,483 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "meshcache.h"
+#include "model.h"
+
+using namespace glm;
+using namespace std;
+
+// Bump whenever the layout below, the vertex layout or how faces are grouped
+// into meshes changes
+static const unsigned int MESH_CACHE_VERSION = 4;
+static const size_t MESH_CACHE_ALIGNMENT = 16;
+
+struct MeshCacheHeader {
+    char magic[4];              // "MESH"
+    unsigned int version;
+    unsigned long long sourceHash;
+    unsigned int meshCount;
+    unsigned int reserved;
+};
+
+// One per mesh after the header, then the texture names of every mesh
+// (four null terminated strings each), then the MeshLODs of every mesh, then
+// the aligned vertex and index data
+struct MeshCacheEntry {
+    unsigned int attributes;
+    unsigned int vertexCount;
+    unsigned int indexCount;
+    unsigned int nameBytes;
+    unsigned long long vertexOffset;
+    unsigned long long indexOffset;
+    float Ka[4], Kd[4], Ks[4];
+    float Ns;
+    unsigned int format;
+    float boundsMin[3], boundsMax[3];
+    unsigned int lodLevels;     // requested, lodCount - 1 may be less
+    unsigned int lodCount;
+};
+
+// Sizes of the attributes in each format
+static size_t positionSize(VertexFormat format) {
+    return format == VertexFormat::Quantized ? 4 * sizeof(short) : sizeof(vec3);
+}
+
+static size_t normalSize(VertexFormat format) {
+    return format == VertexFormat::Float ? sizeof(vec3) : sizeof(unsigned int);
+}
+
+static size_t uvSize(VertexFormat format) {
+    return format == VertexFormat::Float ? sizeof(vec2) : sizeof(unsigned int);
+}
+
+GLsizei MeshData::vertexStride(unsigned int attributes, VertexFormat format) {
+    size_t stride = positionSize(format);
+    if (attributes & NORMALS) stride += normalSize(format);
+    if (attributes & UVS) stride += uvSize(format);
+    return (GLsizei) stride;
+}
+
+// Quantized positions are [-1, 1] around the center of the bounds
+static void quantization(const MeshBounds& bounds, vec3& center, vec3& extent) {
+    center = (bounds.min + bounds.max) * 0.5f;
+    extent = glm::max((bounds.max - bounds.min) * 0.5f, vec3(1e-20f));
+}
+
+mat4 MeshData::positionTransform() const {
+    if (format != VertexFormat::Quantized) return mat4(1.0f);
+    vec3 center, extent;
+    quantization(bounds, center, extent);
+    return translate(mat4(1.0f), center) * scale(mat4(1.0f), extent);
+}
+
+void setMeshAttributes(unsigned int attributes, VertexFormat format) {
+    GLsizei stride = MeshData::vertexStride(attributes, format);
+    size_t offset = 0;
+    if (format == VertexFormat::Quantized) {
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, stride, (void*) offset);
+    } else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*) offset);
+    }
+    glEnableVertexAttribArray(0);
+    offset += positionSize(format);
+
+    if (attributes & MeshData::NORMALS) {
+        if (format == VertexFormat::Float) {
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*) offset);
+        } else {
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*) offset);
+        }
+        glEnableVertexAttribArray(1);
+        offset += normalSize(format);
+    }
+
+    if (attributes & MeshData::UVS) {
+        if (format == VertexFormat::Float) {
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*) offset);
+        } else {
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*) offset);
+        }
+        glEnableVertexAttribArray(2);
+    }
+}
+
+/*****************************************************************************/
+
+// Tom Forsyth's linear speed vertex cache optimization
+static const int VERTEX_CACHE_SIZE = 32;
+
+static float vertexScore(int cachePosition, unsigned int remaining) {
+    if (remaining == 0) return -1.0f;
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        // the last triangle's vertices score the same, whatever order it used
+        if (cachePosition < 3) {
+            score = 0.75f;
+        } else {
+            score = pow(1.0f - (cachePosition - 3) / float(VERTEX_CACHE_SIZE - 3), 1.5f);
+        }
+    }
+    // favor vertices with few triangles left, to finish them off
+    return score + 2.0f / sqrt((float) remaining);
+}
+
+static void optimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return;
+
+    // the triangles of vertex v are triangles[first[v] .. first[v] + remaining[v])
+    vector<unsigned int> first(vertexCount + 1, 0), remaining(vertexCount, 0);
+    for (unsigned int index : indices) remaining[index]++;
+    for (size_t v = 0; v < vertexCount; v++) first[v + 1] = first[v] + remaining[v];
+    vector<unsigned int> triangles(indices.size());
+    vector<unsigned int> fill(first.begin(), first.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        triangles[fill[indices[i]]++] = (unsigned int) (i / 3);
+    }
+
+    vector<int> cachePosition(vertexCount, -1);
+    vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) score[v] = vertexScore(-1, remaining[v]);
+    vector<bool> emitted(triangleCount, false);
+
+    vector<unsigned int> result, cache, nextCache;
+    result.reserve(indices.size());
+    size_t nextTriangle = 0;
+    long best = -1;
+    while (result.size() < indices.size()) {
+        if (best < 0) {
+            // nothing left around the cache, continue in the original order
+            while (emitted[nextTriangle]) nextTriangle++;
+            best = (long) nextTriangle;
+        }
+        emitted[best] = true;
+        const unsigned int* corners = &indices[3 * best];
+
+        nextCache.assign(corners, corners + 3);
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = corners[k];
+            unsigned int* list = &triangles[first[v]];
+            for (unsigned int j = 0; j < remaining[v]; j++) {
+                if (list[j] == (unsigned int) best) {
+                    swap(list[j], list[remaining[v] - 1]);
+                    remaining[v]--;
+                    break;
+                }
+            }
+        }
+        result.insert(result.end(), corners, corners + 3);
+
+        for (unsigned int v : cache) {
+            if (v != corners[0] && v != corners[1] && v != corners[2]) nextCache.push_back(v);
+        }
+        for (size_t j = 0; j < nextCache.size(); j++) {
+            unsigned int v = nextCache[j];
+            cachePosition[v] = (int) j < VERTEX_CACHE_SIZE ? (int) j : -1;
+            score[v] = vertexScore(cachePosition[v], remaining[v]);
+        }
+        if ((int) nextCache.size() > VERTEX_CACHE_SIZE) nextCache.resize(VERTEX_CACHE_SIZE);
+        swap(cache, nextCache);
+
+        // the next triangle is the best one using a cached vertex
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : cache) {
+            for (unsigned int j = 0; j < remaining[v]; j++) {
+                unsigned int t = triangles[first[v] + j];
+                float s = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+                if (s > bestScore) {
+                    bestScore = s;
+                    best = t;
+                }
+            }
+        }
+    }
+    indices.swap(result);
+}
+
+MeshData buildMeshData(const vector<vec3>& vertices, const vector<vec2>& uvs,
+                       const vector<vec3>& normals, VertexFormat format,
+                       const MeshBounds* bounds, int lodLevels) {
+    vector<unsigned int> indices;
+    vector<vec3> indexedVertices, indexedNormals;
+    vector<vec2> indexedUVs;
+    indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVs, indexedNormals);
+    optimizeVertexCache(indices, indexedVertices.size());
+
+    MeshData data;
+    data.format = format;
+    if (bounds) {
+        data.bounds = *bounds;
+    } else if (indexedVertices.size() != 0) {
+        data.bounds.min = data.bounds.max = indexedVertices[0];
+        for (const vec3& vertex : indexedVertices) {
+            data.bounds.min = glm::min(data.bounds.min, vertex);
+            data.bounds.max = glm::max(data.bounds.max, vertex);
+        }
+    }
+    vec3 center, extent;
+    quantization(data.bounds, center, extent);
+
+    if (indexedNormals.size() != 0) data.attributes |= MeshData::NORMALS;
+    if (indexedUVs.size() != 0) data.attributes |= MeshData::UVS;
+    data.indexCount = (unsigned int) indices.size();
+
+    // vertices in the order the triangles use them
+    vector<unsigned int> remap(indexedVertices.size(), ~0u);
+    vector<vec3> positions;
+    positions.reserve(indexedVertices.size());
+    GLsizei stride = data.stride();
+    data.vertexStorage.reserve(indexedVertices.size() * stride);
+    for (unsigned int& index : indices) {
+        if (remap[index] == ~0u) {
+            remap[index] = data.vertexCount++;
+            positions.push_back(indexedVertices[index]);
+            size_t offset = data.vertexStorage.size();
+            data.vertexStorage.resize(offset + stride);
+            unsigned char* vertex = &data.vertexStorage[offset];
+            if (format == VertexFormat::Quantized) {
+                vec3 position = glm::clamp((indexedVertices[index] - center) / extent, -1.0f, 1.0f);
+                short quantized[4] = {
+                    (short) lround(position.x * 32767.0f),
+                    (short) lround(position.y * 32767.0f),
+                    (short) lround(position.z * 32767.0f),
+                    0
+                };
+                memcpy(vertex, quantized, sizeof(quantized));
+            } else {
+                memcpy(vertex, &indexedVertices[index], sizeof(vec3));
+            }
+            vertex += positionSize(format);
+            if (data.attributes & MeshData::NORMALS) {
+                if (format == VertexFormat::Float) {
+                    memcpy(vertex, &indexedNormals[index], sizeof(vec3));
+                } else {
+                    unsigned int packed = packSnorm3x10_1x2(vec4(indexedNormals[index], 0.0f));
+                    memcpy(vertex, &packed, sizeof(packed));
+                }
+                vertex += normalSize(format);
+            }
+            if (data.attributes & MeshData::UVS) {
+                if (format == VertexFormat::Float) {
+                    memcpy(vertex, &indexedUVs[index], sizeof(vec2));
+                } else {
+                    unsigned int packed = packHalf2x16(indexedUVs[index]);
+                    memcpy(vertex, &packed, sizeof(packed));
+                }
+            }
+        }
+        index = remap[index];
+    }
+
+    // coarser levels follow the full mesh in the same index buffer
+    data.lodLevels = (unsigned int) std::max(lodLevels, 0);
+    data.lods.push_back({ 0, data.indexCount, 0.0f });
+    if (lodLevels > 0) {
+        vector<vector<unsigned int>> levels;
+        vector<float> errors;
+        buildLODs(positions, indices, lodLevels, levels, errors);
+        for (size_t level = 0; level < levels.size(); level++) {
+            optimizeVertexCache(levels[level], data.vertexCount);
+            data.lods.push_back({ (unsigned int) indices.size(), (unsigned int) levels[level].size(), errors[level] });
+            indices.insert(indices.end(), levels[level].begin(), levels[level].end());
+        }
+        data.indexCount = (unsigned int) indices.size();
+    }
+
+    data.indexStorage.swap(indices);
+    data.vertices = data.vertexStorage.data();
+    data.indices = data.indexStorage.data();
+    return data;
+}
+
+/*****************************************************************************/
+
+string meshCachePath(const string& sourcePath) {
+    return sourcePath + ".mesh";
+}
+
+unsigned long long hashMeshSource(const string& sourcePath) {
+    MappedFile source(sourcePath);
+    return hashBytes(source.data(), source.size());
+}
+
+static size_t alignCacheOffset(size_t offset) {
+    return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+}
+
+bool loadMeshCache(const string& path, unsigned long long sourceHash,
+                   vector<CachedMesh>& meshes) {
+    if (!fileExists(path)) return false;
+    shared_ptr<MappedFile> file;
+    try {
+        file = make_shared<MappedFile>(path);
+    } catch (exception&) {
+        return false;
+    }
+
+    const unsigned char* bytes = file->data();
+    size_t size = file->size();
+    if (size < sizeof(MeshCacheHeader)) return false;
+    MeshCacheHeader header;
+    memcpy(&header, bytes, sizeof(header));
+    if (memcmp(header.magic, "MESH", 4) != 0 || header.version != MESH_CACHE_VERSION ||
+        header.sourceHash != sourceHash) {
+        return false;
+    }
+
+    size_t entriesEnd = sizeof(MeshCacheHeader) + (size_t) header.meshCount * sizeof(MeshCacheEntry);
+    if (header.meshCount == 0 || entriesEnd > size) return false;
+    const MeshCacheEntry* entries = (const MeshCacheEntry*) (bytes + sizeof(MeshCacheHeader));
+
+    vector<CachedMesh> result(header.meshCount);
+    size_t names = entriesEnd;
+    size_t lods = entriesEnd;
+    for (unsigned int i = 0; i < header.meshCount; i++) {
+        if (entries[i].nameBytes > size - lods) return false;
+        lods += entries[i].nameBytes;
+    }
+    for (unsigned int i = 0; i < header.meshCount; i++) {
+        const MeshCacheEntry& entry = entries[i];
+        CachedMesh& mesh = result[i];
+        MeshData& data = mesh.data;
+        data.attributes = entry.attributes;
+        if (entry.format > (unsigned int) VertexFormat::Quantized) return false;
+        data.format = (VertexFormat) entry.format;
+        data.bounds.min = vec3(entry.boundsMin[0], entry.boundsMin[1], entry.boundsMin[2]);
+        data.bounds.max = vec3(entry.boundsMax[0], entry.boundsMax[1], entry.boundsMax[2]);
+        data.vertexCount = entry.vertexCount;
+        data.indexCount = entry.indexCount;
+        if (entry.vertexOffset % MESH_CACHE_ALIGNMENT != 0 || entry.indexOffset % MESH_CACHE_ALIGNMENT != 0 ||
+            entry.vertexOffset > size || data.vertexBytes() > size - entry.vertexOffset ||
+            entry.indexOffset > size || data.indexBytes() > size - entry.indexOffset) {
+            return false;
+        }
+        data.vertices = bytes + entry.vertexOffset;
+        data.indices = (const unsigned int*) (bytes + entry.indexOffset);
+        data.file = file;
+
+        mesh.Ka = vec4(entry.Ka[0], entry.Ka[1], entry.Ka[2], entry.Ka[3]);
+        mesh.Kd = vec4(entry.Kd[0], entry.Kd[1], entry.Kd[2], entry.Kd[3]);
+        mesh.Ks = vec4(entry.Ks[0], entry.Ks[1], entry.Ks[2], entry.Ks[3]);
+        mesh.Ns = entry.Ns;
+
+        if (entry.nameBytes > size - names) return false;
+        const char* name = (const char*) bytes + names;
+        const char* namesEnd = name + entry.nameBytes;
+        for (int t = 0; t < 4; t++) {
+            const char* end = (const char*) memchr(name, 0, namesEnd - name);
+            if (!end) return false;
+            mesh.textures[t].assign(name, end);
+            name = end + 1;
+        }
+        names += entry.nameBytes;
+
+        if (entry.lodCount == 0 || entry.lodCount > (size - lods) / sizeof(MeshLOD)) return false;
+        data.lodLevels = entry.lodLevels;
+        data.lods.resize(entry.lodCount);
+        memcpy(data.lods.data(), bytes + lods, entry.lodCount * sizeof(MeshLOD));
+        lods += entry.lodCount * sizeof(MeshLOD);
+        for (const MeshLOD& lod : data.lods) {
+            if (lod.firstIndex > data.indexCount || lod.indexCount > data.indexCount - lod.firstIndex) {
+                return false;
+            }
+        }
+    }
+
+    meshes.swap(result);
+    return true;
+}
+
+void writeMeshCache(const string& path, unsigned long long sourceHash,
+                    const vector<CachedMesh>& meshes) {
+    MeshCacheHeader header;
+    memcpy(header.magic, "MESH", 4);
+    header.version = MESH_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.meshCount = (unsigned int) meshes.size();
+    header.reserved = 0;
+
+    vector<MeshCacheEntry> entries(meshes.size());
+    string names;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        size_t before = names.size();
+        for (int t = 0; t < 4; t++) {
+            names += meshes[i].textures[t];
+            names += '\0';
+        }
+        entries[i].nameBytes = (unsigned int) (names.size() - before);
+    }
+
+    size_t lodBytes = 0;
+    for (const CachedMesh& mesh : meshes) lodBytes += mesh.data.lods.size() * sizeof(MeshLOD);
+
+    size_t offset = alignCacheOffset(sizeof(header) + entries.size() * sizeof(MeshCacheEntry) +
+                                     names.size() + lodBytes);
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const CachedMesh& mesh = meshes[i];
+        MeshCacheEntry& entry = entries[i];
+        entry.attributes = mesh.data.attributes;
+        entry.vertexCount = mesh.data.vertexCount;
+        entry.indexCount = mesh.data.indexCount;
+        entry.vertexOffset = offset;
+        offset = alignCacheOffset(offset + mesh.data.vertexBytes());
+        entry.indexOffset = offset;
+        offset = alignCacheOffset(offset + mesh.data.indexBytes());
+        for (int c = 0; c < 4; c++) {
+            entry.Ka[c] = mesh.Ka[c];
+            entry.Kd[c] = mesh.Kd[c];
+            entry.Ks[c] = mesh.Ks[c];
+        }
+        entry.Ns = mesh.Ns;
+        entry.format = (unsigned int) mesh.data.format;
+        for (int c = 0; c < 3; c++) {
+            entry.boundsMin[c] = mesh.data.bounds.min[c];
+            entry.boundsMax[c] = mesh.data.bounds.max[c];
+        }
+        entry.lodLevels = mesh.data.lodLevels;
+        entry.lodCount = (unsigned int) mesh.data.lods.size();
+    }
+
+    // written under another name first, a reader never sees a partial file
+    string temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        cout << "Can't write mesh cache: " << path << endl;
+        return;
+    }
+    static const unsigned char zeros[MESH_CACHE_ALIGNMENT] = {};
+    size_t written = 0;
+    auto write = [&](const void* data, size_t size) {
+        written += fwrite(data, 1, size, file);
+    };
+    auto pad = [&]() {
+        write(zeros, alignCacheOffset(written) - written);
+    };
+    write(&header, sizeof(header));
+    write(entries.data(), entries.size() * sizeof(MeshCacheEntry));
+    write(names.data(), names.size());
+    for (const CachedMesh& mesh : meshes) {
+        write(mesh.data.lods.data(), mesh.data.lods.size() * sizeof(MeshLOD));
+    }
+    for (const CachedMesh& mesh : meshes) {
+        pad();
+        write(mesh.data.vertices, mesh.data.vertexBytes());
+        pad();
+        write(mesh.data.indices, mesh.data.indexBytes());
+    }
+    pad();
+    bool failed = ferror(file) != 0 || written != offset;
+    fclose(file);
+
+    remove(path.c_str());
+    if (failed || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        cout << "Can't write mesh cache: " << path << endl;
+    }
+}
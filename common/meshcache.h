@@ -0,0 +1,126 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <glm/glm.hpp>
+#include "util.h"
+#include "lod.h"
+
+/**
+* How MeshData stores its vertices. Compact packs normals as
+* GL_INT_2_10_10_10_REV and uvs as half floats (20 instead of 32 bytes).
+* Quantized also stores positions as normalized 16 bit integers within the
+* bounds (16 bytes), drawing them needs MeshData::positionTransform().
+*/
+enum class VertexFormat {
+    Float,
+    Compact,
+    Quantized
+};
+
+struct MeshBounds {
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+};
+
+/**
+* Indexed triangles with interleaved vertices: position, then the normal and
+* the uv if the source has them. The bytes are either owned or point into a
+* mapped mesh cache file, ready for glBufferData.
+*/
+struct MeshData {
+    enum Attributes { NORMALS = 1, UVS = 2 };
+
+    unsigned int attributes = 0;
+    VertexFormat format = VertexFormat::Float;
+    MeshBounds bounds;
+    unsigned int vertexCount = 0;
+    unsigned int indexCount = 0;
+    const unsigned char* vertices = nullptr;
+    const unsigned int* indices = nullptr;
+
+    /* Level 0 is the full mesh, indexCount covers all levels */
+    std::vector<MeshLOD> lods;
+    unsigned int lodLevels = 0;
+
+    MeshData() {}
+    MeshData(MeshData&&) = default;
+    MeshData& operator=(MeshData&&) = default;
+    MeshData(const MeshData&) = delete;
+    MeshData& operator=(const MeshData&) = delete;
+
+    GLsizei stride() const { return vertexStride(attributes, format); }
+    size_t vertexBytes() const { return (size_t) vertexCount * stride(); }
+    size_t indexBytes() const { return (size_t) indexCount * sizeof(unsigned int); }
+
+    /* Maps quantized positions back into the bounds, identity otherwise */
+    glm::mat4 positionTransform() const;
+
+    static GLsizei vertexStride(unsigned int attributes, VertexFormat format = VertexFormat::Float);
+
+    std::vector<unsigned char> vertexStorage;
+    std::vector<unsigned int> indexStorage;
+    std::shared_ptr<MappedFile> file;
+};
+
+/**
+* Sets the vertex attributes 0 (position), 1 (normal) and 2 (uv) of the bound
+* VAO from the bound array buffer, laid out as in MeshData.
+*/
+void setMeshAttributes(unsigned int attributes, VertexFormat format = VertexFormat::Float);
+
+/**
+* Indexes de-indexed triangles with indexVBO(), reorders them for the post
+* transform vertex cache and the vertices in the order they are first used.
+* Quantized positions use the given bounds, e.g. those of a whole model so
+* that its meshes share a transform, or else the mesh's own. lodLevels
+* simplified levels are appended with buildLODs().
+*/
+MeshData buildMeshData(
+    const std::vector<glm::vec3>& vertices,
+    const std::vector<glm::vec2>& uvs,
+    const std::vector<glm::vec3>& normals,
+    VertexFormat format = VertexFormat::Float,
+    const MeshBounds* bounds = nullptr,
+    int lodLevels = 0);
+
+/**
+* A mesh of the cache with its material, the textures are file names
+* (Ka, Kd, Ks, Ns).
+*/
+struct CachedMesh {
+    MeshData data;
+    glm::vec4 Ka = glm::vec4(0.0f), Kd = glm::vec4(0.0f), Ks = glm::vec4(0.0f);
+    float Ns = 0.0f;
+    std::string textures[4];
+};
+
+/**
+* The cache of a source mesh lives next to it, "model.obj" -> "model.obj.mesh".
+*/
+std::string meshCachePath(const std::string& sourcePath);
+
+/**
+* Hash of the file contents that a cache is valid for, throws if the file
+* can't be read.
+*/
+unsigned long long hashMeshSource(const std::string& sourcePath);
+
+/**
+* Maps the cache, false if it is missing, of an older version, built from a
+* different source or damaged. The caller checks the vertex format and the
+* number of LOD levels.
+*/
+bool loadMeshCache(const std::string& path, unsigned long long sourceHash,
+                   std::vector<CachedMesh>& meshes);
+
+/**
+* Writes the cache, only logs if that fails since it can be rebuilt.
+*/
+void writeMeshCache(const std::string& path, unsigned long long sourceHash,
+                    const std::vector<CachedMesh>& meshes);
+
+#endif
@@ -1,17 +1,25 @@
 #include <iostream>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
 #include <sstream>
 #include <map>
-#include <tinyxml2.h>
+#include <fstream>
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 #include "util.h"
 #include "model.h"
 #include "texture.h"
+#include "objparser.h"
+#include "vtpreader.h"
+#include "trace.h"
+#include "memorytracker.h"
+#include "glcalls.h"
+#include "backend.h"
 
 using namespace glm;
 using namespace std;
 using namespace ogl;
-using namespace tinyxml2;
 
 // simple OBJ loader
 void loadOBJ(
@@ -112,115 +120,16 @@ void loadVTP(
     vector<vec3>& normals,
     vector<unsigned int>& indices) {
     indices.clear();
-    const char* method = "PolygonalMesh::loadVtpFile()";
-    XMLDocument vtp;
-    assert(vtp.LoadFile(path.c_str()) == 0);
-
-    XMLElement* root = vtp.FirstChildElement("VTKFile");
-    assert(root != nullptr);
-    assert(root->Attribute("type", "PolyData"));
-
-    XMLElement* polydata = root->FirstChildElement("PolyData");
-    assert(polydata != nullptr);
-    XMLElement* piece = polydata->FirstChildElement("Piece");
-    assert(piece != nullptr);
-    XMLElement* enormals = piece->FirstChildElement("PointData");
-    assert(enormals != nullptr);
-    XMLElement* points = piece->FirstChildElement("Points");
-    assert(points != nullptr);
-
-    int numPoints, numPolys;
-    piece->QueryIntAttribute("NumberOfPoints", &numPoints);
-    piece->QueryIntAttribute("NumberOfPolys", &numPolys);
-
-    //assert(enormals->Attribute("format", "ascii"));
-    const char* normalsStr = enormals->FirstChildElement("DataArray")->FirstChild()->Value();
-    stringstream sNorm(normalsStr);
-    vector<vec3> tempNormals;
-    do {
-        vec3 normal;
-        sNorm >> normal.x >> normal.y >> normal.z;
-        tempNormals.push_back(normal);
-    } while (sNorm.good());
-    assert(tempNormals.size() == numPoints + 1);
-
-    XMLElement* pointData = points->FirstChildElement("DataArray");
-    assert(pointData != nullptr);
-    assert(pointData->Attribute("format", "ascii"));
-    const char* coordsStr = points->FirstChildElement("DataArray")->FirstChild()->Value();
-
-    stringstream sCoord(coordsStr);
-    vector<vec3> coordinates;
-    do {
-        vec3 coord;
-        sCoord >> coord.x >> coord.y >> coord.z;
-        coordinates.push_back(coord);
-    } while (sCoord.good());
-    coordinates.pop_back();  // the last is corrupted
-    assert(coordinates.size() == numPoints);
-
-    XMLElement* polys = piece->FirstChildElement("Polys");
-    assert(polys != nullptr);
-
-    // TODO beter implementation
-    XMLElement *econnectivity, *eoffsets;
-    if (polys->FirstChildElement("DataArray")->Attribute("Name", "connectivity")) {
-        econnectivity = polys->FirstChildElement("DataArray");
-        assert(econnectivity != nullptr);
-        assert(econnectivity->Attribute("format", "ascii"));
-    } else {
-        throw runtime_error("Can't access connectivity");
-    }
-
-    if (polys->LastChildElement("DataArray")->Attribute("Name", "offsets")) {
-        eoffsets = polys->LastChildElement("DataArray");
-        assert(eoffsets != nullptr);
-        assert(eoffsets->Attribute("format", "ascii"));
-    } else {
-        throw runtime_error("Can't access offsets");
-    }
-
-    // read offsets
-    const char* offsetsStr = eoffsets->FirstChild()->Value();
-    stringstream sOffsets(offsetsStr);
-    vector<int> offsets;
-    do {
-        int offset;
-        sOffsets >> offset;
-        offsets.push_back(offset);
-    } while (sOffsets.good());
-    assert(offsets.size() == numPolys + 1);
-
-    // read connectivity
-    const char* connStr = econnectivity->FirstChild()->Value();
-    stringstream sConn(connStr);
-    vector<int> connectivity;
-    do {
-        int conn;
-        sConn >> conn;
-        connectivity.push_back(conn);
-    } while (sConn.good());
-    assert(connectivity.size() == offsets.back() + 1);
-
-    // construct vertices
-    int startPoly = 0;
-    for (int i = 0; i < numPolys; ++i) {
-        vector<int> face = slice(connectivity, startPoly, offsets[i]);
-        int i1 = 0, i2 = 1, i3 = 2;
-        while (i3 != face.size()) {
-            vertices.push_back(coordinates[face[i1]]);
-            normals.push_back(tempNormals[face[i1]]);
-            indices.push_back(indices.size());
-            vertices.push_back(coordinates[face[i2]]);
-            normals.push_back(tempNormals[face[i2]]);
-            indices.push_back(indices.size());
-            vertices.push_back(coordinates[face[i3]]);
-            normals.push_back(tempNormals[face[i3]]);
-            indices.push_back(indices.size());
-            i2++;
-            i3++;
-        }
-        startPoly = offsets[i];
+    VTPData vtp = readVTP(path);
+
+    vertices.reserve(vertices.size() + vtp.triangles.size());
+    if (!vtp.normals.empty()) normals.reserve(normals.size() + vtp.triangles.size());
+    if (!vtp.uvs.empty()) uvs.reserve(uvs.size() + vtp.triangles.size());
+    for (unsigned int index : vtp.triangles) {
+        vertices.push_back(vtp.points[index]);
+        if (!vtp.normals.empty()) normals.push_back(vtp.normals[index]);
+        if (!vtp.uvs.empty()) uvs.push_back(vtp.uvs[index]);
+        indices.push_back(indices.size());
     }
 }
 
@@ -267,26 +176,76 @@ void loadOBJWithTiny(
     // TODO .mtl loader
 }
 
-struct PackedVertex {
-    glm::vec3 position;
-    glm::vec2 uv;
-    glm::vec3 normal;
-    bool operator<(const PackedVertex that) const {
-        return memcmp((void*) this, (void*) &that, sizeof(PackedVertex)) > 0;
-    };
+// De-indexes the corners [first, last) of a parsed .obj file
+static void appendCorners(const OBJData& obj, size_t first, size_t last,
+                          vector<vec3>& vertices, vector<vec2>& uvs, vector<vec3>& normals) {
+    bool hasUVs = obj.texcoords.size() != 0, hasNormals = obj.normals.size() != 0;
+    vertices.reserve(vertices.size() + last - first);
+    if (hasUVs) uvs.reserve(uvs.size() + last - first);
+    if (hasNormals) normals.reserve(normals.size() + last - first);
+    for (size_t c = first; c < last; c++) {
+        const OBJCorner& corner = obj.corners[c];
+        vertices.push_back(obj.positions[corner.position]);
+        if (hasUVs) {
+            vec2 uv;
+            if (corner.texcoord >= 0) {
+                uv = obj.texcoords[corner.texcoord];
+                uv.y = 1 - uv.y;
+            }
+            uvs.push_back(uv);
+        }
+        if (hasNormals) {
+            normals.push_back(corner.normal >= 0 ? obj.normals[corner.normal] : vec3(0.0f));
+        }
+    }
+}
+
+void loadOBJParallel(
+    const string& path,
+    vector<vec3>& vertices,
+    vector<vec2>& uvs,
+    vector<vec3>& normals,
+    vector<unsigned int>& indices) {
+    OBJData obj = parseOBJ(path);
+    size_t first = vertices.size();
+    appendCorners(obj, 0, obj.corners.size(), vertices, uvs, normals);
+    for (size_t i = first; i < vertices.size(); i++) {
+        indices.push_back(indices.size());
+    }
+}
+
+// Everything vertices are welded by, bit exact, with positions replaced by
+// grid cells when welding with an epsilon
+struct WeldKey {
+    unsigned int words[8];
+    bool operator==(const WeldKey& that) const {
+        return memcmp(words, that.words, sizeof(words)) == 0;
+    }
 };
 
-bool getSimilarVertexIndex(
-    PackedVertex& packed,
-    map<PackedVertex, unsigned int>& vertexToOutIndex,
-    unsigned int& result) {
-    map<PackedVertex, unsigned int>::iterator it = vertexToOutIndex.find(packed);
-    if (it == vertexToOutIndex.end()) {
-        return false;
+static WeldKey weldKey(const vec3& position, const vec2& uv, const vec3& normal, float epsilon) {
+    WeldKey key;
+    if (epsilon > 0.0f) {
+        for (int c = 0; c < 3; c++) {
+            double cell = floor(position[c] / (double) epsilon + 0.5);
+            int word = (int) std::max(-2147483648.0, std::min(cell, 2147483647.0));
+            memcpy(&key.words[c], &word, sizeof(int));
+        }
     } else {
-        result = it->second;
-        return true;
+        memcpy(&key.words[0], &position, sizeof(vec3));
+    }
+    memcpy(&key.words[3], &uv, sizeof(vec2));
+    memcpy(&key.words[5], &normal, sizeof(vec3));
+    return key;
+}
+
+static unsigned long long weldHash(const WeldKey& key) {
+    unsigned long long hash = 0x9e3779b97f4a7c15ull;
+    for (unsigned int word : key.words) {
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
     }
+    return hash;
 }
 
 void indexVBO(
@@ -296,105 +255,182 @@ void indexVBO(
     vector<unsigned int>& out_indices,
     vector<vec3>& out_vertices,
     vector<vec2>& out_uvs,
-    vector<vec3>& out_normals) {
-    map<PackedVertex, unsigned int> vertexToOutIndex;
-
-    // For each input vertex
-    for (int i = 0; i < static_cast<int>(in_vertices.size()); i++) {
-        vec3 vertices = in_vertices[i];
-        vec2 uvs;
-        vec3 normals;
-        if (in_uvs.size() != 0) uvs = in_uvs[i];
-        if (in_normals.size() != 0) normals = in_normals[i];
-        PackedVertex packed = {vertices, uvs, normals};
-
-        // Try to find a similar vertex in out_XXXX
-        unsigned int index;
-        bool found = getSimilarVertexIndex(packed, vertexToOutIndex, index);
-
-        if (found) { // A similar vertex is already in the VBO, use it instead !
-            out_indices.push_back(index);
-        } else { // If not, it needs to be added in the output data.
-            out_vertices.push_back(vertices);
-            if (in_uvs.size() != 0) out_uvs.push_back(uvs);
-            if (in_normals.size() != 0) out_normals.push_back(normals);
-            unsigned int newindex = (unsigned int) out_vertices.size() - 1;
-            out_indices.push_back(newindex);
-            vertexToOutIndex[packed] = newindex;
+    vector<vec3>& out_normals,
+    float epsilon) {
+    const size_t count = in_vertices.size();
+    const size_t CHUNK = 1 << 16;
+    const int chunks = (int) ((count + CHUNK - 1) / CHUNK);
+
+    vector<WeldKey> keys(count);
+    vector<unsigned long long> hashes(count);
+    parallelFor(chunks, [&](int chunk) {
+        size_t end = std::min(count, (chunk + 1) * CHUNK);
+        for (size_t i = chunk * CHUNK; i < end; i++) {
+            vec2 uv;
+            vec3 normal;
+            if (in_uvs.size() != 0) uv = in_uvs[i];
+            if (in_normals.size() != 0) normal = in_normals[i];
+            keys[i] = weldKey(in_vertices[i], uv, normal, epsilon);
+            hashes[i] = weldHash(keys[i]);
         }
+    });
+
+    // Equal keys have equal hashes, so the high bits of the hash split the
+    // vertices into shards that are welded independently. Every shard keeps
+    // its vertices in input order.
+    const int shardBits = chunks > 1 ? 6 : 0;
+    const int shards = 1 << shardBits;
+    auto shardOf = [&](size_t i) {
+        return shardBits ? (int) (hashes[i] >> (64 - shardBits)) : 0;
+    };
+    vector<size_t> counts((size_t) chunks * shards, 0);
+    parallelFor(chunks, [&](int chunk) {
+        size_t end = std::min(count, (chunk + 1) * CHUNK);
+        for (size_t i = chunk * CHUNK; i < end; i++) counts[(size_t) chunk * shards + shardOf(i)]++;
+    });
+    vector<size_t> shardStart(shards + 1, 0), offsets((size_t) chunks * shards);
+    size_t total = 0;
+    for (int shard = 0; shard < shards; shard++) {
+        shardStart[shard] = total;
+        for (int chunk = 0; chunk < chunks; chunk++) {
+            offsets[(size_t) chunk * shards + shard] = total;
+            total += counts[(size_t) chunk * shards + shard];
+        }
+    }
+    shardStart[shards] = total;
+    vector<unsigned int> members(count);
+    parallelFor(chunks, [&](int chunk) {
+        size_t end = std::min(count, (chunk + 1) * CHUNK);
+        size_t* next = &offsets[(size_t) chunk * shards];
+        for (size_t i = chunk * CHUNK; i < end; i++) members[next[shardOf(i)]++] = (unsigned int) i;
+    });
+
+    // the first vertex with the same key, in an open addressing table per shard
+    vector<unsigned int> first(count);
+    parallelFor(shards, [&](int shard) {
+        size_t size = 16;
+        while (size < 2 * (shardStart[shard + 1] - shardStart[shard])) size *= 2;
+        vector<unsigned int> table(size, ~0u);
+        for (size_t m = shardStart[shard]; m < shardStart[shard + 1]; m++) {
+            unsigned int i = members[m];
+            size_t slot = hashes[i] & (size - 1);
+            while (true) {
+                unsigned int other = table[slot];
+                if (other == ~0u) {
+                    table[slot] = first[i] = i;
+                    break;
+                }
+                if (keys[other] == keys[i]) {
+                    first[i] = other;
+                    break;
+                }
+                slot = (slot + 1) & (size - 1);
+            }
+        }
+    });
+
+    // output in the order of first use, as a sequential weld would
+    vector<unsigned int> outIndex(count);
+    out_indices.reserve(out_indices.size() + count);
+    for (size_t i = 0; i < count; i++) {
+        if (first[i] == i) {
+            outIndex[i] = (unsigned int) out_vertices.size();
+            out_vertices.push_back(in_vertices[i]);
+            if (in_uvs.size() != 0) out_uvs.push_back(in_uvs[i]);
+            if (in_normals.size() != 0) out_normals.push_back(in_normals[i]);
+        }
+        out_indices.push_back(outIndex[first[i]]);
     }
 }
 
-Drawable::Drawable(string path) {
-    if (path.substr(path.size() - 3, 3) == "obj") {
-        loadOBJWithTiny(path.c_str(), vertices, uvs, normals, VEC_UINT_DEFAUTL_VALUE);
-    } else if (path.substr(path.size() - 3, 3) == "vtp") {
-        loadVTP(path.c_str(), vertices, uvs, normals, VEC_UINT_DEFAUTL_VALUE);
-    } else {
+Drawable::Drawable(string path, bool upload, VertexFormat format, bool keepData, int lodLevels)
+    : keepData{keepData} {
+    string extension = path.substr(path.size() - 3, 3);
+    if (extension != "obj" && extension != "vtp") {
         throw runtime_error("File format not supported: " + path);
     }
 
-    createContext();
+    unsigned long long hash = hashMeshSource(path);
+    string cachePath = meshCachePath(path);
+    vector<CachedMesh> cached;
+    if (!loadMeshCache(cachePath, hash, cached) || cached.size() != 1 ||
+        cached[0].data.format != format || cached[0].data.lodLevels != (unsigned int) std::max(lodLevels, 0)) {
+        vector<vec3> vertices, normals;
+        vector<vec2> uvs;
+        vector<unsigned int> indices;
+        if (extension == "obj") {
+            loadOBJParallel(path, vertices, uvs, normals, indices);
+        } else {
+            loadVTP(path, vertices, uvs, normals, indices);
+        }
+        cached.clear();
+        cached.resize(1);
+        cached[0].data = buildMeshData(vertices, uvs, normals, format, nullptr, lodLevels);
+        writeMeshCache(cachePath, hash, cached);
+    }
+
+    data = std::move(cached[0].data);
+    attributes = data.attributes;
+    this->format = data.format;
+    positionTransform = data.positionTransform();
+    indexCount = data.lods[0].indexCount;
+    lods = data.lods;
+    if (upload) this->upload();
 }
 
 Drawable::Drawable(const vector<vec3>& vertices, const vector<vec2>& uvs,
-                   const vector<vec3>& normals) : vertices(vertices), uvs(uvs), normals(normals) {
-    createContext();
+                   const vector<vec3>& normals, VertexFormat format)
+    : data{buildMeshData(vertices, uvs, normals, format)} {
+    attributes = data.attributes;
+    this->format = data.format;
+    positionTransform = data.positionTransform();
+    indexCount = data.lods[0].indexCount;
+    lods = data.lods;
+    upload();
 }
 
 Drawable::~Drawable() {
-    glDeleteBuffers(1, &verticesVBO);
-    glDeleteBuffers(1, &uvsVBO);
-    glDeleteBuffers(1, &normalsVBO);
-    glDeleteBuffers(1, &elementVBO);
-    glDeleteBuffers(1, &VAO);
+    RenderBackend::get().deleteBuffer(VBO);
+    RenderBackend::get().deleteBuffer(elementVBO);
+    glDeleteVertexArrays(1, &VAO);
 }
 
 void Drawable::bind() {
-    glBindVertexArray(VAO);
+    RenderBackend::get().bindVertexArray(VAO);
 }
 
 void Drawable::draw(int mode) {
-    glDrawElements(mode, indices.size(), GL_UNSIGNED_INT, NULL);
+    RenderBackend::get().drawElements(mode, indexCount, 0);
+}
+
+void Drawable::draw(int mode, int lod) {
+    const MeshLOD& level = lods[lod];
+    RenderBackend::get().drawElements(mode, level.indexCount, level.firstIndex * sizeof(unsigned int));
 }
 
-void Drawable::createContext() {
-    indices = vector<unsigned int>();
-    indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVS, indexedNormals);
+int Drawable::selectLOD(float distance, float pixelScale, float maxPixels) const {
+    return ::selectLOD(lods, distance, pixelScale, maxPixels);
+}
 
+void Drawable::upload() {
+    TRACE_SCOPE("upload", "Drawable::upload");
     glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
 
-    glGenBuffers(1, &verticesVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
-    glBufferData(GL_ARRAY_BUFFER, indexedVertices.size() * sizeof(vec3),
-                 &indexedVertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
-
-    if (indexedNormals.size() != 0) {
-        glGenBuffers(1, &normalsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedNormals.size() * sizeof(vec3),
-                     &indexedNormals[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(1);
-    }
-
-    if (indexedUVS.size() != 0) {
-        glGenBuffers(1, &uvsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, uvsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedUVS.size() * sizeof(vec2),
-                     &indexedUVS[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(2);
-    }
-
-    // Generate a buffer for the indices as well
-    glGenBuffers(1, &elementVBO);
+    RenderBackend& backend = RenderBackend::get();
+    VBO = backend.createBuffer(MemoryTag::Meshes, GL_ARRAY_BUFFER, data.vertexBytes(), data.vertices, GL_STATIC_DRAW);
+    elementVBO = backend.createBuffer(MemoryTag::Meshes, GL_ELEMENT_ARRAY_BUFFER, data.indexBytes(), data.indices, GL_STATIC_DRAW);
+
+    setMeshAttributes(attributes, format);
+
+    // the buffers have their own copy, this also unmaps the cache
+    if (!keepData) data = MeshData();
+}
+
+void Drawable::setupAttributes() {
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-                 &indices[0], GL_STATIC_DRAW);
+    setMeshAttributes(attributes, format);
 }
 
 /*****************************************************************************/
@@ -403,181 +439,345 @@ Mesh::Mesh(
     const vector<vec3>& vertices,
     const vector<vec2>& uvs,
     const vector<vec3>& normals,
-    const Material& mtl)
-    : vertices{vertices}, uvs{uvs}, normals{normals}, mtl{mtl} {
-    createContext();
+    const Material& mtl,
+    bool upload)
+    : Mesh(buildMeshData(vertices, uvs, normals), mtl, upload) {
+}
+
+Mesh::Mesh(MeshData data, const Material& mtl, bool upload)
+    : data{std::move(data)}, mtl{mtl} {
+    attributes = this->data.attributes;
+    format = this->data.format;
+    indexCount = this->data.lods[0].indexCount;
+    lods = this->data.lods;
+    if (upload) this->upload();
 }
 
 Mesh::Mesh(Mesh&& other)
-    : vertices{std::move(other.vertices)}, normals{std::move(other.normals)},
-    indexedVertices{std::move(other.indexedVertices)}, indexedNormals{std::move(other.indexedNormals)},
-    uvs{std::move(other.uvs)}, indexedUVS{std::move(other.indexedUVS)},
-    indices{std::move(other.indices)}, mtl{std::move(other.mtl)},
-    VAO{other.VAO}, verticesVBO{other.verticesVBO}, normalsVBO{other.normalsVBO},
-    uvsVBO{other.uvsVBO}, elementVBO{other.elementVBO} {
+    : data{std::move(other.data)}, attributes{other.attributes}, format{other.format},
+    indexCount{other.indexCount}, lods{std::move(other.lods)}, mtl{std::move(other.mtl)},
+    VAO{other.VAO}, VBO{other.VBO}, elementVBO{other.elementVBO} {
     other.VAO = 0;
-    other.verticesVBO = 0;
-    other.normalsVBO = 0;
-    other.uvsVBO = 0;
+    other.VBO = 0;
     other.elementVBO = 0;
 }
 
 Mesh::~Mesh() {
-    glDeleteBuffers(1, &verticesVBO);
-    glDeleteBuffers(1, &uvsVBO);
-    glDeleteBuffers(1, &normalsVBO);
-    glDeleteBuffers(1, &elementVBO);
+    RenderBackend::get().deleteBuffer(VBO);
+    RenderBackend::get().deleteBuffer(elementVBO);
     glDeleteVertexArrays(1, &VAO);
 }
 
 void Mesh::bind() {
-    glBindVertexArray(VAO);
+    RenderBackend::get().bindVertexArray(VAO);
 }
 
 void Mesh::draw(int mode) {
-    glDrawElements(mode, indices.size(), GL_UNSIGNED_INT, NULL);
+    RenderBackend::get().drawElements(mode, indexCount, 0);
 }
 
-void Mesh::createContext() {
-    indices = vector<unsigned int>();
-    indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVS, indexedNormals);
+void Mesh::draw(int mode, int lod) {
+    const MeshLOD& level = lods[lod];
+    RenderBackend::get().drawElements(mode, level.indexCount, level.firstIndex * sizeof(unsigned int));
+}
 
+void Mesh::upload() {
     glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
 
-    glGenBuffers(1, &verticesVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
-    glBufferData(GL_ARRAY_BUFFER, indexedVertices.size() * sizeof(vec3),
-                 &indexedVertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
-
-    if (indexedNormals.size() != 0) {
-        glGenBuffers(1, &normalsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedNormals.size() * sizeof(vec3),
-                     &indexedNormals[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(1);
-    }
-
-    if (indexedUVS.size() != 0) {
-        glGenBuffers(1, &uvsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, uvsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedUVS.size() * sizeof(vec2),
-                     &indexedUVS[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(2);
-    }
-
-    // Generate a buffer for the indices as well
-    glGenBuffers(1, &elementVBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-                 &indices[0], GL_STATIC_DRAW);
+    RenderBackend& backend = RenderBackend::get();
+    VBO = backend.createBuffer(MemoryTag::Meshes, GL_ARRAY_BUFFER, data.vertexBytes(), data.vertices, GL_STATIC_DRAW);
+    elementVBO = backend.createBuffer(MemoryTag::Meshes, GL_ELEMENT_ARRAY_BUFFER, data.indexBytes(), data.indices, GL_STATIC_DRAW);
+
+    setMeshAttributes(attributes, format);
+    data = MeshData();
 }
 
-Model::Model(string path, Model::MTLUploadFunction* uploader)
-    : uploadFunction{uploader} {
-    if (path.substr(path.size() - 3, 3) == "obj") {
-        loadOBJWithTiny(path.c_str());
-    } else {
+Model::Model(string path, Model::MTLUploadFunction* uploader, bool upload, VertexFormat format,
+             int lodLevels)
+    : uploadFunction{uploader}, format{format}, lodLevels{std::max(lodLevels, 0)} {
+    if (path.substr(path.size() - 3, 3) != "obj") {
         throw runtime_error("File format not supported: " + path);
     }
+
+    // the cache has the indexed meshes with their materials
+    unsigned long long hash = hashMeshSource(path);
+    string cachePath = meshCachePath(path);
+    vector<CachedMesh> cached;
+    if (!loadMeshCache(cachePath, hash, cached) || !cacheMatches(cached)) {
+        cached.clear();
+        loadOBJ(path, cached);
+        writeMeshCache(cachePath, hash, cached);
+    }
+    transform = cached.empty() ? mat4(1.0f) : cached[0].data.positionTransform();
+    for (auto& mesh : cached) {
+        addMesh(mesh);
+    }
+    sortMeshes();
+    if (upload) this->upload();
+}
+
+bool Model::cacheMatches(const vector<CachedMesh>& cached) const {
+    for (const auto& mesh : cached) {
+        if (mesh.data.format != format || mesh.data.lodLevels != (unsigned int) lodLevels) return false;
+    }
+    return true;
+}
+
+// As read by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+void Model::sortMeshes() {
+    // materials with the same textures next to each other, then their meshes
+    vector<size_t> textureSet(materials.size());
+    for (size_t m = 0; m < materials.size(); m++) {
+        textureSet[m] = find(materialTextures.begin(), materialTextures.end(), materialTextures[m]) -
+            materialTextures.begin();
+    }
+    stable_sort(meshes.begin(), meshes.end(), [&](const ModelMesh& a, const ModelMesh& b) {
+        if (textureSet[a.material] != textureSet[b.material]) {
+            return textureSet[a.material] < textureSet[b.material];
+        }
+        return a.material < b.material;
+    });
+
+    batches.clear();
+    for (size_t i = 0; i < meshes.size(); i++) {
+        if (i == 0 || meshes[i].material != meshes[i - 1].material) {
+            batches.push_back({ i, 0 });
+        }
+        batches.back().meshCount++;
+    }
+}
+
+void Model::upload() {
+    TRACE_SCOPE("upload", "Model::upload");
+    for (const auto& image : images) {
+        textures[image.first] = uploadTexture(image.second);
+    }
+    images.clear();
+
+    for (size_t m = 0; m < materials.size(); m++) {
+        Material& mtl = materials[m];
+        mtl.texKa = texture(materialTextures[m].Ka);
+        mtl.texKd = texture(materialTextures[m].Kd);
+        mtl.texKs = texture(materialTextures[m].Ks);
+        mtl.texNs = texture(materialTextures[m].Ns);
+        if (mtl.texKa) mtl.Ka.r = -1.0f;
+        if (mtl.texKd) mtl.Kd.r = -1.0f;
+        if (mtl.texKs) mtl.Ks.r = -1.0f;
+        if (mtl.texNs) mtl.Ns = -1.0f;
+    }
+    if (meshes.empty()) return;
+
+    // one vertex and one element buffer for all meshes, which all have the
+    // model's attributes and format
+    unsigned int attributes = meshes[0].data.attributes;
+    GLsizei stride = meshes[0].data.stride();
+    size_t vertexBytes = 0, indexBytes = 0;
+    for (const ModelMesh& mesh : meshes) {
+        if (mesh.data.attributes != attributes || mesh.data.format != format) {
+            throw runtime_error("Meshes of a model need the same vertex layout");
+        }
+        vertexBytes += mesh.data.vertexBytes();
+        indexBytes += mesh.data.indexBytes();
+    }
+
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    RenderBackend& backend = RenderBackend::get();
+    VBO = backend.createBuffer(MemoryTag::Meshes, GL_ARRAY_BUFFER, vertexBytes, NULL, GL_STATIC_DRAW);
+    elementVBO = backend.createBuffer(MemoryTag::Meshes, GL_ELEMENT_ARRAY_BUFFER, indexBytes, NULL, GL_STATIC_DRAW);
+
+    size_t vertexOffset = 0, indexOffset = 0;
+    for (ModelMesh& mesh : meshes) {
+        bufferSubData(MemoryTag::Meshes, GL_ARRAY_BUFFER, vertexOffset, mesh.data.vertexBytes(), mesh.data.vertices);
+        bufferSubData(MemoryTag::Meshes, GL_ELEMENT_ARRAY_BUFFER, indexOffset, mesh.data.indexBytes(), mesh.data.indices);
+        mesh.baseVertex = (GLint) (vertexOffset / stride);
+        mesh.firstIndex = (GLuint) (indexOffset / sizeof(unsigned int));
+        vertexOffset += mesh.data.vertexBytes();
+        indexOffset += mesh.data.indexBytes();
+        mesh.data = MeshData();
+    }
+    setMeshAttributes(attributes, format);
+
+    multiDrawIndirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+    if (multiDrawIndirect) {
+        glGenBuffers(1, &commandBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        bufferData(MemoryTag::Meshes, commandBuffer, GL_DRAW_INDIRECT_BUFFER,
+                   meshes.size() * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_DRAW);
+    }
+
+    levels.assign(meshes.size(), 0);
+    submittedLevels.clear();
+    counts.resize(meshes.size());
+    offsets.resize(meshes.size());
+    baseVertices.resize(meshes.size());
 }
 
 Model::~Model() {
     for (const auto& t : textures) {
-        glDeleteTextures(1, &t.second);
+        deleteTextures(1, &t.second);
     }
+    RenderBackend::get().deleteBuffer(VBO);
+    RenderBackend::get().deleteBuffer(elementVBO);
+    deleteBuffers(1, &commandBuffer);
+    glDeleteVertexArrays(1, &VAO);
 }
 
 void Model::draw() {
-    for (auto& mesh : meshes) {
-        mesh.bind();
+    std::fill(levels.begin(), levels.end(), 0);
+    submit();
+}
+
+void Model::draw(float distance, float pixelScale, float maxPixels) {
+    for (size_t i = 0; i < meshes.size(); i++) {
+        levels[i] = selectLOD(meshes[i].lods, distance, pixelScale, maxPixels);
+    }
+    submit();
+}
+
+void Model::submit() {
+    if (meshes.empty()) return;
+    RenderBackend::get().bindVertexArray(VAO);
+
+    // the draws only change with the levels
+    if (levels != submittedLevels) {
+        vector<DrawElementsIndirectCommand> commands(meshes.size());
+        for (size_t i = 0; i < meshes.size(); i++) {
+            const ModelMesh& mesh = meshes[i];
+            const MeshLOD& lod = mesh.lods[levels[i]];
+            GLuint firstIndex = mesh.firstIndex + lod.firstIndex;
+            commands[i] = { lod.indexCount, 1, firstIndex, mesh.baseVertex, 0 };
+            counts[i] = lod.indexCount;
+            offsets[i] = (const void*) (firstIndex * sizeof(unsigned int));
+            baseVertices[i] = mesh.baseVertex;
+        }
+        if (multiDrawIndirect) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            bufferSubData(MemoryTag::Meshes, GL_DRAW_INDIRECT_BUFFER, 0,
+                          commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+        }
+        submittedLevels = levels;
+    }
+
+    if (multiDrawIndirect) glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    for (const Batch& batch : batches) {
         if (uploadFunction)
-            uploadFunction(mesh.mtl);
-        mesh.draw();
+            uploadFunction(materials[meshes[batch.firstMesh].material]);
+        if (multiDrawIndirect) {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                        (const void*) (batch.firstMesh * sizeof(DrawElementsIndirectCommand)),
+                                        (GLsizei) batch.meshCount, 0);
+            continue;
+        }
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, &counts[batch.firstMesh], GL_UNSIGNED_INT,
+                                      (const GLvoid* const*) &offsets[batch.firstMesh], (GLsizei) batch.meshCount,
+                                      &baseVertices[batch.firstMesh]);
     }
 }
 
-void Model::loadOBJWithTiny(const std::string& filename) {
-    tinyobj::attrib_t attrib;
-    vector<tinyobj::shape_t> shapes;
-    vector<tinyobj::material_t> materials;
+void Model::loadOBJ(const std::string& filename, vector<CachedMesh>& cached) {
+    OBJData obj = parseOBJ(filename);
 
-    string err;
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename.c_str())) {
-        throw runtime_error(err);
+    // quantized meshes share the model's bounds and so its transform
+    MeshBounds bounds;
+    if (obj.positions.size() != 0) {
+        bounds.min = bounds.max = obj.positions[0];
+        for (const vec3& position : obj.positions) {
+            bounds.min = glm::min(bounds.min, position);
+            bounds.max = glm::max(bounds.max, position);
+        }
     }
 
-    for (const auto& material : materials) {
-        loadTexture(material.ambient_texname);
-        loadTexture(material.diffuse_texname);
-        loadTexture(material.specular_texname);
-        loadTexture(material.specular_highlight_texname);
+    vector<tinyobj::material_t> materials;
+    map<string, int> materialIds;
+    for (const auto& library : obj.materialLibraries) {
+        ifstream stream(library);
+        if (!stream) {
+            cout << "Material file not found: " << library << endl;
+            continue;
+        }
+        string warning;
+        tinyobj::LoadMtl(&materialIds, &materials, &stream, &warning);
     }
 
-    for (const auto& shape : shapes) {
+    // a mesh per group, so that every mesh has a single material
+    for (size_t g = 0; g < obj.groups.size(); g++) {
+        const OBJGroup& group = obj.groups[g];
+        size_t end = g + 1 < obj.groups.size() ? obj.groups[g + 1].firstCorner : obj.corners.size();
+        if (end == group.firstCorner) continue;
+
         vector<vec3> vertices{};
         vector<vec2> uvs{};
         vector<vec3> normals{};
-        for (const auto& index : shape.mesh.indices) {
-            int vertex_index = index.vertex_index;
-            if (vertex_index < 0) vertex_index += attrib.vertices.size() / 3;
-            vec3 vertex = {
-                attrib.vertices[3 * vertex_index + 0],
-                attrib.vertices[3 * vertex_index + 1],
-                attrib.vertices[3 * vertex_index + 2]};
-            if (attrib.texcoords.size() != 0) {
-                int texcoord_index = index.texcoord_index;
-                if (texcoord_index < 0) texcoord_index += attrib.texcoords.size() / 2;
-                vec2 uv = {
-                    attrib.texcoords[2 * texcoord_index + 0],
-                    1 - attrib.texcoords[2 * texcoord_index + 1]};
-                uvs.push_back(uv);
-            }
-            if (attrib.normals.size() != 0) {
-                int normal_index = index.normal_index;
-                if (normal_index < 0) normal_index += attrib.normals.size() / 3;
-                vec3 normal = {
-                    attrib.normals[3 * normal_index + 0],
-                    attrib.normals[3 * normal_index + 1],
-                    attrib.normals[3 * normal_index + 2]};
-                normals.push_back(normal);
-            }
-            vertices.push_back(vertex);
-        }
-        Material mtl{};
-        if (materials.size() > 0 && shape.mesh.material_ids.size() > 0) {
-            int idx = shape.mesh.material_ids[0];
-            if (idx < 0 || idx >= static_cast<int>(materials.size()))
-                idx = static_cast<int>(materials.size()) - 1;
+        appendCorners(obj, group.firstCorner, end, vertices, uvs, normals);
+
+        CachedMesh mesh;
+        if (materials.size() > 0) {
+            auto id = materialIds.find(group.material);
+            int idx = id != materialIds.end() ? id->second : static_cast<int>(materials.size()) - 1;
             tinyobj::material_t mat = materials[idx];
-            mtl = {
-                {mat.ambient[0], mat.ambient[1], mat.ambient[2], 1},
-                {mat.diffuse[0], mat.diffuse[1], mat.diffuse[2], 1},
-                {mat.specular[0], mat.specular[1], mat.specular[2], 1},
-                mat.shininess,
-                textures[mat.ambient_texname],
-                textures[mat.diffuse_texname],
-                textures[mat.specular_texname],
-                textures[mat.specular_highlight_texname]
-            };
-            if (mtl.texKa) mtl.Ka.r = -1.0f;
-            if (mtl.texKd) mtl.Kd.r = -1.0f;
-            if (mtl.texKs) mtl.Ks.r = -1.0f;
-            if (mtl.texNs) mtl.Ns = -1.0f;
+            mesh.Ka = {mat.ambient[0], mat.ambient[1], mat.ambient[2], 1};
+            mesh.Kd = {mat.diffuse[0], mat.diffuse[1], mat.diffuse[2], 1};
+            mesh.Ks = {mat.specular[0], mat.specular[1], mat.specular[2], 1};
+            mesh.Ns = mat.shininess;
+            mesh.textures[0] = mat.ambient_texname;
+            mesh.textures[1] = mat.diffuse_texname;
+            mesh.textures[2] = mat.specular_texname;
+            mesh.textures[3] = mat.specular_highlight_texname;
         }
-        meshes.emplace_back(vertices, uvs, normals, mtl);
+        mesh.data = buildMeshData(vertices, uvs, normals, format, &bounds, lodLevels);
+        cached.push_back(std::move(mesh));
+    }
+}
+
+void Model::addMesh(CachedMesh& mesh) {
+    MaterialTextures names;
+    names.Ka = mesh.textures[0];
+    names.Kd = mesh.textures[1];
+    names.Ks = mesh.textures[2];
+    names.Ns = mesh.textures[3];
+
+    // the texture ids are filled in by upload()
+    Material mtl = { mesh.Ka, mesh.Kd, mesh.Ks, mesh.Ns, 0, 0, 0, 0 };
+    size_t m = 0;
+    while (m < materials.size() && !(materialTextures[m] == names && materials[m].Ka == mtl.Ka &&
+           materials[m].Kd == mtl.Kd && materials[m].Ks == mtl.Ks && materials[m].Ns == mtl.Ns)) {
+        m++;
     }
+    if (m == materials.size()) {
+        loadTexture(names.Ka);
+        loadTexture(names.Kd);
+        loadTexture(names.Ks);
+        loadTexture(names.Ns);
+        materials.push_back(mtl);
+        materialTextures.push_back(names);
+    }
+
+    ModelMesh added;
+    added.lods = mesh.data.lods;
+    added.data = std::move(mesh.data);
+    added.material = (unsigned int) m;
+    meshes.push_back(std::move(added));
 }
 
 void Model::loadTexture(const std::string& filename) {
     if (filename.length() == 0) return;
-    if (textures.find(filename) == end(textures)) {
-        GLuint id = loadSOIL(filename.c_str());
-        if (!id) throw std::runtime_error("Failed to load texture: " + filename);
-        textures[filename] = id;
+    if (images.find(filename) == end(images)) {
+        images[filename] = decodeImage(filename.c_str());
     }
+}
+
+GLuint Model::texture(const std::string& filename) const {
+    auto t = textures.find(filename);
+    return t == end(textures) ? 0 : t->second;
 }
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include <string>
 #include <map>
 #include <glm/glm.hpp>
+#include "texture.h"
+#include "meshcache.h"
 
 static std::vector<unsigned int> VEC_UINT_DEFAUTL_VALUE{};
 static std::vector<glm::vec3> VEC_VEC3_DEFAUTL_VALUE{};
@@ -24,7 +26,7 @@ void loadOBJ(
 );
 
 /**
-* A .vtp loader.
+* A .vtp loader, see readVTP().
 */
 void loadVTP(
     const std::string& path,
@@ -47,9 +49,27 @@ void loadOBJWithTiny(
     std::vector<unsigned int>& indices = VEC_UINT_DEFAUTL_VALUE
 );
 
+/**
+* An .obj loader that parses on all cores, see parseOBJ(). Polygons are
+* triangulated, a missing uv or normal of a face is zero when the file has
+* others.
+*/
+void loadOBJParallel(
+    const std::string& path,
+    std::vector<glm::vec3>& vertices,
+    std::vector<glm::vec2>& uvs,
+    std::vector<glm::vec3>& normals,
+    std::vector<unsigned int>& indices = VEC_UINT_DEFAUTL_VALUE
+);
+
 /**
 * Create VBO indexing.
 * http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-9-vbo-indexing/
+*
+* Vertices are welded through hash tables, in parallel for large meshes, and
+* come out in the order they are first used. With an epsilon > 0, positions
+* snap to a grid of that size, vertices in the same cell with the same uv and
+* normal are welded and keep the first one's attributes.
 */
 void indexVBO(
     const std::vector<glm::vec3>& in_vertices,
@@ -58,34 +78,65 @@ void indexVBO(
     std::vector<unsigned int> & out_indices,
     std::vector<glm::vec3> & out_vertices,
     std::vector<glm::vec2> & out_uvs,
-    std::vector<glm::vec3> & out_normals
+    std::vector<glm::vec3> & out_normals,
+    float epsilon = 0.0f
 );
 
+/**
+* Meshes and models can be loaded without a GL context, e.g. on a worker thread
+* of an AssetPipeline, by passing upload = false to the constructor and calling
+* upload() later on the GL thread.
+*
+* Files are indexed once and cached next to them (see meshcache.h), later loads
+* map the cache and upload it as is.
+*
+* The vertex format is opt-in, with VertexFormat::Quantized the model matrix
+* has to be multiplied by positionTransform. The mesh data is released after
+* upload unless keepData is set.
+*
+* With lodLevels > 0 simplified levels of detail are built once and cached
+* with the mesh, they share its buffers. selectLOD() picks one by how far it
+* deviates on screen.
+*/
 class Drawable {
 public:
-    Drawable(std::string path);
+    Drawable(std::string path, bool upload = true,
+             VertexFormat format = VertexFormat::Float, bool keepData = false,
+             int lodLevels = 0);
 
     Drawable(
         const std::vector<glm::vec3>& vertices,
         const std::vector<glm::vec2>& uvs = VEC_VEC2_DEFAUTL_VALUE,
-        const std::vector<glm::vec3>& normals = VEC_VEC3_DEFAUTL_VALUE);
+        const std::vector<glm::vec3>& normals = VEC_VEC3_DEFAUTL_VALUE,
+        VertexFormat format = VertexFormat::Float);
 
     ~Drawable();
 
+    /* Creates the VAO and buffers and releases the mesh data, needs the GL context */
+    void upload();
+
+    /* Binds the buffers and sets the attributes of the currently bound VAO */
+    void setupAttributes();
+
     void bind();
 
     /* Bind VAO before calling draw */
     void draw(int mode = GL_TRIANGLES);
+    void draw(int mode, int lod);
 
-public:
-    std::vector<glm::vec3> vertices, normals, indexedVertices, indexedNormals;
-    std::vector<glm::vec2> uvs, indexedUVS;
-    std::vector<unsigned int> indices;
-
-    GLuint VAO, verticesVBO, uvsVBO, normalsVBO, elementVBO;
+    /* See ::selectLOD(), the distance is in object space units */
+    int selectLOD(float distance, float pixelScale, float maxPixels = 1.0f) const;
 
-private:
-    void createContext();
+public:
+    MeshData data;
+    unsigned int attributes = 0;
+    VertexFormat format = VertexFormat::Float;
+    glm::mat4 positionTransform;
+    GLsizei indexCount = 0;             // of the full mesh
+    std::vector<MeshLOD> lods;
+    bool keepData = false;
+
+    GLuint VAO = 0, VBO = 0, elementVBO = 0;
 };
 
 /*****************************************************************************/
@@ -107,35 +158,97 @@ namespace ogl {
         Mesh(const std::vector<glm::vec3>& vertices,
              const std::vector<glm::vec2>& uvs,
              const std::vector<glm::vec3>& normals,
-             const Material& mtl);
+             const Material& mtl,
+             bool upload = true);
+        Mesh(MeshData data, const Material& mtl, bool upload = true);
         Mesh(const Mesh&) = delete;
         Mesh(Mesh&& other);
         ~Mesh();
+        void upload();
         void bind();
         void draw(int mode = GL_TRIANGLES);
+        void draw(int mode, int lod);
     public:
-        std::vector<glm::vec3> vertices, normals, indexedVertices, indexedNormals;
-        std::vector<glm::vec2> uvs, indexedUVS;
-        std::vector<unsigned int> indices;
+        MeshData data;
+        unsigned int attributes = 0;
+        VertexFormat format = VertexFormat::Float;
+        GLsizei indexCount = 0;
+        std::vector<MeshLOD> lods;
         Material mtl;
-        GLuint VAO, verticesVBO, uvsVBO, normalsVBO, elementVBO;
-    private:
-        void createContext();
+        GLuint VAO = 0, VBO = 0, elementVBO = 0;
     };
 
+    /**
+    * The meshes of a model share one vertex and one element buffer and are
+    * sorted by material. The shaders take the material colors as uniforms, so
+    * every material is its own draw: its meshes go out in one
+    * glMultiDrawElementsIndirect (GL 4.3), or one glMultiDrawElementsBaseVertex
+    * before that, after uploadFunction has set the material's colors and
+    * textures. Materials with the same textures are drawn one after the other.
+    */
     class Model {
     public:
         using MTLUploadFunction = void(const Material&);
-        Model(std::string path, MTLUploadFunction* uploader = nullptr);
+        Model(std::string path, MTLUploadFunction* uploader = nullptr, bool upload = true,
+              VertexFormat format = VertexFormat::Float, int lodLevels = 0);
         ~Model();
+        /* Creates the textures and the mesh buffers, needs the GL context */
+        void upload();
         void draw();
+        /* Every mesh at its own level of detail, see ::selectLOD() */
+        void draw(float distance, float pixelScale, float maxPixels = 1.0f);
+        /* For the model matrix, all meshes are quantized within the model's bounds */
+        glm::mat4 positionTransform() const { return transform; }
     private:
-        std::vector<Mesh> meshes;
+        // a mesh and where it is in the shared buffers
+        struct ModelMesh {
+            MeshData data;
+            std::vector<MeshLOD> lods;
+            GLuint firstIndex = 0;
+            GLint baseVertex = 0;
+            unsigned int material = 0;
+        };
+        // a run of meshes with the same material
+        struct Batch {
+            size_t firstMesh, meshCount;
+        };
+        // texture files of a material
+        struct MaterialTextures {
+            std::string Ka, Kd, Ks, Ns;
+            bool operator==(const MaterialTextures& other) const {
+                return Ka == other.Ka && Kd == other.Kd && Ks == other.Ks && Ns == other.Ns;
+            }
+        };
+
+        std::vector<ModelMesh> meshes;
+        std::vector<Material> materials;
+        std::vector<MaterialTextures> materialTextures;
+        std::vector<Batch> batches;
         std::map<std::string, GLuint> textures;
         MTLUploadFunction* uploadFunction;
+        VertexFormat format;
+        int lodLevels;
+        glm::mat4 transform;
+        bool multiDrawIndirect = false;
+        GLuint VAO = 0, VBO = 0, elementVBO = 0;
+        GLuint commandBuffer = 0;
+
+        // the draws of the meshes at the submitted levels
+        std::vector<int> levels, submittedLevels;
+        std::vector<GLsizei> counts;
+        std::vector<const void*> offsets;
+        std::vector<GLint> baseVertices;
+
+        // decoded images until upload()
+        std::map<std::string, Image> images;
     private:
-        void loadOBJWithTiny(const std::string& filename);
+        void loadOBJ(const std::string& filename, std::vector<CachedMesh>& cached);
+        bool cacheMatches(const std::vector<CachedMesh>& cached) const;
+        void addMesh(CachedMesh& mesh);
+        void sortMeshes();
+        void submit();
         void loadTexture(const std::string& filename);
+        GLuint texture(const std::string& filename) const;
     };
 }
 
@@ -0,0 +1,1092 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include "backend.h"
+#include "glcalls.h"
+
+using namespace std;
+
+namespace nullgl {
+
+/*
+* The GL of the null backend: the objects the application made and the
+* bindings they are used through, enough to reject what a driver would.
+*/
+struct NullUniform {
+    string name;            // as glGetActiveUniform gives it, arrays with [0]
+    GLenum type;
+    GLint size;
+    GLint location;
+};
+
+struct NullProgram {
+    vector<GLuint> shaders;
+    bool linked = false;
+    vector<NullUniform> uniforms;
+    map<GLint, int> locations;          // first location of every uniform
+};
+
+struct NullBuffer {
+    GLsizeiptr size = 0;
+    vector<unsigned char> mapped;       // storage for glMapBufferRange
+};
+
+static struct NullGL {
+    GLuint nextName = 1;
+    uintptr_t nextSync = 1;
+    map<GLuint, NullBuffer> buffers;
+    map<GLuint, GLuint> vertexArrays;   // and their element buffer
+    set<GLuint> textures, framebuffers, renderbuffers, queries;
+    map<GLuint, string> shaders;        // and their source
+    map<GLuint, NullProgram> programs;
+
+    map<GLenum, GLuint> boundBuffers;   // the element buffer is in the vertex array
+    GLuint vertexArray = 0;
+    GLuint program = 0;
+    GLuint renderbuffer = 0;
+    GLuint unit = 0;
+    map<pair<GLuint, GLenum>, GLuint> boundTextures;
+    GLint viewport[4] = { 0, 0, 0, 0 };
+
+    RenderBackend::Counts frame, last, all;
+    unsigned long long frames = 0;
+} gl;
+
+static void invalid(const string& message) {
+    throw runtime_error("Null backend: " + message);
+}
+
+static string hex(GLenum value) {
+    stringstream text;
+    text << "0x" << std::hex << value;
+    return text.str();
+}
+
+static void called() {
+    gl.frame.calls++;
+}
+
+static GLuint generateName() {
+    return gl.nextName++;
+}
+
+/* Entry points that only change state the null backend doesn't keep */
+template<class Fn> struct Ignore;
+template<class R, class... A> struct Ignore<R (GLAPIENTRY*)(A...)> {
+    static R GLAPIENTRY call(A...) {
+        called();
+        return R();
+    }
+};
+
+template<class Fn> static void ignore(Fn& entry) {
+    entry = Ignore<Fn>::call;
+}
+
+// Buffers
+
+static GLuint& bufferBinding(GLenum target) {
+    if (target == GL_ELEMENT_ARRAY_BUFFER) return gl.vertexArrays[gl.vertexArray];
+    return gl.boundBuffers[target];
+}
+
+static NullBuffer& boundBuffer(const char* call, GLenum target) {
+    GLuint buffer = bufferBinding(target);
+    if (!buffer) invalid(string(call) + " without a buffer bound to " + hex(target));
+    return gl.buffers[buffer];
+}
+
+static void checkRange(const char* call, const NullBuffer& buffer, size_t offset, size_t size) {
+    if (offset + size > (size_t) buffer.size) {
+        invalid(string(call) + " of " + to_string(size) + " bytes at " + to_string(offset) +
+                " past the end of a buffer of " + to_string(buffer.size));
+    }
+}
+
+static void GLAPIENTRY genBuffers(GLsizei count, GLuint* names) {
+    called();
+    for (GLsizei i = 0; i < count; i++) {
+        names[i] = generateName();
+        gl.buffers[names[i]];
+    }
+}
+
+static void GLAPIENTRY deleteBuffers(GLsizei count, const GLuint* names) {
+    called();
+    for (GLsizei i = 0; i < count; i++) {
+        // unknown names are ignored, bindings to the buffer are reset
+        if (!gl.buffers.erase(names[i])) continue;
+        for (auto& binding : gl.boundBuffers) {
+            if (binding.second == names[i]) binding.second = 0;
+        }
+        for (auto& vertexArray : gl.vertexArrays) {
+            if (vertexArray.second == names[i]) vertexArray.second = 0;
+        }
+    }
+}
+
+static void GLAPIENTRY bindBuffer(GLenum target, GLuint buffer) {
+    called();
+    if (buffer && !gl.buffers.count(buffer)) invalid("glBindBuffer of unknown buffer " + to_string(buffer));
+    bufferBinding(target) = buffer;
+}
+
+static void GLAPIENTRY bindBufferBase(GLenum target, GLuint /*index*/, GLuint buffer) {
+    bindBuffer(target, buffer);
+}
+
+static void GLAPIENTRY bufferData(GLenum target, GLsizeiptr size, const void* data, GLenum /*usage*/) {
+    called();
+    NullBuffer& buffer = boundBuffer("glBufferData", target);
+    buffer.size = size;
+    buffer.mapped.clear();
+    if (data) gl.frame.bytes += size;
+}
+
+static void GLAPIENTRY bufferStorage(GLenum target, GLsizeiptr size, const void* data, GLbitfield /*flags*/) {
+    bufferData(target, size, data, GL_STATIC_DRAW);
+}
+
+static void GLAPIENTRY bufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* /*data*/) {
+    called();
+    checkRange("glBufferSubData", boundBuffer("glBufferSubData", target), offset, size);
+    gl.frame.bytes += size;
+}
+
+static void* GLAPIENTRY mapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield /*access*/) {
+    called();
+    NullBuffer& buffer = boundBuffer("glMapBufferRange", target);
+    checkRange("glMapBufferRange", buffer, offset, length);
+    buffer.mapped.resize(buffer.size);
+    return buffer.mapped.data() + offset;
+}
+
+static GLboolean GLAPIENTRY unmapBuffer(GLenum target) {
+    called();
+    boundBuffer("glUnmapBuffer", target);
+    return GL_TRUE;
+}
+
+// Vertex arrays
+
+static void GLAPIENTRY genVertexArrays(GLsizei count, GLuint* names) {
+    called();
+    for (GLsizei i = 0; i < count; i++) {
+        names[i] = generateName();
+        gl.vertexArrays[names[i]] = 0;
+    }
+}
+
+static void GLAPIENTRY deleteVertexArrays(GLsizei count, const GLuint* names) {
+    called();
+    for (GLsizei i = 0; i < count; i++) {
+        if (names[i] && gl.vertexArrays.erase(names[i]) && gl.vertexArray == names[i]) gl.vertexArray = 0;
+    }
+}
+
+static void GLAPIENTRY bindVertexArray(GLuint vertexArray) {
+    called();
+    if (vertexArray && !gl.vertexArrays.count(vertexArray)) {
+        invalid("glBindVertexArray of unknown vertex array " + to_string(vertexArray));
+    }
+    gl.vertexArray = vertexArray;
+}
+
+static void checkVertexArray(const char* call) {
+    if (!gl.vertexArray) invalid(string(call) + " without a vertex array");
+}
+
+static void GLAPIENTRY vertexAttribPointer(GLuint /*index*/, GLint /*size*/, GLenum /*type*/, GLboolean /*normalized*/,
+                                           GLsizei /*stride*/, const void* /*pointer*/) {
+    called();
+    checkVertexArray("glVertexAttribPointer");
+    if (!gl.boundBuffers[GL_ARRAY_BUFFER]) invalid("glVertexAttribPointer without a buffer bound to GL_ARRAY_BUFFER");
+}
+
+static void GLAPIENTRY vertexAttribIPointer(GLuint index, GLint size, GLenum type, GLsizei stride, const void* pointer) {
+    vertexAttribPointer(index, size, type, GL_FALSE, stride, pointer);
+}
+
+static void GLAPIENTRY enableVertexAttribArray(GLuint /*index*/) {
+    called();
+    checkVertexArray("glEnableVertexAttribArray");
+}
+
+static void GLAPIENTRY vertexAttribDivisor(GLuint /*index*/, GLuint /*divisor*/) {
+    called();
+    checkVertexArray("glVertexAttribDivisor");
+}
+
+// Draws
+
+static size_t indexBytes(GLenum type) {
+    return type == GL_UNSIGNED_BYTE ? 1 : type == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+static void checkDraw(const char* call) {
+    checkVertexArray(call);
+    if (!gl.program) invalid(string(call) + " without a program");
+    if (!gl.vertexArrays[gl.vertexArray]) invalid(string(call) + " without an element buffer");
+}
+
+static void checkIndices(const char* call, GLsizei count, GLenum type, const void* offset) {
+    checkRange(call, gl.buffers[gl.vertexArrays[gl.vertexArray]], (size_t) offset, count * indexBytes(type));
+}
+
+static void GLAPIENTRY drawElements(GLenum /*mode*/, GLsizei count, GLenum type, const void* offset) {
+    called();
+    checkDraw("glDrawElements");
+    checkIndices("glDrawElements", count, type, offset);
+    gl.frame.draws++;
+    gl.frame.instances++;
+}
+
+static void GLAPIENTRY drawElementsInstanced(GLenum /*mode*/, GLsizei count, GLenum type, const void* offset,
+                                             GLsizei instances) {
+    called();
+    checkDraw("glDrawElementsInstanced");
+    checkIndices("glDrawElementsInstanced", count, type, offset);
+    gl.frame.draws++;
+    gl.frame.instances += instances;
+}
+
+static void GLAPIENTRY multiDrawElementsBaseVertex(GLenum /*mode*/, const GLsizei* counts, GLenum type,
+                                                   const void* const* offsets, GLsizei drawCount,
+                                                   const GLint* /*baseVertices*/) {
+    called();
+    checkDraw("glMultiDrawElementsBaseVertex");
+    for (GLsizei i = 0; i < drawCount; i++) {
+        checkIndices("glMultiDrawElementsBaseVertex", counts[i], type, offsets[i]);
+    }
+    gl.frame.draws += drawCount;
+    gl.frame.instances += drawCount;
+}
+
+static void GLAPIENTRY multiDrawElementsIndirect(GLenum /*mode*/, GLenum /*type*/, const void* offset,
+                                                 GLsizei drawCount, GLsizei stride) {
+    called();
+    checkDraw("glMultiDrawElementsIndirect");
+    size_t commandBytes = 5 * sizeof(GLuint);
+    size_t bytes = drawCount ? (drawCount - 1) * (stride ? stride : commandBytes) + commandBytes : 0;
+    checkRange("glMultiDrawElementsIndirect", boundBuffer("glMultiDrawElementsIndirect", GL_DRAW_INDIRECT_BUFFER),
+               (size_t) offset, bytes);
+    gl.frame.draws += drawCount;
+    gl.frame.instances += drawCount;
+}
+
+// Textures
+
+static GLenum textureBinding(GLenum target) {
+    if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z) {
+        return GL_TEXTURE_CUBE_MAP;
+    }
+    return target;
+}
+
+static void checkTexture(const char* call, GLenum target) {
+    if (!gl.boundTextures[make_pair(gl.unit, textureBinding(target))]) {
+        invalid(string(call) + " without a texture bound to " + hex(target));
+    }
+}
+
+static size_t pixelBytes(GLenum format, GLenum type) {
+    size_t components = 4;
+    switch (format) {
+        case GL_RED: case GL_DEPTH_COMPONENT: components = 1; break;
+        case GL_RG: components = 2; break;
+        case GL_RGB: case GL_BGR: components = 3; break;
+    }
+    switch (type) {
+        case GL_FLOAT: case GL_INT: case GL_UNSIGNED_INT: return components * 4;
+        case GL_HALF_FLOAT: case GL_SHORT: case GL_UNSIGNED_SHORT: return components * 2;
+        default: return components;
+    }
+}
+
+// Client memory counts as uploaded, pixels in an unpack buffer were counted when they got there
+static void countPixels(const void* pixels, size_t bytes) {
+    if (pixels && !gl.boundBuffers[GL_PIXEL_UNPACK_BUFFER]) gl.frame.bytes += bytes;
+}
+
+static void GLAPIENTRY genTextures(GLsizei count, GLuint* names) {
+    called();
+    for (GLsizei i = 0; i < count; i++) {
+        names[i] = generateName();
+        gl.textures.insert(names[i]);
+    }
+}
+
+static void GLAPIENTRY deleteTextures(GLsizei count, const GLuint* names) {
+    called();
+    for (GLsizei i = 0; i < count; i++) {
+        if (!gl.textures.erase(names[i])) continue;
+        for (auto& binding : gl.boundTextures) {
+            if (binding.second == names[i]) binding.second = 0;
+        }
+    }
+}
+
+static void GLAPIENTRY bindTexture(GLenum target, GLuint texture) {
+    called();
+    if (texture && !gl.textures.count(texture)) invalid("glBindTexture of unknown texture " + to_string(texture));
+    gl.boundTextures[make_pair(gl.unit, target)] = texture;
+}
+
+static void GLAPIENTRY activeTexture(GLenum unit) {
+    called();
+    if (unit < GL_TEXTURE0 || unit >= GL_TEXTURE0 + 80) invalid("glActiveTexture of " + hex(unit));
+    gl.unit = unit - GL_TEXTURE0;
+}
+
+static void GLAPIENTRY texImage2D(GLenum target, GLint /*level*/, GLint /*internalFormat*/, GLsizei width,
+                                  GLsizei height, GLint /*border*/, GLenum format, GLenum type, const void* pixels) {
+    called();
+    checkTexture("glTexImage2D", target);
+    countPixels(pixels, (size_t) width * height * pixelBytes(format, type));
+}
+
+static void GLAPIENTRY texSubImage2D(GLenum target, GLint /*level*/, GLint /*x*/, GLint /*y*/, GLsizei width,
+                                     GLsizei height, GLenum format, GLenum type, const void* pixels) {
+    called();
+    checkTexture("glTexSubImage2D", target);
+    countPixels(pixels, (size_t) width * height * pixelBytes(format, type));
+}
+
+static void GLAPIENTRY texImage3D(GLenum target, GLint /*level*/, GLint /*internalFormat*/, GLsizei width,
+                                  GLsizei height, GLsizei depth, GLint /*border*/, GLenum format, GLenum type,
+                                  const void* pixels) {
+    called();
+    checkTexture("glTexImage3D", target);
+    countPixels(pixels, (size_t) width * height * depth * pixelBytes(format, type));
+}
+
+static void GLAPIENTRY compressedTexImage2D(GLenum target, GLint /*level*/, GLenum /*internalFormat*/,
+                                            GLsizei /*width*/, GLsizei /*height*/, GLint /*border*/, GLsizei imageSize,
+                                            const void* data) {
+    called();
+    checkTexture("glCompressedTexImage2D", target);
+    countPixels(data, imageSize);
+}
+
+static void GLAPIENTRY texParameteri(GLenum target, GLenum /*name*/, GLint /*value*/) {
+    called();
+    checkTexture("glTexParameteri", target);
+}
+
+static void GLAPIENTRY texParameterfv(GLenum target, GLenum /*name*/, const GLfloat* /*values*/) {
+    called();
+    checkTexture("glTexParameterfv", target);
+}
+
+static void GLAPIENTRY generateMipmap(GLenum target) {
+    called();
+    checkTexture("glGenerateMipmap", target);
+}
+
+// Framebuffers
+
+static void GLAPIENTRY genFramebuffers(GLsizei count, GLuint* names) {
+    called();
+    for (GLsizei i = 0; i < count; i++) {
+        names[i] = generateName();
+        gl.framebuffers.insert(names[i]);
+    }
+}
+
+static void GLAPIENTRY deleteFramebuffers(GLsizei count, const GLuint* names) {
+    called();
+    for (GLsizei i = 0; i < count; i++) gl.framebuffers.erase(names[i]);
+}
+
+static void GLAPIENTRY bindFramebuffer(GLenum /*target*/, GLuint framebuffer) {
+    called();
+    if (framebuffer && !gl.framebuffers.count(framebuffer)) {
+        invalid("glBindFramebuffer of unknown framebuffer " + to_string(framebuffer));
+    }
+}
+
+static GLenum GLAPIENTRY checkFramebufferStatus(GLenum /*target*/) {
+    called();
+    return GL_FRAMEBUFFER_COMPLETE;
+}
+
+static void GLAPIENTRY genRenderbuffers(GLsizei count, GLuint* names) {
+    called();
+    for (GLsizei i = 0; i < count; i++) {
+        names[i] = generateName();
+        gl.renderbuffers.insert(names[i]);
+    }
+}
+
+static void GLAPIENTRY deleteRenderbuffers(GLsizei count, const GLuint* names) {
+    called();
+    for (GLsizei i = 0; i < count; i++) {
+        if (gl.renderbuffers.erase(names[i]) && gl.renderbuffer == names[i]) gl.renderbuffer = 0;
+    }
+}
+
+static void GLAPIENTRY bindRenderbuffer(GLenum /*target*/, GLuint renderbuffer) {
+    called();
+    if (renderbuffer && !gl.renderbuffers.count(renderbuffer)) {
+        invalid("glBindRenderbuffer of unknown renderbuffer " + to_string(renderbuffer));
+    }
+    gl.renderbuffer = renderbuffer;
+}
+
+static void GLAPIENTRY renderbufferStorage(GLenum /*target*/, GLenum /*internalFormat*/, GLsizei /*width*/,
+                                           GLsizei /*height*/) {
+    called();
+    if (!gl.renderbuffer) invalid("glRenderbufferStorage without a renderbuffer");
+}
+
+static void GLAPIENTRY framebufferRenderbuffer(GLenum /*target*/, GLenum /*attachment*/, GLenum /*renderbufferTarget*/,
+                                               GLuint renderbuffer) {
+    called();
+    if (renderbuffer && !gl.renderbuffers.count(renderbuffer)) {
+        invalid("glFramebufferRenderbuffer of unknown renderbuffer " + to_string(renderbuffer));
+    }
+}
+
+static void GLAPIENTRY framebufferTextureLayer(GLenum /*target*/, GLenum /*attachment*/, GLuint texture,
+                                               GLint /*level*/, GLint /*layer*/) {
+    called();
+    if (texture && !gl.textures.count(texture)) {
+        invalid("glFramebufferTextureLayer of unknown texture " + to_string(texture));
+    }
+}
+
+// Shaders and programs. The uniforms are read from the source, the
+// preprocessor is only followed as far as #define of array sizes.
+
+struct GLSLType {
+    GLenum type;
+    string structName;      // for members and uniforms of a struct type
+};
+
+struct GLSLVariable {
+    string name;
+    GLSLType type;
+    int arraySize;          // 0 for none
+};
+
+struct GLSLSource {
+    vector<string> tokens;
+    map<string, string> defines;                    // the first definition of each
+    map<string, vector<GLSLVariable>> structs;
+};
+
+static GLSLSource tokenize(const string& source) {
+    GLSLSource result;
+    size_t i = 0, n = source.size();
+    while (i < n) {
+        char c = source[i];
+        if (c == '/' && i + 1 < n && source[i + 1] == '/') {
+            i = source.find('\n', i);
+            if (i == string::npos) break;
+        } else if (c == '/' && i + 1 < n && source[i + 1] == '*') {
+            i = source.find("*/", i + 2);
+            if (i == string::npos) break;
+            i += 2;
+        } else if (c == '#') {
+            size_t end = source.find('\n', i);
+            if (end == string::npos) end = n;
+            stringstream line(source.substr(i + 1, end - i - 1));
+            string directive, name, value;
+            line >> directive >> name >> value;
+            if (directive == "define" && !result.defines.count(name)) result.defines[name] = value;
+            i = end;
+        } else if (isalnum((unsigned char) c) || c == '_') {
+            size_t start = i;
+            while (i < n && (isalnum((unsigned char) source[i]) || source[i] == '_' || source[i] == '.')) i++;
+            result.tokens.push_back(source.substr(start, i - start));
+        } else {
+            if (!isspace((unsigned char) c)) result.tokens.push_back(string(1, c));
+            i++;
+        }
+    }
+    return result;
+}
+
+static GLenum glslType(const string& name) {
+    static const map<string, GLenum> types = {
+        { "float", GL_FLOAT }, { "vec2", GL_FLOAT_VEC2 }, { "vec3", GL_FLOAT_VEC3 }, { "vec4", GL_FLOAT_VEC4 },
+        { "mat3", GL_FLOAT_MAT3 }, { "mat4", GL_FLOAT_MAT4 }, { "int", GL_INT }, { "ivec2", GL_INT_VEC2 },
+        { "ivec3", GL_INT_VEC3 }, { "ivec4", GL_INT_VEC4 }, { "uint", GL_UNSIGNED_INT }, { "bool", GL_BOOL },
+        { "sampler2D", GL_SAMPLER_2D }, { "sampler2DArray", GL_SAMPLER_2D_ARRAY },
+        { "sampler2DArrayShadow", GL_SAMPLER_2D_ARRAY_SHADOW }, { "sampler2DShadow", GL_SAMPLER_2D_SHADOW },
+        { "samplerCube", GL_SAMPLER_CUBE }, { "sampler3D", GL_SAMPLER_3D }
+    };
+    auto found = types.find(name);
+    return found == types.end() ? GL_NONE : found->second;
+}
+
+static int arraySize(const GLSLSource& source, string value) {
+    // a define may name another one
+    for (int depth = 0; depth < 4 && source.defines.count(value); depth++) value = source.defines.at(value);
+    int size = atoi(value.c_str());
+    return size > 0 ? size : 1;
+}
+
+// An optional [size] at tokens[i], moves past it
+static int readArraySize(const GLSLSource& source, size_t& i) {
+    const vector<string>& tokens = source.tokens;
+    if (i + 2 >= tokens.size() || tokens[i] != "[") return 0;
+    int size = arraySize(source, tokens[i + 1]);
+    i += 3;
+    return size;
+}
+
+static bool isQualifier(const string& token) {
+    return token == "lowp" || token == "mediump" || token == "highp" || token == "flat" || token == "const";
+}
+
+// "type name[size], name2;" or "type[size] name;" at tokens[i], up to the ';'
+static vector<GLSLVariable> readDeclaration(GLSLSource& source, size_t& i) {
+    const vector<string>& tokens = source.tokens;
+    vector<GLSLVariable> variables;
+    while (i < tokens.size() && isQualifier(tokens[i])) i++;
+    if (i >= tokens.size()) return variables;
+    GLSLType type;
+    type.type = glslType(tokens[i]);
+    if (source.structs.count(tokens[i])) type.structName = tokens[i];
+    i++;
+    int typeArraySize = readArraySize(source, i);
+    while (i < tokens.size() && tokens[i] != ";") {
+        if (tokens[i] == ",") {
+            i++;
+            continue;
+        }
+        GLSLVariable variable;
+        variable.name = tokens[i++];
+        variable.type = type;
+        variable.arraySize = typeArraySize;
+        int size = readArraySize(source, i);
+        if (size) variable.arraySize = size;
+        if (type.type != GL_NONE || !type.structName.empty()) variables.push_back(variable);
+    }
+    i++;
+    return variables;
+}
+
+static void addUniform(NullProgram& program, const GLSLSource& source, const string& name,
+                       const GLSLType& type, int size, GLint& nextLocation) {
+    if (!type.structName.empty()) {
+        // every element of every member is an active uniform of its own
+        for (int element = 0; element < max(size, 1); element++) {
+            string prefix = size ? name + "[" + to_string(element) + "]" : name;
+            for (const GLSLVariable& member : source.structs.at(type.structName)) {
+                addUniform(program, source, prefix + "." + member.name, member.type, member.arraySize, nextLocation);
+            }
+        }
+        return;
+    }
+    NullUniform uniform;
+    uniform.name = size ? name + "[0]" : name;
+    for (const NullUniform& existing : program.uniforms) {
+        if (existing.name == uniform.name) return;      // declared in another stage
+    }
+    uniform.type = type.type;
+    uniform.size = max(size, 1);
+    uniform.location = nextLocation;
+    nextLocation += uniform.size;
+    program.locations[uniform.location] = (int) program.uniforms.size();
+    program.uniforms.push_back(uniform);
+}
+
+static void reflectUniforms(NullProgram& program) {
+    GLint nextLocation = 0;
+    for (GLuint shader : program.shaders) {
+        GLSLSource source = tokenize(gl.shaders[shader]);
+        const vector<string>& tokens = source.tokens;
+        for (size_t i = 0; i < tokens.size(); i++) {
+            if (tokens[i] == "struct" && i + 2 < tokens.size() && tokens[i + 2] == "{") {
+                string name = tokens[i + 1];
+                vector<GLSLVariable> members;
+                i += 3;
+                while (i < tokens.size() && tokens[i] != "}") {
+                    vector<GLSLVariable> declared = readDeclaration(source, i);
+                    members.insert(members.end(), declared.begin(), declared.end());
+                }
+                source.structs[name] = members;
+            } else if (tokens[i] == "uniform") {
+                i++;
+                if (i + 1 < tokens.size() && tokens[i + 1] == "{") {
+                    // uniform blocks are not reflected
+                    while (i < tokens.size() && tokens[i] != "}") i++;
+                    continue;
+                }
+                for (const GLSLVariable& variable : readDeclaration(source, i)) {
+                    addUniform(program, source, variable.name, variable.type, variable.arraySize, nextLocation);
+                }
+                i--;
+            }
+        }
+    }
+}
+
+static GLuint GLAPIENTRY createShader(GLenum /*type*/) {
+    called();
+    GLuint shader = generateName();
+    gl.shaders[shader] = "";
+    return shader;
+}
+
+static void GLAPIENTRY shaderSource(GLuint shader, GLsizei count, const GLchar* const* strings, const GLint* lengths) {
+    called();
+    if (!gl.shaders.count(shader)) invalid("glShaderSource of unknown shader " + to_string(shader));
+    string& source = gl.shaders[shader];
+    source.clear();
+    for (GLsizei i = 0; i < count; i++) {
+        source += lengths && lengths[i] >= 0 ? string(strings[i], lengths[i]) : string(strings[i]);
+    }
+}
+
+static void GLAPIENTRY compileShader(GLuint shader) {
+    called();
+    if (!gl.shaders.count(shader)) invalid("glCompileShader of unknown shader " + to_string(shader));
+}
+
+static void GLAPIENTRY deleteShader(GLuint shader) {
+    called();
+    gl.shaders.erase(shader);
+}
+
+static void GLAPIENTRY getShaderiv(GLuint /*shader*/, GLenum name, GLint* value) {
+    called();
+    *value = name == GL_COMPILE_STATUS ? GL_TRUE : 0;
+}
+
+static void GLAPIENTRY getInfoLog(GLuint /*object*/, GLsizei size, GLsizei* length, GLchar* log) {
+    called();
+    if (length) *length = 0;
+    if (size > 0) log[0] = 0;
+}
+
+static GLuint GLAPIENTRY createProgram() {
+    called();
+    GLuint program = generateName();
+    gl.programs[program];
+    return program;
+}
+
+static NullProgram& findProgram(const char* call, GLuint program) {
+    auto found = gl.programs.find(program);
+    if (found == gl.programs.end()) invalid(string(call) + " of unknown program " + to_string(program));
+    return found->second;
+}
+
+static void GLAPIENTRY attachShader(GLuint program, GLuint shader) {
+    called();
+    if (!gl.shaders.count(shader)) invalid("glAttachShader of unknown shader " + to_string(shader));
+    findProgram("glAttachShader", program).shaders.push_back(shader);
+}
+
+static void GLAPIENTRY detachShader(GLuint program, GLuint shader) {
+    called();
+    vector<GLuint>& shaders = findProgram("glDetachShader", program).shaders;
+    for (size_t i = 0; i < shaders.size(); i++) {
+        if (shaders[i] == shader) {
+            shaders.erase(shaders.begin() + i);
+            break;
+        }
+    }
+}
+
+static void GLAPIENTRY linkProgram(GLuint program) {
+    called();
+    NullProgram& linked = findProgram("glLinkProgram", program);
+    if (linked.shaders.empty()) invalid("glLinkProgram of a program without shaders");
+    linked.uniforms.clear();
+    linked.locations.clear();
+    reflectUniforms(linked);
+    linked.linked = true;
+}
+
+static void GLAPIENTRY deleteProgram(GLuint program) {
+    called();
+    // the program in use stays until another one is
+    if (program != gl.program) gl.programs.erase(program);
+}
+
+static void GLAPIENTRY useProgram(GLuint program) {
+    called();
+    if (program && !findProgram("glUseProgram", program).linked) invalid("glUseProgram of a program not linked");
+    gl.program = program;
+}
+
+static void GLAPIENTRY getProgramiv(GLuint program, GLenum name, GLint* value) {
+    called();
+    const NullProgram& found = findProgram("glGetProgramiv", program);
+    *value = 0;
+    if (name == GL_LINK_STATUS || name == GL_VALIDATE_STATUS || name == GL_COMPLETION_STATUS_ARB) {
+        *value = found.linked;
+    } else if (name == GL_ACTIVE_UNIFORMS) {
+        *value = (GLint) found.uniforms.size();
+    } else if (name == GL_ACTIVE_UNIFORM_MAX_LENGTH) {
+        for (const NullUniform& uniform : found.uniforms) *value = max(*value, (GLint) uniform.name.size() + 1);
+    } else if (name == GL_ATTACHED_SHADERS) {
+        *value = (GLint) found.shaders.size();
+    }
+}
+
+static void GLAPIENTRY getActiveUniform(GLuint program, GLuint index, GLsizei maxLength, GLsizei* length,
+                                        GLint* size, GLenum* type, GLchar* name) {
+    called();
+    const NullProgram& found = findProgram("glGetActiveUniform", program);
+    if (index >= found.uniforms.size()) invalid("glGetActiveUniform of uniform " + to_string(index));
+    const NullUniform& uniform = found.uniforms[index];
+    GLsizei copied = min((GLsizei) uniform.name.size(), maxLength - 1);
+    memcpy(name, uniform.name.c_str(), copied);
+    name[copied] = 0;
+    if (length) *length = copied;
+    *size = uniform.size;
+    *type = uniform.type;
+}
+
+static GLint GLAPIENTRY getUniformLocation(GLuint program, const GLchar* name) {
+    called();
+    const NullProgram& found = findProgram("glGetUniformLocation", program);
+    if (!found.linked) invalid("glGetUniformLocation of a program not linked");
+    string wanted = name;
+    int element = 0;
+    // name[i] of an array, name alone is its first element
+    size_t bracket = wanted.rfind('[');
+    if (!wanted.empty() && wanted.back() == ']' && bracket != string::npos) {
+        element = atoi(wanted.c_str() + bracket + 1);
+        wanted = wanted.substr(0, bracket);
+    }
+    for (const NullUniform& uniform : found.uniforms) {
+        if (uniform.name == wanted && element == 0) return uniform.location;
+        if (uniform.name == wanted + "[0]" && element < uniform.size) return uniform.location + element;
+    }
+    return -1;
+}
+
+static GLint GLAPIENTRY getAttribLocation(GLuint program, const GLchar* /*name*/) {
+    called();
+    findProgram("glGetAttribLocation", program);
+    return -1;
+}
+
+// The uniform a glUniform* call writes count values of, it must have a type the call can set
+static void checkUniform(const char* call, GLint location, GLsizei count, std::initializer_list<GLenum> types) {
+    if (!gl.program) invalid(string(call) + " without a program");
+    if (location == -1) return;
+    const NullProgram& program = gl.programs[gl.program];
+    auto found = program.locations.upper_bound(location);
+    if (found == program.locations.begin()) invalid(string(call) + " of unknown location " + to_string(location));
+    const NullUniform& uniform = program.uniforms[(--found)->second];
+    if (location + count > uniform.location + uniform.size) {
+        invalid(string(call) + " of " + to_string(count) + " values past the end of " + uniform.name);
+    }
+    for (GLenum type : types) {
+        if (uniform.type == type) return;
+    }
+    // any int setter sets samplers and bools
+    if (*types.begin() == GL_INT && (uniform.type == GL_BOOL || (uniform.type >= GL_SAMPLER_1D &&
+        uniform.type <= GL_SAMPLER_2D_SHADOW) || uniform.type == GL_SAMPLER_2D_ARRAY ||
+        uniform.type == GL_SAMPLER_2D_ARRAY_SHADOW)) return;
+    invalid(string(call) + " of " + uniform.name + ", which has another type");
+}
+
+static void GLAPIENTRY uniform1i(GLint location, GLint /*value*/) {
+    called();
+    checkUniform("glUniform1i", location, 1, { GL_INT });
+    gl.frame.bytes += sizeof(GLint);
+}
+
+static void GLAPIENTRY uniform1f(GLint location, GLfloat /*value*/) {
+    called();
+    checkUniform("glUniform1f", location, 1, { GL_FLOAT, GL_BOOL });
+    gl.frame.bytes += sizeof(GLfloat);
+}
+
+static void GLAPIENTRY uniform1fv(GLint location, GLsizei count, const GLfloat* /*values*/) {
+    called();
+    checkUniform("glUniform1fv", location, count, { GL_FLOAT });
+    gl.frame.bytes += count * sizeof(GLfloat);
+}
+
+static void GLAPIENTRY uniform2fv(GLint location, GLsizei count, const GLfloat* /*values*/) {
+    called();
+    checkUniform("glUniform2fv", location, count, { GL_FLOAT_VEC2 });
+    gl.frame.bytes += count * 2 * sizeof(GLfloat);
+}
+
+static void GLAPIENTRY uniform3fv(GLint location, GLsizei count, const GLfloat* /*values*/) {
+    called();
+    checkUniform("glUniform3fv", location, count, { GL_FLOAT_VEC3 });
+    gl.frame.bytes += count * 3 * sizeof(GLfloat);
+}
+
+static void GLAPIENTRY uniform4fv(GLint location, GLsizei count, const GLfloat* /*values*/) {
+    called();
+    checkUniform("glUniform4fv", location, count, { GL_FLOAT_VEC4 });
+    gl.frame.bytes += count * 4 * sizeof(GLfloat);
+}
+
+static void GLAPIENTRY uniformMatrix4fv(GLint location, GLsizei count, GLboolean /*transpose*/,
+                                        const GLfloat* /*values*/) {
+    called();
+    checkUniform("glUniformMatrix4fv", location, count, { GL_FLOAT_MAT4 });
+    gl.frame.bytes += count * 16 * sizeof(GLfloat);
+}
+
+// Queries and syncs, results are always there
+
+static void GLAPIENTRY genQueries(GLsizei count, GLuint* names) {
+    called();
+    for (GLsizei i = 0; i < count; i++) {
+        names[i] = generateName();
+        gl.queries.insert(names[i]);
+    }
+}
+
+static void GLAPIENTRY getQueryObjectuiv(GLuint query, GLenum name, GLuint* value) {
+    called();
+    if (!gl.queries.count(query)) invalid("glGetQueryObjectuiv of unknown query " + to_string(query));
+    *value = name == GL_QUERY_RESULT_AVAILABLE ? GL_TRUE : 0;
+}
+
+static void GLAPIENTRY getQueryObjectui64v(GLuint query, GLenum /*name*/, GLuint64* value) {
+    called();
+    if (!gl.queries.count(query)) invalid("glGetQueryObjectui64v of unknown query " + to_string(query));
+    *value = 0;
+}
+
+static GLsync GLAPIENTRY fenceSync(GLenum /*condition*/, GLbitfield /*flags*/) {
+    called();
+    return (GLsync) gl.nextSync++;
+}
+
+static GLenum GLAPIENTRY clientWaitSync(GLsync /*sync*/, GLbitfield /*flags*/, GLuint64 /*timeout*/) {
+    called();
+    return GL_ALREADY_SIGNALED;
+}
+
+// GL 1.1 queries
+
+static const GLubyte* GLAPIENTRY getString(GLenum name) {
+    called();
+    switch (name) {
+        case GL_VENDOR: return (const GLubyte*) "null";
+        case GL_RENDERER: return (const GLubyte*) "null backend";
+        case GL_VERSION: return (const GLubyte*) "3.3 (null)";
+        case GL_SHADING_LANGUAGE_VERSION: return (const GLubyte*) "3.30";
+        default: return (const GLubyte*) "";
+    }
+}
+
+static void GLAPIENTRY getIntegerv(GLenum name, GLint* value) {
+    called();
+    switch (name) {
+        case GL_VIEWPORT: memcpy(value, gl.viewport, sizeof(gl.viewport)); return;
+        case GL_MAX_VIEWPORT_DIMS: value[0] = value[1] = 16384; return;
+        case GL_MAX_TEXTURE_SIZE: case GL_MAX_CUBE_MAP_TEXTURE_SIZE: *value = 16384; return;
+        case GL_MAX_DRAW_BUFFERS: *value = 8; return;
+        case GL_MAX_3D_TEXTURE_SIZE: case GL_MAX_ARRAY_TEXTURE_LAYERS: *value = 2048; return;
+        case GL_MAX_TEXTURE_IMAGE_UNITS: case GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS: *value = 16; return;
+        case GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS: *value = 80; return;
+        case GL_MAX_VERTEX_ATTRIBS: *value = 16; return;
+        case GL_MAX_VERTEX_UNIFORM_COMPONENTS: case GL_MAX_FRAGMENT_UNIFORM_COMPONENTS: *value = 4096; return;
+        case GL_MAX_VARYING_FLOATS: *value = 128; return;
+        case GL_MAX_ELEMENTS_VERTICES: case GL_MAX_ELEMENTS_INDICES: *value = 1 << 20; return;
+        case GL_MAX_TESS_GEN_LEVEL: *value = 64; return;
+        case GL_MAX_LABEL_LENGTH: *value = 256; return;
+        case GL_UNPACK_ALIGNMENT: case GL_PACK_ALIGNMENT: *value = 4; return;
+        case GL_ARRAY_BUFFER_BINDING: *value = gl.boundBuffers[GL_ARRAY_BUFFER]; return;
+        case GL_PIXEL_UNPACK_BUFFER_BINDING: *value = gl.boundBuffers[GL_PIXEL_UNPACK_BUFFER]; return;
+        case GL_VERTEX_ARRAY_BINDING: *value = gl.vertexArray; return;
+        case GL_CURRENT_PROGRAM: *value = gl.program; return;
+        default: *value = 0;
+    }
+}
+
+static void GLAPIENTRY getFloatv(GLenum name, GLfloat* value) {
+    called();
+    int count = name == GL_COLOR_CLEAR_VALUE ? 4 : 1;
+    for (int i = 0; i < count; i++) value[i] = 0.0f;
+}
+
+static void GLAPIENTRY getTexLevelParameteriv(GLenum target, GLint /*level*/, GLenum /*name*/, GLint* value) {
+    called();
+    checkTexture("glGetTexLevelParameteriv", target);
+    *value = 0;
+}
+
+static void GLAPIENTRY viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    called();
+    gl.viewport[0] = x;
+    gl.viewport[1] = y;
+    gl.viewport[2] = width;
+    gl.viewport[3] = height;
+}
+
+}
+
+using nullgl::gl;
+
+// GLEW without glewInit: GL 3.3 and no extensions
+static void reportVersion() {
+    GLboolean* versions[] = {
+        &__GLEW_VERSION_1_1, &__GLEW_VERSION_1_2, &__GLEW_VERSION_1_2_1, &__GLEW_VERSION_1_3,
+        &__GLEW_VERSION_1_4, &__GLEW_VERSION_1_5, &__GLEW_VERSION_2_0, &__GLEW_VERSION_2_1,
+        &__GLEW_VERSION_3_0, &__GLEW_VERSION_3_1, &__GLEW_VERSION_3_2, &__GLEW_VERSION_3_3
+    };
+    for (GLboolean* version : versions) *version = GL_TRUE;
+}
+
+void NullBackend::initialize() {
+    reportVersion();
+
+    __glewGenBuffers = nullgl::genBuffers;
+    __glewDeleteBuffers = nullgl::deleteBuffers;
+    __glewBindBuffer = nullgl::bindBuffer;
+    __glewBindBufferBase = nullgl::bindBufferBase;
+    __glewBufferData = nullgl::bufferData;
+    __glewBufferStorage = nullgl::bufferStorage;
+    __glewBufferSubData = nullgl::bufferSubData;
+    __glewMapBufferRange = nullgl::mapBufferRange;
+    __glewUnmapBuffer = nullgl::unmapBuffer;
+
+    __glewGenVertexArrays = nullgl::genVertexArrays;
+    __glewDeleteVertexArrays = nullgl::deleteVertexArrays;
+    __glewBindVertexArray = nullgl::bindVertexArray;
+    __glewVertexAttribPointer = nullgl::vertexAttribPointer;
+    __glewVertexAttribIPointer = nullgl::vertexAttribIPointer;
+    __glewEnableVertexAttribArray = nullgl::enableVertexAttribArray;
+    __glewVertexAttribDivisor = nullgl::vertexAttribDivisor;
+    nullgl::ignore(__glewVertexAttribI1ui);
+
+    glrDrawElements = nullgl::drawElements;
+    __glewDrawElementsInstanced = nullgl::drawElementsInstanced;
+    __glewMultiDrawElementsBaseVertex = nullgl::multiDrawElementsBaseVertex;
+    __glewMultiDrawElementsIndirect = nullgl::multiDrawElementsIndirect;
+
+    glrGenTextures = nullgl::genTextures;
+    glrDeleteTextures = nullgl::deleteTextures;
+    glrBindTexture = nullgl::bindTexture;
+    __glewActiveTexture = nullgl::activeTexture;
+    glrTexImage2D = nullgl::texImage2D;
+    glrTexSubImage2D = nullgl::texSubImage2D;
+    __glewTexImage3D = nullgl::texImage3D;
+    __glewCompressedTexImage2D = nullgl::compressedTexImage2D;
+    glrTexParameteri = nullgl::texParameteri;
+    glrTexParameterfv = nullgl::texParameterfv;
+    __glewGenerateMipmap = nullgl::generateMipmap;
+    nullgl::ignore(glrPixelStorei);
+
+    __glewGenFramebuffers = nullgl::genFramebuffers;
+    __glewDeleteFramebuffers = nullgl::deleteFramebuffers;
+    __glewBindFramebuffer = nullgl::bindFramebuffer;
+    __glewCheckFramebufferStatus = nullgl::checkFramebufferStatus;
+    __glewGenRenderbuffers = nullgl::genRenderbuffers;
+    __glewDeleteRenderbuffers = nullgl::deleteRenderbuffers;
+    __glewBindRenderbuffer = nullgl::bindRenderbuffer;
+    __glewRenderbufferStorage = nullgl::renderbufferStorage;
+    __glewFramebufferRenderbuffer = nullgl::framebufferRenderbuffer;
+    __glewFramebufferTextureLayer = nullgl::framebufferTextureLayer;
+    nullgl::ignore(glrDrawBuffer);
+    nullgl::ignore(glrReadBuffer);
+
+    __glewCreateShader = nullgl::createShader;
+    __glewShaderSource = nullgl::shaderSource;
+    __glewCompileShader = nullgl::compileShader;
+    __glewDeleteShader = nullgl::deleteShader;
+    __glewGetShaderiv = nullgl::getShaderiv;
+    __glewGetShaderInfoLog = nullgl::getInfoLog;
+    __glewCreateProgram = nullgl::createProgram;
+    __glewAttachShader = nullgl::attachShader;
+    __glewDetachShader = nullgl::detachShader;
+    __glewLinkProgram = nullgl::linkProgram;
+    __glewDeleteProgram = nullgl::deleteProgram;
+    __glewUseProgram = nullgl::useProgram;
+    __glewGetProgramiv = nullgl::getProgramiv;
+    __glewGetProgramInfoLog = nullgl::getInfoLog;
+    __glewGetActiveUniform = nullgl::getActiveUniform;
+    __glewGetUniformLocation = nullgl::getUniformLocation;
+    __glewGetAttribLocation = nullgl::getAttribLocation;
+    nullgl::ignore(__glewGetActiveAttrib);
+    nullgl::ignore(__glewGetActiveUniformBlockName);
+    nullgl::ignore(__glewGetActiveUniformBlockiv);
+    nullgl::ignore(__glewUniformBlockBinding);
+    nullgl::ignore(__glewProgramParameteri);
+    nullgl::ignore(__glewProgramBinary);
+    nullgl::ignore(__glewGetProgramBinary);
+    __glewUniform1i = nullgl::uniform1i;
+    __glewUniform1f = nullgl::uniform1f;
+    __glewUniform1fv = nullgl::uniform1fv;
+    __glewUniform2fv = nullgl::uniform2fv;
+    __glewUniform3fv = nullgl::uniform3fv;
+    __glewUniform4fv = nullgl::uniform4fv;
+    __glewUniformMatrix4fv = nullgl::uniformMatrix4fv;
+
+    __glewGenQueries = nullgl::genQueries;
+    nullgl::ignore(__glewBeginQuery);
+    nullgl::ignore(__glewEndQuery);
+    __glewGetQueryObjectuiv = nullgl::getQueryObjectuiv;
+    __glewGetQueryObjectui64v = nullgl::getQueryObjectui64v;
+    __glewFenceSync = nullgl::fenceSync;
+    __glewClientWaitSync = nullgl::clientWaitSync;
+    nullgl::ignore(__glewDeleteSync);
+
+    nullgl::ignore(__glewDebugMessageCallback);
+    nullgl::ignore(__glewDebugMessageControl);
+    nullgl::ignore(__glewPushDebugGroup);
+    nullgl::ignore(__glewPopDebugGroup);
+    nullgl::ignore(__glewObjectLabel);
+
+    nullgl::ignore(glrEnable);
+    nullgl::ignore(glrDisable);
+    nullgl::ignore(glrClear);
+    nullgl::ignore(glrClearColor);
+    nullgl::ignore(glrScissor);
+    nullgl::ignore(glrDepthFunc);
+    nullgl::ignore(glrDepthMask);
+    nullgl::ignore(glrBlendFunc);
+    nullgl::ignore(glrPolygonMode);
+    nullgl::ignore(__glewPatchParameteri);
+    nullgl::ignore(glrFinish);
+    nullgl::ignore(glrIsEnabled);
+    glrViewport = nullgl::viewport;
+    glrGetString = nullgl::getString;
+    glrGetIntegerv = nullgl::getIntegerv;
+    glrGetFloatv = nullgl::getFloatv;
+    glrGetTexLevelParameteriv = nullgl::getTexLevelParameteriv;
+}
+
+void NullBackend::endFrame() {
+    gl.last = gl.frame;
+    gl.all.calls += gl.frame.calls;
+    gl.all.draws += gl.frame.draws;
+    gl.all.instances += gl.frame.instances;
+    gl.all.bytes += gl.frame.bytes;
+    gl.frame = Counts();
+    gl.frames++;
+}
+
+RenderBackend::Counts NullBackend::lastFrame() const {
+    return gl.last;
+}
+
+RenderBackend::Counts NullBackend::total() const {
+    return gl.all;
+}
+
+void NullBackend::printReport() const {
+    double frames = (double) max(gl.frames, 1ULL);
+    cout << "Null backend, " << gl.frames << " frames, per frame: " << fixed << setprecision(1)
+         << gl.all.calls / frames << " GL calls, " << gl.all.draws / frames << " draws, "
+         << gl.all.instances / frames << " instances, " << gl.all.bytes / frames / 1.0e3 << " KB" << endl;
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6) << gl.buffers.size() << " buffers, " << gl.textures.size() << " textures, "
+         << gl.programs.size() << " programs live after the last frame" << endl;
+}
@@ -0,0 +1,314 @@
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <stdexcept>
+#include <algorithm>
+#include "objparser.h"
+#include "util.h"
+
+using namespace glm;
+using namespace std;
+
+// Exact powers of ten as doubles
+static const double POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+const char* parseFloat(const char* p, const char* end, float& value) {
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    // up to 19 significant digits fit, the rest only scale
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false;
+    for (; p < end && isDigit(*p); p++, any = true) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa) digits++;
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && isDigit(*p); p++, any = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa) digits++;
+                exponent--;
+            }
+        }
+    }
+    if (!any) return start;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+')) negativeExponent = *e++ == '-';
+        if (e < end && isDigit(*e)) {
+            int power = 0;
+            for (; e < end && isDigit(*e); e++) {
+                if (power < 10000) power = power * 10 + (*e - '0');
+            }
+            exponent += negativeExponent ? -power : power;
+            p = e;
+        }
+    }
+
+    double result = (double) mantissa;
+    if (mantissa != 0 && exponent != 0) {
+        if (exponent >= -22 && exponent <= 22) {
+            result = exponent < 0 ? result / POWERS_OF_TEN[-exponent] : result * POWERS_OF_TEN[exponent];
+        } else {
+            // rare, let the C library get it right
+            string text(start, p);
+            value = strtof(text.c_str(), nullptr);
+            return p;
+        }
+    }
+    value = (float) (negative ? -result : result);
+    return p;
+}
+
+/*****************************************************************************/
+
+// Index of a corner without that attribute, before resolving
+static const int NO_INDEX = INT_MIN;
+
+// Bits of the corner flags, set when the index is relative to the chunk
+static const unsigned char RELATIVE_POSITION = 1, RELATIVE_TEXCOORD = 2, RELATIVE_NORMAL = 4;
+
+struct ChunkGroup {
+    string name;
+    string material;
+    bool setsName;
+    size_t firstCorner;
+};
+
+// What one chunk of lines defines, indices as in the file until resolved
+struct OBJChunk {
+    const char* begin;
+    const char* end;
+    vector<vec3> positions, normals;
+    vector<vec2> texcoords;
+    vector<OBJCorner> corners;
+    vector<unsigned char> flags;
+    vector<ChunkGroup> groups;
+    vector<string> libraries;
+};
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* skipSpace(const char* p, const char* end) {
+    while (p < end && isSpace(*p)) p++;
+    return p;
+}
+
+static const char* parseFloats(const char* p, const char* end, float* values, int count) {
+    for (int i = 0; i < count; i++) {
+        p = skipSpace(p, end);
+        values[i] = 0.0f;
+        p = parseFloat(p, end, values[i]);
+    }
+    return p;
+}
+
+// 1 based or negative index, NO_INDEX if there is none, relative is set for
+// negative indices which become local to the chunk
+static const char* parseIndex(const char* p, const char* end, size_t count,
+                              int& index, bool& relative) {
+    bool negative = p < end && *p == '-';
+    if (negative) p++;
+    long long value = 0;
+    const char* digits = p;
+    for (; p < end && isDigit(*p); p++) {
+        if (value <= INT_MAX) value = value * 10 + (*p - '0');
+    }
+    if (p == digits) {
+        index = NO_INDEX;
+        relative = false;
+        return p;
+    }
+    if (value == 0 || value > INT_MAX) throw runtime_error("Invalid index in OBJ file");
+    relative = negative;
+    index = negative ? (int) ((long long) count - value) : (int) (value - 1);
+    return p;
+}
+
+static string parseName(const char* p, const char* end) {
+    p = skipSpace(p, end);
+    while (end > p && isSpace(end[-1])) end--;
+    return string(p, end);
+}
+
+static bool isKeyword(const char* p, const char* end, const char* keyword) {
+    size_t length = strlen(keyword);
+    return (size_t) (end - p) > length && memcmp(p, keyword, length) == 0 && isSpace(p[length]);
+}
+
+static void parseChunk(OBJChunk& chunk) {
+    vector<OBJCorner> polygon;
+    vector<unsigned char> polygonFlags;
+    const char* p = chunk.begin;
+    while (p < chunk.end) {
+        const char* lineEnd = (const char*) memchr(p, '\n', chunk.end - p);
+        if (!lineEnd) lineEnd = chunk.end;
+        const char* line = skipSpace(p, lineEnd);
+        p = lineEnd + 1;
+        if (line == lineEnd || *line == '#') continue;
+
+        if (line + 1 < lineEnd && line[0] == 'v' && isSpace(line[1])) {
+            vec3 position;
+            parseFloats(line + 2, lineEnd, &position.x, 3);
+            chunk.positions.push_back(position);
+        } else if (line + 2 < lineEnd && line[0] == 'v' && line[1] == 't' && isSpace(line[2])) {
+            vec2 texcoord;
+            parseFloats(line + 3, lineEnd, &texcoord.x, 2);
+            chunk.texcoords.push_back(texcoord);
+        } else if (line + 2 < lineEnd && line[0] == 'v' && line[1] == 'n' && isSpace(line[2])) {
+            vec3 normal;
+            parseFloats(line + 3, lineEnd, &normal.x, 3);
+            chunk.normals.push_back(normal);
+        } else if (line + 1 < lineEnd && line[0] == 'f' && isSpace(line[1])) {
+            polygon.clear();
+            polygonFlags.clear();
+            const char* q = skipSpace(line + 1, lineEnd);
+            while (q < lineEnd) {
+                OBJCorner corner;
+                bool relativePosition, relativeTexcoord = false, relativeNormal = false;
+                corner.texcoord = corner.normal = NO_INDEX;
+                q = parseIndex(q, lineEnd, chunk.positions.size(), corner.position, relativePosition);
+                if (corner.position == NO_INDEX) throw runtime_error("Invalid face in OBJ file");
+                if (q < lineEnd && *q == '/') {
+                    q = parseIndex(q + 1, lineEnd, chunk.texcoords.size(), corner.texcoord, relativeTexcoord);
+                    if (q < lineEnd && *q == '/') {
+                        q = parseIndex(q + 1, lineEnd, chunk.normals.size(), corner.normal, relativeNormal);
+                    }
+                }
+                polygon.push_back(corner);
+                polygonFlags.push_back((relativePosition ? RELATIVE_POSITION : 0) |
+                                       (relativeTexcoord ? RELATIVE_TEXCOORD : 0) |
+                                       (relativeNormal ? RELATIVE_NORMAL : 0));
+                q = skipSpace(q, lineEnd);
+            }
+            // fan triangulation
+            for (size_t i = 1; i + 1 < polygon.size(); i++) {
+                size_t fan[3] = { 0, i, i + 1 };
+                for (size_t k : fan) {
+                    chunk.corners.push_back(polygon[k]);
+                    chunk.flags.push_back(polygonFlags[k]);
+                }
+            }
+        } else if (isKeyword(line, lineEnd, "usemtl")) {
+            // the name is taken from the group before when merging
+            ChunkGroup group = { "", parseName(line + 6, lineEnd), false, chunk.corners.size() };
+            chunk.groups.push_back(group);
+        } else if (isKeyword(line, lineEnd, "o") || isKeyword(line, lineEnd, "g")) {
+            ChunkGroup group = { parseName(line + 1, lineEnd), "", true, chunk.corners.size() };
+            chunk.groups.push_back(group);
+        } else if (isKeyword(line, lineEnd, "mtllib")) {
+            chunk.libraries.push_back(parseName(line + 6, lineEnd));
+        }
+    }
+}
+
+static int resolveIndex(int index, bool relative, size_t base, size_t count) {
+    if (index == NO_INDEX) return -1;
+    long long absolute = relative ? (long long) base + index : index;
+    if (absolute < 0 || absolute >= (long long) count) {
+        throw runtime_error("Index out of range in OBJ file");
+    }
+    return (int) absolute;
+}
+
+OBJData parseOBJ(const string& path) {
+    MappedFile file(path);
+    const char* text = (const char*) file.data();
+    size_t size = file.size();
+
+    // chunks of at least a megabyte, a few per core, split after a newline
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(size >> 20, 4 * (workerThreadCount() + 1)));
+    vector<OBJChunk> chunks(chunkCount);
+    const char* begin = text;
+    for (size_t i = 0; i < chunkCount; i++) {
+        const char* end = text + size * (i + 1) / chunkCount;
+        if (i + 1 < chunkCount && end > begin) {
+            const char* newline = (const char*) memchr(end - 1, '\n', text + size - (end - 1));
+            end = newline ? newline + 1 : text + size;
+        }
+        end = std::max(begin, end);
+        chunks[i].begin = begin;
+        chunks[i].end = end;
+        begin = end;
+    }
+
+    parallelFor((int) chunkCount, [&](int i) {
+        parseChunk(chunks[i]);
+    });
+
+    // where every chunk goes in the merged arrays
+    OBJData obj;
+    vector<size_t> positionBase(chunkCount), texcoordBase(chunkCount), normalBase(chunkCount), cornerBase(chunkCount);
+    size_t positions = 0, texcoords = 0, normals = 0, corners = 0;
+    for (size_t i = 0; i < chunkCount; i++) {
+        positionBase[i] = positions;
+        texcoordBase[i] = texcoords;
+        normalBase[i] = normals;
+        cornerBase[i] = corners;
+        positions += chunks[i].positions.size();
+        texcoords += chunks[i].texcoords.size();
+        normals += chunks[i].normals.size();
+        corners += chunks[i].corners.size();
+    }
+    obj.positions.resize(positions);
+    obj.texcoords.resize(texcoords);
+    obj.normals.resize(normals);
+    obj.corners.resize(corners);
+
+    parallelFor((int) chunkCount, [&](int i) {
+        OBJChunk& chunk = chunks[i];
+        std::copy(chunk.positions.begin(), chunk.positions.end(), obj.positions.begin() + positionBase[i]);
+        std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), obj.texcoords.begin() + texcoordBase[i]);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), obj.normals.begin() + normalBase[i]);
+        for (size_t c = 0; c < chunk.corners.size(); c++) {
+            const OBJCorner& corner = chunk.corners[c];
+            unsigned char flags = chunk.flags[c];
+            OBJCorner& resolved = obj.corners[cornerBase[i] + c];
+            resolved.position = resolveIndex(corner.position, (flags & RELATIVE_POSITION) != 0, positionBase[i], positions);
+            resolved.texcoord = resolveIndex(corner.texcoord, (flags & RELATIVE_TEXCOORD) != 0, texcoordBase[i], texcoords);
+            resolved.normal = resolveIndex(corner.normal, (flags & RELATIVE_NORMAL) != 0, normalBase[i], normals);
+        }
+        vector<OBJCorner>().swap(chunk.corners);
+    });
+
+    // groups carry the name or material of the group before them, empty ones are dropped
+    OBJGroup first = { "", "", 0 };
+    obj.groups.push_back(first);
+    for (size_t i = 0; i < chunkCount; i++) {
+        for (const ChunkGroup& chunkGroup : chunks[i].groups) {
+            OBJGroup group = obj.groups.back();
+            if (chunkGroup.setsName) {
+                group.name = chunkGroup.name;
+            } else {
+                group.material = chunkGroup.material;
+            }
+            group.firstCorner = cornerBase[i] + chunkGroup.firstCorner;
+            if (group.firstCorner == obj.groups.back().firstCorner) {
+                obj.groups.back() = group;
+            } else {
+                obj.groups.push_back(group);
+            }
+        }
+        obj.materialLibraries.insert(obj.materialLibraries.end(),
+                                     chunks[i].libraries.begin(), chunks[i].libraries.end());
+    }
+    return obj;
+}
@@ -0,0 +1,52 @@
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include <vector>
+#include <string>
+#include <glm/glm.hpp>
+
+/**
+* 0 based indices of a face corner, -1 where the face has no uv or normal.
+*/
+struct OBJCorner {
+    int position;
+    int texcoord;
+    int normal;
+};
+
+/**
+* Faces from firstCorner up to the next group, a new group starts at every
+* o, g and usemtl statement.
+*/
+struct OBJGroup {
+    std::string name;
+    std::string material;
+    size_t firstCorner;
+};
+
+/**
+* Geometry of an .obj file. Polygons are triangulated as fans, every three
+* corners are a triangle.
+*/
+struct OBJData {
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> texcoords;
+    std::vector<OBJCorner> corners;
+    std::vector<OBJGroup> groups;
+    std::vector<std::string> materialLibraries;
+};
+
+/**
+* Maps the file and parses it on all cores, in chunks of whole lines that are
+* merged in file order. Relative (negative) indices are resolved, throws if an
+* index is out of range.
+*/
+OBJData parseOBJ(const std::string& path);
+
+/**
+* Parses a decimal float at p, without locale or allocation. Returns the end
+* of the number, or p if there is none.
+*/
+const char* parseFloat(const char* p, const char* end, float& value);
+
+#endif
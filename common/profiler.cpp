@@ -0,0 +1,180 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include "profiler.h"
+#include "glcalls.h"
+
+using namespace std;
+
+Profiler& Profiler::get() {
+    static Profiler profiler;
+    return profiler;
+}
+
+int Profiler::section(const string& name, bool gpu) {
+    lock_guard<mutex> guard(lock);
+    for (size_t i = 0; i < all.size(); i++) {
+        if (all[i]->name == name && all[i]->gpu == gpu) return (int) i;
+    }
+    unique_ptr<Section> section(new Section());
+    section->name = name;
+    section->gpu = gpu;
+    section->samples.reserve(WINDOW);
+    if (gpu) glGenQueries(2, section->queries);
+    all.push_back(move(section));
+    return (int) all.size() - 1;
+}
+
+void Profiler::addCPU(int id, double ms) {
+    lock_guard<mutex> guard(lock);
+    all[id]->frameMs += ms;
+    all[id]->ran = true;
+}
+
+void Profiler::beginGPU(int id) {
+    lock_guard<mutex> guard(lock);
+    Section& section = *all[id];
+    int parity = frameNumber & 1;
+    if (activeGPU != -1 || section.issued[parity] == frameNumber) return;
+    glBeginQuery(GL_TIME_ELAPSED, section.queries[parity]);
+    section.issued[parity] = frameNumber;
+    activeGPU = id;
+}
+
+void Profiler::endGPU(int id) {
+    lock_guard<mutex> guard(lock);
+    if (activeGPU != id) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    activeGPU = -1;
+}
+
+void Profiler::beginFrame() {
+    lock_guard<mutex> guard(lock);
+
+    // the queries of this parity were issued two frames ago, one that isn't
+    // done yet is dropped instead of waited for
+    int parity = frameNumber & 1;
+    for (auto& section : all) {
+        if (!section->gpu || section->issued[parity] < 0) continue;
+        GLuint available = 0;
+        glGetQueryObjectuiv(section->queries[parity], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(section->queries[parity], GL_QUERY_RESULT, &nanoseconds);
+            record(*section, section->issued[parity], (float) (nanoseconds / 1.0e6));
+        }
+        section->issued[parity] = -1;
+    }
+}
+
+void Profiler::endFrame() {
+    lock_guard<mutex> guard(lock);
+    for (auto& section : all) {
+        if (section->gpu || !section->ran) continue;
+        record(*section, frameNumber, (float) section->frameMs);
+        section->frameMs = 0.0;
+        section->ran = false;
+    }
+    if (out.is_open() && json) {
+        out << "{\"frame\":" << frameNumber << ",\"samples\":[" << jsonFrame << "]}\n";
+        jsonFrame.clear();
+    }
+    frameNumber++;
+}
+
+void Profiler::open(const string& path) {
+    lock_guard<mutex> guard(lock);
+    out.open(path);
+    if (!out) {
+        cout << "Can't write profile: " << path << endl;
+        return;
+    }
+    json = path.size() >= 5 && path.substr(path.size() - 5) == ".json";
+    if (!json) out << "frame,kind,section,ms\n";
+}
+
+void Profiler::keepHistory(bool keep) {
+    lock_guard<mutex> guard(lock);
+    keepingHistory = keep;
+}
+
+void Profiler::record(Section& section, long long frame, float ms) {
+    if (keepingHistory) section.history.push_back(ms);
+    if (section.samples.size() < WINDOW) {
+        section.samples.push_back(ms);
+    } else {
+        section.samples[section.next] = ms;
+    }
+    section.next = (section.next + 1) % WINDOW;
+    updateStatistics(section);
+
+    if (!out.is_open()) return;
+    const char* kind = section.gpu ? "gpu" : "cpu";
+    if (json) {
+        ostringstream sample;
+        if (!jsonFrame.empty()) sample << ",";
+        sample << "{\"section\":\"" << section.name << "\",\"kind\":\"" << kind
+            << "\",\"frame\":" << frame << ",\"ms\":" << ms << "}";
+        jsonFrame += sample.str();
+    } else {
+        out << frame << "," << kind << "," << section.name << "," << ms << "\n";
+    }
+}
+
+void Profiler::updateStatistics(Section& section) {
+    vector<float> sorted = section.samples;
+    size_t p99 = (sorted.size() * 99 + 99) / 100 - 1;
+    nth_element(sorted.begin(), sorted.begin() + p99, sorted.end());
+    section.p99 = sorted[p99];
+    section.min = *min_element(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (float sample : sorted) sum += sample;
+    section.mean = (float) (sum / sorted.size());
+}
+
+void Profiler::drawHUD(int width, int height, float budgetMs) {
+    lock_guard<mutex> guard(lock);
+    GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+    GLfloat clearColor[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    glEnable(GL_SCISSOR_TEST);
+
+    auto rectangle = [](int x, int y, int w, int h, float r, float g, float b) {
+        glScissor(x, y, w, h);
+        glClearColor(r, g, b, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    };
+    const int margin = 10, barHeight = 6, gap = 3;
+    int barWidth = width / 3;
+    int y = height - margin;
+    for (auto& section : all) {
+        y -= barHeight + gap;
+        if (y < 0) break;
+        int mean = (int) (std::min(section->mean / budgetMs, 1.0f) * barWidth);
+        int p99 = (int) (std::min(section->p99 / budgetMs, 1.0f) * barWidth);
+        rectangle(margin, y, barWidth, barHeight, 0.1f, 0.1f, 0.1f);
+        if (section->gpu) {
+            rectangle(margin, y, mean, barHeight, 1.0f, 0.55f, 0.1f);
+        } else {
+            rectangle(margin, y, mean, barHeight, 0.2f, 0.5f, 1.0f);
+        }
+        rectangle(margin + std::max(p99 - 1, 0), y, 2, barHeight, 1.0f, 1.0f, 1.0f);
+    }
+
+    glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    if (!scissor) glDisable(GL_SCISSOR_TEST);
+}
+
+string Profiler::summary() const {
+    lock_guard<mutex> guard(lock);
+    ostringstream text;
+    text << fixed << setprecision(2);
+    for (const auto& section : all) {
+        if (section->samples.empty()) continue;
+        if (text.tellp() > 0) text << " | ";
+        text << section->name << (section->gpu ? " gpu " : " cpu ") << section->min << "/"
+            << section->mean << "/" << section->p99;
+    }
+    return text.str();
+}
@@ -0,0 +1,135 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <chrono>
+#include "trace.h"
+
+/**
+* Frame profiler. CPU sections are timed by scopes on any thread and summed
+* per frame, GPU sections by GL_TIME_ELAPSED queries that are double
+* buffered, so a GPU time is read two frames after it was issued without
+* waiting for it. Every section keeps min, mean and p99 over the last frames.
+*
+* Use the PROFILE_CPU / PROFILE_GPU macros, they compile to nothing unless
+* ENABLE_PROFILER is defined (the CMake option of the same name). GPU
+* sections can't nest, an inner one is dropped. CPU sections also show up as
+* slices in a trace capture (see trace.h).
+*/
+class Profiler {
+public:
+    static const int WINDOW = 120;     // frames the statistics cover
+
+    struct Section {
+        std::string name;
+        bool gpu;
+        // milliseconds of the last WINDOW frames it ran in
+        std::vector<float> samples;
+        size_t next = 0;
+        float min = 0.0f, mean = 0.0f, p99 = 0.0f;
+        // every sample since keepHistory(true)
+        std::vector<float> history;
+        // CPU: time summed over the current frame
+        double frameMs = 0.0;
+        bool ran = false;
+        // GPU: a query per frame parity and the frame it was issued in
+        GLuint queries[2] = { 0, 0 };
+        long long issued[2] = { -1, -1 };
+    };
+
+    static Profiler& get();
+
+    /* Registers a section once, the id is what the scopes pass in */
+    int section(const std::string& name, bool gpu);
+
+    void addCPU(int id, double ms);
+    void beginGPU(int id);
+    void endGPU(int id);
+
+    /* Call around every frame on the GL thread */
+    void beginFrame();
+    void endFrame();
+
+    /**
+    * Streams every sample to a file, one line per section and frame: CSV
+    * (frame,kind,section,ms) or, for a .json file, one JSON object per frame.
+    * GPU samples are written with the frame they were issued in.
+    */
+    void open(const std::string& path);
+
+    /**
+    * Bars of the mean of every section over the frame budget, a tick at the
+    * p99, CPU sections blue and GPU ones orange. Drawn with scissored clears,
+    * so it needs no program and leaves the pipeline state alone.
+    */
+    void drawHUD(int width, int height, float budgetMs = 1000.0f / 60.0f);
+
+    /* Also keeps every sample from now on, e.g. for a benchmark report */
+    void keepHistory(bool keep);
+
+    /* min / mean / p99 of every section, e.g. for the window title */
+    std::string summary() const;
+
+    const std::vector<std::unique_ptr<Section>>& sections() const { return all; }
+    long long frame() const { return frameNumber; }
+
+private:
+    Profiler() {}
+    void record(Section& section, long long frame, float ms);
+    void updateStatistics(Section& section);
+
+    std::vector<std::unique_ptr<Section>> all;
+    mutable std::mutex lock;
+    long long frameNumber = 0;
+    int activeGPU = -1;
+    bool keepingHistory = false;
+    std::ofstream out;
+    bool json = false;
+    std::string jsonFrame;
+};
+
+/* Times its lifetime into a CPU section */
+class CPUScope {
+public:
+    CPUScope(int id, const char* name) : id{id}, name{name}, start{std::chrono::steady_clock::now()} {}
+    ~CPUScope() {
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        std::chrono::duration<double, std::milli> elapsed = end - start;
+        Profiler::get().addCPU(id, elapsed.count());
+        if (Tracer::get().capturing()) {
+            Tracer::get().complete("cpu", name, Tracer::toMicroseconds(start), Tracer::toMicroseconds(end));
+        }
+    }
+private:
+    int id;
+    const char* name;
+    std::chrono::steady_clock::time_point start;
+};
+
+/* Times the GL commands issued during its lifetime into a GPU section */
+class GPUScope {
+public:
+    explicit GPUScope(int id) : id{id} { Profiler::get().beginGPU(id); }
+    ~GPUScope() { Profiler::get().endGPU(id); }
+private:
+    int id;
+};
+
+#ifdef ENABLE_PROFILER
+#define PROFILE_CPU(name) \
+    static const int PROFILER_CONCAT(profileCPU, __LINE__) = Profiler::get().section(name, false); \
+    CPUScope PROFILER_CONCAT(profileCPUScope, __LINE__)(PROFILER_CONCAT(profileCPU, __LINE__), name)
+#define PROFILE_GPU(name) \
+    static const int PROFILER_CONCAT(profileGPU, __LINE__) = Profiler::get().section(name, true); \
+    GPUScope PROFILER_CONCAT(profileGPUScope, __LINE__)(PROFILER_CONCAT(profileGPU, __LINE__))
+#else
+#define PROFILE_CPU(name)
+#define PROFILE_GPU(name)
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+#include <stdexcept>
+#include <tinyxml2.h>
+#include "scene.h"
+
+using namespace std;
+using namespace tinyxml2;
+
+static SceneBudget readBudget(const XMLElement* parent, const SceneBudget& defaults) {
+    SceneBudget budget = defaults;
+    const XMLElement* element = parent->FirstChildElement("budget");
+    if (!element) return budget;
+    budget.frameMs = element->FloatAttribute("frameMs", budget.frameMs);
+    budget.memoryMB = element->FloatAttribute("memoryMB", budget.memoryMB);
+    budget.uploadMBps = element->FloatAttribute("uploadMBps", budget.uploadMBps);
+    return budget;
+}
+
+// Attribute() takes a value to compare to, not a default
+static string stringAttribute(const XMLElement* element, const char* name, const string& fallback) {
+    const char* value = element->Attribute(name);
+    return value ? value : fallback;
+}
+
+static void checkRange(const Scene& scene, const char* attribute, int value, int min, int max) {
+    if (value < min || value > max) {
+        throw runtime_error("Scene " + scene.name + ": " + attribute + " must be in " +
+                            to_string(min) + ".." + to_string(max));
+    }
+}
+
+vector<Scene> loadScenes(const string& path, const Scene& defaults) {
+    XMLDocument document;
+    if (document.LoadFile(path.c_str()) != XML_SUCCESS) {
+        throw runtime_error("Can't read scene file " + path + ": " + document.ErrorName());
+    }
+    const XMLElement* root = document.FirstChildElement("scenes");
+    if (!root) throw runtime_error("No <scenes> in " + path);
+    SceneBudget budget = readBudget(root, defaults.budget);
+
+    vector<Scene> scenes;
+    for (const XMLElement* element = root->FirstChildElement("scene"); element;
+         element = element->NextSiblingElement("scene")) {
+        Scene scene = defaults;
+        scene.name = stringAttribute(element, "name", "scene" + to_string(scenes.size() + 1));
+        scene.n = element->IntAttribute("n", scene.n);
+        scene.waveCount = element->IntAttribute("waves", scene.waveCount);
+        scene.wavePreset = element->IntAttribute("preset", scene.wavePreset);
+        scene.emitters = element->IntAttribute("emitters", scene.emitters);
+        scene.particlesPerEmitter = element->IntAttribute("particles", scene.particlesPerEmitter);
+        scene.textureSet = stringAttribute(element, "textures", scene.textureSet);
+        scene.budget = readBudget(element, budget);
+
+        checkRange(scene, "n", scene.n, 1, 12);
+        checkRange(scene, "waves", scene.waveCount, 1, 100000);
+        checkRange(scene, "preset", scene.wavePreset, 1, 3);
+        checkRange(scene, "emitters", scene.emitters, 0, 100000);
+        checkRange(scene, "particles", scene.particlesPerEmitter, 1, 1000000);
+        scenes.push_back(scene);
+    }
+    if (scenes.empty()) throw runtime_error("No <scene> in " + path);
+    return scenes;
+}
+
+Scene loadScene(const string& path, const string& name, const Scene& defaults) {
+    vector<Scene> scenes = loadScenes(path, defaults);
+    if (name.empty()) return scenes.front();
+    for (const Scene& scene : scenes) {
+        if (scene.name == name) return scene;
+    }
+    throw runtime_error("No scene " + name + " in " + path);
+}
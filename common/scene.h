@@ -0,0 +1,52 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <string>
+#include <vector>
+
+/**
+* Limits a scene is expected to run within, 0 leaves one unchecked.
+*/
+struct SceneBudget {
+    float frameMs = 1000.0f / 60.0f;    // p99 frame time
+    float memoryMB = 0.0f;              // peak resident memory of the process
+    float uploadMBps = 0.0f;            // per frame buffer and uniform uploads
+};
+
+/**
+* What lab03 simulates and draws, in place of its built-in sizes.
+*/
+struct Scene {
+    std::string name;
+    int n = 9;                          // the water grid has 2^n cells per side
+    int waveCount = 300;
+    int wavePreset = 1;                 // base wave, 1..3
+    int emitters = 0;                   // bubble emitters on the highest vertices, 0 for none
+    int particlesPerEmitter = 25;
+    std::string textureSet = "Water_002";   // <set>_COLOR.bmp, <set>_ROUGH.bmp, ...
+    SceneBudget budget;
+};
+
+/**
+* Reads the scenes of an XML file:
+*
+*   <scenes>
+*     <budget frameMs="16.7" memoryMB="2048" uploadMBps="500"/>
+*     <scene name="calm" n="9" waves="300" preset="1" textures="Water_002"/>
+*     <scene name="storm" n="10" waves="1000" emitters="100" particles="50">
+*       <budget frameMs="33.3"/>
+*     </scene>
+*   </scenes>
+*
+* Attributes a scene leaves out come from defaults, the budget from the one of
+* <scenes>. Unnamed scenes are called scene1, scene2, ... Throws when the file
+* can't be read or a value is out of range.
+*/
+std::vector<Scene> loadScenes(const std::string& path, const Scene& defaults = Scene());
+
+/**
+* The scene called name, or the first one when name is empty.
+*/
+Scene loadScene(const std::string& path, const std::string& name, const Scene& defaults = Scene());
+
+#endif
@@ -1,95 +1,643 @@
 #include <GL/glew.h>
+#include <glfw3.h>
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+#include <map>
 using namespace std;
 
 #include "shader.h"
+#include "util.h"
+#include "gldebug.h"
+#include "glcalls.h"
+#include "backend.h"
 
-void compileShader(GLuint& shaderID, const char* file) {
-    // read shader code from the file
-    std::string shaderCode;
-    std::ifstream shaderStream(file, std::ios::in);
-    if (shaderStream.is_open()) {
-        std::string Line = "";
-        while (getline(shaderStream, Line)) {
-            shaderCode += "\n" + Line;
-        }
-        shaderStream.close();
-    } else {
+// GL_KHR_parallel_shader_compile is newer than our GLEW
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+typedef void (GLAPIENTRY *MaxShaderCompilerThreadsProc)(GLuint count);
+
+static string shaderCacheDirectory = "shadercache";
+
+void setShaderCacheDirectory(const std::string& directory) {
+    shaderCacheDirectory = directory;
+}
+
+static string readShaderFile(const string& file) {
+    std::ifstream shaderStream(file, std::ios::in | std::ios::binary);
+    if (!shaderStream.is_open()) {
         throw runtime_error(string("Can't open shader file: ") + file);
     }
+    std::ostringstream shaderCode;
+    shaderCode << shaderStream.rdbuf();
+    return shaderCode.str();
+}
+
+// Directory part of a path, with the trailing separator
+static string directoryOf(const string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == string::npos ? "" : path.substr(0, slash + 1);
+}
+
+// Appends file to code with every #include "name" line replaced by the named
+// file, relative to the including one. A file is included at most once per
+// stage, like #pragma once, which also stops include cycles. files receives the
+// source string number of each file for the #line directives.
+static void expandIncludes(const string& file, vector<string>& files, string& code) {
+    if (find(files.begin(), files.end(), file) != files.end()) return;
+    files.push_back(file);
+    int sourceString = (int) files.size() - 1;
+    if (sourceString > 0) code += "#line 1 " + to_string(sourceString) + "\n";
+
+    std::istringstream stream(readShaderFile(file));
+    string line;
+    int lineNumber = 0;
+    while (getline(stream, line)) {
+        lineNumber++;
+        size_t start = line.find_first_not_of(" \t");
+        if (start == string::npos || line.compare(start, 8, "#include") != 0) {
+            code += line + "\n";
+            continue;
+        }
+
+        size_t open = line.find('"', start + 8);
+        size_t close = open == string::npos ? string::npos : line.find('"', open + 1);
+        if (close == string::npos) {
+            throw runtime_error("Malformed #include in " + file + ":" + to_string(lineNumber));
+        }
+        expandIncludes(directoryOf(file) + line.substr(open + 1, close - open - 1), files, code);
+        code += "#line " + to_string(lineNumber + 1) + " " + to_string(sourceString) + "\n";
+    }
+}
+
+// Inserts the defines on the line after #version
+static string injectDefines(const string& code, const string& defines) {
+    if (defines.empty()) return code;
+    size_t version = code.find("#version");
+    size_t lineEnd = version == string::npos ? string::npos : code.find('\n', version);
+    if (lineEnd == string::npos) return defines + "\n" + code;
+    return code.substr(0, lineEnd + 1) + defines + "\n#line 2 0\n" + code.substr(lineEnd + 1);
+}
+
+string preprocessShader(const string& file, const string& defines, vector<string>* includedFiles) {
+    vector<string> files;
+    string code;
+    expandIncludes(file, files, code);
+    if (includedFiles) *includedFiles = files;
+    return injectDefines(code, defines);
+}
+
+ShaderDefines& ShaderDefines::set(const string& name, int value) {
+    values[name] = to_string(value);
+    return *this;
+}
+
+ShaderDefines& ShaderDefines::set(const string& name, const string& value) {
+    values[name] = value;
+    return *this;
+}
+
+string ShaderDefines::str() const {
+    string defines;
+    for (const auto& value : values) {
+        defines += "#define " + value.first;
+        if (!value.second.empty()) defines += " " + value.second;
+        defines += "\n";
+    }
+    return defines;
+}
+
+// Lets the driver compile on as many threads as it likes, if it can
+static void enableParallelShaderCompile() {
+    static bool checked = false;
+    if (checked) return;
+    checked = true;
+
+    const char* names[][2] = {
+        {"GL_KHR_parallel_shader_compile", "glMaxShaderCompilerThreadsKHR"},
+        {"GL_ARB_parallel_shader_compile", "glMaxShaderCompilerThreadsARB"}
+    };
+    for (const auto& name : names) {
+        if (!glfwExtensionSupported(name[0])) continue;
+        MaxShaderCompilerThreadsProc maxShaderCompilerThreads =
+            (MaxShaderCompilerThreadsProc) glfwGetProcAddress(name[1]);
+        if (!maxShaderCompilerThreads) continue;
+        maxShaderCompilerThreads(0xFFFFFFFF);
+        GLint threads = 0;
+        glGetIntegerv(GL_MAX_SHADER_COMPILER_THREADS_KHR, &threads);
+        cout << "Parallel shader compile: " << name[0] << ", threads " << threads << endl;
+        return;
+    }
+}
+
+static bool programBinariesSupported() {
+    if (shaderCacheDirectory.empty()) return false;
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+/*
+* Program binary file: header followed by the glGetProgramBinary data. The key
+* hashes the preprocessed sources with the driver strings, a binary is only
+* reused with exactly the same sources on the same driver.
+*/
+struct ProgramBinaryHeader {
+    char magic[4];
+    unsigned int version;
+    unsigned long long key;
+    unsigned int format;
+    unsigned int length;
+};
+
+static const unsigned int PROGRAM_BINARY_VERSION = 1;
+
+static string programBinaryPath(unsigned long long key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", key);
+    return shaderCacheDirectory + "/" + name;
+}
+
+static bool loadProgramBinary(GLuint program, unsigned long long key) {
+    FILE* file = fopen(programBinaryPath(key).c_str(), "rb");
+    if (!file) return false;
+
+    ProgramBinaryHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+        memcmp(header.magic, "PBIN", 4) == 0 &&
+        header.version == PROGRAM_BINARY_VERSION &&
+        header.key == key;
+    vector<char> data;
+    if (valid) {
+        data.resize(header.length);
+        valid = header.length > 0 && fread(&data[0], 1, header.length, file) == header.length;
+    }
+    fclose(file);
+    if (!valid) return false;
 
+    // the driver refuses binaries it can't use, e.g. after an update
+    glProgramBinary(program, header.format, &data[0], header.length);
     GLint result = GL_FALSE;
-    int infoLogLength;
+    glGetProgramiv(program, GL_LINK_STATUS, &result);
+    return result == GL_TRUE;
+}
+
+static void saveProgramBinary(GLuint program, unsigned long long key) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    vector<char> data(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, NULL, &format, &data[0]);
 
-    // compile Vertex Shader
-    cout << "Compiling shader: " << file << endl;
-    char const* sourcePointer = shaderCode.c_str();
-    glShaderSource(shaderID, 1, &sourcePointer, NULL);
-    glCompileShader(shaderID);
+    ProgramBinaryHeader header;
+    memcpy(header.magic, "PBIN", 4);
+    header.version = PROGRAM_BINARY_VERSION;
+    header.key = key;
+    header.format = format;
+    header.length = (unsigned int) length;
+
+    createDirectory(shaderCacheDirectory);
+    FILE* file = fopen(programBinaryPath(key).c_str(), "wb");
+    if (!file) return;
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(&data[0], 1, data.size(), file);
+    fclose(file);
+}
 
-    // check Vertex Shader
-    glGetShaderiv(shaderID, GL_COMPILE_STATUS, &result);
+// The log refers to included files by source string number, so on failure the
+// numbers are listed as well
+static void printShaderLog(GLuint shaderID, const vector<string>& sourceStrings) {
+    int infoLogLength;
     glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &infoLogLength);
     if (infoLogLength > 0) {
         std::vector<char> shaderErrorMessage(infoLogLength + 1);
         glGetShaderInfoLog(shaderID, infoLogLength, NULL, &shaderErrorMessage[0]);
-        //throw runtime_error(string(&shaderErrorMessage[0]));
         cout << &shaderErrorMessage[0] << endl;
     }
+
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shaderID, GL_COMPILE_STATUS, &compiled);
+    if (compiled != GL_TRUE && sourceStrings.size() > 1) {
+        for (size_t i = 0; i < sourceStrings.size(); i++) {
+            cout << "  source string " << i << ": " << sourceStrings[i] << endl;
+        }
+    }
 }
 
-GLuint loadShaders(const char* vertexFilePath,
-                   const char* fragmentFilePath,
-                   const char* geometryFilePath) {
-    // Create the shaders
-    GLuint vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    compileShader(vertexShaderID, vertexFilePath);
-
-    GLuint fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-    compileShader(fragmentShaderID, fragmentFilePath);
-
-    GLuint geometryShaderID = 0;
-    if (geometryFilePath) {
-        geometryShaderID = glCreateShader(GL_GEOMETRY_SHADER);
-        compileShader(geometryShaderID, geometryFilePath);
-    }
-
-    // Link the program
-    cout << "Linking shaders... " << endl;
-    GLuint programID = glCreateProgram();
-    glAttachShader(programID, vertexShaderID);
-    if (geometryFilePath)
-        glAttachShader(programID, geometryShaderID);
-    glAttachShader(programID, fragmentShaderID);
-    glLinkProgram(programID);
-
-    // Check the program
-    GLint result = GL_FALSE;
+static void printProgramLog(GLuint programID) {
     int infoLogLength;
-    glGetProgramiv(programID, GL_LINK_STATUS, &result);
     glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &infoLogLength);
     if (infoLogLength > 0) {
         std::vector<char> programErrorMessage(infoLogLength + 1);
         glGetProgramInfoLog(programID, infoLogLength, NULL, &programErrorMessage[0]);
-        //throw runtime_error(string(&programErrorMessage[0]));
         cout << &programErrorMessage[0] << endl;
     }
+}
+
+vector<GLuint> loadShaderPrograms(const vector<ProgramSource>& programs) {
+    auto start = chrono::steady_clock::now();
+    enableParallelShaderCompile();
+    bool binaries = programBinariesSupported();
+
+    string driver = string((const char*) glGetString(GL_VENDOR)) + "\n" +
+        (const char*) glGetString(GL_RENDERER) + "\n" +
+        (const char*) glGetString(GL_VERSION);
+    unsigned long long driverKey = hashBytes(driver.data(), driver.size());
+
+    struct Pending {
+        GLuint program;
+        vector<GLuint> shaders;
+        vector<string> files;
+        vector<vector<string>> sourceStrings;
+        unsigned long long key;
+        bool cached;
+    };
+    vector<Pending> pending(programs.size());
+
+    // Issue every compile before asking for any result, so that the driver can
+    // work on all of them at the same time
+    int cachedCount = 0;
+    for (size_t p = 0; p < programs.size(); p++) {
+        const ProgramSource& source = programs[p];
+        pair<GLenum, const string*> stages[] = {
+            {GL_VERTEX_SHADER, &source.vertex},
+            {GL_TESS_CONTROL_SHADER, &source.tessControl},
+            {GL_TESS_EVALUATION_SHADER, &source.tessEvaluation},
+            {GL_GEOMETRY_SHADER, &source.geometry},
+            {GL_FRAGMENT_SHADER, &source.fragment}
+        };
+
+        vector<pair<GLenum, string>> codes;
+        unsigned long long key = driverKey;
+        for (const auto& stage : stages) {
+            if (stage.second->empty()) continue;
+            vector<string> sourceStrings;
+            string code = preprocessShader(*stage.second, source.defines, &sourceStrings);
+            pending[p].sourceStrings.push_back(sourceStrings);
+            key = hashBytes(&stage.first, sizeof(stage.first), key);
+            key = hashBytes(code.data(), code.size(), key);
+            codes.push_back(make_pair(stage.first, code));
+            pending[p].files.push_back(*stage.second);
+        }
+
+        pending[p].key = key;
+        pending[p].program = glCreateProgram();
+        pending[p].cached = binaries && loadProgramBinary(pending[p].program, key);
+        if (pending[p].cached) {
+            cachedCount++;
+            continue;
+        }
+        // a rejected binary leaves the program unusable, start over
+        glDeleteProgram(pending[p].program);
+        pending[p].program = glCreateProgram();
+
+        for (size_t s = 0; s < codes.size(); s++) {
+            cout << "Compiling shader: " << pending[p].files[s] << endl;
+            GLuint shaderID = glCreateShader(codes[s].first);
+            char const* sourcePointer = codes[s].second.c_str();
+            glShaderSource(shaderID, 1, &sourcePointer, NULL);
+            glCompileShader(shaderID);
+            pending[p].shaders.push_back(shaderID);
+        }
+    }
+
+    for (auto& program : pending) {
+        if (program.cached) continue;
+        for (GLuint shaderID : program.shaders) {
+            glAttachShader(program.program, shaderID);
+        }
+        if (binaries) {
+            glProgramParameteri(program.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(program.program);
+    }
+
+    // Collect the results
+    vector<GLuint> result;
+    for (auto& program : pending) {
+        if (!program.cached) {
+            for (size_t s = 0; s < program.shaders.size(); s++) {
+                printShaderLog(program.shaders[s], program.sourceStrings[s]);
+            }
+
+            GLint linked = GL_FALSE;
+            glGetProgramiv(program.program, GL_LINK_STATUS, &linked);
+            printProgramLog(program.program);
+
+            for (GLuint shaderID : program.shaders) {
+                glDetachShader(program.program, shaderID);
+                glDeleteShader(shaderID);
+            }
+
+            if (linked != GL_TRUE) {
+                cout << "Linking failed: " << program.files[0] << endl;
+                glDeleteProgram(program.program);
+                program.program = 0;
+            } else if (binaries) {
+                saveProgramBinary(program.program, program.key);
+            }
+        }
+        string label;
+        for (const string& file : program.files) label += (label.empty() ? "" : " + ") + file;
+        GLDebug::get().label(GL_PROGRAM, program.program, label);
+        result.push_back(program.program);
+    }
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Shader programs complete: " << programs.size() << " (" << cachedCount
+         << " from cache) in " << ms << " ms" << endl;
 
-    glDetachShader(programID, vertexShaderID);
-    glDeleteShader(vertexShaderID);
+    return result;
+}
 
-    if (geometryFilePath) {
-        glDetachShader(programID, geometryShaderID);
-        glDeleteShader(geometryShaderID);
+GLuint loadShaders(const char* vertexFilePath,
+                   const char* fragmentFilePath,
+                   const char* geometryFilePath,
+                   const char* tessControlFilePath,
+                   const char* tessEvaluationFilePath) {
+    ProgramSource source;
+    source.vertex = vertexFilePath;
+    source.fragment = fragmentFilePath;
+    if (geometryFilePath) source.geometry = geometryFilePath;
+    // tessellation stages come in pairs (GL 4.0)
+    if (tessControlFilePath && tessEvaluationFilePath) {
+        source.tessControl = tessControlFilePath;
+        source.tessEvaluation = tessEvaluationFilePath;
     }
+    return loadShaderPrograms(vector<ProgramSource>(1, source))[0];
+}
 
-    glDetachShader(programID, fragmentShaderID);
-    glDeleteShader(fragmentShaderID);
+/*****************************************************************************/
 
-    cout << "Shader program complete." << endl;
+ShaderProgram::Stats ShaderProgram::frameStats = {0, 0, 0};
+ShaderProgram::Stats ShaderProgram::lastFrameStats = {0, 0, 0};
 
-    return programID;
-}
\ No newline at end of file
+void ShaderProgram::resetFrameStats() {
+    lastFrameStats = frameStats;
+    frameStats = {0, 0, 0};
+}
+
+// FNV-1a
+static unsigned int hashName(const string& name) {
+    unsigned int hash = 2166136261u;
+    for (char c : name) {
+        hash ^= (unsigned char) c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Size in bytes of one element of a uniform type, 0 for samplers and
+// anything that is not uploaded through the typed setters
+static size_t uniformTypeSize(GLenum type) {
+    switch (type) {
+        case GL_FLOAT: return sizeof(float);
+        case GL_FLOAT_VEC2: return 2 * sizeof(float);
+        case GL_FLOAT_VEC3: return 3 * sizeof(float);
+        case GL_FLOAT_VEC4: return 4 * sizeof(float);
+        case GL_FLOAT_MAT4: return 16 * sizeof(float);
+        default: return sizeof(int);  // int, bool and sampler uniforms
+    }
+}
+
+ShaderProgram::ShaderProgram(GLuint program) : id(program) {
+    reflect();
+}
+
+ShaderProgram::~ShaderProgram() {
+    glDeleteProgram(id);
+}
+
+void ShaderProgram::use() {
+    RenderBackend::get().useProgram(id);
+}
+
+void ShaderProgram::reflect() {
+    GLint count = 0, maxLength = 0;
+
+    glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    vector<char> name(maxLength + 1);
+    for (GLint i = 0; i < count; i++) {
+        Uniform uniform;
+        GLsizei length = 0;
+        glGetActiveUniform(id, i, (GLsizei) name.size(), &length, &uniform.size, &uniform.type, &name[0]);
+        uniform.name = string(&name[0], length);
+        uniform.location = glGetUniformLocation(id, uniform.name.c_str());
+        uniforms.push_back(uniform);
+    }
+
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+    name.resize(maxLength + 1);
+    for (GLint i = 0; i < count; i++) {
+        UniformBlock block;
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(id, i, (GLsizei) name.size(), &length, &name[0]);
+        block.name = string(&name[0], length);
+        block.index = i;
+        glGetActiveUniformBlockiv(id, i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+        uniformBlocks.push_back(block);
+    }
+
+    glGetProgramiv(id, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(id, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    name.resize(maxLength + 1);
+    for (GLint i = 0; i < count; i++) {
+        Attribute attribute;
+        GLsizei length = 0;
+        glGetActiveAttrib(id, i, (GLsizei) name.size(), &length, &attribute.size, &attribute.type, &name[0]);
+        attribute.name = string(&name[0], length);
+        attribute.location = glGetAttribLocation(id, attribute.name.c_str());
+        attributes.push_back(attribute);
+    }
+
+    // power of two table, at most half full. Arrays are also found without
+    // their "[0]" suffix.
+    size_t names = 2 * uniforms.size() + uniformBlocks.size() + attributes.size();
+    size_t capacity = 16;
+    while (capacity < 2 * names) capacity *= 2;
+    table.assign(capacity, Entry{"", 0, UNIFORM, -1});
+
+    for (int i = 0; i < (int) uniforms.size(); i++) {
+        const string& uniformName = uniforms[i].name;
+        insert(uniformName, UNIFORM, i);
+        if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0) {
+            insert(uniformName.substr(0, uniformName.size() - 3), UNIFORM, i);
+        }
+    }
+    for (int i = 0; i < (int) uniformBlocks.size(); i++) {
+        insert(uniformBlocks[i].name, UNIFORM_BLOCK, i);
+    }
+    for (int i = 0; i < (int) attributes.size(); i++) {
+        insert(attributes[i].name, ATTRIBUTE, i);
+    }
+
+    // value cache, one slot per location holding the whole array
+    GLint maxLocation = -1;
+    for (const auto& uniform : uniforms) {
+        maxLocation = std::max(maxLocation, uniform.location);
+    }
+    cacheIndex.assign(maxLocation + 1, -1);
+    size_t offset = 0;
+    for (const auto& uniform : uniforms) {
+        if (uniform.location < 0) continue;
+        CachedValue value;
+        value.offset = offset;
+        value.capacity = uniformTypeSize(uniform.type) * uniform.size;
+        value.bytes = 0;
+        cacheIndex[uniform.location] = (int) cachedValues.size();
+        cachedValues.push_back(value);
+        offset += value.capacity;
+    }
+    cacheData.assign(offset, 0);
+}
+
+void ShaderProgram::insert(const string& name, EntryKind kind, int index) {
+    unsigned int hash = hashName(name);
+    size_t mask = table.size() - 1;
+    size_t slot = hash & mask;
+    while (table[slot].index != -1) {
+        slot = (slot + 1) & mask;
+    }
+    table[slot] = Entry{name, hash, kind, index};
+}
+
+const ShaderProgram::Entry* ShaderProgram::find(const string& name, EntryKind kind) const {
+    unsigned int hash = hashName(name);
+    size_t mask = table.size() - 1;
+    for (size_t slot = hash & mask; table[slot].index != -1; slot = (slot + 1) & mask) {
+        const Entry& entry = table[slot];
+        if (entry.hash == hash && entry.kind == kind && entry.name == name) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+GLint ShaderProgram::uniformLocation(const string& name) const {
+    const Entry* entry = find(name, UNIFORM);
+    if (entry) return uniforms[entry->index].location;
+    // elements of basic type arrays are reflected as one uniform
+    if (!name.empty() && name.back() == ']') {
+        return glGetUniformLocation(id, name.c_str());
+    }
+    return -1;
+}
+
+GLuint ShaderProgram::uniformBlockIndex(const string& name) const {
+    const Entry* entry = find(name, UNIFORM_BLOCK);
+    return entry ? uniformBlocks[entry->index].index : GL_INVALID_INDEX;
+}
+
+GLint ShaderProgram::attributeLocation(const string& name) const {
+    const Entry* entry = find(name, ATTRIBUTE);
+    return entry ? attributes[entry->index].location : -1;
+}
+
+bool ShaderProgram::changed(GLint location, const void* data, size_t bytes) {
+    if (location < 0) return false;
+
+    int index = location < (GLint) cacheIndex.size() ? cacheIndex[location] : -1;
+    if (index >= 0 && bytes <= cachedValues[index].capacity) {
+        CachedValue& value = cachedValues[index];
+        unsigned char* cached = &cacheData[value.offset];
+        if (value.bytes == bytes && memcmp(cached, data, bytes) == 0) {
+            frameStats.skipped++;
+            return false;
+        }
+        memcpy(cached, data, bytes);
+        value.bytes = bytes;
+    }
+
+    frameStats.uploads++;
+    frameStats.bytes += (unsigned int) bytes;
+    return true;
+}
+
+void ShaderProgram::set(GLint location, int value) {
+    if (changed(location, &value, sizeof(value)))
+        glUniform1i(location, value);
+}
+
+void ShaderProgram::set(GLint location, float value) {
+    if (changed(location, &value, sizeof(value)))
+        glUniform1f(location, value);
+}
+
+void ShaderProgram::set(GLint location, const glm::vec2& value) {
+    if (changed(location, &value[0], sizeof(value)))
+        glUniform2fv(location, 1, &value[0]);
+}
+
+void ShaderProgram::set(GLint location, const glm::vec3& value) {
+    if (changed(location, &value[0], sizeof(value)))
+        glUniform3fv(location, 1, &value[0]);
+}
+
+void ShaderProgram::set(GLint location, const glm::vec4& value) {
+    if (changed(location, &value[0], sizeof(value)))
+        glUniform4fv(location, 1, &value[0]);
+}
+
+void ShaderProgram::set(GLint location, const glm::mat4& value) {
+    if (changed(location, &value[0][0], sizeof(value)))
+        glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
+}
+
+void ShaderProgram::set(GLint location, const float* values, int count) {
+    if (changed(location, values, count * sizeof(float)))
+        glUniform1fv(location, count, values);
+}
+
+void ShaderProgram::set(GLint location, const glm::mat4* values, int count) {
+    if (changed(location, &values[0][0][0], count * sizeof(glm::mat4)))
+        glUniformMatrix4fv(location, count, GL_FALSE, &values[0][0][0]);
+}
+
+/*****************************************************************************/
+
+ShaderPermutations::ShaderPermutations(const ProgramSource& source) : source(source) {
+}
+
+ShaderPermutations::~ShaderPermutations() {
+    for (auto& program : programs) {
+        delete program.second;
+    }
+}
+
+void ShaderPermutations::prepare(const vector<ShaderDefines>& variants) {
+    vector<string> keys;
+    vector<ProgramSource> sources;
+    for (const ShaderDefines& defines : variants) {
+        string key = defines.str();
+        if (programs.count(key) || std::find(keys.begin(), keys.end(), key) != keys.end()) continue;
+        keys.push_back(key);
+        sources.push_back(source);
+        sources.back().defines = key;
+    }
+    if (sources.empty()) return;
+
+    vector<GLuint> built = loadShaderPrograms(sources);
+    for (size_t i = 0; i < keys.size(); i++) {
+        // failed variants are remembered as well, so they aren't rebuilt
+        programs[keys[i]] = built[i] ? new ShaderProgram(built[i]) : nullptr;
+    }
+}
+
+ShaderProgram* ShaderPermutations::get(const ShaderDefines& defines) {
+    string key = defines.str();
+    if (!programs.count(key)) {
+        prepare(vector<ShaderDefines>(1, defines));
+    }
+    return programs[key];
+}
@@ -1,8 +1,192 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <glm/glm.hpp>
+
+/**
+* Paths of the stages of a program and #define lines injected after the
+* #version directive of each stage. Empty paths are skipped.
+*/
+struct ProgramSource {
+    std::string vertex;
+    std::string fragment;
+    std::string geometry;
+    std::string tessControl;
+    std::string tessEvaluation;
+    std::string defines;
+};
+
+/**
+* Host side #defines of a shader variant. They are kept sorted by name, so equal
+* sets give equal strings and str() can key a permutation cache.
+*/
+class ShaderDefines {
+public:
+    ShaderDefines& set(const std::string& name, int value);
+    ShaderDefines& set(const std::string& name, const std::string& value = "");
+    std::string str() const;
+
+private:
+    std::map<std::string, std::string> values;
+};
+
+/**
+* Reads a shader file, resolving #include "name" relative to the including file
+* (each file once) and inserting the defines after #version. Included files are
+* marked with #line directives, their source string numbers are the indices in
+* includedFiles.
+*/
+std::string preprocessShader(const std::string& file, const std::string& defines,
+                             std::vector<std::string>* includedFiles = nullptr);
+
+/**
+* Builds several programs at once, 0 for the ones that fail to link.
+*
+* Programs are first looked up in the binary cache, keyed by a hash of their
+* sources and the driver vendor/renderer/version, and loaded with
+* glProgramBinary. The rest are compiled from source: every compile and link is
+* issued before any result is queried, so with GL_KHR_parallel_shader_compile
+* the driver builds all of them concurrently. Newly linked programs are written
+* back to the cache.
+*/
+std::vector<GLuint> loadShaderPrograms(const std::vector<ProgramSource>& programs);
+
+/**
+* Directory of the program binary cache ("shadercache" by default), an empty
+* path disables the cache.
+*/
+void setShaderCacheDirectory(const std::string& directory);
+
 GLuint loadShaders(const char* vertexFilePath,
                    const char* fragmentFilePath,
-                   const char* geometryFilePath = nullptr);
+                   const char* geometryFilePath = nullptr,
+                   const char* tessControlFilePath = nullptr,
+                   const char* tessEvaluationFilePath = nullptr);
+
+/**
+* A linked program with its active uniforms, uniform blocks and attributes
+* reflected once at link time into a flat hash table, so that no
+* glGetUniformLocation is needed while rendering.
+*
+* The typed setters remember the last value of every uniform and skip the
+* upload when it would not change it. They upload to the program in use, so
+* call use() first.
+*/
+class ShaderProgram {
+public:
+    struct Uniform {
+        std::string name;
+        GLint location;     // -1 for members of uniform blocks
+        GLenum type;
+        GLint size;         // array length
+    };
+
+    struct UniformBlock {
+        std::string name;
+        GLuint index;
+        GLint dataSize;
+    };
+
+    struct Attribute {
+        std::string name;
+        GLint location;
+        GLenum type;
+        GLint size;
+    };
+
+    // Uniform traffic of all programs
+    struct Stats {
+        unsigned int uploads;  // glUniform* calls issued
+        unsigned int skipped;  // calls dropped because the value was unchanged
+        unsigned int bytes;    // bytes uploaded
+    };
+    static Stats frameStats;
+    static Stats lastFrameStats;
+
+    /* Call once per frame: keeps the counters of the frame in lastFrameStats */
+    static void resetFrameStats();
+
+    GLuint id;
+    std::vector<Uniform> uniforms;
+    std::vector<UniformBlock> uniformBlocks;
+    std::vector<Attribute> attributes;
+
+    /* Takes ownership of a linked program */
+    ShaderProgram(GLuint program);
+    ShaderProgram(const ShaderProgram&) = delete;
+    ~ShaderProgram();
+
+    void use();
+
+    /* -1 when the uniform is not active */
+    GLint uniformLocation(const std::string& name) const;
+    /* GL_INVALID_INDEX when the block is not active */
+    GLuint uniformBlockIndex(const std::string& name) const;
+    /* -1 when the attribute is not active */
+    GLint attributeLocation(const std::string& name) const;
+
+    void set(GLint location, int value);
+    void set(GLint location, float value);
+    void set(GLint location, const glm::vec2& value);
+    void set(GLint location, const glm::vec3& value);
+    void set(GLint location, const glm::vec4& value);
+    void set(GLint location, const glm::mat4& value);
+    void set(GLint location, const float* values, int count);
+    void set(GLint location, const glm::mat4* values, int count);
+
+private:
+    enum EntryKind { UNIFORM, UNIFORM_BLOCK, ATTRIBUTE };
+
+    // open addressing table over the reflected names
+    struct Entry {
+        std::string name;
+        unsigned int hash;
+        EntryKind kind;
+        int index;          // into uniforms, uniformBlocks or attributes, -1 if empty
+    };
+    std::vector<Entry> table;
+
+    // last uploaded value of every uniform location
+    struct CachedValue {
+        size_t offset;
+        size_t capacity;
+        size_t bytes;       // 0 until the first upload
+    };
+    std::vector<int> cacheIndex;         // location -> cachedValues, -1 if untracked
+    std::vector<CachedValue> cachedValues;
+    std::vector<unsigned char> cacheData;
+
+    void reflect();
+    void insert(const std::string& name, EntryKind kind, int index);
+    const Entry* find(const std::string& name, EntryKind kind) const;
+    bool changed(GLint location, const void* data, size_t bytes);
+};
+
+/**
+* Compile-time specialized variants of one program, e.g. with the exact wave
+* count or shadow kernel size defined so the compiler can unroll the loops.
+* Variants are built on first use, or up front in one batch with prepare(), and
+* live as long as the cache.
+*/
+class ShaderPermutations {
+public:
+    explicit ShaderPermutations(const ProgramSource& source);
+    ~ShaderPermutations();
+
+    /** Builds the variants that don't exist yet with one loadShaderPrograms. */
+    void prepare(const std::vector<ShaderDefines>& variants);
+
+    /** The variant for the defines, nullptr if it fails to link. */
+    ShaderProgram* get(const ShaderDefines& defines);
+
+    const ProgramSource source;
+
+private:
+    std::map<std::string, ShaderProgram*> programs;
+};
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,138 @@
+#include <iostream>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include "shadow.h"
+#include "memorytracker.h"
+#include "glcalls.h"
+#include "gldebug.h"
+#include "backend.h"
+
+using namespace glm;
+using namespace std;
+
+CascadedShadowMap::CascadedShadowMap(int resolution, int cascadeCount)
+    : resolution(resolution), initialized(false) {
+    shadowDistance = 40.0f;
+    splitLambda = 0.75f;
+    casterMargin = 10.0f;
+    biasTexels = 1.5f;
+
+    // near cascades every frame, every further cascade half as often
+    cascades.resize(cascadeCount);
+    for (int i = 0; i < cascadeCount; i++) {
+        cascades[i].viewProjection = mat4(1.0f);
+        cascades[i].splitDepth = 0.0f;
+        cascades[i].bias = 0.0f;
+        cascades[i].updateInterval = 1 << i;
+        cascades[i].needsRender = true;
+    }
+
+    texture = RenderBackend::get().createTexture(GL_TEXTURE_2D_ARRAY);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution,
+                 cascadeCount, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    // 24 bit depth is stored in 4 bytes
+    MemoryTracker::get().allocate(MemoryTracker::TEXTURE, texture,
+                                  (size_t) resolution * resolution * cascadeCount * 4, MemoryTag::ShadowMap);
+    GLDebug::get().label(GL_TEXTURE, texture, "shadow cascades");
+    // linear filtering with comparison gives a 2x2 PCF per tap
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+    glGenFramebuffers(1, &FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    GLDebug::get().label(GL_FRAMEBUFFER, FBO, "shadow map");
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, 0);
+
+    // No color buffer is drawn to
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        throw runtime_error("Shadow map frame buffer not initialized correctly");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+CascadedShadowMap::~CascadedShadowMap() {
+    glDeleteFramebuffers(1, &FBO);
+    deleteTextures(1, &texture);
+}
+
+void CascadedShadowMap::update(const mat4& cameraView, float fov, float aspect,
+                               float nearPlane, const vec3& lightDirection,
+                               unsigned int frame) {
+    mat4 inverseView = inverse(cameraView);
+    float tanHalfY = tan(radians(fov) * 0.5f);
+    float tanHalfX = tanHalfY * aspect;
+    int count = (int) cascades.size();
+
+    float splitNear = nearPlane;
+    for (int i = 0; i < count; i++) {
+        Cascade& cascade = cascades[i];
+
+        // practical split scheme
+        float p = (i + 1) / (float) count;
+        float logSplit = nearPlane * pow(shadowDistance / nearPlane, p);
+        float uniformSplit = nearPlane + (shadowDistance - nearPlane) * p;
+        float splitFar = splitLambda * logSplit + (1.0f - splitLambda) * uniformSplit;
+        cascade.splitDepth = splitFar;
+
+        // staggered so that the cascades don't all refresh on the same frame
+        cascade.needsRender = !initialized || (frame + i) % cascade.updateInterval == 0;
+        if (!cascade.needsRender) {
+            splitNear = splitFar;
+            continue;
+        }
+
+        // Bounding sphere of the slice. It only depends on the projection, so
+        // the cascade keeps its size while the camera moves or rotates.
+        vec3 corners[8];
+        for (int c = 0; c < 8; c++) {
+            float z = (c & 4) ? splitFar : splitNear;
+            float x = ((c & 1) ? 1.0f : -1.0f) * z * tanHalfX;
+            float y = ((c & 2) ? 1.0f : -1.0f) * z * tanHalfY;
+            corners[c] = vec3(x, y, -z);
+        }
+        vec3 centerView = vec3(0.0f, 0.0f, -0.5f * (splitNear + splitFar));
+        float radius = 0.0f;
+        for (int c = 0; c < 8; c++) {
+            radius = glm::max(radius, length(corners[c] - centerView));
+        }
+        radius = ceil(radius * 16.0f) / 16.0f;
+
+        vec3 center = vec3(inverseView * vec4(centerView, 1.0f));
+        vec3 up = abs(lightDirection.y) > 0.99f ? vec3(0, 0, 1) : vec3(0, 1, 0);
+        float depthRange = 2.0f * radius + 2.0f * casterMargin;
+        mat4 lightView = lookAt(center - lightDirection * (radius + casterMargin), center, up);
+        mat4 lightProjection = ortho(-radius, radius, -radius, radius, 0.0f, depthRange);
+
+        // snap the world origin to a texel, so that moving the cascade moves
+        // the map by whole texels only
+        vec4 origin = lightProjection * lightView * vec4(0, 0, 0, 1);
+        float texelsPerUnit = resolution / 2.0f;
+        vec2 snapped = vec2(origin) * texelsPerUnit;
+        vec2 offset = (round(snapped) - snapped) / texelsPerUnit;
+        lightProjection[3][0] += offset.x;
+        lightProjection[3][1] += offset.y;
+
+        cascade.viewProjection = lightProjection * lightView;
+        cascade.bias = biasTexels * (2.0f * radius / resolution) / depthRange;
+
+        splitNear = splitFar;
+    }
+    initialized = true;
+}
+
+void CascadedShadowMap::bindCascade(int cascade) {
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, cascade);
+    glViewport(0, 0, resolution, resolution);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
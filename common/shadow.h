@@ -0,0 +1,59 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+* Cascaded shadow maps fitted to the camera frustum. Each cascade covers a
+* slice of the view frustum with a bounding sphere, so its size does not change
+* when the camera rotates, and its projection is snapped to whole shadow map
+* texels, so the shadows do not shimmer when the camera moves.
+*
+* The cascades live in the layers of one depth texture array with hardware
+* comparison enabled (sampler2DArrayShadow). Distant cascades can be refreshed
+* less often than the near ones through Cascade::updateInterval.
+*/
+class CascadedShadowMap {
+public:
+    struct Cascade {
+        glm::mat4 viewProjection; // matrix the layer was last rendered with
+        float splitDepth;         // far end of the slice, view space distance
+        float bias;               // depth bias in [0, 1] depth units
+        int updateInterval;       // frames between two renders of the layer
+        bool needsRender;
+    };
+
+    GLuint texture, FBO;
+    int resolution;
+    std::vector<Cascade> cascades;
+
+    // Shadows are computed up to this distance from the camera
+    float shadowDistance;
+    // Blend between logarithmic (1) and uniform (0) split distances
+    float splitLambda;
+    // Extra depth behind each cascade for casters outside the view frustum
+    float casterMargin;
+    // Depth bias in texels of the cascade
+    float biasTexels;
+
+    CascadedShadowMap(int resolution, int cascadeCount);
+    ~CascadedShadowMap();
+
+    /**
+    * Refits the cascades that are due this frame to the camera frustum and
+    * marks them with needsRender.
+    */
+    void update(const glm::mat4& cameraView, float fov, float aspect,
+                float nearPlane, const glm::vec3& lightDirection,
+                unsigned int frame);
+
+    /* Binds and clears the layer of a cascade as the depth target */
+    void bindCascade(int cascade);
+
+private:
+    bool initialized;
+};
+
+#endif
@@ -1,12 +1,129 @@
 #include <GL/glew.h>
 #include <glfw3.h>
 #include <SOIL.h>
+#include <stb_image_aug.h>
 #include <string.h>
 #include <iostream>
 #include "texture.h"
+#include "util.h"
+#include "trace.h"
+#include "memorytracker.h"
+#include "glcalls.h"
+#include "gldebug.h"
 using namespace std;
 
-GLuint loadBMP(const char* imagePath) {
+// Offsets of ring allocations, enough for any unpack alignment and block size
+static const size_t UPLOAD_ALIGNMENT = 256;
+
+PixelUploadRing::PixelUploadRing(size_t capacity)
+    : buffer(0), capacity(capacity), mapped(nullptr), head(0) {
+    // without a persistent mapping a staging copy is no faster than the
+    // upload from memory
+    if (!GLEW_VERSION_4_4 && !GLEW_ARB_buffer_storage) return;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    // coherent, so writes from other threads need no explicit flush
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, capacity, nullptr, flags);
+    mapped = (unsigned char*) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, capacity, flags);
+    MemoryTracker::get().allocate(MemoryTracker::BUFFER, buffer, capacity, MemoryTag::Staging);
+    GLDebug::get().label(GL_BUFFER, buffer, "pixel upload ring");
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+PixelUploadRing::~PixelUploadRing() {
+    if (!buffer) return;
+    for (const Region& region : regions) {
+        if (region.fence) glDeleteSync(region.fence);
+    }
+    // the driver keeps the storage alive for the copies still in flight
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    deleteBuffers(1, &buffer);
+}
+
+// Takes space after head, wrapping to the start when the end is too short.
+// Regions stay in address order, so the space up to the oldest one is free.
+PixelUploadRing::Allocation PixelUploadRing::reserve(size_t size) {
+    Allocation allocation;
+    size = (size + UPLOAD_ALIGNMENT - 1) / UPLOAD_ALIGNMENT * UPLOAD_ALIGNMENT;
+    if (size == 0 || size > capacity) return allocation;
+
+    size_t offset;
+    if (regions.empty()) {
+        offset = head = 0;
+    } else {
+        size_t tail = regions.front().offset;
+        if (head > tail) {
+            if (head + size <= capacity) {
+                offset = head;
+            } else if (size <= tail) {
+                // pad the end, the padding is released with the regions before it
+                Region padding = { head, capacity - head, 0, true };
+                regions.push_back(padding);
+                offset = 0;
+            } else {
+                return allocation;
+            }
+        } else if (head < tail && head + size <= tail) {
+            offset = head;
+        } else {
+            return allocation;
+        }
+    }
+
+    Region region = { offset, size, 0, false };
+    regions.push_back(region);
+    head = offset + size;
+
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.pixels = mapped ? mapped + offset : nullptr;
+    return allocation;
+}
+
+// Frees the oldest regions whose copies have completed
+void PixelUploadRing::retire() {
+    while (!regions.empty() && regions.front().uploaded) {
+        Region& front = regions.front();
+        if (front.fence) {
+            GLenum state = glClientWaitSync(front.fence, 0, 0);
+            if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) break;
+            glDeleteSync(front.fence);
+        }
+        regions.pop_front();
+    }
+}
+
+PixelUploadRing::Allocation PixelUploadRing::tryAllocate(size_t size) {
+    if (!mapped) return Allocation();
+    lock_guard<mutex> guard(lock);
+    return reserve(size);
+}
+
+void PixelUploadRing::upload(const Allocation& allocation, GLenum target, GLint level,
+                             int width, int height, GLenum format) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(target, level, 0, 0, width, height, format, GL_UNSIGNED_BYTE,
+                    (const void*) allocation.offset);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    lock_guard<mutex> guard(lock);
+    for (Region& region : regions) {
+        if (region.offset == allocation.offset && !region.uploaded) {
+            region.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            region.uploaded = true;
+            break;
+        }
+    }
+    retire();
+}
+
+/*****************************************************************************/
+
+Image decodeBMP(const char* imagePath, PixelUploadRing* ring) {
     cout << "Reading image: " << imagePath << endl;
 
     // Data read from the header of the BMP file
@@ -14,8 +131,6 @@ GLuint loadBMP(const char* imagePath) {
     unsigned int dataPos;
     unsigned int imageSize;
     unsigned int width, height;
-    // Actual RGB data
-    unsigned char * data;
 
     // Open the file
     FILE * file = fopen(imagePath, "rb");
@@ -61,15 +176,85 @@ GLuint loadBMP(const char* imagePath) {
         dataPos = 54; // The BMP header is done that way
     }
 
-    // Create a buffer
-    data = new unsigned char[imageSize];
-
-    // Read the actual data from the file into the buffer
+    // Read the actual data from the file into the upload ring, or a buffer
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.format = GL_BGR;
+    if (ring) image.staging = ring->tryAllocate(imageSize);
+    unsigned char* data;
+    if (image.staging.pixels) {
+        image.ring = ring;
+        data = image.staging.pixels;
+    } else {
+        image.pixels.resize(imageSize);
+        data = &image.pixels[0];
+    }
+    fseek(file, dataPos, SEEK_SET);
     fread(data, 1, imageSize, file);
 
     // Everything is in memory now, the file can be closed.
     fclose(file);
 
+    return image;
+}
+
+Image decodeImage(const char* imagePath, PixelUploadRing* ring) {
+    cout << "Reading image: " << imagePath << endl;
+
+    int width, height, channels;
+    unsigned char* data = stbi_load(imagePath, &width, &height, &channels, 0);
+    if (!data) {
+        throw runtime_error(string("Image could not be opened: ") + imagePath);
+    }
+
+    const GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.format = formats[channels - 1];
+    size_t size = (size_t) width * height * channels;
+    if (ring) image.staging = ring->tryAllocate(size);
+    if (image.staging.pixels) {
+        image.ring = ring;
+        memcpy(image.staging.pixels, data, size);
+    } else {
+        image.pixels.assign(data, data + size);
+    }
+    stbi_image_free(data);
+
+    return image;
+}
+
+int bytesPerPixel(const Image& image) {
+    switch (image.format) {
+        case GL_RED: return 1;
+        case GL_RG: return 2;
+        case GL_RGB: case GL_BGR: return 3;
+        default: return 4;
+    }
+}
+
+void uploadTextureImage(GLenum target, const Image& image) {
+    GLenum internalFormat = image.format == GL_BGR ? GL_RGB :
+                            image.format == GL_BGRA ? GL_RGBA : image.format;
+    MemoryTracker::get().upload(MemoryTag::Textures, (size_t) image.width * image.height * bytesPerPixel(image));
+    if (image.staging.pixels) {
+        // the storage first, then a copy on the GPU from the ring
+        glTexImage2D(target, 0, internalFormat, image.width, image.height, 0,
+                     image.format, GL_UNSIGNED_BYTE, nullptr);
+        image.ring->upload(image.staging, target, 0, image.width, image.height, image.format);
+        return;
+    }
+
+    // rows of RGB images are not 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(target, 0, internalFormat, image.width, image.height, 0,
+                 image.format, GL_UNSIGNED_BYTE, &image.pixels[0]);
+}
+
+GLuint uploadTexture(const Image& image) {
+    TRACE_SCOPE("upload", "uploadTexture");
     // Create one OpenGL texture
     GLuint textureID;
     glGenTextures(1, &textureID);
@@ -78,10 +263,7 @@ GLuint loadBMP(const char* imagePath) {
     glBindTexture(GL_TEXTURE_2D, textureID);
 
     // Give the image to OpenGL
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
-
-    // OpenGL has now copied the data. Free our own version
-    delete[] data;
+    uploadTextureImage(GL_TEXTURE_2D, image);
 
     // Poor filtering, or ...
     //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -94,11 +276,18 @@ GLuint loadBMP(const char* imagePath) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     // ... which requires mipmaps. Generate them automatically.
     glGenerateMipmap(GL_TEXTURE_2D);
+    MemoryTracker::get().allocate(MemoryTracker::TEXTURE, textureID,
+                                  textureBytes(image.width, image.height, bytesPerPixel(image), true),
+                                  MemoryTag::Textures);
 
     // Return the ID of the texture we just created
     return textureID;
 }
 
+GLuint loadBMP(const char* imagePath) {
+    return uploadTexture(decodeBMP(imagePath));
+}
+
 // Since GLFW 3, glfwLoadTexture2D() has been removed. You have to use another texture loading library,
 // or do it yourself (just like loadBMP_custom and loadDDS)
 //GLuint loadTGA_glfw(const char * imagepath){
@@ -127,45 +316,30 @@ GLuint loadBMP(const char* imagePath) {
 #define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
 #define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
 #define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+#define FOURCC_ATI2 0x32495441 // Equivalent to "ATI2" in ASCII, BC5
+#define DDSCAPS2_CUBEMAP 0x200
 
 GLuint loadDDS(const char* imagePath) {
-    unsigned char header[124];
-
-    FILE *fp;
+    cout << "Reading image: " << imagePath << endl;
 
-    /* try to open the file */
-    fp = fopen(imagePath, "rb");
-    if (fp == NULL) {
-        throw runtime_error(string("Image could not be opened: ") + imagePath);
-    }
+    // the mip levels are uploaded straight from the mapping, without a copy
+    MappedFile file(imagePath);
+    const unsigned char* data = file.data();
 
     /* verify the type of file */
-    char filecode[4];
-    fread(filecode, 1, 4, fp);
-    if (strncmp(filecode, "DDS ", 4) != 0) {
-        fclose(fp);
-        throw runtime_error("DDS error");
+    if (file.size() < 128 || strncmp((const char*) data, "DDS ", 4) != 0) {
+        throw runtime_error(string("Not a correct DDS file: ") + imagePath);
     }
 
     /* get the surface desc */
-    fread(&header, 124, 1, fp);
-
+    const unsigned char* header = data + 4;
     unsigned int height = *(unsigned int*)&(header[8]);
     unsigned int width = *(unsigned int*)&(header[12]);
-    unsigned int linearSize = *(unsigned int*)&(header[16]);
     unsigned int mipMapCount = *(unsigned int*)&(header[24]);
     unsigned int fourCC = *(unsigned int*)&(header[80]);
+    unsigned int caps2 = *(unsigned int*)&(header[108]);
+    if (mipMapCount == 0) mipMapCount = 1;
 
-    unsigned char * buffer;
-    unsigned int bufsize;
-    /* how big is it going to be including all mipmaps? */
-    bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize;
-    buffer = (unsigned char*) malloc(bufsize * sizeof(unsigned char));
-    fread(buffer, 1, bufsize, fp);
-    /* close the file pointer */
-    fclose(fp);
-
-    unsigned int components = (fourCC == FOURCC_DXT1) ? 3 : 4;
     unsigned int format;
     switch (fourCC) {
         case FOURCC_DXT1:
@@ -177,38 +351,62 @@ GLuint loadDDS(const char* imagePath) {
         case FOURCC_DXT5:
             format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
             break;
+        case FOURCC_ATI2:
+            format = GL_COMPRESSED_RG_RGTC2;
+            break;
         default:
-            free(buffer);
             return 0;
     }
 
+    // Cube maps store the faces +X, -X, +Y, -Y, +Z, -Z, each with its mip chain
+    bool cubemap = (caps2 & DDSCAPS2_CUBEMAP) != 0;
+    GLenum target = cubemap ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+    int faces = cubemap ? 6 : 1;
+
     // Create one OpenGL texture
     GLuint textureID;
     glGenTextures(1, &textureID);
 
     // "Bind" the newly created texture : all future texture functions will modify this texture
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    glBindTexture(target, textureID);
+    GLDebug::get().label(GL_TEXTURE, textureID, imagePath);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
     unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
-    unsigned int offset = 0;
+    size_t offset = 128;
 
     /* load the mipmaps */
-    for (unsigned int level = 0; level < mipMapCount && (width || height); ++level) {
-        unsigned int size = ((width + 3) / 4)*((height + 3) / 4)*blockSize;
-        glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height,
-                               0, size, buffer + offset);
-
-        offset += size;
-        width /= 2;
-        height /= 2;
-
-        // Deal with Non-Power-Of-Two textures. This code is not included in the webpage to reduce clutter.
-        if (width < 1) width = 1;
-        if (height < 1) height = 1;
+    for (int face = 0; face < faces; face++) {
+        GLenum faceTarget = cubemap ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+        unsigned int levelWidth = width;
+        unsigned int levelHeight = height;
+        for (unsigned int level = 0; level < mipMapCount; ++level) {
+            unsigned int size = ((levelWidth + 3) / 4)*((levelHeight + 3) / 4)*blockSize;
+            if (offset + size > file.size()) {
+                deleteTextures(1, &textureID);
+                throw runtime_error(string("Truncated DDS file: ") + imagePath);
+            }
+            glCompressedTexImage2D(faceTarget, level, format, levelWidth, levelHeight,
+                                   0, size, data + offset);
+
+            MemoryTracker::get().grow(MemoryTracker::TEXTURE, textureID, size, MemoryTag::Textures);
+            MemoryTracker::get().upload(MemoryTag::Textures, size);
+            offset += size;
+            levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+            levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+        }
     }
 
-    free(buffer);
+    // only the levels in the file, so that the texture is complete without
+    // glGenerateMipmap
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, mipMapCount - 1);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER,
+                    mipMapCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    GLint wrap = cubemap ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(target, GL_TEXTURE_WRAP_R, wrap);
 
     return textureID;
 }
@@ -230,6 +428,14 @@ GLuint loadSOIL(const char* imagePath) {
     // error check
     if (texture == 0) {
         cout << "SOIL loading error: " << SOIL_last_result() << endl;
+    } else {
+        GLint width = 0, height = 0;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        MemoryTracker::get().allocate(MemoryTracker::TEXTURE, texture, textureBytes(width, height, 3, false),
+                                      MemoryTag::Textures);
+        MemoryTracker::get().upload(MemoryTag::Textures, (size_t) width * height * 3);
     }
 
     return texture;
@@ -2,6 +2,105 @@
 #define TEXTURE_H
 
 #include <GL/glew.h>
+#include <vector>
+#include <deque>
+#include <mutex>
+
+/**
+* Staging memory for texture uploads: a ring in a GL_PIXEL_UNPACK_BUFFER, from
+* which glTexSubImage2D copies asynchronously. Each upload is fenced and its
+* space is reused once the fence has signaled.
+*
+* The buffer needs ARB_buffer_storage (GL 4.4) to be persistently mapped, so
+* decode jobs on worker threads can write the pixels straight into it with
+* tryAllocate(). Without it there is no buffer and tryAllocate() always fails,
+* the images are then decoded into memory and uploaded from there.
+*/
+class PixelUploadRing {
+public:
+    struct Allocation {
+        unsigned char* pixels = nullptr;    // nullptr if the allocation failed
+        size_t offset = 0;
+        size_t size = 0;
+    };
+
+    explicit PixelUploadRing(size_t capacity = 64 << 20);
+    ~PixelUploadRing();
+    PixelUploadRing(const PixelUploadRing&) = delete;
+    PixelUploadRing& operator=(const PixelUploadRing&) = delete;
+
+    bool persistent() const { return mapped != nullptr; }
+
+    /** Any thread, only with a persistent mapping. Fails instead of waiting. */
+    Allocation tryAllocate(size_t size);
+
+    /**
+    * GL thread. Copies an allocation into a level of the texture bound to
+    * target (a cube map face for cube maps), whose storage must exist already.
+    * The allocation must not be used afterwards.
+    */
+    void upload(const Allocation& allocation, GLenum target, GLint level,
+                int width, int height, GLenum format);
+
+private:
+    struct Region {
+        size_t offset;
+        size_t size;
+        GLsync fence;       // set by upload()
+        bool uploaded;
+    };
+
+    GLuint buffer;
+    size_t capacity;
+    unsigned char* mapped;  // persistent mapping, nullptr without a buffer
+    size_t head;
+    std::deque<Region> regions;     // in allocation order
+    std::mutex lock;
+
+    Allocation reserve(size_t size);
+    void retire();
+};
+
+/**
+* Decoded pixels. The decode functions only read files, so they can run on any
+* thread, the upload functions need the GL context. Given an upload ring the
+* decode functions write the pixels into it when it has room, instead of into
+* the pixels vector, and the upload is a copy on the GPU.
+*/
+struct Image {
+    int width = 0;
+    int height = 0;
+    GLenum format = GL_RGB;     // of the pixels, GL_BGR for .bmp files
+    std::vector<unsigned char> pixels;
+    PixelUploadRing* ring = nullptr;
+    PixelUploadRing::Allocation staging;
+
+    /* No pixels in memory or in the ring, e.g. after a failed decode */
+    bool empty() const { return pixels.empty() && !staging.pixels; }
+};
+
+/**
+* Reads a 24bpp .bmp file.
+*/
+Image decodeBMP(const char* imagePath, PixelUploadRing* ring = nullptr);
+
+/**
+* Reads any format stb_image knows (see loadSOIL), keeping its channels.
+*/
+Image decodeImage(const char* imagePath, PixelUploadRing* ring = nullptr);
+
+/* Bytes of a pixel of the image as the texture stores it */
+int bytesPerPixel(const Image& image);
+
+/**
+* Creates a repeating 2D texture with trilinear filtering and mipmaps.
+*/
+GLuint uploadTexture(const Image& image);
+
+/**
+* Fills one level 0 image of a texture target, e.g. a cube map face.
+*/
+void uploadTextureImage(GLenum target, const Image& image);
 
 /**
 * A simple .bmp loader. Use loadSOIL() instead.
@@ -9,7 +108,9 @@
 GLuint loadBMP(const char* imagePath);
 
 /**
-* A .dds loader.
+* A .dds loader for BC1/BC2/BC3 ("DXT1/3/5") and BC5 ("ATI2") textures and cube
+* maps, see tools/texconv. The file is memory mapped and its mip levels are
+* uploaded as they are.
 */
 GLuint loadDDS(const char* imagePath);
 
@@ -0,0 +1,190 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include "trace.h"
+
+using namespace std;
+
+static const chrono::steady_clock::time_point processStart = chrono::steady_clock::now();
+
+// Name of the calling thread and the buffer it records into, which is
+// released for a later thread when it exits
+static thread_local string threadName;
+
+struct BufferHolder {
+    atomic<bool>* released = nullptr;
+    void* buffer = nullptr;
+    ~BufferHolder() {
+        if (released) released->store(true);
+    }
+};
+static thread_local BufferHolder holder;
+
+Tracer& Tracer::get() {
+    static Tracer tracer;
+    return tracer;
+}
+
+double Tracer::now() {
+    return toMicroseconds(chrono::steady_clock::now());
+}
+
+double Tracer::toMicroseconds(chrono::steady_clock::time_point time) {
+    return chrono::duration<double, micro>(time - processStart).count();
+}
+
+void Tracer::setThreadName(const string& name) {
+    threadName = name;
+}
+
+const char* Tracer::intern(const string& name) {
+    lock_guard<mutex> guard(lock);
+    return names.insert(name).first->c_str();
+}
+
+void Tracer::start(const string& path, int frames) {
+    lock_guard<mutex> guard(lock);
+    if (active.load()) return;
+    this->path = path;
+    framesLeft = frames;
+    frameStart = now();
+    // buffers of older captures restart as soon as their thread records
+    generation++;
+    active.store(true);
+    cout << "Tracing " << frames << " frames to " << path << endl;
+}
+
+void Tracer::frame() {
+    if (!capturing()) return;
+    double end = now();
+    complete("frame", "frame", frameStart, end);
+    frameStart = end;
+    if (--framesLeft <= 0) {
+        active.store(false);
+        write();
+    }
+}
+
+Tracer::ThreadBuffer& Tracer::buffer() {
+    if (holder.buffer) return *(ThreadBuffer*) holder.buffer;
+
+    // reuses the buffer of an exited thread unless it has events of this capture
+    lock_guard<mutex> guard(lock);
+    ThreadBuffer* buffer = nullptr;
+    for (auto& candidate : buffers) {
+        if (candidate->released.load() && candidate->generation.load() != generation.load()) {
+            buffer = candidate.get();
+            break;
+        }
+    }
+    if (!buffer) {
+        buffers.push_back(unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+        buffer = buffers.back().get();
+        buffer->events.reset(new Event[EVENTS_PER_THREAD]);
+    }
+    buffer->released.store(false);
+    buffer->generation.store(0);
+    buffer->count.store(0);
+    buffer->tid = nextTid++;
+    buffer->name = threadName.empty() ? "thread " + to_string(buffer->tid) : threadName;
+    holder.buffer = buffer;
+    holder.released = &buffer->released;
+    return *buffer;
+}
+
+void Tracer::record(const Event& event) {
+    ThreadBuffer& buffer = this->buffer();
+    unsigned int current = generation.load(memory_order_acquire);
+    if (buffer.generation.load(memory_order_relaxed) != current) {
+        buffer.dropped.store(0, memory_order_relaxed);
+        buffer.count.store(0, memory_order_relaxed);
+        buffer.generation.store(current, memory_order_release);
+    }
+    size_t index = buffer.count.load(memory_order_relaxed);
+    if (index >= EVENTS_PER_THREAD) {
+        buffer.dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    buffer.events[index] = event;
+    buffer.count.store(index + 1, memory_order_release);
+}
+
+void Tracer::complete(const char* category, const char* name, double start, double end) {
+    record({ category, name, 'X', start, end - start, 0 });
+}
+
+void Tracer::counter(const char* name, double value) {
+    record({ "counter", name, 'C', now(), value, 0 });
+}
+
+void Tracer::flowBegin(const char* name, unsigned long long id) {
+    record({ "flow", name, 's', now(), 0.0, id });
+}
+
+void Tracer::flowEnd(const char* name, unsigned long long id) {
+    record({ "flow", name, 'f', now(), 0.0, id });
+}
+
+static void writeString(ostream& out, const char* text) {
+    out << '"';
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            out << '\\' << *c;
+        } else if ((unsigned char) *c < 0x20) {
+            out << "\\u" << hex << setw(4) << setfill('0') << (int) *c << dec << setfill(' ');
+        } else {
+            out << *c;
+        }
+    }
+    out << '"';
+}
+
+void Tracer::write() {
+    lock_guard<mutex> guard(lock);
+    ofstream out(path);
+    if (!out) {
+        cout << "Can't write trace: " << path << endl;
+        return;
+    }
+    out << fixed << setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    size_t written = 0, dropped = 0;
+    unsigned int current = generation.load();
+    for (auto& buffer : buffers) {
+        if (buffer->generation.load(memory_order_acquire) != current) continue;
+        size_t count = buffer->count.load(memory_order_acquire);
+        dropped += buffer->dropped.load(memory_order_relaxed);
+
+        if (!first) out << ",\n";
+        first = false;
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+            << ",\"args\":{\"name\":";
+        writeString(out, buffer->name.c_str());
+        out << "}}";
+
+        for (size_t i = 0; i < count; i++) {
+            const Event& event = buffer->events[i];
+            out << ",\n{\"name\":";
+            writeString(out, event.name);
+            out << ",\"cat\":";
+            writeString(out, event.category);
+            out << ",\"ph\":\"" << event.phase << "\",\"ts\":" << event.time
+                << ",\"pid\":1,\"tid\":" << buffer->tid;
+            if (event.phase == 'X') {
+                out << ",\"dur\":" << event.value;
+            } else if (event.phase == 'C') {
+                out << ",\"args\":{\"value\":" << event.value << "}";
+            } else {
+                out << ",\"id\":" << event.id;
+                if (event.phase == 'f') out << ",\"bp\":\"e\"";
+            }
+            out << "}";
+        }
+        written += count;
+    }
+    out << "\n]}\n";
+    cout << "Trace written to " << path << ": " << written << " events";
+    if (dropped) cout << ", " << dropped << " dropped";
+    cout << endl;
+}
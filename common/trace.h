@@ -0,0 +1,127 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <set>
+#include <chrono>
+
+/**
+* Event tracer for the Chrome trace format, the files open in Perfetto
+* (ui.perfetto.dev) or chrome://tracing. A capture covers the next frames and
+* is written after its last one. Every thread records into its own buffer
+* without locking, outside of a capture recording is a single atomic load.
+*
+* Names must outlive the capture, use string literals or intern(). Use the
+* TRACE_* macros, they compile to nothing unless ENABLE_PROFILER is defined.
+*/
+class Tracer {
+public:
+    static const size_t EVENTS_PER_THREAD = 1 << 16;
+
+    static Tracer& get();
+
+    bool capturing() const { return active.load(std::memory_order_relaxed); }
+
+    /* Captures from now until `frames` calls of frame(), then writes path */
+    void start(const std::string& path, int frames);
+
+    /* Call once per frame on the main thread, records the frame as a slice */
+    void frame();
+
+    /* A stable copy of a name that isn't a literal */
+    const char* intern(const std::string& name);
+
+    /* Shown for the calling thread */
+    static void setThreadName(const std::string& name);
+
+    /* Microseconds since the start of the process */
+    static double now();
+    static double toMicroseconds(std::chrono::steady_clock::time_point time);
+
+    void complete(const char* category, const char* name, double start, double end);
+    void counter(const char* name, double value);
+    void flowBegin(const char* name, unsigned long long id);
+    void flowEnd(const char* name, unsigned long long id);
+
+private:
+    struct Event {
+        const char* category;
+        const char* name;
+        char phase;
+        double time;
+        double value;                   // duration of slices, value of counters
+        unsigned long long id;          // of flows
+    };
+
+    struct ThreadBuffer {
+        std::unique_ptr<Event[]> events;
+        // written by the thread, read by write() on the thread ending the capture
+        std::atomic<size_t> count;
+        std::atomic<unsigned int> generation;   // of the capture the events belong to
+        std::atomic<size_t> dropped;
+        int tid = 0;
+        std::string name;
+        std::atomic<bool> released;     // its thread has exited
+        ThreadBuffer() : count(0), generation(0), dropped(0), released(false) {}
+    };
+
+    Tracer() : active(false), generation(0) {}
+    ThreadBuffer& buffer();
+    void record(const Event& event);
+    void write();
+
+    std::atomic<bool> active;
+    std::atomic<unsigned int> generation;
+    std::mutex lock;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::set<std::string> names;
+    int nextTid = 1;
+    std::string path;
+    int framesLeft = 0;
+    double frameStart = 0.0;
+};
+
+/* Records its lifetime as a slice */
+class TraceScope {
+public:
+    TraceScope(const char* category, const char* name)
+        : category{category}, name{name},
+          start{Tracer::get().capturing() ? Tracer::now() : -1.0} {}
+    ~TraceScope() {
+        if (start >= 0.0 && Tracer::get().capturing()) {
+            Tracer::get().complete(category, name, start, Tracer::now());
+        }
+    }
+private:
+    const char* category;
+    const char* name;
+    double start;
+};
+
+#define PROFILER_CONCAT2(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT2(a, b)
+
+#ifdef ENABLE_PROFILER
+#define TRACE_SCOPE(category, name) TraceScope PROFILER_CONCAT(traceScope, __LINE__)(category, name)
+#define TRACE_COUNTER(name, value) \
+    do { if (Tracer::get().capturing()) Tracer::get().counter(name, (double) (value)); } while (0)
+#define TRACE_FLOW_BEGIN(name, id) \
+    do { if (Tracer::get().capturing()) Tracer::get().flowBegin(name, id); } while (0)
+#define TRACE_FLOW_END(name, id) \
+    do { if (Tracer::get().capturing()) Tracer::get().flowEnd(name, id); } while (0)
+#define TRACE_THREAD_NAME(name) Tracer::setThreadName(name)
+#define TRACE_INTERN(name) Tracer::get().intern(name)
+#else
+#define TRACE_SCOPE(category, name)
+#define TRACE_COUNTER(name, value)
+#define TRACE_FLOW_BEGIN(name, id)
+#define TRACE_FLOW_END(name, id)
+#define TRACE_THREAD_NAME(name)
+#define TRACE_INTERN(name) nullptr
+#endif
+
+#endif
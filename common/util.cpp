@@ -1,8 +1,29 @@
 #include <GL/glew.h>
 #include <iostream>
 #include <cmath>
+#include <errno.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#ifdef _WIN32
+#include <direct.h>
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#define PSAPI_VERSION 2
+#include <psapi.h>
+#else
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 using namespace std;
 #include "util.h"
+#include "glcalls.h"
 
 void logGLParameters() {
     GLenum params[] = {
@@ -71,4 +92,129 @@ bool fileExists(const std::string & abs_filename) {
     }
 
     return ret;
-}
\ No newline at end of file
+}
+
+bool createDirectory(const std::string& path) {
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+unsigned long long hashBytes(const void* data, size_t size, unsigned long long seed) {
+    const unsigned char* bytes = (const unsigned char*) data;
+    unsigned long long hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+int workerThreadCount() {
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 1 ? (int) cores - 1 : 1;
+}
+
+size_t peakMemoryUsage() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return (size_t) usage.ru_maxrss;            // bytes
+#else
+    return (size_t) usage.ru_maxrss * 1024;     // kilobytes
+#endif
+#endif
+}
+
+static atomic<int> threadLimit(0);
+
+void limitThreads(int threads) {
+    threadLimit = max(threads, 0);
+}
+
+void parallelFor(int tasks, const function<void(int)>& task) {
+    int threads = min(tasks, workerThreadCount() + 1);
+    if (threadLimit > 0) threads = min(threads, threadLimit.load());
+    if (threads <= 1) {
+        for (int i = 0; i < tasks; i++) task(i);
+        return;
+    }
+
+    atomic<int> next(0);
+    mutex errorLock;
+    exception_ptr error;
+    auto run = [&]() {
+        for (int i = next++; i < tasks; i = next++) {
+            try {
+                task(i);
+            } catch (...) {
+                lock_guard<mutex> guard(errorLock);
+                if (!error) error = current_exception();
+            }
+        }
+    };
+
+    vector<thread> workers;
+    for (int i = 1; i < threads; i++) workers.push_back(thread(run));
+    run();
+    for (auto& worker : workers) worker.join();
+    if (error) rethrow_exception(error);
+}
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& path) : bytes(nullptr), length(0), file(nullptr), mapping(nullptr) {
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw runtime_error("File could not be opened: " + path);
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    length = (size_t) fileSize.QuadPart;
+    if (length == 0) return;
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping) bytes = (const unsigned char*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!bytes) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        throw runtime_error("File could not be mapped: " + path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (bytes) UnmapViewOfFile(bytes);
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+}
+#else
+MappedFile::MappedFile(const std::string& path) : bytes(nullptr), length(0), file(-1) {
+    file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        throw runtime_error("File could not be opened: " + path);
+    }
+    struct stat fileStat;
+    fstat(file, &fileStat);
+    length = (size_t) fileStat.st_size;
+    if (length == 0) return;
+
+    void* mapped = mmap(NULL, length, PROT_READ, MAP_PRIVATE, file, 0);
+    if (mapped == MAP_FAILED) {
+        close(file);
+        throw runtime_error("File could not be mapped: " + path);
+    }
+    bytes = (const unsigned char*) mapped;
+}
+
+MappedFile::~MappedFile() {
+    if (bytes) munmap((void*) bytes, length);
+    close(file);
+}
+#endif
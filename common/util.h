@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <functional>
 
 /* We can use a function like this to print some GL capabilities of our adapter
 to the log file. handy if we want to debug problems on other people's computers
@@ -41,4 +42,62 @@ std::string getBaseDir(const std::string& filepath);
 */
 bool fileExists(const std::string& abs_filename);
 
+/**
+* Create a directory, succeeds if it already exists.
+*/
+bool createDirectory(const std::string& path);
+
+/**
+* 64 bit FNV-1a hash, pass the previous result as seed to hash in pieces.
+*/
+unsigned long long hashBytes(const void* data, size_t size,
+                             unsigned long long seed = 14695981039346656037ull);
+
+/**
+* Number of worker threads for background jobs, one core is left to the GL
+* thread.
+*/
+int workerThreadCount();
+
+/**
+* Runs task(0) .. task(tasks - 1) on all cores, the calling thread included,
+* and rethrows the first exception once every task has finished.
+*/
+void parallelFor(int tasks, const std::function<void(int)>& task);
+
+/**
+* Caps the threads of parallelFor, the calling one included, e.g. to measure
+* how a kernel scales. 0 lifts the cap.
+*/
+void limitThreads(int threads);
+
+/**
+* Peak resident memory of the process in bytes, 0 where it is unknown.
+*/
+size_t peakMemoryUsage();
+
+/**
+* Read only memory mapping of a whole file, throws if it can't be opened.
+*/
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const unsigned char* bytes;
+    size_t length;
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int file;
+#endif
+};
+
 #endif
\ No newline at end of file
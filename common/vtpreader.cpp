@@ -0,0 +1,507 @@
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "vtpreader.h"
+#include "objparser.h"
+#include "util.h"
+
+using namespace glm;
+using namespace std;
+
+enum class VTPType {
+    Int8, UInt8, Int16, UInt16, Int32, UInt32, Int64, UInt64, Float32, Float64
+};
+
+static VTPType parseType(const string& name) {
+    static const char* names[] = {
+        "Int8", "UInt8", "Int16", "UInt16", "Int32", "UInt32", "Int64", "UInt64", "Float32", "Float64"
+    };
+    for (int i = 0; i < 10; i++) {
+        if (name == names[i]) return (VTPType) i;
+    }
+    throw runtime_error("Unsupported DataArray type in VTP file: " + name);
+}
+
+static size_t typeSize(VTPType type) {
+    static const size_t sizes[] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8 };
+    return sizes[(int) type];
+}
+
+template<typename In, typename Out>
+static void convertAs(const unsigned char* in, size_t count, Out* out) {
+    for (size_t i = 0; i < count; i++) {
+        In value;
+        memcpy(&value, in + i * sizeof(In), sizeof(In));
+        out[i] = (Out) value;
+    }
+}
+
+// Little endian values of the given type to Out
+template<typename Out>
+static void convert(VTPType type, const unsigned char* in, size_t count, Out* out) {
+    switch (type) {
+    case VTPType::Int8: convertAs<signed char>(in, count, out); break;
+    case VTPType::UInt8: convertAs<unsigned char>(in, count, out); break;
+    case VTPType::Int16: convertAs<short>(in, count, out); break;
+    case VTPType::UInt16: convertAs<unsigned short>(in, count, out); break;
+    case VTPType::Int32: convertAs<int>(in, count, out); break;
+    case VTPType::UInt32: convertAs<unsigned int>(in, count, out); break;
+    case VTPType::Int64: convertAs<long long>(in, count, out); break;
+    case VTPType::UInt64: convertAs<unsigned long long>(in, count, out); break;
+    case VTPType::Float32: convertAs<float>(in, count, out); break;
+    case VTPType::Float64: convertAs<double>(in, count, out); break;
+    }
+}
+
+/*****************************************************************************/
+
+// Just enough XML for VTK files: tags with attributes, text is left in place
+struct XMLTag {
+    string name;
+    bool closing;       // </name>
+    bool empty;         // <name/>
+    vector<pair<string, string>> attributes;
+    const char* begin;  // at the '<'
+    const char* end;    // after the '>'
+
+    string attribute(const char* key, const char* fallback = "") const {
+        for (const auto& attribute : attributes) {
+            if (attribute.first == key) return attribute.second;
+        }
+        return fallback;
+    }
+};
+
+static bool isXMLSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static const char* skipXMLSpace(const char* p, const char* end) {
+    while (p < end && isXMLSpace(*p)) p++;
+    return p;
+}
+
+static const char* findText(const char* p, const char* end, const char* text) {
+    const char* found = search(p, end, text, text + strlen(text));
+    if (found == end) throw runtime_error("Unterminated XML in VTP file");
+    return found + strlen(text);
+}
+
+// The next tag from p on, false at the end of the text
+static bool nextTag(const char*& p, const char* end, XMLTag& tag) {
+    while (true) {
+        p = (const char*) memchr(p, '<', end - p);
+        if (!p) return false;
+        if (end - p >= 4 && memcmp(p, "<!--", 4) == 0) {
+            p = findText(p, end, "-->");
+        } else if (end - p >= 2 && (p[1] == '?' || p[1] == '!')) {
+            p = findText(p, end, ">");
+        } else {
+            break;
+        }
+    }
+
+    tag.begin = p;
+    const char* q = p + 1;
+    tag.closing = q < end && *q == '/';
+    if (tag.closing) q++;
+    const char* name = q;
+    while (q < end && !isXMLSpace(*q) && *q != '>' && *q != '/') q++;
+    tag.name.assign(name, q);
+    tag.empty = false;
+    tag.attributes.clear();
+
+    while (true) {
+        q = skipXMLSpace(q, end);
+        if (q >= end) throw runtime_error("Unterminated XML tag in VTP file");
+        if (*q == '>') break;
+        if (*q == '/') {
+            tag.empty = true;
+            q++;
+            continue;
+        }
+        const char* key = q;
+        while (q < end && !isXMLSpace(*q) && *q != '=' && *q != '>') q++;
+        string attributeName(key, q);
+        q = skipXMLSpace(q, end);
+        if (q >= end || *q != '=') throw runtime_error("Invalid XML attribute in VTP file");
+        q = skipXMLSpace(q + 1, end);
+        if (q >= end || (*q != '"' && *q != '\'')) throw runtime_error("Invalid XML attribute in VTP file");
+        const char* value = q + 1;
+        const char* valueEnd = (const char*) memchr(value, *q, end - value);
+        if (!valueEnd) throw runtime_error("Unterminated XML attribute in VTP file");
+        tag.attributes.push_back(make_pair(attributeName, string(value, valueEnd)));
+        q = valueEnd + 1;
+    }
+    tag.end = q + 1;
+    p = tag.end;
+    return true;
+}
+
+/*****************************************************************************/
+
+// Bytes of a binary DataArray, raw or base64 encoded. Padding may appear
+// between separately encoded parts, as in VTK's compressed inline data.
+class ByteReader {
+public:
+    ByteReader(const char* p, const char* end, bool base64)
+        : p(p), end(end), base64(base64), buffer(0), bits(0) {}
+
+    void read(void* out, size_t size) {
+        unsigned char* bytes = (unsigned char*) out;
+        if (!base64) {
+            if (size > (size_t) (end - p)) throw runtime_error("Truncated data in VTP file");
+            memcpy(bytes, p, size);
+            p += size;
+            return;
+        }
+        for (size_t i = 0; i < size;) {
+            if (bits >= 8) {
+                bits -= 8;
+                bytes[i++] = (unsigned char) (buffer >> bits);
+                continue;
+            }
+            if (p >= end) throw runtime_error("Truncated data in VTP file");
+            char c = *p++;
+            int value = base64Value(c);
+            if (c == '=') {
+                bits = 0;
+            } else if (value >= 0) {
+                buffer = (buffer << 6) | value;
+                bits += 6;
+            } else if (!isXMLSpace(c)) {
+                throw runtime_error("Invalid base64 data in VTP file");
+            }
+        }
+    }
+
+    unsigned long long readHeader(size_t headerSize) {
+        if (headerSize == 4) {
+            unsigned int value;
+            read(&value, 4);
+            return value;
+        }
+        unsigned long long value;
+        read(&value, 8);
+        return value;
+    }
+
+private:
+    static int base64Value(char c) {
+        if (c >= 'A' && c <= 'Z') return c - 'A';
+        if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+        if (c >= '0' && c <= '9') return c - '0' + 52;
+        if (c == '+') return 62;
+        if (c == '/') return 63;
+        return -1;
+    }
+
+    const char* p;
+    const char* end;
+    bool base64;
+    unsigned int buffer;
+    int bits;
+};
+
+// Where the DataArrays of a piece are and how they are encoded
+struct ArrayRef {
+    enum Format { ASCII, BINARY, APPENDED };
+
+    bool present = false;
+    VTPType type = VTPType::Float32;
+    int components = 1;
+    Format format = ASCII;
+    const char* begin = nullptr;    // inline text
+    const char* end = nullptr;
+    size_t offset = 0;              // into the appended data
+};
+
+struct VTPPiece {
+    size_t numberOfPoints = 0;
+    size_t numberOfPolys = 0;
+    ArrayRef points, normals, uvs, connectivity, offsets;
+};
+
+struct VTPLayout {
+    size_t headerSize = 4;
+    bool compressed = false;
+    bool appendedBase64 = false;
+    const char* appended = nullptr; // after the '_'
+    const char* end = nullptr;
+};
+
+static const char* parseAscii(const char* p, const char* end, float& value) {
+    return parseFloat(p, end, value);
+}
+
+template<typename T>
+static const char* parseAscii(const char* p, const char* end, T& value) {
+    const char* start = p;
+    bool negative = p < end && *p == '-';
+    if (negative || (p < end && *p == '+')) p++;
+    long long result = 0;
+    const char* digits = p;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) result = result * 10 + (*p - '0');
+    if (p == digits) return start;
+    value = (T) (negative ? -result : result);
+    return p;
+}
+
+template<typename Out>
+static void readBinary(ByteReader& reader, const VTPLayout& layout, VTPType type,
+                       size_t count, Out* out) {
+    size_t size = typeSize(type);
+    vector<unsigned char> block;
+    if (!layout.compressed) {
+        if (reader.readHeader(layout.headerSize) < count * size) {
+            throw runtime_error("DataArray too short in VTP file");
+        }
+        // a block at a time, never the whole array
+        const size_t blockValues = 65536 / size;
+        for (size_t done = 0; done < count;) {
+            size_t n = std::min(count - done, blockValues);
+            block.resize(n * size);
+            reader.read(block.data(), n * size);
+            convert(type, block.data(), n, out + done);
+            done += n;
+        }
+        return;
+    }
+
+#ifdef HAVE_ZLIB
+    unsigned long long blocks = reader.readHeader(layout.headerSize);
+    unsigned long long blockSize = reader.readHeader(layout.headerSize);
+    unsigned long long lastBlockSize = reader.readHeader(layout.headerSize);
+    if (blockSize % size != 0) throw runtime_error("Unsupported compressed block size in VTP file");
+    vector<unsigned long long> compressedSizes(blocks);
+    for (auto& compressedSize : compressedSizes) {
+        compressedSize = reader.readHeader(layout.headerSize);
+    }
+
+    vector<unsigned char> compressed;
+    size_t done = 0;
+    for (unsigned long long b = 0; b < blocks && done < count; b++) {
+        uLongf rawSize = (uLongf) (b + 1 == blocks && lastBlockSize ? lastBlockSize : blockSize);
+        compressed.resize(compressedSizes[b]);
+        reader.read(compressed.data(), compressed.size());
+        block.resize(rawSize);
+        uLongf length = rawSize;
+        if (uncompress(block.data(), &length, compressed.data(), (uLong) compressed.size()) != Z_OK ||
+            length != rawSize) {
+            throw runtime_error("Corrupt compressed data in VTP file");
+        }
+        size_t n = std::min(count - done, (size_t) rawSize / size);
+        convert(type, block.data(), n, out + done);
+        done += n;
+    }
+    if (done < count) throw runtime_error("DataArray too short in VTP file");
+#else
+    throw runtime_error("Compressed VTP files need a build with zlib");
+#endif
+}
+
+// count values of the array into out, converted to Out
+template<typename Out>
+static void readArray(const ArrayRef& array, const VTPLayout& layout, size_t count, Out* out) {
+    if (array.format == ArrayRef::ASCII) {
+        const char* p = array.begin;
+        for (size_t i = 0; i < count; i++) {
+            p = skipXMLSpace(p, array.end);
+            const char* next = parseAscii(p, array.end, out[i]);
+            if (next == p) throw runtime_error("DataArray too short in VTP file");
+            p = next;
+        }
+    } else if (array.format == ArrayRef::BINARY) {
+        ByteReader reader(array.begin, array.end, true);
+        readBinary(reader, layout, array.type, count, out);
+    } else {
+        if (!layout.appended || array.offset > (size_t) (layout.end - layout.appended)) {
+            throw runtime_error("Missing appended data in VTP file");
+        }
+        ByteReader reader(layout.appended + array.offset, layout.end, layout.appendedBase64);
+        readBinary(reader, layout, array.type, count, out);
+    }
+}
+
+static ArrayRef arrayRef(const XMLTag& tag, const char*& p, const char* end) {
+    ArrayRef array;
+    array.present = true;
+    array.type = parseType(tag.attribute("type"));
+    array.components = atoi(tag.attribute("NumberOfComponents", "1").c_str());
+    string format = tag.attribute("format", "ascii");
+    if (format == "ascii") {
+        array.format = ArrayRef::ASCII;
+    } else if (format == "binary") {
+        array.format = ArrayRef::BINARY;
+    } else if (format == "appended") {
+        array.format = ArrayRef::APPENDED;
+        array.offset = strtoull(tag.attribute("offset", "0").c_str(), nullptr, 10);
+    } else {
+        throw runtime_error("Unsupported DataArray format in VTP file: " + format);
+    }
+    if (!tag.empty) {
+        // the text after any child elements (the InformationKeys of newer VTK
+        // writers) up to the closing tag, read later in place
+        array.begin = tag.end;
+        XMLTag child;
+        const char* q = tag.end;
+        while (true) {
+            if (!nextTag(q, end, child)) throw runtime_error("Unterminated DataArray in VTP file");
+            if (child.closing && child.name == "DataArray") break;
+            array.begin = child.end;
+        }
+        array.end = child.begin;
+        p = child.end;
+    }
+    return array;
+}
+
+// Fills vec2s from an array with two or more components
+static void readUVs(const ArrayRef& array, const VTPLayout& layout, size_t count, vec2* out) {
+    if (array.components == 2) {
+        readArray(array, layout, 2 * count, &out[0].x);
+        return;
+    }
+    vector<float> values(count * array.components);
+    readArray(array, layout, values.size(), values.data());
+    for (size_t i = 0; i < count; i++) {
+        out[i] = vec2(values[i * array.components], values[i * array.components + 1]);
+    }
+}
+
+static void readPiece(const VTPPiece& piece, const VTPLayout& layout, VTPData& data) {
+    size_t base = data.points.size();
+    size_t count = piece.numberOfPoints;
+    if (!piece.points.present || piece.points.components != 3) {
+        throw runtime_error("Missing points in VTP file");
+    }
+    data.points.resize(base + count);
+    readArray(piece.points, layout, 3 * count, &data.points[base].x);
+
+    // pieces without normals or uvs get zeros when others have them
+    if (piece.normals.present && piece.normals.components == 3) {
+        data.normals.resize(base + count);
+        readArray(piece.normals, layout, 3 * count, &data.normals[base].x);
+    }
+    if (piece.uvs.present && piece.uvs.components >= 2) {
+        data.uvs.resize(base + count);
+        readUVs(piece.uvs, layout, count, &data.uvs[base]);
+    }
+
+    if (piece.numberOfPolys == 0) return;
+    if (!piece.connectivity.present || !piece.offsets.present) {
+        throw runtime_error("Missing polygons in VTP file");
+    }
+    vector<long long> offsets(piece.numberOfPolys);
+    readArray(piece.offsets, layout, offsets.size(), offsets.data());
+    if (offsets.back() < 0) throw runtime_error("Invalid polygon offsets in VTP file");
+    vector<unsigned int> connectivity((size_t) offsets.back());
+    readArray(piece.connectivity, layout, connectivity.size(), connectivity.data());
+
+    data.triangles.reserve(data.triangles.size() + 3 * (connectivity.size() - std::min(connectivity.size(), 2 * offsets.size())));
+    long long start = 0;
+    for (long long polygonEnd : offsets) {
+        if (polygonEnd < start || polygonEnd > (long long) connectivity.size()) {
+            throw runtime_error("Invalid polygon offsets in VTP file");
+        }
+        // fan triangulation
+        for (long long k = start + 1; k + 1 < polygonEnd; k++) {
+            unsigned int corners[3] = { connectivity[start], connectivity[k], connectivity[k + 1] };
+            for (unsigned int corner : corners) {
+                if (corner >= count) throw runtime_error("Point index out of range in VTP file");
+                data.triangles.push_back((unsigned int) base + corner);
+            }
+        }
+        start = polygonEnd;
+    }
+}
+
+VTPData readVTP(const string& path) {
+    MappedFile file(path);
+    const char* text = (const char*) file.data();
+    const char* end = text + file.size();
+
+    VTPLayout layout;
+    layout.end = end;
+    vector<VTPPiece> pieces;
+    vector<string> sections;    // the open elements
+    string normalsName, uvsName;
+    bool polyData = false;
+
+    XMLTag tag;
+    const char* p = text;
+    while (p && nextTag(p, end, tag)) {
+        if (tag.closing) {
+            if (!sections.empty() && sections.back() == tag.name) sections.pop_back();
+            continue;
+        }
+        string section = sections.empty() ? string() : sections.back();
+        if (tag.name == "VTKFile") {
+            if (tag.attribute("type") != "PolyData") throw runtime_error("Not a PolyData VTK file: " + path);
+            if (tag.attribute("byte_order", "LittleEndian") != "LittleEndian") {
+                throw runtime_error("Big endian VTP files are not supported: " + path);
+            }
+            layout.headerSize = tag.attribute("header_type", "UInt32") == "UInt64" ? 8 : 4;
+            string compressor = tag.attribute("compressor");
+            if (!compressor.empty() && compressor != "vtkZLibDataCompressor") {
+                throw runtime_error("Unsupported VTP compressor: " + compressor);
+            }
+            layout.compressed = !compressor.empty();
+            polyData = true;
+        } else if (tag.name == "Piece") {
+            VTPPiece piece;
+            piece.numberOfPoints = strtoull(tag.attribute("NumberOfPoints", "0").c_str(), nullptr, 10);
+            piece.numberOfPolys = strtoull(tag.attribute("NumberOfPolys", "0").c_str(), nullptr, 10);
+            pieces.push_back(piece);
+        } else if (tag.name == "DataArray") {
+            string name = tag.attribute("Name");
+            ArrayRef array = arrayRef(tag, p, end);
+            // the arrays of FieldData, CellData, Verts, Lines and Strips are skipped
+            if (section != "Points" && section != "PointData" && section != "Polys") continue;
+            if (pieces.empty()) throw runtime_error("DataArray outside of a Piece in VTP file");
+            VTPPiece& piece = pieces.back();
+            if (section == "Points" && !piece.points.present) {
+                piece.points = array;
+            } else if (section == "PointData") {
+                bool normals = normalsName.empty() ? array.components == 3 : name == normalsName;
+                bool uvs = uvsName.empty() ? name == "TCoords" || name == "TextureCoordinates" : name == uvsName;
+                if (normals && !piece.normals.present) piece.normals = array;
+                else if (uvs && !piece.uvs.present) piece.uvs = array;
+            } else if (section == "Polys") {
+                if (name == "connectivity") piece.connectivity = array;
+                else if (name == "offsets") piece.offsets = array;
+            }
+            // arrayRef() read up to the closing tag
+            continue;
+        } else if (tag.name == "AppendedData") {
+            string encoding = tag.attribute("encoding", "raw");
+            if (encoding != "raw" && encoding != "base64") {
+                throw runtime_error("Unsupported appended data encoding in VTP file: " + encoding);
+            }
+            layout.appendedBase64 = encoding == "base64";
+            // raw bytes follow the '_', there are no more tags to read
+            const char* underscore = (const char*) memchr(tag.end, '_', end - tag.end);
+            if (!underscore) throw runtime_error("Invalid appended data in VTP file");
+            layout.appended = underscore + 1;
+            p = nullptr;
+            continue;
+        } else if (tag.name == "PointData") {
+            normalsName = tag.attribute("Normals");
+            uvsName = tag.attribute("TCoords");
+        }
+        if (!tag.empty) sections.push_back(tag.name);
+    }
+    if (!polyData) throw runtime_error("Not a PolyData VTK file: " + path);
+
+    VTPData data;
+    for (const auto& piece : pieces) {
+        readPiece(piece, layout, data);
+    }
+    if (!data.normals.empty()) data.normals.resize(data.points.size());
+    if (!data.uvs.empty()) data.uvs.resize(data.points.size());
+    return data;
+}
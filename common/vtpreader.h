@@ -0,0 +1,30 @@
+#ifndef VTP_READER_H
+#define VTP_READER_H
+
+#include <vector>
+#include <string>
+#include <glm/glm.hpp>
+
+/**
+* Indexed triangles of a VTK PolyData (.vtp) file, the polygons of all pieces
+* triangulated as fans. normals and uvs are empty when the point data has
+* none.
+*/
+struct VTPData {
+    std::vector<glm::vec3> points, normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<unsigned int> triangles;
+};
+
+/**
+* Reads the file in one pass over a memory mapping, without building a DOM.
+* DataArrays can be ascii, inline base64 or appended (raw or base64), and
+* zlib compressed when built with zlib. Values are converted straight into
+* the result, so memory stays close to its size. Elements inside DataArrays
+* (InformationKey) and the arrays of other sections are skipped, as in the
+* files ParaView writes (see lab03/quad.vtp). Throws on anything malformed or
+* unsupported.
+*/
+VTPData readVTP(const std::string& path);
+
+#endif
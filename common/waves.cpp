@@ -0,0 +1,111 @@
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include "waves.h"
+#include "profiler.h"
+
+using namespace std;
+using namespace glm;
+
+static const float PI = 3.14159265f;
+static const float G = 9.80665f;
+
+const WavePreset wavePresets[3] = {
+    { 1.5f / 6, 0.1f, 8.0f, 1.75f },
+    { 1.0f / 6, 0.05f, 10.0f, 1.5f },
+    { 2.0f / 6, 0.2f, 9.0f, 2.0f }
+};
+
+vector<Wave> createWaves(int waveCount, const WavePreset& preset) {
+    vector<Wave> waves;
+    waves.reserve(waveCount);
+    float baseSteepness = preset.steepness;
+    float baseWavelength = preset.length;
+    float baseSpeed = preset.speed;
+    float baseAmplitude = preset.amplitude;
+
+    // Parameters for frequency and amplitude decay (similar to FBM)
+    float amplitudeDecay = 0.85f;  // Each successive wave will have half the amplitude of the previous
+    float frequencyMultiplier = 1.15f;  // Frequency doubles for each successive wave
+
+    for (int i = 0; i < waveCount; i++) {
+        Wave wave;
+
+        // Generate a random direction (angle in radians between 0 and 2π)
+        float randomAngle = ((rand() % 100) / 100.0f) * (2.0f * PI);
+        wave.direction = vec2(cos(randomAngle), sin(randomAngle));
+
+        // Apply amplitude decay and frequency increase as per FBM
+        wave.amplitude = baseAmplitude * pow(amplitudeDecay, i);  // Amplitude decreases exponentially
+        wave.wavelength = baseWavelength / pow(frequencyMultiplier, i);  // Frequency (or 1/wavelength) increases exponentially
+        wave.speed = baseSpeed * sqrt((9.81f * wave.wavelength) / (2.0f * PI));
+
+        // Slight variations in steepness for realism
+        wave.steepness = baseSteepness * (0.9f + (rand() % 20 / 100.0f));
+
+        waves.push_back(wave);
+    }
+    return waves;
+}
+
+float waveHeight(const vec3& vertex, const vector<Wave>& waves, float time) {
+    float height = 0.0f;
+
+    for (const auto& wave : waves) {
+        // Gerstner wave height calculation (as an example)
+        float wavePhase = dot(wave.direction, vec2(vertex.x, vertex.z)) - wave.speed * time;
+        height += wave.amplitude * sin(wavePhase);
+    }
+
+    return height;
+}
+
+vec3 wavePosition(const vec2& position, const vector<Wave>& waves, float time) {
+    vec3 result(position.x, 0.0f, position.y);
+    for (const auto& wave : waves) {
+        vec2 d = normalize(wave.direction);
+        float k = 2.0f * PI / wave.wavelength;
+        float w = sqrt(G * k);
+        float phase = k * dot(d, position) - wave.speed * w * time;
+        float q = std::min(wave.steepness / k, 1.0f);
+        float width = wave.amplitude * q * sin(phase);
+        result += vec3(d.x * width, wave.amplitude * cos(phase), d.y * width);
+    }
+    return result;
+}
+
+vec3 waveNormal(const vec3& position, const vector<Wave>& waves, float time) {
+    vec3 normal(0.0f, 1.0f, 0.0f);
+    for (const auto& wave : waves) {
+        vec2 d = normalize(wave.direction);
+        float k = 2.0f * PI / wave.wavelength;
+        float w = sqrt(G * k);
+        float phase = k * dot(d, vec2(position.x, position.z)) - wave.speed * w * time;
+        float af = wave.amplitude * k;
+        float omega = af * cos(phase);
+        normal -= vec3(d.x * omega, wave.steepness * af * sin(phase), d.y * omega);
+    }
+    return normalize(normal);
+}
+
+vector<vec3> findTopVertices(const vector<vec3>& vertices, const vector<Wave>& waves, float time, int topCount) {
+    PROFILE_CPU("findTopVertices");
+    vector<pair<float, vec3>> vertexHeights;
+
+    // Calculate the height for each vertex
+    for (const auto& vertex : vertices) {
+        float height = waveHeight(vertex, waves, time);
+        vertexHeights.push_back(make_pair(height, vertex));
+    }
+
+    // Sort vertices by their calculated height
+    std::sort(vertexHeights.begin(), vertexHeights.end(), [](const pair<float, vec3>& a, const pair<float, vec3>& b) {
+        return a.first > b.first;  // Sort by height in descending order
+        });
+
+    vector<vec3> topVertices;
+    for (int i = 0; i < topCount && i < (int) vertexHeights.size(); ++i) {
+        topVertices.push_back(vertexHeights[i].second);
+    }
+    return topVertices;
+}
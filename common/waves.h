@@ -0,0 +1,51 @@
+#ifndef WAVES_H
+#define WAVES_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+* A Gerstner wave, as in the waves[] uniform of lab03/waves.glsl.
+*/
+struct Wave {
+    glm::vec2 direction;
+    float steepness;
+    float wavelength;
+    float speed;
+    float amplitude;
+};
+
+/* Base wave of createWaves, --waves 1, 2 or 3 */
+struct WavePreset {
+    float amplitude;
+    float steepness;
+    float length;
+    float speed;
+};
+extern const WavePreset wavePresets[3];
+
+/**
+* Random directions with amplitude decaying and frequency growing like an FBM,
+* ordered from the longest wave to the shortest. Uses rand().
+*/
+std::vector<Wave> createWaves(int waveCount, const WavePreset& preset);
+
+/**
+* Cheap height estimate of the surface above a grid vertex, a sum of sines
+* without the horizontal displacement. findTopVertices ranks by it.
+*/
+float waveHeight(const glm::vec3& vertex, const std::vector<Wave>& waves, float time);
+
+/* Displaced position and normal of a grid point, as gerstner_wave_position
+and gerstner_wave_normal in waves.glsl without the wave LOD */
+glm::vec3 wavePosition(const glm::vec2& position, const std::vector<Wave>& waves, float time);
+glm::vec3 waveNormal(const glm::vec3& position, const std::vector<Wave>& waves, float time);
+
+/**
+* The topCount vertices with the largest waveHeight, highest first.
+*/
+std::vector<glm::vec3> findTopVertices(const std::vector<glm::vec3>& vertices,
+                                       const std::vector<Wave>& waves, float time,
+                                       int topCount = 10);
+
+#endif
@@ -3,6 +3,8 @@
 #include <string>
 #include <vector>
 #include <cstdlib> 
+#include <chrono>
+#include <fstream>
 
 // Include GLEW
 #include <GL/glew.h>
@@ -21,14 +23,19 @@
 #include <common/model.h>
 #include <common/texture.h>
 #include <common/light.h>
+#include <common/shadow.h>
+#include <common/assets.h>
 #include <common/FountainEmitter.h>
-#include "stb_image_aug.h"
+#include <common/profiler.h>
+#include <common/waves.h>
+#include <common/scene.h>
+#include <common/memorytracker.h>
+#include <common/gldebug.h>
+#include <common/glrecorder.h>
+#include <common/backend.h>
+#include <common/glstate.h>
 #include <algorithm>
 
-//Enable for particles
-//#define PARTICLES 
-
-
 using namespace std;
 using namespace glm;
 
@@ -37,8 +44,7 @@ void initialize();
 void createContext();
 void mainLoop();
 void free();
-void createWaves(int waveCount);
-void uploadWavesToShader(GLuint shaderProgram);
+void uploadWavesToShader(ShaderProgram* program);
 vec2 rotateVector(const vec2& v, float angle);
 
 #define W_WIDTH 1024
@@ -50,16 +56,15 @@ vec2 rotateVector(const vec2& v, float angle);
 GLFWwindow* window;
 Camera* camera;
 Light* light;
-GLuint shaderProgram, depthProgram, miniMapProgram, particleShaderProgram;
+ShaderProgram *shaderProgram, *depthProgram, *miniMapProgram, *particleShaderProgram;
 GLuint viewMatrixLocation;
 GLuint projectionMatrixLocation;
 GLuint modelMatrixLocation;
 
 GLuint shadowViewProjectionLocation;
 GLuint shadowModelLocation;
-GLuint depthFBO, depthTexture;
+CascadedShadowMap* shadowMap;
 
-GLuint quadTextureSamplerLocation;
 Drawable* quad;
 
 GLuint textureSampler;
@@ -85,55 +90,93 @@ GLuint normalTextureSampler;
 GLuint timeUniform;
 
 GLuint skyboxVAO, skyboxVBO, skyboxEBO;
-GLuint skyboxProgram;
+ShaderProgram* skyboxProgram;
 GLuint cubemapTexture;
 
 GLuint LaLocation, LdLocation, LsLocation;
 GLuint lightPositionLocation;
 GLuint lightPowerLocation;
 
-GLuint depthMapSampler;
-GLuint lightVPLocation;
+GLuint cascadeVPLocation;
+GLuint cascadeSplitsLocation;
+GLuint cascadeBiasLocation;
 
 GLuint wavesVAO;
 GLuint wavesVBO, wavesIBO, wavesUVBO;
 GLuint waveMeshLength;  // Renamed from 'length' to 'waveMeshLength'
 GLuint waveTimeLocation;
 GLuint wavesLocation;
-
-//#define PARTICLES
-#ifdef PARTICLES
-int N = 6;
-#else
+GLuint waveLodScaleLocation;
+GLuint skyboxSampler;
+
+// Coarse patch grid for the tessellated water surface
+GLuint patchVAO;
+GLuint patchVBO, patchIBO, patchUVBO;
+GLuint patchIndexCount;
+GLuint viewportSizeLocation;
+GLuint pixelsPerEdgeLocation;
+GLuint maxTessLevelLocation;
+GLuint displacementBoundLocation;
+bool useTessellation = false;
+
+// Options, set from the command line by parseArguments
+bool particles = false;     // --particles: bubbles on the wave crests
+int emitterCount = 50;      // on the highest vertices
+int particlesPerEmitter = 25;
+string textureSet = "Water_002";
+string sceneFile;           // --scene file: the sizes above from a scene (common/scene.h)
+string sceneName;           // --scene-name name, the first scene of the file by default
+bool wireframe = false;     // --wireframe: draw the water as lines
+string profileOut;          // --profile-out file: per frame timings as .csv or .json
+bool showProfiler = false;  // F3 toggles the timing and memory bars (with ENABLE_PROFILER)
+string traceOut;            // --trace file: Chrome trace of startup and the first frames
+int traceFrames = 120;      // --trace-frames n, also the length of an F4 capture
+float vramBudget = 0.0f;    // --vram-budget MB of GL memory, 0 for none
+float uploadBudget = 0.0f;  // --upload-budget MB uploaded per frame
+bool glDebug = false;       // --gl-debug: debug context, driver messages and warnings
+string recordOut;           // --record file: GL command capture for tools/glreplay
+int recordFrames = 60;      // --record-frames n after the loading
+string backendName = "gl33";    // --backend gl33|gl45|null (common/backend.h)
+bool stateCache = true;     // --no-state-cache: pass every redundant bind to the driver
+unsigned int waveUniformBytes = 0;  // of uploadWavesToShader in this frame
+
+// Benchmark (--bench n): n frames into an offscreen framebuffer of a hidden
+// window, at a fixed time step and along a fixed camera path, then a report
+int benchFrames = 0;
+float benchDt = 1.0f / 60.0f;       // --bench-dt seconds
+string benchOut = "bench.json";     // --bench-out file
+GLuint screenFBO = 0;               // where the passes draw, offscreen when benchmarking
+GLuint benchColorRBO, benchDepthRBO;
+vector<float> benchFrameTimes;
+double benchUploadBytes = 0.0;      // buffers, textures and uniforms of the measured frames
+RenderBackend::Counts benchBackendCounts;   // what the null backend counted in them
+GLStateCache::Counts benchStateCounts;      // and the state calls passed on and dropped
+
+//Enable for screen-space adaptive tessellation of the water surface (needs a
+//GL 4.0 context, the fixed grid is used when it is not available)
+#define TESSELLATION
+
+// The grid has 2^N cells per side, fewer with particles
 int N = 9;
-#endif 
+int sideSlices = 512;
 
-//#define LINE
-#define FILL
+// Patches per side of the tessellated surface and the target length of a
+// generated triangle edge on screen
+int patchSlices = 32;
+float pixelsPerEdge = 8.0f;
 
-int sideSlices = pow(2, N);
+// wavePresets[] of createWaves, --waves 1, 2 or 3
+int wavePreset = 0;
 
-#define Wave1
-#ifdef Wave1
-float waveAmplitude = 1.5f / 6;
-float waveSteepness = 0.1f;
-float waveLength = 8.0f;
-float waveSpeed = 1.75f;
-#endif
-
-#ifdef Wave2
-float waveAmplitude = 1.0f / 6;
-float waveSteepness = 0.05f;
-float waveLength = 10.0f;
-float waveSpeed = 1.5f;
-#endif
-
-#ifdef Wave3
-float waveAmplitude = 2.0f / 6;
-float waveSteepness = 0.2f;
-float waveLength = 9.0f;
-float waveSpeed = 2.0f;
-#endif
+// Variants of the water program, specialized for the exact wave count
+// (WAVE_COUNT), the shadow filter taps per side (PCF, --pcf 1..3, F1 cycles)
+// and the wave LOD (WAVE_LOD, --no-lod, F2 toggles). All of them are built at
+// startup, switching only selects another program.
+ShaderPermutations* waterPermutations;
+int shadowPCF = 2;
+bool waveLod = true;
+float waveLodScale = 0.01f;
+GLint maxTessLevel = 64;
 
 
 
@@ -145,22 +188,28 @@ vector<uvec3> indices;
 vector<vec2> uvs;
 
 
-#define SHADOW_WIDTH 2048
-#define SHADOW_HEIGHT 2048
+// Resolution of each cascade layer and number of cascades (CASCADES in
+// texture.fragmentshader)
+#define SHADOW_RESOLUTION 1024
+#define SHADOW_CASCADES 3
 
-struct Wave {
-    vec2 direction;
-    float steepness;
-    float wavelength;
-    float speed;
-    float amplitude;
-};
+unsigned int frameIndex = 0;
 
 float directionX = 1.0f;
 float directionZ = 1.0f;
 int waveCount = 300;
 vector<Wave> waves;
 
+// Locations of the members of every waves[i], resolved once
+struct WaveLocations {
+    GLint direction;
+    GLint steepness;
+    GLint wavelength;
+    GLint speed;
+    GLint amplitude;
+};
+vector<WaveLocations> waveLocations;
+
 
 vec2 primaryDirection = vec2(0.75f, 1.0f);
 
@@ -175,150 +224,248 @@ vec2 rotateVector(const vec2& v, float angle) {
     );
 }
 
-void createWaves(int waveCount) {
-    waves.clear();
-    float baseSteepness = waveSteepness;
-    float baseWavelength = waveLength;
-    float baseSpeed = waveSpeed;
-    float baseAmplitude = waveAmplitude;
-
-    // Parameters for frequency and amplitude decay (similar to FBM)
-    float amplitudeDecay = 0.85f;  // Each successive wave will have half the amplitude of the previous
-    float frequencyMultiplier = 1.15f;  // Frequency doubles for each successive wave
+// Function to upload waves to the shader. The waves only change in
+// createWaves, so after the first frame every upload is skipped by the cache.
+void uploadWavesToShader(ShaderProgram* program) {
+    unsigned int uniformBytes = ShaderProgram::frameStats.bytes;
+    program->use();
+    program->set(waveLodScaleLocation, waveLodScale);
+
+    if (waveLocations.size() != waves.size()) {
+        waveLocations.clear();
+        for (int i = 0; i < waveCount; i++) {
+            string prefix = "waves[" + to_string(i) + "].";
+            WaveLocations locations;
+            locations.direction = program->uniformLocation(prefix + "direction");
+            locations.steepness = program->uniformLocation(prefix + "steepness");
+            locations.wavelength = program->uniformLocation(prefix + "wavelength");
+            locations.speed = program->uniformLocation(prefix + "speed");
+            locations.amplitude = program->uniformLocation(prefix + "amplitude");
+            waveLocations.push_back(locations);
+        }
+    }
 
+    // The tessellation control shader pads the patch bounds by the largest
+    // possible displacement before culling them
+    float displacementBound = 0.0f;
     for (int i = 0; i < waveCount; i++) {
-        Wave wave;
-
-        // Generate a random direction (angle in radians between 0 and 2π)
-        float randomAngle = ((rand() % 100) / 100.0f) * (2.0f * 3.14159265f);
-        wave.direction = vec2(cos(randomAngle), sin(randomAngle));
-
-        // Apply amplitude decay and frequency increase as per FBM
-        wave.amplitude = baseAmplitude * pow(amplitudeDecay, i);  // Amplitude decreases exponentially
-        wave.wavelength = baseWavelength / pow(frequencyMultiplier, i);  // Frequency (or 1/wavelength) increases exponentially
-        wave.speed = baseSpeed * sqrt((9.81f * wave.wavelength) / (2.0f * 3.14159265f));
-
-        // Slight variations in steepness for realism
-        wave.steepness = baseSteepness * (0.9f + (rand() % 20 / 100.0f));
-
-        waves.push_back(wave);
+        displacementBound += waves[i].amplitude;
     }
-}
-
-
-
-// Function to upload waves to the shader
-void uploadWavesToShader(GLuint shaderProgram) {
-    glUseProgram(shaderProgram);
-    GLint waveCountLocation = glGetUniformLocation(shaderProgram, "n");
-    glUniform1i(waveCountLocation, waveCount);
+    program->set(displacementBoundLocation, displacementBound);
 
     for (int i = 0; i < waveCount; i++) {
-        string prefix = "waves[" + to_string(i) + "].";
-        glUniform2fv(glGetUniformLocation(shaderProgram, (prefix + "direction").c_str()), 1, &waves[i].direction[0]);
-        glUniform1f(glGetUniformLocation(shaderProgram, (prefix + "steepness").c_str()), waves[i].steepness);
-        glUniform1f(glGetUniformLocation(shaderProgram, (prefix + "wavelength").c_str()), waves[i].wavelength);
-        glUniform1f(glGetUniformLocation(shaderProgram, (prefix + "speed").c_str()), waves[i].speed);
-        glUniform1f(glGetUniformLocation(shaderProgram, (prefix + "amplitude").c_str()), waves[i].amplitude);
+        const WaveLocations& locations = waveLocations[i];
+        program->set(locations.direction, waves[i].direction);
+        program->set(locations.steepness, waves[i].steepness);
+        program->set(locations.wavelength, waves[i].wavelength);
+        program->set(locations.speed, waves[i].speed);
+        program->set(locations.amplitude, waves[i].amplitude);
     }
+    uniformBytes = ShaderProgram::frameStats.bytes - uniformBytes;
+    MemoryTracker::get().upload(MemoryTag::Waves, uniformBytes);
+    waveUniformBytes += uniformBytes;
 }
 
 void uploadLight(const Light& light) {
-    glUniform4f(LaLocation, light.La.r, light.La.g, light.La.b, light.La.a);
-    glUniform4f(LdLocation, light.Ld.r, light.Ld.g, light.Ld.b, light.Ld.a);
-    glUniform4f(LsLocation, light.Ls.r, light.Ls.g, light.Ls.b, light.Ls.a);
-    glUniform3f(lightPositionLocation, light.lightPosition_worldspace.x,
-        light.lightPosition_worldspace.y, light.lightPosition_worldspace.z);
-    glUniform1f(lightPowerLocation, light.power);
+    PROFILE_CPU("uploadLight");
+    shaderProgram->set(LaLocation, light.La);
+    shaderProgram->set(LdLocation, light.Ld);
+    shaderProgram->set(LsLocation, light.Ls);
+    shaderProgram->set(lightPositionLocation, light.lightPosition_worldspace);
+    shaderProgram->set(lightPowerLocation, light.power);
 }
 
 
 
-void createContext() {
-    // Create and compile our GLSL program from the shaders
-    shaderProgram = loadShaders("texture.vertexshader", "texture.fragmentshader");
-    depthProgram = loadShaders("Depth.vertexshader", "Depth.fragmentshader");
-    miniMapProgram = loadShaders("SimpleTexture.vertexshader", "SimpleTexture.fragmentshader");
-    particleShaderProgram = loadShaders("particleSystem.vertexshader", "particleSystem.fragmentshader");
-    skyboxProgram = loadShaders("skybox.vertexshader", "skybox.fragmentshader");
-    // Draw wireframe triangles or fill: GL_LINE, or GL_FILL
-#ifdef FILL
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-#endif
+void createPatchGrid() {
+    vector<vec3> patchVertices;
+    vector<vec2> patchUVs;
+    vector<unsigned int> patchIndices;
 
-#ifdef LINE
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    // Same extent and UVs as the triangle grid, but with patchSlices cells
+    for (int j = 0; j <= patchSlices; ++j) {
+        for (int i = 0; i <= patchSlices; ++i) {
+            float x = ((float)i / (float)patchSlices) * 2.5 * N;
+            float z = ((float)j / (float)patchSlices) * 2.5 * N;
+            patchVertices.push_back(vec3(x, 0, z));
+            patchUVs.push_back(vec2(-(float)i / (float)patchSlices, -(float)j / (float)patchSlices));
+        }
+    }
 
-#endif // LINE
+    // One quad patch per cell, corners in the order the control shader expects
+    for (int j = 0; j < patchSlices; ++j) {
+        for (int i = 0; i < patchSlices; ++i) {
+            int row1 = j * (patchSlices + 1);
+            int row2 = (j + 1) * (patchSlices + 1);
+            patchIndices.push_back(row1 + i);
+            patchIndices.push_back(row1 + i + 1);
+            patchIndices.push_back(row2 + i + 1);
+            patchIndices.push_back(row2 + i);
+        }
+    }
 
+    glGenVertexArrays(1, &patchVAO);
+    glBindVertexArray(patchVAO);
 
-    // Get a pointer location to model matrix in the vertex shader
-    projectionMatrixLocation = glGetUniformLocation(shaderProgram, "P");
-    viewMatrixLocation = glGetUniformLocation(shaderProgram, "V");
-    modelMatrixLocation = glGetUniformLocation(shaderProgram, "M");
+    RenderBackend& backend = RenderBackend::get();
+    patchVBO = backend.createBuffer(MemoryTag::Grid, GL_ARRAY_BUFFER, patchVertices.size() * sizeof(vec3), patchVertices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
 
-    depthMapSampler = glGetUniformLocation(shaderProgram, "shadowMapSampler");
-    lightVPLocation = glGetUniformLocation(shaderProgram, "lightVP");
+    patchUVBO = backend.createBuffer(MemoryTag::Grid, GL_ARRAY_BUFFER, patchUVs.size() * sizeof(vec2), patchUVs.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
 
-    LaLocation = glGetUniformLocation(shaderProgram, "light.La");
-    LdLocation = glGetUniformLocation(shaderProgram, "light.Ld");
-    LsLocation = glGetUniformLocation(shaderProgram, "light.Ls");
-    lightPositionLocation = glGetUniformLocation(shaderProgram, "light.lightPosition_worldspace");
-    lightPowerLocation = glGetUniformLocation(shaderProgram, "light.power");
+    patchIBO = backend.createBuffer(MemoryTag::Grid, GL_ELEMENT_ARRAY_BUFFER, patchIndices.size() * sizeof(unsigned int), patchIndices.data(), GL_STATIC_DRAW);
 
-    //https://3dtextures.me/2018/11/29/water-002/
-    movingTexture = loadBMP("Water_002_COLOR.bmp");
-    displacementTexture = loadBMP("oceandisplacement.bmp");
-    foamTexture = loadBMP("foamTest.bmp"); // Load foam texture
-    movingTextureSampler = glGetUniformLocation(shaderProgram, "movingTextureSampler");
-    displacementTextureSampler = glGetUniformLocation(shaderProgram, "displacementTextureSampler");
-    foamTextureSampler = glGetUniformLocation(shaderProgram, "foamTextureSampler"); // Foam texture sampler
-    shadowMapSampler = glGetUniformLocation(shaderProgram, "shadowMapSampler");
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    roughnessTexture = loadBMP("Water_002_ROUGH.bmp");
-    occTexture = loadBMP("Water_002_OCC.bmp");
-    normalTexture = loadBMP("Water_002_NORM.bmp");
-    roughnessTextureSampler = glGetUniformLocation(shaderProgram, "roughnessTextureSampler");
-    occTextureSampler = glGetUniformLocation(shaderProgram, "occTextureSampler");
-    normalTextureSampler = glGetUniformLocation(shaderProgram, "normalTextureSampler");
+    patchIndexCount = (GLuint)patchIndices.size();
+    GLDebug::get().label(GL_BUFFER, patchVBO, "water patch vertices");
+    GLDebug::get().label(GL_BUFFER, patchUVBO, "water patch uvs");
+    GLDebug::get().label(GL_BUFFER, patchIBO, "water patch indices");
+    glPatchParameteri(GL_PATCH_VERTICES, 4);
+}
 
+ShaderDefines waterDefines(int pcf, bool lod) {
+    ShaderDefines defines;
+    defines.set("WAVE_COUNT", waveCount);
+    defines.set("CASCADES", SHADOW_CASCADES);
+    defines.set("PCF", pcf);
+    if (lod) defines.set("WAVE_LOD");
+    return defines;
+}
 
-    waveTimeLocation = glGetUniformLocation(shaderProgram, "waveTime");
-    wavesLocation = glGetUniformLocation(shaderProgram, "waves");
+// Builds every variant of the water program, on the fixed grid when the
+// tessellated one doesn't link
+void createWaterPermutations() {
+    ProgramSource source;
+    if (useTessellation) {
+        source.vertex = "texturePatch.vertexshader";
+        source.tessControl = "texture.tesscontrolshader";
+        source.tessEvaluation = "texture.tessevaluationshader";
+    } else {
+        source.vertex = "texture.vertexshader";
+    }
+    source.fragment = "texture.fragmentshader";
 
-    // Shadow shader
-    shadowViewProjectionLocation = glGetUniformLocation(depthProgram, "VP");
-    shadowModelLocation = glGetUniformLocation(depthProgram, "M");
+    vector<ShaderDefines> variants;
+    for (int pcf = 1; pcf <= 3; pcf++) {
+        variants.push_back(waterDefines(pcf, true));
+        variants.push_back(waterDefines(pcf, false));
+    }
 
-    quadTextureSamplerLocation = glGetUniformLocation(miniMapProgram, "textureSampler");
+    waterPermutations = new ShaderPermutations(source);
+    waterPermutations->prepare(variants);
+    if (useTessellation && !waterPermutations->get(waterDefines(shadowPCF, waveLod))) {
+        cout << "Tessellation program failed to link, using the grid instead" << endl;
+        useTessellation = false;
+        delete waterPermutations;
+        createWaterPermutations();
+    }
+}
 
+// Makes the water variant of the current options the active shaderProgram and
+// resolves its uniforms
+void selectWaterProgram() {
+    ShaderProgram* program = waterPermutations->get(waterDefines(shadowPCF, waveLod));
+    if (!program) {
+        throw runtime_error("Water program failed to link");
+    }
+    shaderProgram = program;
 
-    projectionAndViewMatrix = glGetUniformLocation(particleShaderProgram, "PV");
+    // Get a pointer location to model matrix in the vertex shader
+    projectionMatrixLocation = shaderProgram->uniformLocation("P");
+    viewMatrixLocation = shaderProgram->uniformLocation("V");
+    modelMatrixLocation = shaderProgram->uniformLocation("M");
+
+    cascadeVPLocation = shaderProgram->uniformLocation("cascadeVP");
+    cascadeSplitsLocation = shaderProgram->uniformLocation("cascadeSplits");
+    cascadeBiasLocation = shaderProgram->uniformLocation("cascadeBias");
+
+    LaLocation = shaderProgram->uniformLocation("light.La");
+    LdLocation = shaderProgram->uniformLocation("light.Ld");
+    LsLocation = shaderProgram->uniformLocation("light.Ls");
+    lightPositionLocation = shaderProgram->uniformLocation("light.lightPosition_worldspace");
+    lightPowerLocation = shaderProgram->uniformLocation("light.power");
+
+    movingTextureSampler = shaderProgram->uniformLocation("movingTextureSampler");
+    displacementTextureSampler = shaderProgram->uniformLocation("displacementTextureSampler");
+    foamTextureSampler = shaderProgram->uniformLocation("foamTextureSampler"); // Foam texture sampler
+    shadowMapSampler = shaderProgram->uniformLocation("shadowMapSampler");
+    roughnessTextureSampler = shaderProgram->uniformLocation("roughnessTextureSampler");
+    occTextureSampler = shaderProgram->uniformLocation("occTextureSampler");
+    normalTextureSampler = shaderProgram->uniformLocation("normalTextureSampler");
+
+    waveTimeLocation = shaderProgram->uniformLocation("waveTime");
+    wavesLocation = shaderProgram->uniformLocation("waves");
+    waveLodScaleLocation = shaderProgram->uniformLocation("waveLodScale");
+
+    viewportSizeLocation = shaderProgram->uniformLocation("viewportSize");
+    pixelsPerEdgeLocation = shaderProgram->uniformLocation("pixelsPerEdge");
+    maxTessLevelLocation = shaderProgram->uniformLocation("maxTessLevel");
+    displacementBoundLocation = shaderProgram->uniformLocation("displacementBound");
+    skyboxSampler = shaderProgram->uniformLocation("skybox");
+
+    // every variant has its own waves[i] locations
+    waveLocations.clear();
+
+    shaderProgram->use();
+    if (useTessellation) {
+        shaderProgram->set(viewportSizeLocation, vec2(W_WIDTH, W_HEIGHT));
+        shaderProgram->set(pixelsPerEdgeLocation, pixelsPerEdge);
+        shaderProgram->set(maxTessLevelLocation, (float)maxTessLevel);
+    }
+}
 
+// F1 cycles the shadow filter size, F2 toggles the wave LOD
+void handleVariantKeys() {
+    static bool f1Down = false, f2Down = false;
+    if (!window) return;
+    bool f1 = glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS;
+    bool f2 = glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS;
+    if ((f1 && !f1Down) || (f2 && !f2Down)) {
+        if (f1 && !f1Down) shadowPCF = shadowPCF % 3 + 1;
+        if (f2 && !f2Down) waveLod = !waveLod;
+        selectWaterProgram();
+        cout << "Water variant: PCF " << shadowPCF << ", wave LOD " << (waveLod ? "on" : "off") << endl;
+    }
+    f1Down = f1;
+    f2Down = f2;
+}
 
-    vector<vec3> quadVertices = {
-        vec3(0.5, 0.5, -1.0),
-        vec3(1.0, 0.5, -1.0),
-        vec3(1.0, 1.0, -1.0),
-        vec3(1.0, 1.0, -1.0),
-        vec3(0.5, 1.0, -1.0),
-        vec3(0.5, 0.5, -1.0)
-    };
+// Builds every program and resolves the uniforms of the ones that don't change
+void createPrograms() {
+    // Create and compile our GLSL programs from the shaders, all in one batch
+    vector<ProgramSource> sources(4);
+    sources[0].vertex = "Depth.vertexshader";
+    sources[0].fragment = "Depth.fragmentshader";
+    sources[1].vertex = "SimpleTexture.vertexshader";
+    sources[1].fragment = "SimpleTexture.fragmentshader";
+    sources[2].vertex = "particleSystem.vertexshader";
+    sources[2].fragment = "particleSystem.fragmentshader";
+    sources[3].vertex = "skybox.vertexshader";
+    sources[3].fragment = "skybox.fragmentshader";
+    vector<GLuint> programs = loadShaderPrograms(sources);
+    depthProgram = new ShaderProgram(programs[0]);
+    miniMapProgram = new ShaderProgram(programs[1]);
+    particleShaderProgram = new ShaderProgram(programs[2]);
+    skyboxProgram = new ShaderProgram(programs[3]);
+
+    createWaterPermutations();
 
-    vector<vec2> quadUVs = {
-        vec2(0.0, 0.0),
-        vec2(1.0, 0.0),
-        vec2(1.0, 1.0),
-        vec2(1.0, 1.0),
-        vec2(0.0, 1.0),
-        vec2(0.0, 0.0)
-    };
+    // Shadow shader
+    shadowViewProjectionLocation = depthProgram->uniformLocation("VP");
+    shadowModelLocation = depthProgram->uniformLocation("M");
 
-    quad = new Drawable(quadVertices, quadUVs);
 
-    glGenVertexArrays(1, &wavesVAO);
-    glBindVertexArray(wavesVAO);
+    projectionAndViewMatrix = particleShaderProgram->uniformLocation("PV");
+}
 
+// Fills the vertices, uvs and indices of the water grid, no GL calls
+void createWaveGrid() {
     // Grid initialization
     for (int j = 0; j <= sideSlices; ++j) {
         for (int i = 0; i <= sideSlices; ++i) {
@@ -346,50 +493,183 @@ void createContext() {
             indices.push_back(glm::uvec3(row1 + i, row2 + i + 1, row2 + i));
         }
     }
+}
+
+// Uploads the water grid, and the tessellation patches, then selects the water
+// program. Runs after createPrograms, which may turn off useTessellation.
+void uploadWaveGrid() {
+    glGenVertexArrays(1, &wavesVAO);
+    glBindVertexArray(wavesVAO);
 
-    glGenBuffers(1, &wavesVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, wavesVBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+    RenderBackend& backend = RenderBackend::get();
+    wavesVBO = backend.createBuffer(MemoryTag::Grid, GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
 
     // Create buffer for UV coordinates
-    glGenBuffers(1, &wavesUVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, wavesUVBO);
-    glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), uvs.data(), GL_STATIC_DRAW);
+    wavesUVBO = backend.createBuffer(MemoryTag::Grid, GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), uvs.data(), GL_STATIC_DRAW);
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
 
-    glGenBuffers(1, &wavesIBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, wavesIBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(glm::uvec3), indices.data(), GL_STATIC_DRAW);
+    wavesIBO = backend.createBuffer(MemoryTag::Grid, GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(glm::uvec3), indices.data(), GL_STATIC_DRAW);
 
     glBindVertexArray(0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     waveMeshLength = (GLuint)indices.size() * 3; // Renamed variable to avoid ambiguity
+    GLDebug::get().label(GL_BUFFER, wavesVBO, "water grid vertices");
+    GLDebug::get().label(GL_BUFFER, wavesUVBO, "water grid uvs");
+    GLDebug::get().label(GL_BUFFER, wavesIBO, "water grid indices");
+
+    if (useTessellation) {
+        createPatchGrid();
+        glGetIntegerv(GL_MAX_TESS_GEN_LEVEL, &maxTessLevel);
+    }
+    selectWaterProgram();
+}
+
+void createCubemap() {
+    cubemapTexture = RenderBackend::get().createTexture(GL_TEXTURE_CUBE_MAP);
+    GLDebug::get().label(GL_TEXTURE, cubemapTexture, "skybox");
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    // These are very important to prevent seams
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+}
 
-    glGenFramebuffers(1, &depthFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+// A block compressed .dds made by tools/texconv is loaded instead of the image
+// it was converted from when it exists
+string compressedPath(const string& path) {
+    return path.substr(0, path.find_last_of('.')) + ".dds";
+}
 
-    glGenTextures(1, &depthTexture);
-    glBindTexture(GL_TEXTURE_2D, depthTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0,
-        GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+void createContext() {
+    // Draw wireframe triangles or fill: GL_LINE, or GL_FILL
+    glPolygonMode(GL_FRONT_AND_BACK, wireframe ? GL_LINE : GL_FILL);
 
-    // Attach the depth texture as the framebuffer's depth buffer
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    // Images are decoded and the grid is built on worker threads while this
+    // thread compiles the programs and uploads whatever is ready
+    AssetPipeline assets;
 
-    // No color buffer is drawn to
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
+    // the decode jobs write the pixels straight into this ring when they can,
+    // the uploads are then copies on the GPU
+    PixelUploadRing uploadRing;
+    // a capture can't follow writes into a mapped buffer, decode into memory
+    PixelUploadRing* ring = GLRecorder::get().recording() ? nullptr : &uploadRing;
+
+    AssetPipeline::Job programs = assets.addUpload("shader programs", createPrograms);
+    AssetPipeline::Job grid = assets.add("water grid", createWaveGrid);
+    assets.addUpload("upload water grid", uploadWaveGrid, { programs, grid });
+
+    //https://3dtextures.me/2018/11/29/water-002/
+    const string textureFiles[] = {
+        textureSet + "_COLOR.bmp",
+        "oceandisplacement.bmp",
+        "foamTest.bmp", // Foam texture
+        textureSet + "_ROUGH.bmp",
+        textureSet + "_OCC.bmp",
+        textureSet + "_NORM.bmp"
+    };
+    GLuint* textureIDs[] = {
+        &movingTexture,
+        &displacementTexture,
+        &foamTexture,
+        &roughnessTexture,
+        &occTexture,
+        &normalTexture
+    };
+    vector<Image> textureImages(6);
+    for (int i = 0; i < 6; i++) {
+        string dds = compressedPath(textureFiles[i]);
+        if (fileExists(dds)) {
+            assets.addUpload("load " + dds, [&, i, dds]() {
+                *textureIDs[i] = loadDDS(dds.c_str());
+            });
+            continue;
+        }
+
+        AssetPipeline::Job decode = assets.add("decode " + textureFiles[i], [&, i]() {
+            textureImages[i] = decodeBMP(textureFiles[i].c_str(), ring);
+        });
+        assets.addUpload("upload " + textureFiles[i], [&, i]() {
+            *textureIDs[i] = uploadTexture(textureImages[i]);
+            GLDebug::get().label(GL_TEXTURE, *textureIDs[i], textureFiles[i]);
+            textureImages[i] = Image();
+        }, { decode });
+    }
+
+    vector<std::string> faces
+    {
+        "right.jpg",
+        "left.jpg",
+        "top.jpg",
+        "bottom.jpg",
+        "front.jpg",
+        "back.jpg"
+    };
+    vector<Image> faceImages(6);
+    bool compressedSkybox = fileExists("skybox.dds");  // texconv --cubemap
+    if (compressedSkybox) {
+        assets.addUpload("load skybox.dds", []() {
+            cubemapTexture = loadDDS("skybox.dds");
+            glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+        });
+    }
+    AssetPipeline::Job cubemap = compressedSkybox ? -1 :
+        assets.addUpload("create cubemap", createCubemap);
+    for (unsigned int i = 0; i < 6 && !compressedSkybox; i++) {
+        AssetPipeline::Job decode = assets.add("decode " + faces[i], [&, i]() {
+            try {
+                faceImages[i] = decodeImage(faces[i].c_str(), ring);
+            } catch (exception&) {
+                std::cout << "Failed to load texture: " << faces[i] << std::endl;
+            }
+        });
+        assets.addUpload("upload " + faces[i], [&, i]() {
+            if (faceImages[i].empty()) return;
+            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+            uploadTextureImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, faceImages[i]);
+            MemoryTracker::get().grow(MemoryTracker::TEXTURE, cubemapTexture,
+                                      textureBytes(faceImages[i].width, faceImages[i].height,
+                                                   bytesPerPixel(faceImages[i]), false),
+                                      MemoryTag::Textures);
+            faceImages[i] = Image();
+        }, { cubemap, decode });
+    }
+
+    {
+        GLDebugGroup debugGroup("load assets");
+        assets.run();
+    }
+    assets.printReport();
+    // the loading uploads are not part of the first frame
+    cout << "Uploaded " << MemoryTracker::get().resetUploads() / 1.0e6 << " MB while loading" << endl;
+
+    vector<vec3> quadVertices = {
+        vec3(0.5, 0.5, -1.0),
+        vec3(1.0, 0.5, -1.0),
+        vec3(1.0, 1.0, -1.0),
+        vec3(1.0, 1.0, -1.0),
+        vec3(0.5, 1.0, -1.0),
+        vec3(0.5, 0.5, -1.0)
+    };
+
+    vector<vec2> quadUVs = {
+        vec2(0.0, 0.0),
+        vec2(1.0, 0.0),
+        vec2(1.0, 1.0),
+        vec2(1.0, 1.0),
+        vec2(0.0, 1.0),
+        vec2(0.0, 0.0)
+    };
+
+    quad = new Drawable(quadVertices, quadUVs);
+
+    shadowMap = new CascadedShadowMap(SHADOW_RESOLUTION, SHADOW_CASCADES);
 
     float skyboxVertices[] =
     {
@@ -427,112 +707,62 @@ void createContext() {
     };
 
     glGenVertexArrays(1, &skyboxVAO);
-    glGenBuffers(1, &skyboxVBO);
-    glGenBuffers(1, &skyboxEBO);
     glBindVertexArray(skyboxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, skyboxEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(skyboxIndices), &skyboxIndices, GL_STATIC_DRAW);
+    RenderBackend& backend = RenderBackend::get();
+    skyboxVBO = backend.createBuffer(MemoryTag::Meshes, GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
+    skyboxEBO = backend.createBuffer(MemoryTag::Meshes, GL_ELEMENT_ARRAY_BUFFER, sizeof(skyboxIndices), &skyboxIndices, GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-
-    vector<std::string> faces
-    {
-        "right.jpg",
-        "left.jpg",
-        "top.jpg",
-        "bottom.jpg",
-        "front.jpg",
-        "back.jpg"
-    };
-
-    
-    glGenTextures(1, &cubemapTexture);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    // These are very important to prevent seams
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
-
-    for (unsigned int i = 0; i < 6; i++)
-    {
-        int width, height, nrChannels;
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            std::cout << "Succeeded to load texture: " << faces[i] << std::endl;
-            glTexImage2D
-            (
-                GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                0,
-                GL_RGB,
-                width,
-                height,
-                0,
-                GL_RGB,
-                GL_UNSIGNED_BYTE,
-                data
-            );
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Failed to load texture: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-
-
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        glfwTerminate();
-        throw runtime_error("Frame buffer not initialized correctly");
-    }
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLDebug::get().label(GL_BUFFER, skyboxVBO, "skybox vertices");
+    GLDebug::get().label(GL_BUFFER, skyboxEBO, "skybox indices");
 }
 
 void free() {
     // Delete Vertex Arrays
     glDeleteVertexArrays(1, &wavesVAO);
     glDeleteVertexArrays(1, &skyboxVAO);
+    glDeleteVertexArrays(1, &patchVAO);
 
     // Delete Buffers
-    glDeleteBuffers(1, &wavesVBO);
-    glDeleteBuffers(1, &wavesUVBO);
-    glDeleteBuffers(1, &wavesIBO);
-    glDeleteBuffers(1, &skyboxVBO);
-    glDeleteBuffers(1, &skyboxEBO);
+    RenderBackend::get().deleteBuffer(wavesVBO);
+    RenderBackend::get().deleteBuffer(wavesUVBO);
+    RenderBackend::get().deleteBuffer(wavesIBO);
+    RenderBackend::get().deleteBuffer(skyboxVBO);
+    RenderBackend::get().deleteBuffer(skyboxEBO);
+    RenderBackend::get().deleteBuffer(patchVBO);
+    RenderBackend::get().deleteBuffer(patchUVBO);
+    RenderBackend::get().deleteBuffer(patchIBO);
 
     // Delete Textures
-    glDeleteTextures(1, &texture);
-    glDeleteTextures(1, &movingTexture);
-    glDeleteTextures(1, &displacementTexture);
-    glDeleteTextures(1, &foamTexture); // Foam texture
-    glDeleteTextures(1, &depthTexture); // Shadow map texture
-    glDeleteTextures(1, &cubemapTexture); // Skybox texture
-    glDeleteTextures(1, &roughnessTexture);
-    glDeleteTextures(1, &occTexture);
-    glDeleteTextures(1, &normalTexture);
+    deleteTextures(1, &texture);
+    deleteTextures(1, &movingTexture);
+    deleteTextures(1, &displacementTexture);
+    deleteTextures(1, &foamTexture); // Foam texture
+    deleteTextures(1, &cubemapTexture); // Skybox texture
+    deleteTextures(1, &roughnessTexture);
+    deleteTextures(1, &occTexture);
+    deleteTextures(1, &normalTexture);
 
     // Delete Framebuffers
-    glDeleteFramebuffers(1, &depthFBO);
-    glDeleteRenderbuffers(1, &foamRBO); // Foam Render Buffer (if applicable)
+    deleteRenderbuffers(1, &foamRBO); // Foam Render Buffer (if applicable)
+    if (screenFBO) {
+        glDeleteFramebuffers(1, &screenFBO);
+        deleteRenderbuffers(1, &benchColorRBO);
+        deleteRenderbuffers(1, &benchDepthRBO);
+        screenFBO = 0;
+    }
 
     // Delete Shader Programs
-    glDeleteProgram(shaderProgram);
-    glDeleteProgram(depthProgram);
-    glDeleteProgram(miniMapProgram);
-    glDeleteProgram(particleShaderProgram);
-    glDeleteProgram(skyboxProgram);
+    delete waterPermutations;
+    delete depthProgram;
+    delete miniMapProgram;
+    delete particleShaderProgram;
+    delete skyboxProgram;
+    waterPermutations = nullptr;
+    shaderProgram = depthProgram = miniMapProgram = particleShaderProgram = skyboxProgram = nullptr;
 
     // Free dynamically allocated objects
     if (camera) {
@@ -547,120 +777,264 @@ void free() {
         delete quad;
         quad = nullptr;
     }
+    if (shadowMap) {
+        delete shadowMap;
+        shadowMap = nullptr;
+    }
 
     // Terminate GLFW
     glfwTerminate();
 }
 
 
-void depth_pass(mat4 viewMatrix, mat4 projectionMatrix) {
+// Seconds of animation, a fixed step per frame when benchmarking
+float simulationTime() {
+    return benchFrames > 0 ? frameIndex * benchDt : (float) glfwGetTime();
+}
 
-    // Task 3.3
-    //*/
+// Once around the water during the benchmark, looking at its center
+void benchCamera() {
+    float extent = 2.5f * N;
+    vec3 center(extent / 2.0f, 0.0f, extent / 2.0f);
+    float angle = 2.0f * 3.14159265f * frameIndex / benchFrames;
+    vec3 position = center + extent * vec3(0.8f * sin(angle), 0.3f, 0.8f * cos(angle));
+    vec3 direction = normalize(center - position);
+    camera->setPose(position, atan2(direction.x, direction.z), asin(direction.y));
+}
 
+void updateCamera() {
+    if (benchFrames > 0) {
+        benchCamera();
+    } else {
+        camera->update();
+    }
+}
 
-    // Setting viewport to shadow map size
-    glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+// The hidden window of the benchmark may have no pixels, so it draws here
+void createOffscreenTarget() {
+    glGenRenderbuffers(1, &benchColorRBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, benchColorRBO);
+    renderbufferStorage(MemoryTag::Targets, benchColorRBO, GL_RGBA8, W_WIDTH, W_HEIGHT, 4);
+    glGenRenderbuffers(1, &benchDepthRBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, benchDepthRBO);
+    renderbufferStorage(MemoryTag::Targets, benchDepthRBO, GL_DEPTH24_STENCIL8, W_WIDTH, W_HEIGHT, 4);
+
+    glGenFramebuffers(1, &screenFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+    GLDebug::get().label(GL_FRAMEBUFFER, screenFBO, "offscreen target");
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, benchColorRBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, benchDepthRBO);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        throw runtime_error("Offscreen framebuffer not complete");
+    }
+}
 
-    // Binding the depth framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+// min, mean and percentiles of the samples as a JSON object
+void writeBenchStats(ostream& out, vector<float> samples) {
+    if (samples.empty()) {
+        out << "{}";
+        return;
+    }
+    sort(samples.begin(), samples.end());
+    auto percentile = [&](float p) {
+        return samples[(size_t) std::min(p / 100.0f * samples.size(), (float) samples.size() - 1)];
+    };
+    double sum = 0.0;
+    for (float sample : samples) sum += sample;
+    out << "{\"min\": " << samples.front() << ", \"mean\": " << sum / samples.size()
+        << ", \"p50\": " << percentile(50) << ", \"p90\": " << percentile(90)
+        << ", \"p99\": " << percentile(99) << ", \"max\": " << samples.back() << "}";
+}
 
-    // Cleaning the framebuffer depth information (stored from the last render)
-    glClear(GL_DEPTH_BUFFER_BIT);
+// Frame times with glFinish, and the per pass times when the profiler is built
+void writeBenchReport(int warmup) {
+    ofstream out(benchOut);
+    if (!out) throw runtime_error("Can't write benchmark report: " + benchOut);
+    out << "{\n";
+    out << "  \"frames\": " << benchFrameTimes.size() << ",\n";
+    out << "  \"warmup\": " << warmup << ",\n";
+    out << "  \"dt\": " << benchDt << ",\n";
+    out << "  \"width\": " << W_WIDTH << ", \"height\": " << W_HEIGHT << ",\n";
+    out << "  \"scene\": \"" << sceneName << "\",\n";
+    out << "  \"waves\": " << waveCount << ", \"N\": " << N << ", \"emitters\": "
+        << (particles ? emitterCount : 0) << ", \"particles_per_emitter\": " << particlesPerEmitter << ",\n";
+    string renderer = (const char*) glGetString(GL_RENDERER);
+    replace(renderer.begin(), renderer.end(), '"', '\'');
+    out << "  \"renderer\": \"" << renderer << "\",\n";
+    double seconds = 0.0;
+    for (float frameTime : benchFrameTimes) seconds += frameTime / 1000.0;
+    out << "  \"peak_memory_mb\": " << peakMemoryUsage() / 1.0e6 << ",\n";
+    out << "  \"upload_mb_per_s\": " << (seconds > 0.0 ? benchUploadBytes / 1.0e6 / seconds : 0.0) << ",\n";
+    out << "  \"gpu_memory_peak_mb\": " << MemoryTracker::get().peak() / 1.0e6 << ",\n";
+    out << "  \"upload_peak_mb_per_frame\": " << MemoryTracker::get().uploadPeak() / 1.0e6 << ",\n";
+    // with --gl-debug, over the whole run including the loading
+    const GLDebug::Counts& glMessages = GLDebug::get().total();
+    out << "  \"gl_debug\": {\"enabled\": " << (GLDebug::get().enabled() ? "true" : "false")
+        << ", \"performance\": " << glMessages.performance << ", \"errors\": " << glMessages.errors << "},\n";
+    RenderBackend& backend = RenderBackend::get();
+    double frames = (double) std::max(benchFrameTimes.size(), (size_t) 1);
+    out << "  \"state_cache\": {\"enabled\": " << (GLStateCache::get().enabled() ? "true" : "false")
+        << ", \"issued_per_frame\": " << benchStateCounts.issued / frames
+        << ", \"elided_per_frame\": " << benchStateCounts.elided / frames << "},\n";
+    out << "  \"backend\": {\"name\": \"" << backend.name() << "\", \"calls_per_frame\": "
+        << benchBackendCounts.calls / frames << ", \"draws_per_frame\": " << benchBackendCounts.draws / frames
+        << ", \"instances_per_frame\": " << benchBackendCounts.instances / frames
+        << ", \"bytes_per_frame\": " << benchBackendCounts.bytes / frames << "},\n";
+    out << "  \"frame_ms\": ";
+    writeBenchStats(out, benchFrameTimes);
+    out << ",\n  \"passes\": [";
+#ifdef ENABLE_PROFILER
+    bool first = true;
+    for (const auto& section : Profiler::get().sections()) {
+        out << (first ? "\n" : ",\n") << "    {\"name\": \"" << section->name << "\", \"kind\": \""
+            << (section->gpu ? "gpu" : "cpu") << "\", \"ms\": ";
+        writeBenchStats(out, section->history);
+        out << "}";
+        first = false;
+    }
+#endif
+    out << "\n  ]\n}\n";
+    cout << "Benchmark report written to " << benchOut << endl;
+}
 
-    // Selecting the new shader program that will output the depth component
-    glUseProgram(depthProgram);
+// Draws the water with the current program: tessellated patches when the
+// program has tessellation stages, the fixed grid otherwise
+void drawWaveSurface() {
+    RenderBackend& backend = RenderBackend::get();
+    if (useTessellation) {
+        backend.bindVertexArray(patchVAO);
+        backend.drawElements(GL_PATCHES, patchIndexCount, 0);
+    } else {
+        backend.bindVertexArray(wavesVAO);
+        backend.drawElements(GL_TRIANGLES, indices.size() * 3, 0);
+    }
+}
 
-    // sending the view and projection matrix to the shader
-    mat4 view_projection = projectionMatrix * viewMatrix;
-    glUniformMatrix4fv(shadowViewProjectionLocation, 1, GL_FALSE, &view_projection[0][0]);
+void depth_pass() {
+    PROFILE_CPU("depth_pass");
+    PROFILE_GPU("depth_pass");
+    GLDebugGroup debugGroup("depth_pass");
+    // Fit the cascades that are due this frame to the camera frustum
+    shadowMap->update(camera->viewMatrix, camera->FoV, camera->aspect, camera->nearPlane,
+        light->direction, frameIndex);
 
+    // Selecting the new shader program that will output the depth component
+    depthProgram->use();
 
     // Set the model matrix
     mat4 model = mat4(1.0f);
-    glUniformMatrix4fv(shadowModelLocation, 1, GL_FALSE, &model[0][0]);
+    depthProgram->set(shadowModelLocation, model);
 
-    // Render the waves for shadow mapping
-    glBindVertexArray(wavesVAO);
-    glDrawElements(GL_TRIANGLES, indices.size() * 3, GL_UNSIGNED_INT, nullptr);
+    for (int i = 0; i < (int)shadowMap->cascades.size(); i++) {
+        const CascadedShadowMap::Cascade& cascade = shadowMap->cascades[i];
+        if (!cascade.needsRender) continue;
+
+        // Binding and clearing the layer of the cascade
+        shadowMap->bindCascade(i);
+
+        // sending the view and projection matrix to the shader
+        depthProgram->set(shadowViewProjectionLocation, cascade.viewProjection);
+
+        // Render the waves for shadow mapping
+        RenderBackend::get().bindVertexArray(wavesVAO);
+        RenderBackend::get().drawElements(GL_TRIANGLES, indices.size() * 3, 0);
+    }
 
     // Unbind the framebuffer to stop rendering to the depth texture
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
 
     // Reset to the main shader program if needed
-    glUseProgram(shaderProgram);
+    shaderProgram->use();
+}
+
+// Binds the shadow cascades to texture unit 3 and uploads their matrices
+void uploadShadowCascades() {
+    RenderBackend::get().bindTexture(3, GL_TEXTURE_2D_ARRAY, shadowMap->texture);
+    shaderProgram->set(shadowMapSampler, 3);
+
+    vector<mat4> cascadeVP;
+    vector<float> cascadeSplits, cascadeBias;
+    for (const auto& cascade : shadowMap->cascades) {
+        cascadeVP.push_back(cascade.viewProjection);
+        cascadeSplits.push_back(cascade.splitDepth);
+        cascadeBias.push_back(cascade.bias);
+    }
+    GLsizei count = (GLsizei)shadowMap->cascades.size();
+    shaderProgram->set(cascadeVPLocation, &cascadeVP[0], count);
+    shaderProgram->set(cascadeSplitsLocation, &cascadeSplits[0], count);
+    shaderProgram->set(cascadeBiasLocation, &cascadeBias[0], count);
 }
 
 void waveUpdate() {
-    glUniform1f(waveTimeLocation, (float)glfwGetTime() / 20.0);
+    PROFILE_CPU("waveUpdate");
+    PROFILE_GPU("waveUpdate");
+    GLDebugGroup debugGroup("waveUpdate");
+    shaderProgram->set(waveTimeLocation, simulationTime() / 20.0f);
     mat4 MVP, modelMatrix, viewMatrix, projectionMatrix;
 
     projectionMatrix = perspective(radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
     viewMatrix = lookAt(
-        vec3(5 * sin((float)glfwGetTime()), 0, 5 * cos((float)glfwGetTime())),
+        vec3(5 * sin(simulationTime()), 0, 5 * cos(simulationTime())),
         vec3(0, 0, 0),
         vec3(0, 1, 0)
     );
     modelMatrix = mat4(1.0f);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
     glViewport(0, 0, W_WIDTH, W_HEIGHT);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(shaderProgram);
+    shaderProgram->use();
 
     uploadWavesToShader(shaderProgram);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, movingTexture);
-    glUniform1i(movingTextureSampler, 0);
+    RenderBackend& backend = RenderBackend::get();
+    backend.bindTexture(0, GL_TEXTURE_2D, movingTexture);
+    shaderProgram->set(movingTextureSampler, 0);
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, displacementTexture);
-    glUniform1i(displacementTextureSampler, 1);
+    backend.bindTexture(1, GL_TEXTURE_2D, displacementTexture);
+    shaderProgram->set(displacementTextureSampler, 1);
 
-    glActiveTexture(GL_TEXTURE2);  // Bind foam texture to unit 2
-    glBindTexture(GL_TEXTURE_2D, foamTexture);
-    glUniform1i(foamTextureSampler, 2);
+    backend.bindTexture(2, GL_TEXTURE_2D, foamTexture);  // Bind foam texture to unit 2
+    shaderProgram->set(foamTextureSampler, 2);
 
-    glActiveTexture(GL_TEXTURE3);  // Bind to texture unit 3
-    glBindTexture(GL_TEXTURE_2D, depthTexture);  // Bind the shadow map texture
-    glUniform1i(shadowMapSampler, 3);
+    uploadShadowCascades();
 
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-    glUniform1i(glGetUniformLocation(shaderProgram, "skybox"), 4);
+    backend.bindTexture(4, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+    shaderProgram->set(skyboxSampler, 4);
 
     
-    camera->update();
+    updateCamera();
     projectionMatrix = camera->projectionMatrix;
     viewMatrix = camera->viewMatrix;
     modelMatrix = glm::mat4(1.0);
 
-    glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
-    glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
-    glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &modelMatrix[0][0]);
+    shaderProgram->set(viewMatrixLocation, viewMatrix);
+    shaderProgram->set(projectionMatrixLocation, projectionMatrix);
+    shaderProgram->set(modelMatrixLocation, modelMatrix);
 
-    glBindVertexArray(wavesVAO);
-    glDrawElements(GL_TRIANGLES, indices.size() * 3, GL_UNSIGNED_INT, nullptr);
+    drawWaveSurface();
 }
 
 void lighting_pass(mat4 viewMatrix, mat4 projectionMatrix) {
+    PROFILE_CPU("lighting_pass");
+    PROFILE_GPU("lighting_pass");
+    GLDebugGroup debugGroup("lighting_pass");
 
 
     // Step 1: Binding a frame buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
     glViewport(0, 0, W_WIDTH, W_HEIGHT);
 
     // Step 2: Clearing color and depth info
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // Step 3: Selecting shader program
-    glUseProgram(shaderProgram);
+    shaderProgram->use();
 
 
     // Making view and projection matrices uniform to the shader program
-    glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
-    glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
+    shaderProgram->set(viewMatrixLocation, viewMatrix);
+    shaderProgram->set(projectionMatrixLocation, projectionMatrix);
 
     // uploading the light parameters to the shader program
     uploadLight(*light);
@@ -668,15 +1042,8 @@ void lighting_pass(mat4 viewMatrix, mat4 projectionMatrix) {
 
     // Task 4.1 Display shadows on the 
     //*/
-    // Sending the shadow texture to the shaderProgram
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, depthTexture);
-    glUniform1i(depthMapSampler, 0);
-
-    // Sending the light View-Projection matrix to the shader program
-    mat4 lightVP = light->lightVP();
-    glUniformMatrix4fv(lightVPLocation, 1, GL_FALSE, &lightVP[0][0]);
-
+    // Sending the shadow cascades and their View-Projection matrices to the shader program
+    uploadShadowCascades();
     //*/
 
 
@@ -703,28 +1070,15 @@ void lighting_pass(mat4 viewMatrix, mat4 projectionMatrix) {
 
 
     // upload the model matrix
-    glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &planeModelMatrix[0][0]);
+    shaderProgram->set(modelMatrixLocation, planeModelMatrix);
 
-    glBindVertexArray(wavesVAO);
-    glDrawElements(GL_TRIANGLES, indices.size() * 3, GL_UNSIGNED_INT, nullptr);
+    drawWaveSurface();
 }
 
-void renderDepthMap() {
-    glUseProgram(miniMapProgram);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, depthTexture);
-    glUniform1i(quadTextureSamplerLocation, 0);
-
-    quad->bind();
-    quad->draw();
-    glUseProgram(shaderProgram);
-}
-
-
 void initializeEmitters(const vector<vec3>& topVertices) {
     emitters.clear();  // Ensure the emitters vector is empty
     for (int i = 0; i < topVertices.size(); ++i) {
-        FountainEmitter emitter = FountainEmitter(quad, 25);  // Create each emitter
+        FountainEmitter emitter = FountainEmitter(quad, particlesPerEmitter);  // Create each emitter
         emitter.emitter_pos = topVertices[i];  // Assign position directly from top vertices
         emitter.use_rotations = true;
         emitter.use_sorting = false;
@@ -738,7 +1092,6 @@ void updateEmitters(const vector<vec3>& vertices) {
     for (size_t i = 0; i < emitters.size(); ++i) {
         // Update emitter position with wave height from the vertices
         vec3 newPos = vertices[i];
-        cout << newPos.x << " " << newPos.z << endl;
 
         // Assign position directly to the emitter
         emitters[i].emitter_pos = vec3(newPos.x*2,newPos.y,newPos.z*2);
@@ -751,66 +1104,60 @@ void updateEmitters(const vector<vec3>& vertices) {
     }
 }
 
-float calculateHeight(const vec3& vertex, const vector<Wave>& waves, float time) {
-    float height = 0.0f;
-
-    for (const auto& wave : waves) {
-        // Gerstner wave height calculation (as an example)
-        float wavePhase = dot(wave.direction, vec2(vertex.x, vertex.z)) - wave.speed * time;
-        height += wave.amplitude * sin(wavePhase);
-    }
-
-    return height;
-}
-
-vector<vec3> findTopVertices(const vector<vec3>& vertices, const vector<Wave>& waves, float time, int topCount = 10) {
-    vector<pair<float, vec3>> vertexHeights;
-
-    // Calculate the height for each vertex
-    for (const auto& vertex : vertices) {
-        float height = calculateHeight(vertex, waves, time);
-        vertexHeights.push_back(make_pair(height, vertex));
-    }
-    
-    // Sort vertices by their calculated height
-    std::sort(vertexHeights.begin(), vertexHeights.end(), [](const pair<float, vec3>& a, const pair<float, vec3>& b) {
-        return a.first > b.first;  // Sort by height in descending order
-        });
-
-    // Extract the top 50 vertices
-    vector<vec3> topVertices;
-    for (int i = 0; i < topCount && i < vertexHeights.size(); ++i) {
-        topVertices.push_back(vertexHeights[i].second);
-
+#ifdef ENABLE_PROFILER
+// F3 toggles the timing bars, the numbers go to the window title twice a
+// second. F4 captures a trace of the next frames to trace.json.
+void drawProfiler() {
+    static bool f3Down = false, f4Down = false;
+    static double lastTitle = 0.0;
+    bool f3 = window && glfwGetKey(window, GLFW_KEY_F3) == GLFW_PRESS;
+    bool f4 = window && glfwGetKey(window, GLFW_KEY_F4) == GLFW_PRESS;
+    if (f3 && !f3Down) {
+        showProfiler = !showProfiler;
+        if (!showProfiler) glfwSetWindowTitle(window, TITLE);
     }
-
-    for (int i = 0; i < topVertices.size(); i++) {
-        cout << topVertices[i].x << " " << topVertices[i].z << endl;
+    if (f4 && !f4Down) Tracer::get().start("trace.json", traceFrames);
+    f3Down = f3;
+    f4Down = f4;
+    TRACE_COUNTER("uniform uploads", ShaderProgram::lastFrameStats.uploads);
+    TRACE_COUNTER("uniform bytes", ShaderProgram::lastFrameStats.bytes);
+    TRACE_COUNTER("gpu memory MB", MemoryTracker::get().live() / 1.0e6);
+    TRACE_COUNTER("upload MB", MemoryTracker::get().uploadedLastFrame() / 1.0e6);
+    TRACE_COUNTER("gl performance warnings", GLDebug::get().lastFrame().performance);
+    TRACE_COUNTER("gl state calls elided", GLStateCache::get().lastFrame().elided);
+    if (!showProfiler) return;
+
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    Profiler::get().drawHUD(width, height);
+    MemoryTracker::get().drawHUD(width, height);
+    if (glfwGetTime() - lastTitle > 0.5) {
+        lastTitle = glfwGetTime();
+        string title = string(TITLE) + " | " + MemoryTracker::get().summary() + " | " + Profiler::get().summary();
+        glfwSetWindowTitle(window, title.c_str());
     }
-
-    return topVertices;
 }
-
+#endif
 
 void mainLoop() {
 
-    float lastFrameTime = glfwGetTime();
+    float lastFrameTime = simulationTime();
+    int benchWarmup = std::min(10, benchFrames / 10);
 
     light->update();
-    mat4 light_proj = light->projectionMatrix;
-    mat4 light_view = light->viewMatrix;
+    updateCamera();
 
     // Task 3.3
     // Create the depth buffer
-    depth_pass(light_view, light_proj);
+    depth_pass();
 
 
-#ifdef PARTICLES
-    vector<vec3> topVertices = findTopVertices(vertices, waves, 0, 50);  // Calculate top 50 vertices
-    // Update the emitter positions
+    if (particles) {
+        vector<vec3> topVertices = findTopVertices(vertices, waves, 0, emitterCount);
+        // Update the emitter positions
 
-    initializeEmitters(topVertices);
-#endif // PARTICLES
+        initializeEmitters(topVertices);
+    }
 
     
 
@@ -821,7 +1168,7 @@ void mainLoop() {
     f_emitter.use_rotations = true;
     f_emitter.use_sorting = false;
     f_emitter.height_threshold = 100.0f;
-    GLuint projectionAndViewMatrix = glGetUniformLocation(particleShaderProgram, "PV");*/
+    GLuint projectionAndViewMatrix = particleShaderProgram->uniformLocation("PV");*/
 
 
     do {
@@ -835,13 +1182,9 @@ void mainLoop() {
 
         //glDepthFunc(GL_LEQUAL);
         //glDepthMask(GL_FALSE);
-        //glUseProgram(skyboxProgram);
+        //skyboxProgram->use();
         //mat4 viewMatrixSky = mat4(mat3(camera->viewMatrix));  // Remove the translation part
 
-        //
-        //glUniformMatrix4fv(glGetUniformLocation(skyboxProgram, "view"), 1, GL_FALSE, &viewMatrixSky[0][0]);
-        //glUniformMatrix4fv(glGetUniformLocation(skyboxProgram,"projection"), 1, GL_FALSE, &projectionMatrix[0][0]);
-
 
         //glBindVertexArray(skyboxVAO);
         //glActiveTexture(GL_TEXTURE0);
@@ -854,17 +1197,22 @@ void mainLoop() {
         //glDepthFunc(GL_LESS);
         
         
-        //glUseProgram(shaderProgram);
+        //shaderProgram->use();
+        chrono::steady_clock::time_point frameStart = chrono::steady_clock::now();
+#ifdef ENABLE_PROFILER
+        Profiler::get().beginFrame();
+        if (benchFrames > 0 && (int) frameIndex == benchWarmup) Profiler::get().keepHistory(true);
+#endif
+        handleVariantKeys();
         light->update();
-        mat4 light_proj = light->projectionMatrix;
-        mat4 light_view = light->viewMatrix;
-        depth_pass(light_view, light_proj);
 
         //// Getting camera information
-        camera->update();
+        updateCamera();
         mat4 projectionMatrix = camera->projectionMatrix;
         mat4 viewMatrix = camera->viewMatrix;
 
+        depth_pass();
+
 
 
 
@@ -878,65 +1226,110 @@ void mainLoop() {
         waveUpdate();
 
 
-        float currentTime = glfwGetTime();
+        float currentTime = simulationTime();
         float dt = currentTime - lastFrameTime;
         lastFrameTime = currentTime;
-#ifdef PARTICLES
-        float time = glfwGetTime();
-        vector<vec3> topVertices = findTopVertices(vertices, waves, time, 50);  // Calculate top 50 vertices
+        if (particles) {
+            PROFILE_CPU("particles");
+            PROFILE_GPU("particles");
+            GLDebugGroup debugGroup("particles");
+            float time = simulationTime();
+            vector<vec3> topVertices = findTopVertices(vertices, waves, time, emitterCount);
         
 
-        // Initialize emitters with top vertex positions (if needed only once, move this out)
-        updateEmitters(topVertices);
+            // Initialize emitters with top vertex positions (if needed only once, move this out)
+            updateEmitters(topVertices);
 
-        // Set up the particle shader program
-        glUseProgram(particleShaderProgram);
-        auto PV = projectionMatrix * viewMatrix;
-        glUniformMatrix4fv(projectionAndViewMatrix, 1, GL_FALSE, &PV[0][0]);
+            // Set up the particle shader program
+            particleShaderProgram->use();
+            auto PV = projectionMatrix * viewMatrix;
+            particleShaderProgram->set(projectionAndViewMatrix, PV);
 
-        glEnable(GL_PROGRAM_POINT_SIZE);
+            glEnable(GL_PROGRAM_POINT_SIZE);
 
-        // Update and render each emitter
-        for (auto& emitter : emitters) {
-            emitter.updateParticles(currentTime, dt, camera->position);
-            emitter.renderParticles();
-        }
+            // Update and render each emitter
+            for (auto& emitter : emitters) {
+                emitter.updateParticles(currentTime, dt, camera->position);
+                emitter.renderParticles();
+            }
 
-        glDisable(GL_PROGRAM_POINT_SIZE);
-#endif
+            glDisable(GL_PROGRAM_POINT_SIZE);
+        }
 
 
 
         uploadLight(*light);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, depthTexture);
-        glUniform1i(depthMapSampler, 0);
-
-        mat4 lightVP = light->lightVP();
-        glUniformMatrix4fv(lightVPLocation, 1, GL_FALSE, &lightVP[0][0]);
-
-
-        //renderDepthMap();
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        // uniforms are counted by the programs, everything else as it is sent
+        MemoryTracker::get().upload(MemoryTag::Uniforms, ShaderProgram::frameStats.bytes - waveUniformBytes);
+        waveUniformBytes = 0;
+        MemoryTracker::get().endFrame();
+        GLDebug::get().endFrame();
+#ifdef ENABLE_PROFILER
+        drawProfiler();
+#endif
+        RenderBackend::get().endFrame();
+        GLStateCache::get().endFrame();
+        if (benchFrames > 0) {
+            // nothing to show, the frame time includes the GPU work instead
+            glFinish();
+            chrono::duration<float, milli> frameTime = chrono::steady_clock::now() - frameStart;
+            if ((int) frameIndex >= benchWarmup) {
+                benchFrameTimes.push_back(frameTime.count());
+                benchUploadBytes += MemoryTracker::get().uploadedLastFrame();
+                RenderBackend::Counts counts = RenderBackend::get().lastFrame();
+                benchBackendCounts.calls += counts.calls;
+                benchBackendCounts.draws += counts.draws;
+                benchBackendCounts.instances += counts.instances;
+                benchBackendCounts.bytes += counts.bytes;
+                benchStateCounts.issued += GLStateCache::get().lastFrame().issued;
+                benchStateCounts.elided += GLStateCache::get().lastFrame().elided;
+            }
+        } else {
+            glfwSwapBuffers(window);
+        }
+#ifdef ENABLE_PROFILER
+        Profiler::get().endFrame();
+        Tracer::get().frame();
+#endif
+        GLRecorder::get().frame();
+        frameIndex++;
+        ShaderProgram::resetFrameStats();
+        if (window) glfwPollEvents();
+        if (benchFrames > 0 && (int) frameIndex >= benchFrames) {
+            writeBenchReport(benchWarmup);
+            break;
+        }
 
-    } while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
-        glfwWindowShouldClose(window) == 0);
+    } while (!window || (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
+        glfwWindowShouldClose(window) == 0));
 }
 
-void initialize() {
+// The window and the GL context, or the null backend in their place
+void createWindow() {
     if (!glfwInit()) {
         throw runtime_error("Failed to initialize GLFW\n");
     }
 
     glfwWindowHint(GLFW_SAMPLES, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+    if (benchFrames > 0) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    if (glDebug) glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+
+    window = NULL;
+#ifdef TESSELLATION
+    // Tessellation shaders need GL 4.0, fall back to 3.3 without them
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
     window = glfwCreateWindow(W_WIDTH, W_HEIGHT, TITLE, NULL, NULL);
+#endif
+    if (window == NULL) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(W_WIDTH, W_HEIGHT, TITLE, NULL, NULL);
+    }
     if (window == NULL) {
         glfwTerminate();
         throw runtime_error("Failed to open GLFW window.\n");
@@ -948,11 +1341,36 @@ void initialize() {
         glfwTerminate();
         throw runtime_error("Failed to initialize GLEW\n");
     }
+}
+
+void initialize() {
+    RenderBackend& backend = RenderBackend::get();
+    if (backend.needsContext()) createWindow();
+    backend.initialize();
+    // over the backend's entry points and under the recorder's
+    if (stateCache) GLStateCache::get().enable();
+    if (glDebug) GLDebug::get().enable();
+    if (!recordOut.empty()) {
+        // before any object is made; program binaries would hide the shaders
+        GLRecorder::get().start(recordOut, recordFrames + 1);
+        setShaderCacheDirectory("");
+    }
+
+    if (benchFrames > 0) createOffscreenTarget();
 
-    glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    glfwPollEvents();
-    glfwSetCursorPos(window, W_WIDTH / 2, W_HEIGHT / 2);
+#ifdef TESSELLATION
+    useTessellation = GLEW_VERSION_4_0 || GLEW_ARB_tessellation_shader;
+    if (!useTessellation) {
+        cout << "Tessellation shaders not supported, using the fixed grid" << endl;
+    }
+#endif
+
+    if (window) {
+        glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        glfwPollEvents();
+        glfwSetCursorPos(window, W_WIDTH / 2, W_HEIGHT / 2);
+    }
 
     glClearColor(0.4, 0.4, 0.4, 1.0);
     glEnable(GL_DEPTH_TEST);
@@ -973,17 +1391,130 @@ void initialize() {
     );
 }
 
-int main(void) {
+// Grid size, waves, particles and textures of a scene, the command line gives
+// the values the scene leaves out
+void applyScene() {
+    Scene defaults;
+    defaults.n = N;
+    defaults.waveCount = waveCount;
+    defaults.wavePreset = wavePreset + 1;
+    defaults.emitters = particles ? emitterCount : 0;
+    defaults.particlesPerEmitter = particlesPerEmitter;
+    defaults.textureSet = textureSet;
+
+    Scene scene = loadScene(sceneFile, sceneName, defaults);
+    sceneName = scene.name;
+    N = scene.n;
+    waveCount = scene.waveCount;
+    wavePreset = scene.wavePreset - 1;
+    particles = scene.emitters > 0;
+    if (particles) emitterCount = scene.emitters;
+    particlesPerEmitter = scene.particlesPerEmitter;
+    textureSet = scene.textureSet;
+    cout << "Scene " << scene.name << ": N " << N << ", " << waveCount << " waves, "
+         << (particles ? emitterCount : 0) << " emitters of " << particlesPerEmitter << " particles" << endl;
+}
+
+// --waves 1..3, --wave-count n, --pcf 1..3, --no-lod, --particles, --wireframe,
+// --profile-out file, --trace file, --trace-frames n, --bench n, --bench-dt s,
+// --bench-out file, --scene file, --scene-name name, --vram-budget MB, --upload-budget MB,
+// --gl-debug, --record file, --record-frames n, --backend gl33|gl45|null, --no-state-cache
+void parseArguments(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--particles") {
+            particles = true;
+        } else if (arg == "--gl-debug") {
+            glDebug = true;
+        } else if (arg == "--wireframe") {
+            wireframe = true;
+        } else if (arg == "--no-lod") {
+            waveLod = false;
+        } else if (arg == "--no-state-cache") {
+            stateCache = false;
+        } else if (arg == "--waves" && hasValue) {
+            wavePreset = glm::clamp(atoi(argv[++i]), 1, 3) - 1;
+        } else if (arg == "--wave-count" && hasValue) {
+            waveCount = glm::max(atoi(argv[++i]), 1);
+        } else if (arg == "--bench" && hasValue) {
+            benchFrames = glm::max(atoi(argv[++i]), 1);
+        } else if (arg == "--bench-dt" && hasValue) {
+            benchDt = (float) atof(argv[++i]);
+        } else if (arg == "--bench-out" && hasValue) {
+            benchOut = argv[++i];
+        } else if (arg == "--scene" && hasValue) {
+            sceneFile = argv[++i];
+        } else if (arg == "--scene-name" && hasValue) {
+            sceneName = argv[++i];
+        } else if (arg == "--trace" && hasValue) {
+            traceOut = argv[++i];
+        } else if (arg == "--trace-frames" && hasValue) {
+            traceFrames = glm::max(atoi(argv[++i]), 1);
+        } else if (arg == "--profile-out" && hasValue) {
+            profileOut = argv[++i];
+        } else if (arg == "--vram-budget" && hasValue) {
+            vramBudget = (float) atof(argv[++i]);
+        } else if (arg == "--upload-budget" && hasValue) {
+            uploadBudget = (float) atof(argv[++i]);
+        } else if (arg == "--record" && hasValue) {
+            recordOut = argv[++i];
+        } else if (arg == "--record-frames" && hasValue) {
+            recordFrames = glm::max(atoi(argv[++i]), 1);
+        } else if (arg == "--backend" && hasValue) {
+            backendName = argv[++i];
+        } else if (arg == "--pcf" && hasValue) {
+            shadowPCF = glm::clamp(atoi(argv[++i]), 1, 3);
+        } else {
+            throw runtime_error("Unknown argument: " + arg);
+        }
+    }
+
+    RenderBackend::select(backendName);
+    // the capture only has the GL 3.3 calls
+    if (!recordOut.empty() && backendName != "gl33") throw runtime_error("--record needs the gl33 backend");
+    if (!RenderBackend::get().needsContext()) {
+        // nothing to look at
+        if (benchFrames == 0) benchFrames = 600;
+        if (glDebug) throw runtime_error("--gl-debug needs a GL backend");
+    }
+
+    N = particles ? 6 : 9;
+    if (!sceneFile.empty()) applyScene();
+    MemoryTracker::get().setTotalBudget((size_t) (vramBudget * 1.0e6));
+    MemoryTracker::get().setUploadBudget((size_t) (uploadBudget * 1.0e6));
+    sideSlices = pow(2, N);
+}
+
+int main(int argc, char* argv[]) {
     try {
+        parseArguments(argc, argv);
+        TRACE_THREAD_NAME("main");
+#ifdef ENABLE_PROFILER
+        if (!traceOut.empty()) Tracer::get().start(traceOut, traceFrames);
+#endif
         initialize();
+#ifdef ENABLE_PROFILER
+        if (!profileOut.empty()) Profiler::get().open(profileOut);
+#else
+        if (!profileOut.empty() || !traceOut.empty()) {
+            cout << "Built without ENABLE_PROFILER, no profile or trace is written" << endl;
+        }
+#endif
         createContext();
-        createWaves(waveCount);
+        waves = createWaves(waveCount, wavePresets[wavePreset]);
         mainLoop();
+        GLRecorder::get().stop();
+        MemoryTracker::get().printReport();
+        GLDebug::get().printReport();
+        GLStateCache::get().printReport();
+        RenderBackend::get().printReport();
         free();
     }
     catch (exception& ex) {
         cout << ex.what() << endl;
-        getchar();
+        // a benchmark may run unattended
+        if (benchFrames == 0) getchar();
         free();
         return -1;
     }
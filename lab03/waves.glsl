@@ -0,0 +1,87 @@
+// Gerstner wave sum shared by texture.vertexshader and
+// texture.tessevaluationshader.
+//
+// WAVE_COUNT is defined by the host so that the loops have a constant trip
+// count. With WAVE_LOD the waves shorter than waveLodScale times the view
+// distance are skipped; createWaves orders them from the longest to the
+// shortest, so the loops can stop at the first one.
+
+#ifndef WAVE_COUNT
+#define WAVE_COUNT 300
+#endif
+#define pi 3.1415926535897932384626433832795
+#define g 9.806650
+
+struct Wave {
+    vec2 direction;
+    float steepness;
+    float wavelength;
+    float speed;
+    float amplitude;
+};
+
+uniform Wave[WAVE_COUNT] waves;
+
+#ifdef WAVE_LOD
+uniform float waveLodScale;
+#endif
+
+// Shortest wavelength worth evaluating at this distance from the camera
+float minimumWavelength(float viewDistance) {
+#ifdef WAVE_LOD
+    return waveLodScale * viewDistance;
+#else
+    return 0.0;
+#endif
+}
+
+vec3 gerstner_wave_normal(vec3 position, float time, float minWavelength) {
+    vec3 wave_normal = vec3(0.0, 1.0, 0.0);
+    for (int i = 0; i < WAVE_COUNT; i++) {
+        Wave wave = waves[i];
+#ifdef WAVE_LOD
+        if (wave.wavelength < minWavelength) break;
+#endif
+        vec2 d = normalize(wave.direction);
+        float k = 2.0 * pi / wave.wavelength;
+        float w = sqrt(g * k);
+        float phase = k * dot(d, position.xz) - wave.speed * w * time;
+
+        float Af = wave.amplitude * k;
+
+        // Calculate wave influence on the normal
+        wave_normal.y -= wave.steepness * Af * sin(phase);
+
+        float omega = Af * cos(phase);
+        wave_normal.x -= d.x * omega;
+        wave_normal.z -= d.y * omega;
+    }
+    return normalize(wave_normal);
+}
+
+vec3 gerstner_wave_position(vec2 position, float time, float minWavelength) {
+    vec3 wave_position = vec3(position.x, 0.0, position.y);
+    for (int i = 0; i < WAVE_COUNT; i++) {
+        Wave wave = waves[i];
+#ifdef WAVE_LOD
+        if (wave.wavelength < minWavelength) break;
+#endif
+        vec2 d = normalize(wave.direction);
+        float k = 2.0 * pi / wave.wavelength;
+        float w = sqrt(g * k);
+        float phase = k * dot(d, position) - wave.speed * w * time;
+
+        // Wave amplitude factor (Q)
+        float Q = min(wave.steepness / k, 1.0);
+        float A = wave.amplitude;
+
+        // Apply height displacement
+        wave_position.y += A * cos(phase);
+
+        // Horizontal displacement based on steepness
+        float width = A * Q * sin(phase);
+        wave_position.x += d.x * width;
+        wave_position.z += d.y * width;
+    }
+    return wave_position;
+}
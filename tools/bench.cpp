@@ -0,0 +1,486 @@
+// CPU microbenchmarks of the simulation and loading code, none of them needs
+// a GL context.
+//
+//   bench [--filter text] [--threads 1,2,4] [--quick] [--csv file] [--data dir]
+//
+// Every benchmark runs at a few sizes and reports the time of one run and the
+// throughput. The ones built on parallelFor also run at every thread count
+// (1, 2, 4 .. all cores by default) and report the speedup over the first.
+// The input files are generated into the data directory (bench-data) once.
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+#include <glm/glm.hpp>
+#include <common/util.h>
+#include <common/model.h>
+#include <common/texture.h>
+#include <common/waves.h>
+#include <common/FountainEmitter.h>
+
+using namespace std;
+using namespace glm;
+
+// One size of a benchmark, run() is what gets timed
+struct Case {
+    function<void()> run;
+    double items;               // processed by one run
+};
+
+struct Benchmark {
+    string name;
+    string unit;                // of the items
+    vector<int> sizes;
+    bool threaded;              // through parallelFor, so it runs at every thread count
+    function<Case(int size)> setup;
+};
+
+struct Result {
+    string name;
+    int size;
+    int threads;                // 0 when not threaded
+    double ms;
+    double throughput;          // items per second
+    string unit;
+    double speedup;
+};
+
+string dataDirectory = "bench-data";
+
+// The loaders log every file, which would drown the results
+class Quiet {
+public:
+    Quiet() : saved{cout.rdbuf(nullptr)} {}
+    ~Quiet() {
+        cout.rdbuf(saved);
+        cout.clear();
+    }
+private:
+    streambuf* saved;
+};
+
+// Median time of one run over a few batches that each take at least a fifth
+// of minSeconds
+double measure(const Case& benchmarkCase, double minSeconds) {
+    Quiet quiet;
+    typedef chrono::steady_clock Clock;
+    auto timeBatch = [&](int runs) {
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < runs; i++) benchmarkCase.run();
+        return chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    timeBatch(1);
+    int runs = 1;
+    while (timeBatch(runs) < minSeconds / 5 && runs < (1 << 24)) runs *= 2;
+
+    vector<double> perRun;
+    for (int batch = 0; batch < 5; batch++) perRun.push_back(timeBatch(runs) / runs);
+    sort(perRun.begin(), perRun.end());
+    return perRun[perRun.size() / 2] * 1000.0;
+}
+
+string formatThroughput(double perSecond, const string& unit) {
+    const char* prefixes[] = { "", "k", "M", "G" };
+    int prefix = 0;
+    while (perSecond >= 1000.0 && prefix < 3) {
+        perSecond /= 1000.0;
+        prefix++;
+    }
+    ostringstream text;
+    text << fixed << setprecision(perSecond < 10.0 ? 2 : 1) << perSecond << " "
+         << prefixes[prefix] << unit << "/s";
+    return text.str();
+}
+
+// Inputs
+
+// A size x size grid of the water plane, row by row
+vector<vec3> gridVertices(int size) {
+    vector<vec3> vertices;
+    vertices.reserve(size * size);
+    for (int z = 0; z < size; z++) {
+        for (int x = 0; x < size; x++) {
+            vertices.push_back(vec3(x * 0.25f, 0.0f, z * 0.25f));
+        }
+    }
+    return vertices;
+}
+
+// Two triangles per cell of a (size + 1) x (size + 1) grid of points
+vector<unsigned int> gridTriangles(int size) {
+    vector<unsigned int> indices;
+    indices.reserve(6 * size * size);
+    for (int z = 0; z < size; z++) {
+        for (int x = 0; x < size; x++) {
+            unsigned int a = z * (size + 1) + x, b = a + 1, c = a + size + 1, d = c + 1;
+            unsigned int corners[] = { a, c, b, b, c, d };
+            indices.insert(indices.end(), corners, corners + 6);
+        }
+    }
+    return indices;
+}
+
+vector<Wave> benchWaves(int count) {
+    srand(1);
+    return createWaves(count, wavePresets[0]);
+}
+
+// .obj of a size x size cell grid with uvs and normals
+string objFile(int size) {
+    string path = dataDirectory + "/grid" + to_string(size) + ".obj";
+    if (fileExists(path)) return path;
+    ofstream out(path);
+    int side = size + 1;
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) out << "v " << x * 0.25f << " " << 0.1f * (x % 3) << " " << z * 0.25f << "\n";
+    }
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) out << "vt " << (float) x / size << " " << (float) z / size << "\n";
+    }
+    out << "vn 0 1 0\n";
+    vector<unsigned int> indices = gridTriangles(size);
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        out << "f";
+        for (int k = 0; k < 3; k++) out << " " << indices[i + k] + 1 << "/" << indices[i + k] + 1 << "/1";
+        out << "\n";
+    }
+    if (!out) throw runtime_error("Can't write " + path);
+    return path;
+}
+
+// .vtp of the same grid as quads, with ascii or raw appended data arrays, laid
+// out as ParaView writes it: field data first and InformationKeys in the arrays
+string vtpFile(int size, bool appended) {
+    string path = dataDirectory + "/grid" + to_string(size) + (appended ? "-appended" : "-ascii") + "-pv.vtp";
+    if (fileExists(path)) return path;
+
+    int side = size + 1;
+    vector<float> points, normals, uvs;
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            float point[] = { x * 0.25f, 0.1f * (x % 3), z * 0.25f };
+            float normal[] = { 0.0f, 1.0f, 0.0f };
+            float uv[] = { (float) x / size, (float) z / size };
+            points.insert(points.end(), point, point + 3);
+            normals.insert(normals.end(), normal, normal + 3);
+            uvs.insert(uvs.end(), uv, uv + 2);
+        }
+    }
+    vector<unsigned int> connectivity, offsets;
+    for (int z = 0; z < size; z++) {
+        for (int x = 0; x < size; x++) {
+            unsigned int a = z * side + x;
+            unsigned int quad[] = { a, a + side, a + side + 1, a + 1 };
+            connectivity.insert(connectivity.end(), quad, quad + 4);
+            offsets.push_back((unsigned int) connectivity.size());
+        }
+    }
+
+    ofstream out(path, ios::binary);
+    string blob;
+    auto dataArray = [&](const string& type, const string& name, int components,
+                         const void* data, size_t count, size_t valueSize, bool isFloat) {
+        out << "<DataArray type=\"" << type << "\" Name=\"" << name << "\" NumberOfComponents=\""
+            << components << "\" format=\"" << (appended ? "appended" : "ascii") << "\"";
+        if (appended) out << " offset=\"" << blob.size() << "\"";
+        out << ">\n";
+        if (isFloat) {
+            out << "<InformationKey name=\"L2_NORM_RANGE\" location=\"vtkDataArray\" length=\"2\">\n"
+                << "<Value index=\"0\">\n0\n</Value>\n<Value index=\"1\">\n1\n</Value>\n</InformationKey>\n";
+        }
+        if (appended) {
+            out << "</DataArray>\n";
+            unsigned int bytes = (unsigned int) (count * valueSize);
+            blob.append((const char*) &bytes, 4);
+            blob.append((const char*) data, bytes);
+            return;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (isFloat) out << ((const float*) data)[i];
+            else out << ((const unsigned int*) data)[i];
+            out << ((i + 1) % 12 == 0 ? "\n" : " ");
+        }
+        out << "\n</DataArray>\n";
+    };
+    out << "<?xml version=\"1.0\"?>\n"
+        << "<VTKFile type=\"PolyData\" version=\"1.0\" byte_order=\"LittleEndian\" header_type=\"UInt32\">\n"
+        << "<PolyData>\n<FieldData>\n"
+        << "<DataArray type=\"Float64\" Name=\"TimeValue\" NumberOfTuples=\"1\" format=\"ascii\">\n0\n</DataArray>\n"
+        << "</FieldData>\n<Piece NumberOfPoints=\"" << side * side << "\" NumberOfPolys=\"" << offsets.size() << "\">\n"
+        << "<PointData Normals=\"Normals\" TCoords=\"TCoords\">\n";
+    dataArray("Float32", "Normals", 3, normals.data(), normals.size(), 4, true);
+    dataArray("Float32", "TCoords", 2, uvs.data(), uvs.size(), 4, true);
+    out << "</PointData>\n<Points>\n";
+    dataArray("Float32", "Points", 3, points.data(), points.size(), 4, true);
+    out << "</Points>\n<Polys>\n";
+    dataArray("UInt32", "connectivity", 1, connectivity.data(), connectivity.size(), 4, false);
+    dataArray("UInt32", "offsets", 1, offsets.data(), offsets.size(), 4, false);
+    out << "</Polys>\n</Piece>\n</PolyData>\n";
+    if (appended) out << "<AppendedData encoding=\"raw\">\n_" << blob << "\n</AppendedData>\n";
+    out << "</VTKFile>\n";
+    if (!out) throw runtime_error("Can't write " + path);
+    return path;
+}
+
+// 24bpp .bmp of size x size pixels
+string bmpFile(int size) {
+    string path = dataDirectory + "/image" + to_string(size) + ".bmp";
+    if (fileExists(path)) return path;
+
+    unsigned int rowSize = (size * 3 + 3) & ~3u;
+    unsigned int imageSize = rowSize * size;
+    unsigned char header[54] = { 'B', 'M' };
+    auto put32 = [&](int offset, unsigned int value) {
+        for (int i = 0; i < 4; i++) header[offset + i] = (unsigned char) (value >> (8 * i));
+    };
+    put32(0x02, 54 + imageSize);
+    put32(0x0A, 54);
+    put32(0x0E, 40);
+    put32(0x12, size);
+    put32(0x16, size);
+    header[0x1A] = 1;
+    header[0x1C] = 24;
+    put32(0x22, imageSize);
+
+    vector<unsigned char> pixels(imageSize);
+    for (size_t i = 0; i < pixels.size(); i++) pixels[i] = (unsigned char) (i * 7 + i / 3);
+    ofstream out(path, ios::binary);
+    out.write((const char*) header, sizeof(header));
+    out.write((const char*) pixels.data(), pixels.size());
+    if (!out) throw runtime_error("Can't write " + path);
+    return path;
+}
+
+double fileSize(const string& path) {
+    ifstream in(path, ios::binary | ios::ate);
+    return (double) in.tellg();
+}
+
+// Loaders share this signature
+typedef void (*MeshLoader)(const string&, vector<vec3>&, vector<vec2>&, vector<vec3>&, vector<unsigned int>&);
+
+Case loaderCase(MeshLoader loader, const string& path) {
+    Case result;
+    result.items = fileSize(path);
+    result.run = [loader, path]() {
+        vector<vec3> vertices, normals;
+        vector<vec2> uvs;
+        vector<unsigned int> indices;
+        loader(path, vertices, uvs, normals, indices);
+    };
+    return result;
+}
+
+// The benchmarks
+
+vector<Benchmark> benchmarks() {
+    vector<Benchmark> all;
+
+    all.push_back({ "createWaves", "waves", { 30, 300, 3000 }, false, [](int size) {
+        shared_ptr<vector<Wave>> waves = make_shared<vector<Wave>>();
+        return Case{ [=]() { *waves = createWaves(size, wavePresets[0]); }, (double) size };
+    } });
+
+    // grids of the water against the default 300 waves
+    all.push_back({ "waveHeight", "vertices", { 64, 256 }, true, [](int size) {
+        shared_ptr<vector<vec3>> vertices = make_shared<vector<vec3>>(gridVertices(size));
+        shared_ptr<vector<float>> heights = make_shared<vector<float>>(vertices->size());
+        shared_ptr<vector<Wave>> waves = make_shared<vector<Wave>>(benchWaves(300));
+        return Case{ [=]() {
+            parallelFor(size, [&](int row) {
+                for (int i = row * size; i < (row + 1) * size; i++) {
+                    (*heights)[i] = waveHeight((*vertices)[i], *waves, 1.0f);
+                }
+            });
+        }, (double) vertices->size() };
+    } });
+
+    all.push_back({ "wavePosition+Normal", "vertices", { 64, 256 }, true, [](int size) {
+        shared_ptr<vector<vec3>> vertices = make_shared<vector<vec3>>(gridVertices(size));
+        shared_ptr<vector<vec3>> out = make_shared<vector<vec3>>(2 * vertices->size());
+        shared_ptr<vector<Wave>> waves = make_shared<vector<Wave>>(benchWaves(300));
+        return Case{ [=]() {
+            parallelFor(size, [&](int row) {
+                for (int i = row * size; i < (row + 1) * size; i++) {
+                    const vec3& vertex = (*vertices)[i];
+                    (*out)[2 * i] = wavePosition(vec2(vertex.x, vertex.z), *waves, 1.0f);
+                    (*out)[2 * i + 1] = waveNormal(vertex, *waves, 1.0f);
+                }
+            });
+        }, (double) vertices->size() };
+    } });
+
+    all.push_back({ "findTopVertices", "vertices", { 64, 128, 256 }, false, [](int size) {
+        shared_ptr<vector<vec3>> vertices = make_shared<vector<vec3>>(gridVertices(size));
+        shared_ptr<vector<Wave>> waves = make_shared<vector<Wave>>(benchWaves(300));
+        shared_ptr<vector<vec3>> top = make_shared<vector<vec3>>();
+        return Case{ [=]() { *top = findTopVertices(*vertices, *waves, 1.0f, 50); }, (double) vertices->size() };
+    } });
+
+    // every particle is active and pushes against every other one
+    all.push_back({ "updateParticles", "particles", { 25, 100, 400, 1600 }, false, [](int size) {
+        shared_ptr<FountainEmitter> emitter = make_shared<FountainEmitter>(nullptr, size);
+        emitter->height_threshold = 0.05f;
+        srand(1);
+        while (emitter->active_particles < size) emitter->updateParticles(0.0f, 1.0f / 60.0f);
+        return Case{ [=]() { emitter->updateParticles(0.0f, 1.0f / 60.0f, vec3(10.0f, 5.0f, 10.0f)); }, (double) size };
+    } });
+
+    // std::execution inside, not capped by --threads
+    all.push_back({ "packInstances", "particles", { 1000, 10000, 100000 }, false, [](int size) {
+        shared_ptr<FountainEmitter> emitter = make_shared<FountainEmitter>(nullptr, size);
+        srand(1);
+        for (int i = 0; i < size; i++) emitter->createNewParticle(i);
+        return Case{ [=]() { emitter->packInstances(); }, (double) size };
+    } });
+
+    // welds the triangle soup of a grid back into its shared vertices
+    all.push_back({ "indexVBO", "vertices", { 64, 256, 512 }, true, [](int size) {
+        vector<unsigned int> triangles = gridTriangles(size);
+        shared_ptr<vector<vec3>> vertices = make_shared<vector<vec3>>(), normals = make_shared<vector<vec3>>();
+        shared_ptr<vector<vec2>> uvs = make_shared<vector<vec2>>();
+        for (unsigned int index : triangles) {
+            int x = index % (size + 1), z = index / (size + 1);
+            vertices->push_back(vec3(x * 0.25f, 0.0f, z * 0.25f));
+            uvs->push_back(vec2((float) x / size, (float) z / size));
+            normals->push_back(vec3(0.0f, 1.0f, 0.0f));
+        }
+        return Case{ [=]() {
+            vector<unsigned int> indices;
+            vector<vec3> outVertices, outNormals;
+            vector<vec2> outUVs;
+            indexVBO(*vertices, *uvs, *normals, indices, outVertices, outUVs, outNormals);
+        }, (double) vertices->size() };
+    } });
+
+    all.push_back({ "loadOBJ", "B", { 64, 256 }, false, [](int size) {
+        return loaderCase(loadOBJ, objFile(size));
+    } });
+    all.push_back({ "loadOBJWithTiny", "B", { 64, 256 }, false, [](int size) {
+        return loaderCase(loadOBJWithTiny, objFile(size));
+    } });
+    all.push_back({ "loadOBJParallel", "B", { 64, 256 }, true, [](int size) {
+        return loaderCase(loadOBJParallel, objFile(size));
+    } });
+    all.push_back({ "loadVTP ascii", "B", { 64, 256 }, false, [](int size) {
+        return loaderCase(loadVTP, vtpFile(size, false));
+    } });
+    all.push_back({ "loadVTP appended", "B", { 64, 256 }, false, [](int size) {
+        return loaderCase(loadVTP, vtpFile(size, true));
+    } });
+
+    all.push_back({ "decodeBMP", "B", { 256, 1024, 2048 }, false, [](int size) {
+        string path = bmpFile(size);
+        return Case{ [path]() { decodeBMP(path.c_str()); }, fileSize(path) };
+    } });
+
+    return all;
+}
+
+vector<int> defaultThreadCounts() {
+    int cores = std::max((int) thread::hardware_concurrency(), 1);
+    vector<int> counts;
+    for (int threads = 1; threads < cores; threads *= 2) counts.push_back(threads);
+    counts.push_back(cores);
+    return counts;
+}
+
+vector<int> parseThreadCounts(const string& list) {
+    vector<int> counts;
+    stringstream text(list);
+    string item;
+    while (getline(text, item, ',')) {
+        int threads = atoi(item.c_str());
+        if (threads < 1) throw runtime_error("Invalid thread count: " + item);
+        counts.push_back(threads);
+    }
+    return counts;
+}
+
+void printResult(const Result& result) {
+    cout << left << setw(22) << result.name << right << setw(8) << result.size
+         << setw(9) << (result.threads ? to_string(result.threads) : string("-"))
+         << fixed << setprecision(3) << setw(12) << result.ms
+         << setw(20) << formatThroughput(result.throughput, result.unit);
+    if (result.threads) cout << setprecision(2) << setw(9) << result.speedup << "x";
+    cout << endl;
+}
+
+int main(int argc, char* argv[]) {
+    string filter, csvPath;
+    vector<int> threadCounts = defaultThreadCounts();
+    double minSeconds = 0.5;
+    try {
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--filter" && hasValue) filter = argv[++i];
+            else if (arg == "--threads" && hasValue) threadCounts = parseThreadCounts(argv[++i]);
+            else if (arg == "--csv" && hasValue) csvPath = argv[++i];
+            else if (arg == "--data" && hasValue) dataDirectory = argv[++i];
+            else if (arg == "--quick") minSeconds = 0.1;
+            else {
+                cout << "Usage: bench [--filter text] [--threads 1,2,4] [--quick] [--csv file] [--data dir]" << endl;
+                return 1;
+            }
+        }
+        if (!createDirectory(dataDirectory)) throw runtime_error("Can't create " + dataDirectory);
+
+        cout << left << setw(22) << "benchmark" << right << setw(8) << "size" << setw(9) << "threads"
+             << setw(12) << "ms/run" << setw(20) << "throughput" << setw(10) << "speedup" << endl;
+        vector<Result> results;
+        for (const Benchmark& benchmark : benchmarks()) {
+            if (!filter.empty() && benchmark.name.find(filter) == string::npos) continue;
+            for (int size : benchmark.sizes) {
+                Case benchmarkCase;
+                {
+                    Quiet quiet;
+                    benchmarkCase = benchmark.setup(size);
+                }
+                vector<int> counts = benchmark.threaded ? threadCounts : vector<int>(1, 0);
+                double singleThreadMs = 0.0;
+                for (int threads : counts) {
+                    limitThreads(threads);
+                    Result result;
+                    result.name = benchmark.name;
+                    result.size = size;
+                    result.threads = threads;
+                    result.ms = measure(benchmarkCase, minSeconds);
+                    result.throughput = benchmarkCase.items / (result.ms / 1000.0);
+                    result.unit = benchmark.unit;
+                    if (threads == counts.front()) singleThreadMs = result.ms;
+                    result.speedup = singleThreadMs / result.ms;
+                    printResult(result);
+                    results.push_back(result);
+                }
+                limitThreads(0);
+            }
+        }
+
+        if (!csvPath.empty()) {
+            ofstream csv(csvPath);
+            if (!csv) throw runtime_error("Can't write " + csvPath);
+            csv << "benchmark,size,threads,ms,throughput,unit,speedup\n";
+            for (const Result& result : results) {
+                csv << result.name << "," << result.size << "," << result.threads << "," << result.ms << ","
+                    << result.throughput << "," << result.unit << "/s," << result.speedup << "\n";
+            }
+            cout << "Results written to " << csvPath << endl;
+        }
+    } catch (exception& ex) {
+        cout << ex.what() << endl;
+        return 1;
+    }
+    return 0;
+}
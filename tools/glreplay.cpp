@@ -0,0 +1,145 @@
+// Replays a GL command capture of lab03 (--record) as fast as the driver
+// takes it, without the input, the simulation and the asset decoding.
+//
+//   glreplay [--loops 10] [--out report.json] capture.glrec
+//
+// The loading and the first recorded frame are replayed once, then every
+// other frame in order, --loops times, each timed to glFinish in a hidden
+// window. The frame times are printed and, with --out, written as JSON.
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <stdexcept>
+#include <GL/glew.h>
+#include <glfw3.h>
+#include <common/glrecorder.h>
+
+using namespace std;
+
+struct Stats {
+    double min = 0.0, mean = 0.0, p50 = 0.0, p99 = 0.0, max = 0.0;
+};
+
+Stats statistics(vector<double> samples) {
+    Stats stats;
+    if (samples.empty()) return stats;
+    sort(samples.begin(), samples.end());
+    auto percentile = [&](double p) {
+        return samples[(size_t) std::min(p / 100.0 * samples.size(), (double) samples.size() - 1)];
+    };
+    double sum = 0.0;
+    for (double sample : samples) sum += sample;
+    stats.min = samples.front();
+    stats.mean = sum / samples.size();
+    stats.p50 = percentile(50);
+    stats.p99 = percentile(99);
+    stats.max = samples.back();
+    return stats;
+}
+
+GLFWwindow* createHiddenWindow() {
+    if (!glfwInit()) throw runtime_error("Failed to initialize GLFW");
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // 4.0 for captures with tessellation, 3.3 otherwise
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+    GLFWwindow* window = glfwCreateWindow(1024, 768, "glreplay", NULL, NULL);
+    if (window == NULL) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(1024, 768, "glreplay", NULL, NULL);
+    }
+    if (window == NULL) {
+        glfwTerminate();
+        throw runtime_error("Failed to open GLFW window");
+    }
+    glfwMakeContextCurrent(window);
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK) {
+        glfwTerminate();
+        throw runtime_error("Failed to initialize GLEW");
+    }
+    return window;
+}
+
+int main(int argc, char* argv[]) {
+    string capturePath, out;
+    int loops = 10;
+    bool usage = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--loops" && hasValue) loops = max(atoi(argv[++i]), 1);
+        else if (arg == "--out" && hasValue) out = argv[++i];
+        else if (capturePath.empty() && arg.compare(0, 2, "--") != 0) capturePath = arg;
+        else usage = true;
+    }
+    if (usage || capturePath.empty()) {
+        cout << "Usage: glreplay [--loops 10] [--out report.json] capture.glrec" << endl;
+        return 1;
+    }
+
+    try {
+        GLReplay replay(capturePath);
+        createHiddenWindow();
+        cout << "Replaying " << replay.frameCount() << " frames of " << capturePath
+             << " on " << glGetString(GL_RENDERER) << endl;
+
+        auto setupStart = chrono::steady_clock::now();
+        replay.setup();
+        glFinish();
+        chrono::duration<double, milli> setupTime = chrono::steady_clock::now() - setupStart;
+
+        vector<double> frameTimes;
+        for (int loop = 0; loop < loops; loop++) {
+            for (int frame = 0; frame < replay.frameCount(); frame++) {
+                auto frameStart = chrono::steady_clock::now();
+                replay.replayFrame(frame);
+                glFinish();
+                chrono::duration<double, milli> frameTime = chrono::steady_clock::now() - frameStart;
+                frameTimes.push_back(frameTime.count());
+            }
+        }
+
+        size_t calls = 0, bytes = 0;
+        for (int frame = 0; frame < replay.frameCount(); frame++) {
+            calls += replay.frameCalls(frame);
+            bytes += replay.frameBytes(frame);
+        }
+        int frames = max(replay.frameCount(), 1);
+        Stats stats = statistics(frameTimes);
+        cout << fixed << setprecision(3)
+             << "setup " << setupTime.count() << " ms" << endl
+             << "frame ms: min " << stats.min << ", mean " << stats.mean << ", p50 " << stats.p50
+             << ", p99 " << stats.p99 << ", max " << stats.max << endl
+             << "per frame: " << calls / frames << " calls, " << bytes / frames / 1.0e3 << " KB of commands" << endl;
+
+        if (!out.empty()) {
+            ofstream report(out);
+            if (!report) throw runtime_error("Can't write replay report: " + out);
+            report << "{\n";
+            report << "  \"capture\": \"" << capturePath << "\",\n";
+            report << "  \"frames\": " << replay.frameCount() << ", \"loops\": " << loops << ",\n";
+            report << "  \"setup_ms\": " << setupTime.count() << ",\n";
+            report << "  \"calls_per_frame\": " << calls / frames << ",\n";
+            report << "  \"bytes_per_frame\": " << bytes / frames << ",\n";
+            report << "  \"frame_ms\": {\"min\": " << stats.min << ", \"mean\": " << stats.mean
+                   << ", \"p50\": " << stats.p50 << ", \"p99\": " << stats.p99 << ", \"max\": " << stats.max << "}\n";
+            report << "}\n";
+            cout << "Replay report written to " << out << endl;
+        }
+        glfwTerminate();
+    } catch (exception& ex) {
+        cout << ex.what() << endl;
+        return 1;
+    }
+    return 0;
+}
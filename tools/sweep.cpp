@@ -0,0 +1,140 @@
+// Runs every scene of a scene file through lab03's benchmark mode and reports
+// where frame time, memory and upload bandwidth cross the scene budgets.
+//
+//   sweep [--lab ./lab03] [--frames 300] [--out prefix] scenes.xml
+//
+// Run it from the lab03 directory so the program finds its assets. Each scene
+// is a separate lab03 run writing <prefix><scene>.json (see --bench-out); a
+// run that fails counts as over every budget. Scenes should go from light to
+// heavy, the summary names the first one over each budget.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <stdexcept>
+#include <common/scene.h>
+
+using namespace std;
+
+struct Measurement {
+    bool ran = false;
+    double frameMean = 0.0, frameP99 = 0.0;
+    double memoryMB = 0.0;
+    double uploadMBps = 0.0;
+};
+
+// Value of the first "key": number after from in a report of lab03
+double reportNumber(const string& report, const string& key, size_t from = 0) {
+    size_t position = report.find("\"" + key + "\":", from);
+    if (position == string::npos) throw runtime_error("No " + key + " in the report");
+    return strtod(report.c_str() + position + key.size() + 3, nullptr);
+}
+
+Measurement readReport(const string& path) {
+    ifstream in(path);
+    if (!in) throw runtime_error("No report " + path);
+    stringstream text;
+    text << in.rdbuf();
+    string report = text.str();
+
+    Measurement measurement;
+    size_t frames = report.find("\"frame_ms\":");
+    if (frames == string::npos) throw runtime_error("No frame times in " + path);
+    measurement.frameMean = reportNumber(report, "mean", frames);
+    measurement.frameP99 = reportNumber(report, "p99", frames);
+    measurement.memoryMB = reportNumber(report, "peak_memory_mb");
+    measurement.uploadMBps = reportNumber(report, "upload_mb_per_s");
+    measurement.ran = true;
+    return measurement;
+}
+
+string quote(const string& argument) {
+    return "\"" + argument + "\"";
+}
+
+int main(int argc, char* argv[]) {
+    string lab = "./lab03", prefix = "sweep-", scenesPath;
+    int frames = 300;
+    bool usage = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--lab" && hasValue) lab = argv[++i];
+        else if (arg == "--frames" && hasValue) frames = max(atoi(argv[++i]), 1);
+        else if (arg == "--out" && hasValue) prefix = argv[++i];
+        else if (scenesPath.empty() && arg.compare(0, 2, "--") != 0) scenesPath = arg;
+        else usage = true;
+    }
+    if (usage || scenesPath.empty()) {
+        cout << "Usage: sweep [--lab ./lab03] [--frames 300] [--out prefix] scenes.xml" << endl;
+        return 1;
+    }
+
+    try {
+        vector<Scene> scenes = loadScenes(scenesPath);
+        vector<Measurement> measurements;
+        for (const Scene& scene : scenes) {
+            string report = prefix + scene.name + ".json";
+            remove(report.c_str());
+            string command = quote(lab) + " --scene " + quote(scenesPath) + " --scene-name " + quote(scene.name) +
+                             " --bench " + to_string(frames) + " --bench-out " + quote(report);
+            cout << "Running " << scene.name << ": " << command << endl;
+            Measurement measurement;
+            if (system(command.c_str()) == 0) {
+                try {
+                    measurement = readReport(report);
+                } catch (exception& ex) {
+                    cout << ex.what() << endl;
+                }
+            }
+            measurements.push_back(measurement);
+        }
+
+        cout << endl << left << setw(16) << "scene" << right << setw(4) << "N" << setw(7) << "waves"
+             << setw(11) << "particles" << setw(10) << "mean ms" << setw(9) << "p99 ms"
+             << setw(12) << "memory MB" << setw(13) << "upload MB/s" << "  over budget" << endl;
+        const char* budgetNames[] = { "frame time", "memory", "upload" };
+        int firstOver[3] = { -1, -1, -1 };
+        for (size_t i = 0; i < scenes.size(); i++) {
+            const Scene& scene = scenes[i];
+            const SceneBudget& budget = scene.budget;
+            const Measurement& measurement = measurements[i];
+            bool over[3] = {
+                !measurement.ran || (budget.frameMs > 0.0f && measurement.frameP99 > budget.frameMs),
+                !measurement.ran || (budget.memoryMB > 0.0f && measurement.memoryMB > budget.memoryMB),
+                !measurement.ran || (budget.uploadMBps > 0.0f && measurement.uploadMBps > budget.uploadMBps)
+            };
+
+            cout << left << setw(16) << scene.name << right << setw(4) << scene.n << setw(7) << scene.waveCount
+                 << setw(11) << scene.emitters * scene.particlesPerEmitter << fixed << setprecision(2);
+            if (measurement.ran) {
+                cout << setw(10) << measurement.frameMean << setw(9) << measurement.frameP99
+                     << setw(12) << measurement.memoryMB << setw(13) << measurement.uploadMBps << " ";
+            } else {
+                cout << setw(44) << "failed" << " ";
+            }
+            for (int budgetIndex = 0; budgetIndex < 3; budgetIndex++) {
+                if (!over[budgetIndex]) continue;
+                cout << " " << budgetNames[budgetIndex];
+                if (firstOver[budgetIndex] < 0) firstOver[budgetIndex] = (int) i;
+            }
+            cout << endl;
+        }
+
+        cout << endl;
+        for (int budgetIndex = 0; budgetIndex < 3; budgetIndex++) {
+            cout << left << setw(12) << budgetNames[budgetIndex];
+            if (firstOver[budgetIndex] < 0) cout << "within budget in every scene" << endl;
+            else cout << "first over budget in " << scenes[firstOver[budgetIndex]].name << endl;
+        }
+    } catch (exception& ex) {
+        cout << ex.what() << endl;
+        return 1;
+    }
+    return 0;
+}
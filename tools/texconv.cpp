@@ -0,0 +1,98 @@
+// Offline texture converter: builds the full mip chain of an image and writes
+// it block compressed to a .dds file that loadDDS uploads as it is.
+//
+//   texconv [--bc1 | --bc3 | --bc5] [--normal] input output.dds
+//   texconv --cubemap [--bc1 | --bc3] +x -x +y -y +z -z output.dds
+//
+// The default format is BC1, or BC3 when the image has alpha. --bc5 keeps only
+// the red and green channels, for normal maps, whose z has to be rebuilt in the
+// shader. --normal renormalizes the mip levels of a normal map.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <GL/glew.h>
+#include <common/texture.h>
+#include <common/dds.h>
+
+using namespace std;
+
+// The image as RGBA8, .bmp files go through decodeBMP so the rows keep the
+// order loadBMP uploads them in
+RGBAImage readImage(const string& path, bool& hasAlpha) {
+    bool bmp = path.size() > 4 && path.substr(path.size() - 4) == ".bmp";
+    Image image = bmp ? decodeBMP(path.c_str()) : decodeImage(path.c_str());
+
+    RGBAImage result;
+    result.width = image.width;
+    result.height = image.height;
+    result.pixels.resize(image.width * image.height * 4);
+    hasAlpha = image.format == GL_RGBA || image.format == GL_BGRA;
+
+    int channels = image.format == GL_RED ? 1 : image.format == GL_RG ? 2 :
+                   image.format == GL_RGB || image.format == GL_BGR ? 3 : 4;
+    bool bgr = image.format == GL_BGR || image.format == GL_BGRA;
+    for (int i = 0; i < image.width * image.height; i++) {
+        const unsigned char* in = &image.pixels[i * channels];
+        unsigned char* out = &result.pixels[i * 4];
+        if (channels == 1) {
+            out[0] = out[1] = out[2] = in[0];
+        } else if (channels == 2) {
+            out[0] = in[0];
+            out[1] = in[1];
+            out[2] = 0;
+        } else {
+            out[0] = in[bgr ? 2 : 0];
+            out[1] = in[1];
+            out[2] = in[bgr ? 0 : 2];
+        }
+        out[3] = channels == 4 ? in[3] : 255;
+    }
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    bool cubemap = false, normalMap = false, formatGiven = false;
+    BlockFormat format = BlockFormat::BC1;
+    vector<string> files;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--cubemap") cubemap = true;
+        else if (arg == "--normal") normalMap = true;
+        else if (arg == "--bc1") format = BlockFormat::BC1, formatGiven = true;
+        else if (arg == "--bc3") format = BlockFormat::BC3, formatGiven = true;
+        else if (arg == "--bc5") format = BlockFormat::BC5, formatGiven = true;
+        else files.push_back(arg);
+    }
+
+    size_t inputs = cubemap ? 6 : 1;
+    if (files.size() != inputs + 1) {
+        cout << "Usage: texconv [--bc1 | --bc3 | --bc5] [--normal] input output.dds" << endl
+             << "       texconv --cubemap [--bc1 | --bc3] +x -x +y -y +z -z output.dds" << endl;
+        return 1;
+    }
+
+    try {
+        vector<vector<RGBAImage>> faces;
+        bool hasAlpha = false;
+        for (size_t i = 0; i < inputs; i++) {
+            bool alpha;
+            RGBAImage image = readImage(files[i], alpha);
+            hasAlpha = hasAlpha || alpha;
+            if (!faces.empty() && (image.width != faces[0][0].width || image.height != faces[0][0].height)) {
+                throw runtime_error("Cube map faces differ in size: " + files[i]);
+            }
+            faces.push_back(buildMipChain(image, normalMap));
+        }
+        if (!formatGiven && hasAlpha) format = BlockFormat::BC3;
+
+        writeDDS(files[inputs], format, faces);
+        cout << "Wrote " << files[inputs] << ": " << faces[0][0].width << "x" << faces[0][0].height
+             << ", " << faces[0].size() << " levels" << (cubemap ? ", cube map" : "") << endl;
+    } catch (exception& ex) {
+        cout << ex.what() << endl;
+        return 1;
+    }
+    return 0;
+}